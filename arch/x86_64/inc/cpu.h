@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-20  Initial  v0.0.3   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Keep the fields used on every switch on one cache line; idle residency; parked process
 //
 //===================================================================================================================
 
@@ -41,25 +42,36 @@ typedef enum {
 
 //
 // -- This is the abstraction of the x86 CPU
-//    --------------------------------------
+//
+//    The gs base is the address of `cpu`, so `cpu` is gs:0 and `process` is gs:8.  The rest of the first cache
+//    line is written only by this cpu.  `ProcessSwitch.s` gets the gs offsets from `asm-offsets.inc`.
+//    ----------------------------------------------------------------------------------------------------------
 typedef struct ArchCpu_t {
+    ArchCpu_t *cpu;
+    struct Process_t *process;
+    AtomicInt_t postponeCount;          // the depth of the postpone requests while this cpu holds the scheduler
+    bool processChangePending;          // a reschedule was postponed on this cpu
     int cpuNum;
-    Addr_t stackTop;
-    Addr_t location;
-    AtomicInt_t state;
     int kernelLocksHeld;
-    bool processChangePending;
-    AtomicInt_t postponeCount;
     int disableIntDepth;
     Addr_t flags;
-    uint64_t lastTimer;
-    uint64_t cpuIdleTime;
-    ArchCpu_t *cpu;
-    struct Process_t *process;
+    uint64_t lastTimer;                 // the clock (ns) when time was last accounted
+    uint64_t cpuIdleTime;               // ns
+
+    // -- set up while the cpu is started
+    Addr_t stackTop __attribute__((aligned(CACHE_LINE_SIZE)));
+    Addr_t location;
+    AtomicInt_t state;
     Tss_t tss;
     Addr_t gsSelector;
     Addr_t tssSelector;
-} ArchCpu_t;
+
+    // -- the idle statistics and state; the hot line above is full, and these are only touched around an idle
+    uint64_t lastTick;                  // the clock (ns) at the last timer tick
+    uint64_t idleTime[IDLE_STATES];     // ns spent in each idle state
+    uint64_t idleCount[IDLE_STATES];    // the number of times each idle state was entered
+    struct Process_t *parked;           // the blocked process whose stack the scheduler's idle loop is on
+} __attribute__((aligned(CACHE_LINE_SIZE))) ArchCpu_t;
 
 
 //
@@ -69,12 +81,6 @@ extern ArchCpu_t cpus[MAX_CPU];
 
 
 
-//
-// -- The CPU number currently starting
-//    ---------------------------------
-extern int cpuStarting;
-
-
 //
 // -- The number of active CPUs
 //    -------------------------
@@ -161,11 +167,13 @@ inline void NOP(void)
 
 
 //
-// -- Synchronize the cpu caches
-//    --------------------------
-inline void WBNOINVD(void)
+// -- Read the Time Stamp Counter
+//    ---------------------------
+inline uint64_t RDTSC(void)
 {
-    __asm volatile ("wbnoinvd" ::: "memory");
+    uint32_t _lo, _hi;
+    __asm volatile ("rdtsc" : "=a"(_lo),"=d"(_hi) :: "memory");
+    return (((uint64_t)_hi) << 32) | _lo;
 }
 
 
@@ -194,6 +202,10 @@ inline void CPUID(int code, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
     __asm volatile("cpuid" : "=a"(*a),"=b"(*b),"=c"(*c),"=d"(*d) : "a"(code) : "memory");
 }
 
+inline void CPUID_SUB(int code, int sub, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm volatile("cpuid" : "=a"(*a),"=b"(*b),"=c"(*c),"=d"(*d) : "a"(code),"c"(sub) : "memory");
+}
+
 
 //
 // -- CPUID bits
@@ -262,6 +274,32 @@ const uint64_t CPUID_FEAT_EDX_TM           = (1<<29);
 const uint64_t CPUID_FEAT_EDX_PBE          = (1<<31);
 
 
+//
+// -- Extended CPUID bits (function 0x80000001)
+//    -----------------------------------------
+const uint64_t CPUID_FEAT_EXT_EDX_PDPE1GB  = (1<<26);
+
+
+//
+// -- Advanced power management CPUID bits (function 0x80000007)
+//    ----------------------------------------------------------
+const uint64_t CPUID_FEAT_APM_EDX_INVARIANT_TSC = (1<<8);
+
+
+//
+// -- Does the TSC tick at a constant rate in every P- and C-state?
+//    -------------------------------------------------------------
+inline bool CpuHasInvariantTsc(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    CPUID(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax < 0x80000007) return false;
+
+    CPUID(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_FEAT_APM_EDX_INVARIANT_TSC) != 0;
+}
+
+
 
 //
 // -- Model Specific Registers
@@ -325,6 +363,28 @@ inline volatile uint64_t PEEK64(Addr_t regLocation) { return (*((volatile uint64
 // -- Some assembly CPU instructions
 //    ------------------------------
 inline void INVLPG(Addr_t a) { __asm volatile("invlpg (%0)" :: "r"(a) : "memory"); }
+inline void FLUSH_TLB(void) { Addr_t r; __asm volatile("mov %%cr3,%0\n mov %0,%%cr3" : "=r"(r) :: "memory"); }
+inline Addr_t GET_CR0(void) { Addr_t r; __asm volatile("mov %%cr0,%0" : "=r"(r) :: "memory"); return r; }
+inline void SET_CR0(Addr_t r) { __asm volatile("mov %0,%%cr0" :: "r"(r) : "memory"); }
+inline Addr_t GET_CR4(void) { Addr_t r; __asm volatile("mov %%cr4,%0" : "=r"(r) :: "memory"); return r; }
+inline void SET_CR4(Addr_t r) { __asm volatile("mov %0,%%cr4" :: "r"(r) : "memory"); }
+inline void CLTS(void) { __asm volatile("clts" ::: "memory"); }
+inline void XSETBV(uint32_t r, uint64_t v) {
+    __asm volatile("xsetbv" :: "c"(r), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)) : "memory");
+}
+
+
+//
+// -- Control register bits
+//    ---------------------
+const uint64_t CR0_MP                       = (1<<1);
+const uint64_t CR0_EM                       = (1<<2);
+const uint64_t CR0_TS                       = (1<<3);
+const uint64_t CR0_NE                       = (1<<5);
+
+const uint64_t CR4_OSFXSR                   = (1<<9);
+const uint64_t CR4_OSXMMEXCPT               = (1<<10);
+const uint64_t CR4_OSXSAVE                  = (1<<18);
 
 
 
@@ -336,6 +396,10 @@ inline void INVLPG(Addr_t a) { __asm volatile("invlpg (%0)" :: "r"(a) : "memory"
 extern "C" {
     void CpuInit(void);
     void CpuApStart(BootInterface_t *interface);
+    void IdleInit(void);
+    void CpuIdle(volatile void *monitor, uint64_t expectedNs);
+    int IdleStateCount(void);
+    const char *IdleStateName(int state);
     int krn_ActiveCores(void);
 }
 
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-14  Initial  v0.0.2   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Add the cache line size and the TSC clocksource
 //
 //===================================================================================================================
 
@@ -39,6 +40,12 @@
 #define BYTE_ALIGNMENT      8
 
 
+//
+// -- This is the cache line size; data written by different cpus belongs on different lines
+//    --------------------------------------------------------------------------------------
+#define CACHE_LINE_SIZE     64
+
+
 //
 // -- The allocated stack size
 //    ------------------------
@@ -58,6 +65,20 @@ typedef int64_t Return_t;
 
 
 
+//
+// -- The invariant TSC clocksource, calibrated once and then read by any cpu in any address space; the
+//    nanoseconds are `((tsc - base) * mult) >> CLOCK_SHIFT`, and `mult` is 0 when there is no usable TSC
+//    ---------------------------------------------------------------------------------------------------
+#define CLOCK_SHIFT         32
+
+typedef struct ClockSource_t {
+    uint64_t base;                      // the TSC at nanosecond 0
+    uint64_t mult;                      // nanoseconds per TSC tick, scaled by 2^CLOCK_SHIFT
+    uint64_t hz;                        // the calibrated TSC frequency
+} ClockSource_t;
+
+
+
 //
 // -- This is the spinlock structure
 //    ------------------------------
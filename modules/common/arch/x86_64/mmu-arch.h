@@ -48,7 +48,7 @@ typedef struct PageEntry_t {
     unsigned int pcd : 1;               //!< Page-level cache disable
     unsigned int a : 1;                 //!< accessed
     unsigned int d : 1;                 //!< dirty (needs to be written for a swap)
-    unsigned int pat : 1;               //!< set to 0 for tables, page Page Attribute Table (set to 0)
+    unsigned int pat : 1;               //!< PAT in a PT entry; Page Size (PS) in a PDPT or PD entry
     unsigned int g : 1;                 //!< Global (set to 0)
     unsigned int k : 1;                 //!< Is this a kernel page?
     unsigned int avl : 2;               //!< Available for software use
@@ -25,6 +25,21 @@
 
 
 
+//
+// -- The number of 4K frames covered by a large page at the PD and PDPT levels
+//    -------------------------------------------------------------------------
+#define FRAMES_2M       (512ul)
+#define FRAMES_1G       (512ul * 512ul)
+
+
+
+//
+// -- Whether this CPU supports 1GB pages; -1 means we have not yet checked
+//    ---------------------------------------------------------------------
+static int use1G = -1;
+
+
+
 /********************************************************************************************************************
 *   Documented in `mmu-arch.h`
 *///-----------------------------------------------------------------------------------------------------------------
@@ -109,6 +124,148 @@ PageEntry_t *GetPTEntry(Addr_t a)
 
 
 
+//
+// -- Determine if the CPU supports 1GB pages, checking CPUID only once
+//    -----------------------------------------------------------------
+static bool MmuHas1G(void)
+{
+    if (use1G < 0) {
+        uint32_t a, b, c, d;
+
+        use1G = 0;
+        CPUID(0x80000000, &a, &b, &c, &d);
+        if (a >= 0x80000001) {
+            CPUID(0x80000001, &a, &b, &c, &d);
+            if (d & CPUID_FEAT_EXT_EDX_PDPE1GB) use1G = 1;
+        }
+    }
+
+    return use1G != 0;
+}
+
+
+
+//
+// -- Get the page-aligned address of the table which contains an entry (through the recursive mapping)
+//    -------------------------------------------------------------------------------------------------
+static inline uint64_t *MmuTable(PageEntry_t *ent)
+{
+    return (uint64_t *)((Addr_t)ent & 0xfffffffffffff000);
+}
+
+
+
+//
+// -- How many frames from `a` to the next boundary of a `frames`-sized page
+//    ----------------------------------------------------------------------
+static inline size_t MmuToBoundary(Addr_t a, size_t frames)
+{
+    return frames - ((a >> 12) & (frames - 1));
+}
+
+
+
+//
+// -- Can a large page of `frames` frames be used at this address and frame?
+//    ----------------------------------------------------------------------
+static inline bool MmuFits(Addr_t a, Frame_t f, size_t count, size_t frames)
+{
+    return count >= frames && MmuToBoundary(a, frames) == frames && (f & (frames - 1)) == 0;
+}
+
+
+
+//
+// -- Build a complete page entry so that it can be written with a single store
+//    -------------------------------------------------------------------------
+static inline uint64_t MmuMakeEntry(Frame_t f, int flags, bool large)
+{
+    union {
+        PageEntry_t e;
+        uint64_t v;
+    } rv;
+
+    rv.v = 0;
+    rv.e.frame = f;
+    rv.e.rw = (flags&PG_WRT?1:0);
+    rv.e.pcd = (flags&PG_DEV?1:0);
+    rv.e.pwt = (flags&PG_DEV?1:0);
+    rv.e.us = (flags&PG_DEV?1:0);
+    rv.e.pat = (large?1:0);
+    rv.e.p = 1;
+
+    return rv.v;
+}
+
+
+
+//
+// -- Write a whole page entry with a single store.  The hardware page walk is coherent with the caches on x86,
+//    so nothing needs to be written back to memory; the release only keeps the compiler from moving earlier
+//    table writes past this one.  Stale TLB entries are taken care of by `INVLPG` or a CR3 reload, which are
+//    both serializing.
+//    -----------------------------------------------------------------------------------------------------------
+static inline void MmuSetEntry(PageEntry_t *ent, uint64_t v)
+{
+    __atomic_store_n((volatile uint64_t *)ent, v, __ATOMIC_RELEASE);
+}
+
+
+
+//
+// -- Allocate a new table for `ent` and clear it; `tbl` is the table as seen through the recursive mapping
+//    -----------------------------------------------------------------------------------------------------
+static void MmuNewTable(PageEntry_t *ent, uint64_t *tbl)
+{
+    MmuSetEntry(ent, MmuMakeEntry(PmmAlloc(), PG_WRT, false));
+    INVLPG((Addr_t)tbl);
+
+    for (int i = 0; i < 512; i ++) tbl[i] = 0;
+}
+
+
+
+//
+// -- Break a large page of `frames` frames into a table of the next smaller page size.  The address range is
+//    briefly unmapped while the new table is populated, so do not split the page holding the running code.
+//    -------------------------------------------------------------------------------------------------------
+static void MmuSplitLarge(PageEntry_t *ent, uint64_t *tbl, size_t frames)
+{
+    PageEntry_t old = *ent;
+    size_t step = frames / 512;
+
+    MmuNewTable(ent, tbl);
+
+    for (int i = 0; i < 512; i ++) {
+        union {
+            PageEntry_t e;
+            uint64_t v;
+        } n;
+
+        n.e = old;
+        n.e.frame = old.frame + (i * step);
+        n.e.pat = (step > 1 ? 1 : 0);
+        MmuSetEntry((PageEntry_t *)&tbl[i], n.v);
+    }
+}
+
+
+
+//
+// -- Flush the TLB for a range of pages, giving up on single pages when the range is large
+//    -------------------------------------------------------------------------------------
+static void MmuFlushRange(Addr_t a, size_t count)
+{
+    if (count > MMU_FLUSH_LIMIT) {
+        FLUSH_TLB();
+        return;
+    }
+
+    for (size_t i = 0; i < count; i ++, a += PAGE_SIZE) INVLPG(a);
+}
+
+
+
 /********************************************************************************************************************
 *   Documented in `mmu-funcs.h`
 *///-----------------------------------------------------------------------------------------------------------------
@@ -146,6 +303,7 @@ Return_t cmn_MmuIsMapped(Addr_t a)
 #endif
 
     if (!GetPDPTEntry(a)->p) return false;
+    if (GetPDPTEntry(a)->pat) return true;
 
 #if DEBUG_ENABLED(MmuIsMapped)
 
@@ -156,6 +314,7 @@ Return_t cmn_MmuIsMapped(Addr_t a)
 #endif
 
     if (!GetPDEntry(a)->p) return false;
+    if (GetPDEntry(a)->pat) return true;
 
 #if DEBUG_ENABLED(MmuIsMapped)
 
@@ -193,12 +352,7 @@ Return_t cmn_MmuUnmapPage(Addr_t a)
 
 #endif
 
-    if (cmn_MmuIsMapped(a)) {
-        *(uint64_t *)GetPTEntry(a) = 0;
-        INVLPG(a);
-    }
-
-    return 0;
+    return cmn_MmuUnmapRange(a, 1);
 }
 
 
@@ -218,150 +372,205 @@ Return_t cmn_MmuMapPage(Addr_t a, Frame_t f, int flags)
     SerialPutHex64(f);
     SerialPutChar('\n');
 
-    SerialPutString("Checking if the page is mapped\n");
-
 #endif
 
-    if (cmn_MmuIsMapped(a)) cmn_MmuUnmapPage(a);
+    return cmn_MmuMapRange(a, f, 1, flags);
+}
+
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
 
-    SerialPutString(".. Done -- guaranteed unmapped\n");
+/********************************************************************************************************************
+*   Documented in `mmu-funcs.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t cmn_MmuMapRange(Addr_t a, Frame_t f, size_t count, int flags)
+{
+#if DEBUG_ENABLED(cmn_MmuMapRange)
+
+    SerialPutString("In address space ");
+    SerialPutHex64(GetAddressSpace());
+    SerialPutString(", mapping address ");
+    SerialPutHex64(a);
+    SerialPutString(" to frame ");
+    SerialPutHex64(f);
+    SerialPutString(" for ");
+    SerialPutHex64(count);
+    SerialPutString(" pages\n");
 
 #endif
 
-    Frame_t t;
-    PageEntry_t *ent = GetPML4Entry(a);
+    Addr_t start = a;
+    size_t total = count;
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
+    while (count) {
+        PageEntry_t *ent = GetPML4Entry(a);
+        if (!ent->p) MmuNewTable(ent, MmuTable(GetPDPTEntry(a)));
 
-    SerialPutString(".. Mapping PML4 @ ");
-    SerialPutHex64((Addr_t)ent);
-    SerialPutChar('\n');
 
-#endif
+        //
+        // -- At the PDPT level, use 1GB pages for as long as we can
+        //    ------------------------------------------------------
+        ent = GetPDPTEntry(a);
 
-    if (!ent->p) {
-        t = PmmAlloc();
-        ent->frame = t;
-        ent->rw = 1;
-        ent->p = 1;
+        if (MmuHas1G() && MmuFits(a, f, count, FRAMES_1G) && (!ent->p || ent->pat)) {
+            do {
+                MmuSetEntry(ent, MmuMakeEntry(f, flags, true));
 
-        WBNOINVD();
-        INVLPG((Addr_t)GetPDPTEntry(a));
+                ent ++;
+                a += FRAMES_1G * PAGE_SIZE;
+                f += FRAMES_1G;
+                count -= FRAMES_1G;
+            } while (MmuFits(a, f, count, FRAMES_1G) && (a & 0x7fc0000000) != 0 && (!ent->p || ent->pat));
 
-        uint64_t *tbl = (uint64_t *)((Addr_t)GetPDPTEntry(a) & 0xfffffffffffff000);
-        for (int i = 0; i < 512; i ++) {
-            tbl[i] = 0;
+            continue;
         }
-    }
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
+        if (!ent->p) MmuNewTable(ent, MmuTable(GetPDEntry(a)));
+        else if (ent->pat) MmuSplitLarge(ent, MmuTable(GetPDEntry(a)), FRAMES_1G);
 
-    SerialPutString(".... [hex ");
-    SerialPutHex64(*(uint64_t *)ent);
-    SerialPutString("]\n");
 
-#endif
+        //
+        // -- At the PD level, use 2MB pages for as long as we can
+        //    ----------------------------------------------------
+        ent = GetPDEntry(a);
 
-    ent = GetPDPTEntry(a);
+        if (MmuFits(a, f, count, FRAMES_2M) && (!ent->p || ent->pat)) {
+            do {
+                MmuSetEntry(ent, MmuMakeEntry(f, flags, true));
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
+                ent ++;
+                a += FRAMES_2M * PAGE_SIZE;
+                f += FRAMES_2M;
+                count -= FRAMES_2M;
+            } while (MmuFits(a, f, count, FRAMES_2M) && (a & 0x3fe00000) != 0 && (!ent->p || ent->pat));
 
-    SerialPutString(".. Mapping PDPT @ ");
-    SerialPutHex64((Addr_t)ent);
-    SerialPutChar('\n');
+            continue;
+        }
 
-#endif
+        if (!ent->p) MmuNewTable(ent, MmuTable(GetPTEntry(a)));
+        else if (ent->pat) MmuSplitLarge(ent, MmuTable(GetPTEntry(a)), FRAMES_2M);
 
-    if (!ent->p) {
-        t = PmmAlloc();
-        ent->frame = t;
-        ent->rw = 1;
-        ent->p = 1;
 
-        WBNOINVD();
-        INVLPG((Addr_t)GetPDEntry(a));
+        //
+        // -- Finally, fill in the PT entries through the end of this table
+        //    -------------------------------------------------------------
+        ent = GetPTEntry(a);
 
-        uint64_t *tbl = (uint64_t *)((Addr_t)GetPDEntry(a) & 0xfffffffffffff000);
-        for (int i = 0; i < 512; i ++) tbl[i] = 0;
+        do {
+            MmuSetEntry(ent, MmuMakeEntry(f, flags, false));
+
+            ent ++;
+            a += PAGE_SIZE;
+            f ++;
+            count --;
+        } while (count && (a & 0x1ff000) != 0);
     }
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
+    MmuFlushRange(start, total);
 
-    SerialPutString(".... [hex ");
-    SerialPutHex64(*(uint64_t *)ent);
-    SerialPutString("]\n");
+#if DEBUG_ENABLED(cmn_MmuMapRange)
+
+    SerialPutString("Mapping complete!!\n");
 
 #endif
 
-    ent = GetPDEntry(a);
+    return 0;
+}
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
 
-    SerialPutString(".. Mapping PD @ ");
-    SerialPutHex64((Addr_t)ent);
-    SerialPutChar('\n');
+
+/********************************************************************************************************************
+*   Documented in `mmu-funcs.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t cmn_MmuUnmapRange(Addr_t a, size_t count)
+{
+#if DEBUG_ENABLED(cmn_MmuUnmapRange)
+
+    SerialPutString("In address space ");
+    SerialPutHex64(GetAddressSpace());
+    SerialPutString(", unmapping address ");
+    SerialPutHex64(a);
+    SerialPutString(" for ");
+    SerialPutHex64(count);
+    SerialPutString(" pages\n");
 
 #endif
 
-    if (!ent->p) {
-        t = PmmAlloc();
-        ent->frame = t;
-        ent->rw = 1;
-        ent->p = 1;
+    Addr_t start = a;
+    size_t total = count;
+    size_t skip;
 
-        WBNOINVD();
-        INVLPG((Addr_t)GetPTEntry(a));
+    while (count) {
+        skip = 0;
 
-        uint64_t *tbl = (uint64_t *)((Addr_t)GetPTEntry(a) & 0xfffffffffffff000);
-        for (int i = 0; i < 512; i ++) tbl[i] = 0;
+        if (!GetPML4Entry(a)->p) {
+            skip = MmuToBoundary(a, FRAMES_1G * 512);
+            goto next;
+        }
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
 
-        SerialPutString("Address: ");
-        SerialPutHex64((uint64_t)ent);
-        SerialPutString(" .... [hex ");
-        SerialPutHex64(*((uint64_t *)ent));
-        SerialPutString("]\n");
+        //
+        // -- Either remove a whole 1GB page or break it up so we can remove part of it
+        //    -------------------------------------------------------------------------
+        if (!GetPDPTEntry(a)->p) {
+            skip = MmuToBoundary(a, FRAMES_1G);
+            goto next;
+        }
 
-#endif
+        if (GetPDPTEntry(a)->pat) {
+            if (MmuFits(a, 0, count, FRAMES_1G)) {
+                MmuSetEntry(GetPDPTEntry(a), 0);
+                skip = FRAMES_1G;
+                goto next;
+            }
 
-    }
+            MmuSplitLarge(GetPDPTEntry(a), MmuTable(GetPDEntry(a)), FRAMES_1G);
+        }
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
 
-    SerialPutString(".... [hex ");
-    SerialPutHex64(*(uint64_t *)ent);
-    SerialPutString("]\n");
+        //
+        // -- And the same at the 2MB level
+        //    -----------------------------
+        if (!GetPDEntry(a)->p) {
+            skip = MmuToBoundary(a, FRAMES_2M);
+            goto next;
+        }
 
-#endif
+        if (GetPDEntry(a)->pat) {
+            if (MmuFits(a, 0, count, FRAMES_2M)) {
+                MmuSetEntry(GetPDEntry(a), 0);
+                skip = FRAMES_2M;
+                goto next;
+            }
 
-    ent = GetPTEntry(a);
+            MmuSplitLarge(GetPDEntry(a), MmuTable(GetPTEntry(a)), FRAMES_2M);
+        }
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
 
-    SerialPutString(".. Mapping PT @ ");
-    SerialPutHex64((Addr_t)ent);
-    SerialPutChar('\n');
+        //
+        // -- Clear the PT entries through the end of this table
+        //    --------------------------------------------------
+        {
+            PageEntry_t *ent = GetPTEntry(a);
 
-#endif
+            do {
+                MmuSetEntry(ent, 0);
 
-    ent->frame = f;
-    ent->rw = (flags&PG_WRT?1:0);
-    ent->pcd = (flags&PG_DEV?1:0);
-    ent->pwt = (flags&PG_DEV?1:0);
-    ent->us = (flags&PG_DEV?1:0);
-    ent->p = 1;
+                ent ++;
+                a += PAGE_SIZE;
+                count --;
+            } while (count && (a & 0x1ff000) != 0);
+        }
 
-    WBNOINVD();
-    INVLPG((Addr_t)a);
+        continue;
 
-#if DEBUG_ENABLED(cmn_MmuMapPage)
+next:
+        if (skip > count) skip = count;
+        a += skip * PAGE_SIZE;
+        count -= skip;
+    }
 
-    SerialPutString("Mapping complete!!\n");
+    MmuFlushRange(start, total);
 
-#endif
     return 0;
 }
 
@@ -41,3 +41,103 @@
 extern "C" Addr_t ElfLoadImage(Addr_t location);
 
 
+
+#if !defined(__LOADER__) || defined(__DOXYGEN__)
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Addr_t ElfLoadImageDemand(Addr_t location)
+*   @brief              Prepare an ELF Image to be paged in on demand
+*
+*   Record a descriptor for each loadable segment of the ELF image at `location` in the current address space,
+*   but do not map anything.  Pages are mapped by \ref ElfPageFault() the first time they are touched.  If the
+*   descriptor table is full, any remaining segments are mapped immediately.
+*
+*   @param              location        The address of the ELF header to evaluate
+*
+*   @returns            The stated entry point for the ELF executable
+*
+*   @retval             NULL            When the ELF could not be loaded
+*   @retval             non-zero        The ELF was prepared and this is the entry address
+*
+*   @note               This function is not available in the loader.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Addr_t ElfLoadImageDemand(Addr_t location);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t ElfPageFault(Addr_t addr)
+*   @brief              Resolve a not-present page fault against the demand-paged ELF segments
+*
+*   Look for a segment in the current address space which contains `addr` and make that page present.
+*
+*   @param              addr            The faulting address (from `cr2`)
+*
+*   @returns            Whether the fault was resolved
+*
+*   @retval             0               The page is now present and the faulting instruction can be restarted
+*   @retval             -EFAULT         The address is not part of any demand-paged segment
+*
+*   @note               This function is not available in the loader.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t ElfPageFault(Addr_t addr);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t ElfMakeResident(void)
+*   @brief              Map every page of the demand-paged segments in the current address space
+*
+*   Used for modules which must never take a page fault, such as the PMM which is needed to resolve faults.
+*
+*   @returns            0
+*
+*   @note               This function is not available in the loader.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t ElfMakeResident(void);
+
+
+
+/****************************************************************************************************************//**
+*   @def                ELF_SYM_NAME_LEN
+*   @brief              The longest symbol name (including the terminating null) passed to an \ref ElfSymbolFunc_t
+*///-----------------------------------------------------------------------------------------------------------------
+#define ELF_SYM_NAME_LEN        64
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            ElfSymbolFunc_t
+*   @brief              Called for each function symbol by \ref ElfWalkFunctions(); longer names are truncated
+*///-----------------------------------------------------------------------------------------------------------------
+typedef void (*ElfSymbolFunc_t)(const char *name, Addr_t addr, size_t size, void *data);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t ElfWalkFunctions(Addr_t location, ElfSymbolFunc_t fn, void *data)
+*   @brief              Call a function for every sized function symbol in an ELF image's symbol table
+*
+*   The image is read at its physical address, borrowing the identity mapping one page at a time, so it does
+*   not need to be mapped in the current address space.
+*
+*   @param              location        The physical address of the ELF header
+*   @param              fn              The function to call for each symbol
+*   @param              data            Passed through to `fn`
+*
+*   @returns            Whether a symbol table was found
+*
+*   @retval             0               The symbol table was walked
+*   @retval             -EINVAL         `location` is not a valid ELF image or `fn` is NULL
+*   @retval             -ENOENT         The image has no symbol table (it was stripped)
+*
+*   @note               This function is not available in the loader.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t ElfWalkFunctions(Addr_t location, ElfSymbolFunc_t fn, void *data);
+
+
+
+#endif
+
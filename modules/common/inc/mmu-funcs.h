@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Nov-07 | Initial |  v0.0.13 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Add `krn_MmuFrame()` and `krn_MmuShootdown()`
 *
 *///=================================================================================================================
 
@@ -80,6 +81,45 @@ extern "C" Return_t cmn_MmuIsMapped(Addr_t a);
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 Return_t cmn_MmuMapRange(Addr_t a, Frame_t f, size_t count, int flags)
+*   @brief              Map a range of addresses to a range of contiguous physical frames
+*
+*   In the current address space, map `count` pages starting at address `a` to the contiguous frames starting at
+*   `f`.  Each level of the paging tables is visited once for each table it covers rather than once per page, and
+*   the TLB is flushed once at the end.  Where both the address and the frame are aligned and enough of the range
+*   remains, 2MB pages (and 1GB pages when the CPU supports them) are used in place of 4K pages.
+*
+*   @param              a               The starting address to map
+*   @param              f               The first frame to support the mapped addresses
+*   @param              count           The number of 4K pages to map
+*   @param              flags           Flags indicating how this mapping will be used; see \ref PG
+*
+*   @returns            0
+*
+*   @note               An existing table is never replaced by a large page, so an address range which has been
+*                       mapped with 4K pages before will continue to be mapped with 4K pages.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t cmn_MmuMapRange(Addr_t a, Frame_t f, size_t count, int flags);
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t cmn_MmuUnmapRange(Addr_t a, size_t count)
+*   @brief              Unmap a range of addresses
+*
+*   In the current address space, unmap `count` pages starting at address `a`.  Addresses which are not mapped are
+*   skipped a table at a time.  A large page which is only partly covered by the range is broken into smaller pages
+*   first.  The TLB is flushed once at the end.
+*
+*   @param              a               The starting address to unmap
+*   @param              count           The number of 4K pages to unmap
+*
+*   @returns            0
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t cmn_MmuUnmapRange(Addr_t a, size_t count);
+
+
+
 #if defined( __LOADER__) || defined(__DOXYGEN__)
 
 
@@ -168,6 +208,37 @@ extern "C" Return_t krn_MmuMapPageEx(Addr_t space, Addr_t a, Frame_t f, int flag
 extern "C" Return_t krn_MmuUnmapEx(Addr_t space, Addr_t a);
 
 
+
+/****************************************************************************************************************//**
+*   @fn                 Frame_t krn_MmuFrame(Addr_t a)
+*   @brief              Find the frame an address is mapped to
+*
+*   In the current address space, find the frame behind an address which is mapped with a 4K page.
+*
+*   @param              a               The address to look up
+*
+*   @returns            The frame the address is mapped to
+*
+*   @retval             0               The address is not mapped, or is part of a large page
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Frame_t krn_MmuFrame(Addr_t a);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void krn_MmuShootdown(Addr_t a, size_t count)
+*   @brief              Flush a range which was just unmapped from the TLBs of the other cpus
+*
+*   `cmn_MmuUnmapRange()` only flushes this cpu's TLB.  Before the frames behind the range are given to anyone
+*   else, any other cpu running in this address space must drop its entries as well, or it could still write to
+*   them.  This waits until every other cpu has flushed the range.
+*
+*   @param              a               The first address of the range
+*   @param              count           The number of pages in the range
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void krn_MmuShootdown(Addr_t a, size_t count);
+
+
 #endif
 
 
@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Jan-13 | Initial |  v0.0.01 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Check the transmitter once and fill the FIFO without polling
 *
 *///=================================================================================================================
 
@@ -47,6 +48,32 @@ extern "C" void SerialPutChar(uint8_t ch);
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 bool SerialTxReady(void)
+*   @brief              Check if the serial port can accept more output without waiting
+*
+*   @returns            Whether the transmit holding register (and therefore the FIFO) is empty
+*
+*   When this returns true, a full FIFO worth of characters can be written without polling.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" bool SerialTxReady(void);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void SerialPutCharNoWait(uint8_t ch)
+*   @brief              Output a single character to the serial port without waiting for the transmitter
+*
+*   @param              ch              The character to output
+*
+*   Write a character straight to the transmit holding register, with '\n' expanded to "\r\n" as
+*   `SerialPutChar()` does.  Only valid once `SerialTxReady()` has returned true, and for no more than a FIFO's
+*   worth of characters after that.
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void SerialPutCharNoWait(uint8_t ch);
+
+
+
 /****************************************************************************************************************//**
 *   @fn                 void SerialPutString(const char *s)
 *   @brief              Output a string of characters to the serial port
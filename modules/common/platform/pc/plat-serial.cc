@@ -16,6 +16,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Jan-13 | Initial |  v0.0.01 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Check the transmitter once and fill the FIFO without polling
 *
 *///=================================================================================================================
 
@@ -55,3 +56,24 @@ void SerialPutChar(uint8_t ch)
 }
 
 
+
+/********************************************************************************************************************
+*   Documented in `serial.h`
+*///-----------------------------------------------------------------------------------------------------------------
+void SerialPutCharNoWait(uint8_t ch)
+{
+    if (ch == '\n') OUTB(COM1_BASE + 0, '\r');
+
+    OUTB(COM1_BASE + 0, ch);
+}
+
+
+
+/********************************************************************************************************************
+*   Documented in `serial.h`
+*///-----------------------------------------------------------------------------------------------------------------
+bool SerialTxReady(void)
+{
+    return (INB(COM1_BASE + 5) & 0x20) != 0;
+}
+
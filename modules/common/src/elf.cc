@@ -262,6 +262,36 @@ static bool ElfValidateHeader(Addr_t location)
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 static void ElfMapSegment(Addr_t location, Elf64PHdr_t *pHdr)
+*   @brief              Eagerly map every page of a loadable segment
+*
+*   The file-backed pages are mapped directly to the frames holding the ELF image and any remaining pages (the
+*   bss) are given new frames.
+*
+*   @param              location        The address of the ELF header
+*   @param              pHdr            The program header for the segment to map
+*///-----------------------------------------------------------------------------------------------------------------
+static void ElfMapSegment(Addr_t location, Elf64PHdr_t *pHdr)
+{
+    Addr_t off = pHdr->pVAddr & (PAGE_SIZE - 1);
+    Addr_t virt = pHdr->pVAddr - off;
+    Addr_t phys = location + pHdr->pOffset - off;
+    size_t fPages = (pHdr->pFileSz ? (off + pHdr->pFileSz + PAGE_SIZE - 1) / PAGE_SIZE : 0);
+    size_t mPages = (off + pHdr->pMemSz + PAGE_SIZE - 1) / PAGE_SIZE;
+    int flags = (pHdr->pFlags&PF_W?PG_WRT:PG_NONE);
+
+    // -- the file-backed part of the segment is contiguous, so map it in one pass
+    if (fPages) cmn_MmuMapRange(virt, phys >> 12, fPages, flags);
+
+    // -- the balance is bss, which gets new frames
+    for (size_t p = fPages; p < mPages; p ++) {
+        cmn_MmuMapPage(virt + (p * PAGE_SIZE), PmmAlloc(), flags);
+    }
+}
+
+
+
 /********************************************************************************************************************
 *   Documented in `elf.h`
 *///-----------------------------------------------------------------------------------------------------------------
@@ -276,29 +306,142 @@ Addr_t ElfLoadImage(Addr_t location)
         Elf64PHdr_t *pHdr = (Elf64PHdr_t *)(location + eHdr->ePhOff);
 
         for (unsigned int i = 0; i < eHdr->ePhNum; i ++) {
-            if (pHdr[i].pType == PT_LOAD) {
-                Addr_t phys = location + pHdr[i].pOffset;
-                Addr_t virt = pHdr[i].pVAddr;
-                int64_t fSize = pHdr[i].pFileSz;
-                int64_t mSize = pHdr[i].pMemSz;
-
-                while (mSize >= 0) {
-                    Frame_t f = phys >> 12;
-
-                    if (fSize <= 0) {
-                        f = PmmAlloc();
-                    }
-
-                    cmn_MmuMapPage(virt, f, (pHdr[i].pType&PF_W?PG_WRT:PG_NONE));
-
-                    virt += PAGE_SIZE;
-                    phys += PAGE_SIZE;
-                    mSize -= PAGE_SIZE;
-                    fSize -= PAGE_SIZE;
-                }
+            if (pHdr[i].pType == PT_LOAD) ElfMapSegment(location, &pHdr[i]);
+        }
+
+        rv = eHdr->eEntry;
+        cmn_MmuUnmapPage(location);
+    }
+
+    return rv;
+}
+
+
+
+#if !defined(__LOADER__)
+
+
+
+#include "spinlock.h"
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            ElfSegment_t
+*   @brief              Formalization of the \ref ElfSegment_t structure into a defined type
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             ElfSegment_t
+*   @brief              A loadable segment whose pages are mapped on first touch
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct ElfSegment_t {
+    Addr_t space;                   //!< The address space owning the segment; 0 when the slot is free
+    Addr_t start;                   //!< The first page of the segment
+    Addr_t end;                     //!< The address following the last page of the segment
+    Addr_t fileEnd;                 //!< The address where the file-backed contents end and the bss begins
+    Addr_t phys;                    //!< The physical address of the file contents for `start`
+    int flags;                      //!< The paging flags for the segment
+} ElfSegment_t;
+
+
+
+/****************************************************************************************************************//**
+*   @var                elfSegments
+*   @brief              The demand-paged segments for all address spaces
+*///-----------------------------------------------------------------------------------------------------------------
+static ElfSegment_t elfSegments[MOD_MAX_SEGMENTS] = { { 0 } };
+
+
+
+/****************************************************************************************************************//**
+*   @var                elfLock
+*   @brief              Protects \ref elfSegments and serializes resolving faults
+*///-----------------------------------------------------------------------------------------------------------------
+static Spinlock_t elfLock = {0};
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 static void ElfLoadPage(ElfSegment_t *seg, Addr_t page)
+*   @brief              Make a single page of a demand-paged segment present
+*
+*   A page which is completely backed by the file is mapped directly to the frame in the ELF image, so read-only
+*   text is shared with the image and never copied.  Any other page gets a new cleared frame, and a page which
+*   straddles the end of the file contents gets the file portion copied in.
+*
+*   @param              seg             The segment containing the page
+*   @param              page            The page-aligned address to make present
+*
+*   @note               The segment's address space must be the current address space.
+*///-----------------------------------------------------------------------------------------------------------------
+static void ElfLoadPage(ElfSegment_t *seg, Addr_t page)
+{
+    Addr_t src = seg->phys + (page - seg->start);
+
+    if (page + PAGE_SIZE <= seg->fileEnd) {
+        cmn_MmuMapPage(page, src >> 12, seg->flags);
+        return;
+    }
+
+    Frame_t frame = PmmAlloc();
+    cmn_MmuMapPage(page, frame, PG_WRT);
+    kMemSetB((void *)page, 0, PAGE_SIZE);
+
+    if (page < seg->fileEnd) {
+        // -- the image is only reachable at its physical address; borrow that identity mapping if needed
+        bool mapped = cmn_MmuIsMapped(src);
+
+        if (!mapped) cmn_MmuMapPage(src, src >> 12, PG_NONE);
+        kMemMoveB((void *)page, (void *)src, seg->fileEnd - page);
+        if (!mapped) cmn_MmuUnmapPage(src);
+    }
+
+    if (!(seg->flags & PG_WRT)) cmn_MmuMapPage(page, frame, seg->flags);
+}
+
+
+
+/********************************************************************************************************************
+*   Documented in `elf.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Addr_t ElfLoadImageDemand(Addr_t location)
+{
+    Addr_t rv = 0;
+    Addr_t space = GetAddressSpace();
+    int slot = 0;
+
+    cmn_MmuMapPage(location, location >> 12, PG_NONE);
+
+    if (ElfValidateHeader(location)) {
+        Elf64EHdr_t *eHdr = (Elf64EHdr_t *)location;
+        Elf64PHdr_t *pHdr = (Elf64PHdr_t *)(location + eHdr->ePhOff);
+
+        krn_SpinLock(&elfLock);
+
+        for (unsigned int i = 0; i < eHdr->ePhNum; i ++) {
+            if (pHdr[i].pType != PT_LOAD) continue;
+
+            while (slot < MOD_MAX_SEGMENTS && elfSegments[slot].space != 0) slot ++;
+
+            // -- out of descriptors; this segment will just have to be mapped now
+            if (slot == MOD_MAX_SEGMENTS) {
+                ElfMapSegment(location, &pHdr[i]);
+                continue;
             }
+
+            ElfSegment_t *seg = &elfSegments[slot];
+            Addr_t off = pHdr[i].pVAddr & (PAGE_SIZE - 1);
+
+            seg->start = pHdr[i].pVAddr - off;
+            seg->end = seg->start + ((off + pHdr[i].pMemSz + PAGE_SIZE - 1) & ~((Addr_t)PAGE_SIZE - 1));
+            seg->fileEnd = pHdr[i].pVAddr + pHdr[i].pFileSz;
+            seg->phys = location + pHdr[i].pOffset - off;
+            seg->flags = (pHdr[i].pFlags&PF_W?PG_WRT:PG_NONE);
+            seg->space = space;
         }
 
+        krn_SpinUnlock(&elfLock);
+
         rv = eHdr->eEntry;
         cmn_MmuUnmapPage(location);
     }
@@ -307,3 +450,196 @@ Addr_t ElfLoadImage(Addr_t location)
 }
 
 
+
+/********************************************************************************************************************
+*   Documented in `elf.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t ElfPageFault(Addr_t addr)
+{
+    Addr_t space = GetAddressSpace();
+    Addr_t page = addr & ~((Addr_t)PAGE_SIZE - 1);
+    Return_t rv = -EFAULT;
+
+    krn_SpinLock(&elfLock);
+
+    for (int i = 0; i < MOD_MAX_SEGMENTS; i ++) {
+        ElfSegment_t *seg = &elfSegments[i];
+
+        if (seg->space != space || page < seg->start || page >= seg->end) continue;
+
+        if (!cmn_MmuIsMapped(page)) ElfLoadPage(seg, page);
+        rv = 0;
+        break;
+    }
+
+    krn_SpinUnlock(&elfLock);
+
+    return rv;
+}
+
+
+
+/********************************************************************************************************************
+*   Documented in `elf.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t ElfMakeResident(void)
+{
+    Addr_t space = GetAddressSpace();
+
+    krn_SpinLock(&elfLock);
+
+    for (int i = 0; i < MOD_MAX_SEGMENTS; i ++) {
+        ElfSegment_t *seg = &elfSegments[i];
+
+        if (seg->space != space) continue;
+
+        for (Addr_t page = seg->start; page < seg->end; page += PAGE_SIZE) {
+            if (!cmn_MmuIsMapped(page)) ElfLoadPage(seg, page);
+        }
+    }
+
+    krn_SpinUnlock(&elfLock);
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            Elf64SHdr_t
+*   @brief              Formalization of the 64-bit ELF Section Header
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             Elf64SHdr_t
+*   @brief              The 64-bit ELF Section Header, which is needed to find the symbol table
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct Elf64SHdr_t {
+    elfWord_t shName;               //!< Section name (offset into the section name string table)
+    elfWord_t shType;               //!< Section type
+    elfXWord_t shFlags;             //!< Section attributes
+    elf64Addr_t shAddr;             //!< Virtual address in memory
+    elf64Off_t shOffset;            //!< Offset in file
+    elfXWord_t shSize;              //!< Size of section
+    elfWord_t shLink;               //!< Link to other section (the string table for a symbol table)
+    elfWord_t shInfo;               //!< Miscellaneous information
+    elfXWord_t shAddrAlign;         //!< Address alignment boundary
+    elfXWord_t shEntSize;           //!< Size of entries, if the section has a table
+} __attribute__((packed)) Elf64SHdr_t;
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            Elf64Sym_t
+*   @brief              Formalization of the 64-bit ELF Symbol Table Entry
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             Elf64Sym_t
+*   @brief              A 64-bit ELF Symbol Table Entry
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct Elf64Sym_t {
+    elfWord_t stName;               //!< Symbol name (offset into the string table)
+    unsigned char stInfo;           //!< Type and binding attributes
+    unsigned char stOther;          //!< Reserved
+    elfHalf_t stShndx;              //!< Section table index
+    elf64Addr_t stValue;            //!< Symbol value
+    elfXWord_t stSize;              //!< Size of object
+} __attribute__((packed)) Elf64Sym_t;
+
+
+
+/****************************************************************************************************************//**
+*   @def                SHT_SYMTAB
+*   @brief              The section type of the symbol table
+*///-----------------------------------------------------------------------------------------------------------------
+#define SHT_SYMTAB      2
+
+
+
+/****************************************************************************************************************//**
+*   @def                STT_FUNC
+*   @brief              The symbol type of a function (the low nibble of `stInfo`)
+*///-----------------------------------------------------------------------------------------------------------------
+#define STT_FUNC        2
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 static void ElfCopyPhys(void *dst, Addr_t src, size_t len)
+*   @brief              Copy from a physical address, borrowing the identity mapping one page at a time if needed
+*
+*   @param              dst             Where to copy to
+*   @param              src             The physical address to copy from
+*   @param              len             The number of bytes to copy
+*///-----------------------------------------------------------------------------------------------------------------
+static void ElfCopyPhys(void *dst, Addr_t src, size_t len)
+{
+    uint8_t *d = (uint8_t *)dst;
+
+    while (len) {
+        Addr_t page = src & ~((Addr_t)PAGE_SIZE - 1);
+        size_t n = page + PAGE_SIZE - src;
+        if (n > len) n = len;
+
+        bool mapped = cmn_MmuIsMapped(page);
+        if (!mapped) cmn_MmuMapPage(page, page >> 12, PG_NONE);
+        kMemMoveB(d, (void *)src, n);
+        if (!mapped) cmn_MmuUnmapPage(page);
+
+        d += n;
+        src += n;
+        len -= n;
+    }
+}
+
+
+
+/********************************************************************************************************************
+*   Documented in `elf.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t ElfWalkFunctions(Addr_t location, ElfSymbolFunc_t fn, void *data)
+{
+    Elf64EHdr_t eHdr;
+    Return_t rv = -ENOENT;
+
+    if (!fn) return -EINVAL;
+
+    ElfCopyPhys(&eHdr, location, sizeof(eHdr));
+    if (!ElfValidateHeader((Addr_t)&eHdr)) return -EINVAL;
+
+    for (unsigned int i = 0; i < eHdr.eShNum; i ++) {
+        Elf64SHdr_t symTab;
+        Elf64SHdr_t strTab;
+
+        ElfCopyPhys(&symTab, location + eHdr.eShOff + i * eHdr.eShEntSize, sizeof(symTab));
+        if (symTab.shType != SHT_SYMTAB || symTab.shEntSize == 0) continue;
+
+        ElfCopyPhys(&strTab, location + eHdr.eShOff + symTab.shLink * eHdr.eShEntSize, sizeof(strTab));
+
+        for (size_t j = 0; j < symTab.shSize / symTab.shEntSize; j ++) {
+            Elf64Sym_t sym;
+            char name[ELF_SYM_NAME_LEN];
+
+            ElfCopyPhys(&sym, location + symTab.shOffset + j * symTab.shEntSize, sizeof(sym));
+            if ((sym.stInfo & 0xf) != STT_FUNC || sym.stSize == 0 || sym.stName >= strTab.shSize) continue;
+
+            // -- the name is null terminated in the table; just do not read past the end of it
+            size_t len = strTab.shSize - sym.stName;
+            if (len > ELF_SYM_NAME_LEN - 1) len = ELF_SYM_NAME_LEN - 1;
+
+            ElfCopyPhys(name, location + strTab.shOffset + sym.stName, len);
+            name[len] = 0;
+
+            fn(name, sym.stValue, sym.stSize, data);
+        }
+
+        rv = 0;
+    }
+
+    return rv;
+}
+
+
+
+#endif
+
+
@@ -47,6 +47,7 @@ header:
         dq      1                                                           ;; interrupts
         dq      4                                                           ;; internal Services
         dq      0                                                           ;; OS services
+        dq      1                                                           ;; dependencies
         dq      DEBUGGER_INT                                                ;; Interrupt 1
         dq      dbg_Dispatch                                                ;; .. target address
         dq      0                                                           ;; .. stack
@@ -62,6 +63,7 @@ header:
         dq      INT_DBG_PROMPT_GENERIC                                      ;; internal function 4
         dq      dbg_PromptGeneric                                           ;; .. target address
         dq      0                                                           ;; .. stack
+        dq      INT_PMM_ALLOC                                               ;; dependency 1 (frame allocation)
 
 
 
@@ -0,0 +1,49 @@
+;;===================================================================================================================
+;;
+;;  entry.s -- Entry point for x86_64 architecture
+;;
+;;        Copyright (c)  2017-2021 -- Adam Clark
+;;        Licensed under "THE BEER-WARE LICENSE"
+;;        See License.md for details.
+;;
+;; -----------------------------------------------------------------------------------------------------------------
+;;
+;;     Date      Tracker  Version  Pgmr  Description
+;;  -----------  -------  -------  ----  --------------------------------------------------------------------------
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+;;
+;;===================================================================================================================
+
+
+
+                global      header
+
+                extern      HpetInitEarly
+                extern      hpet_Nanos
+                extern      hpet_Periodic
+
+%include        'constants.inc'
+
+                section     .text
+
+
+;;
+;; -- Set up the header structure for parsing from the kernel
+;;    -------------------------------------------------------
+header:
+                db          'C','e','n','t','u','r','y',' ','O','S',' ','6','4',0,0,0   ;; Sig
+                db          'H','P','E','T',0,0,0,0,0,0,0,0,0,0,0,0                     ;; Name
+                dq          HpetInitEarly                                               ;; Early Init
+                dq          0                                                           ;; Late Init
+                dq          0xffffaf4000000000                                          ;; Stack Locations
+                dq          0                                                           ;; interrupts
+                dq          2                                                           ;; internal Services
+                dq          0                                                           ;; OS services
+                dq          1                                                           ;; dependencies
+                dq          INT_HPET_NANOS                                              ;; Internal fctn 0x0a0 (Nanos)
+                dq          hpet_Nanos                                                  ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_HPET_PERIODIC                                           ;; Internal fctn 0x0a1 (Periodic)
+                dq          hpet_Periodic                                               ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_PMM_ALLOC                                               ;; dependency 1 (frame allocation)
@@ -0,0 +1,271 @@
+/****************************************************************************************************************//**
+*   @file               hpet.cc
+*   @brief              Functions to handle the High Precision Event Timer
+*   @author             Adam Clark (hobbyos@eryjus.com)
+*   @date               2021-Nov-26
+*   @since              v0.0.13
+*
+*   @copyright          Copyright (c)  2017-2021 -- Adam Clark\n
+*                       Licensed under "THE BEER-WARE LICENSE"\n
+*                       See \ref LICENSE.md for details.
+*
+*   The loader finds the HPET in the ACPI tables and passes its address in the `BootInterface_t`.  This module
+*   starts the main counter, which is a fixed-rate clocksource of its own, and uses it to calibrate the invariant
+*   TSC in a few milliseconds rather than against the PIT.  The LAPIC module depends on `HpetNanos()` to
+*   calibrate its timer the same way.  A comparator which can deliver its interrupts as an FSB (MSI) message
+*   can also be started as a periodic timer when no other timer is available.
+*
+* ------------------------------------------------------------------------------------------------------------------
+*
+*   |     Date    | Tracker |  Version | Pgmr | Description
+*   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Initial version
+*
+*///=================================================================================================================
+
+
+
+#include "types.h"
+#include "boot-interface.h"
+#include "kernel-funcs.h"
+#include "hpet.h"
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t HpetInitEarly(BootInterface_t *loaderInterface)
+*   @brief              Early initialization function
+*
+*   Map the HPET, start its main counter and calibrate the TSC against it.
+*
+*   @param              loaderInterface     The Loader Interface structure containing hardware info
+*
+*   @returns            Whether the module should remain loaded
+*
+*   @retval             0                   The HPET is running
+*   @retval             -ENODEV             There is no usable HPET and the module can be unloaded
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t HpetInitEarly(BootInterface_t *loaderInterface);
+
+
+
+/********************************************************************************************************************
+*   See documentation in `hpet.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Hpet_t hpet = {
+    .baseAddr = 0,
+    .periodFs = 0,
+    .nsMult = 0,
+    .timerCount = 0,
+    .minTick = 0,
+    .wide = false,
+    .last = 0,
+};
+
+
+
+/****************************************************************************************************************//**
+*   @var                lock
+*   @brief              Serializes the set up of the periodic timers
+*///-----------------------------------------------------------------------------------------------------------------
+static Spinlock_t lock = {0};
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t HpetToNanos(uint64_t ticks)
+*   @brief              Convert main counter ticks to nanoseconds
+*
+*   @param              ticks               The main counter ticks
+*
+*   @returns            The nanoseconds
+*///-----------------------------------------------------------------------------------------------------------------
+static inline uint64_t HpetToNanos(uint64_t ticks)
+{
+    return (uint64_t)(((unsigned __int128)ticks * hpet.nsMult) >> CLOCK_SHIFT);
+}
+
+
+
+/********************************************************************************************************************
+*   See documentation in `hpet.h`
+*///-----------------------------------------------------------------------------------------------------------------
+uint64_t HpetCount(void)
+{
+    if (hpet.wide) return PEEK64(hpet.baseAddr + HPET_MAIN_CNT);
+
+    // -- a 32-bit counter wraps every few minutes; the high bits count the wraps seen by any reader
+    uint64_t last = __atomic_load_n(&hpet.last, __ATOMIC_RELAXED);
+    uint64_t now = (last & 0xffffffff00000000ul) | PEEK32(hpet.baseAddr + HPET_MAIN_CNT);
+
+    if (now < last) now += 0x100000000ul;
+    __atomic_compare_exchange_n(&hpet.last, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    return now;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t HpetTscHz(void)
+*   @brief              Measure the TSC frequency over CLOCK_HPET_CAL_US of the main counter
+*
+*   Each counter read is bracketed by TSC reads and the midpoint is used, so the cost of reading the HPET mostly
+*   cancels out.
+*
+*   @returns            The TSC ticks per second
+*///-----------------------------------------------------------------------------------------------------------------
+static uint64_t HpetTscHz(void)
+{
+    uint64_t before = RDTSC();
+    uint64_t start = HpetToNanos(HpetCount());
+    uint64_t tscStart = (before + RDTSC()) / 2;
+    uint64_t now;
+    uint64_t tscNow;
+
+    do {
+        before = RDTSC();
+        now = HpetToNanos(HpetCount());
+        tscNow = (before + RDTSC()) / 2;
+    } while (now - start < CLOCK_HPET_CAL_US * 1000);
+
+    return (tscNow - tscStart) * 1000000000 / (now - start);
+}
+
+
+
+/********************************************************************************************************************
+*   See documentation above
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t HpetInitEarly(BootInterface_t *loaderInterface)
+{
+    ProcessInitTable();
+
+    KernelPrintf("Initializing the HPET\n");
+
+    if (loaderInterface->hpetAddr == 0) {
+        KernelPrintf(".. ACPI does not report an HPET\n");
+        return -ENODEV;
+    }
+
+    MmuMapPage(HPET_MMIO, loaderInterface->hpetAddr >> 12, PG_WRT|PG_DEV);
+    hpet.baseAddr = HPET_MMIO + (loaderInterface->hpetAddr & (PAGE_SIZE - 1));
+
+    uint64_t cap = PEEK64(hpet.baseAddr + HPET_GCAP_ID);
+
+    hpet.periodFs = cap >> HPET_CAP_PERIOD_SHIFT;
+    hpet.timerCount = ((cap >> HPET_CAP_NUM_TIM_SHIFT) & HPET_CAP_NUM_TIM_MASK) + 1;
+    hpet.wide = (cap & HPET_CAP_COUNT_SIZE) != 0;
+    hpet.minTick = loaderInterface->hpetMinTick;
+
+    // -- the specification limits the period to 100ns
+    if (hpet.periodFs == 0 || hpet.periodFs > 100000000) {
+        KernelPrintf(".. the HPET reports an invalid period (%ld fs)\n", hpet.periodFs);
+        MmuUnmapPage(HPET_MMIO);
+        return -ENODEV;
+    }
+
+    hpet.nsMult = (hpet.periodFs << CLOCK_SHIFT) / 1000000;
+
+
+    // -- stop the counter, quiet every comparator, and restart the counter from 0 without legacy routing
+    uint64_t conf = PEEK64(hpet.baseAddr + HPET_GEN_CONF) & ~(uint64_t)(HPET_CONF_ENABLE | HPET_CONF_LEG_RT);
+    POKE64(hpet.baseAddr + HPET_GEN_CONF, conf);
+
+    for (int t = 0; t < hpet.timerCount; t ++) {
+        Addr_t reg = hpet.baseAddr + HPET_TIMER(HPET_TN_CONF_CAP, t);
+        POKE64(reg, PEEK64(reg) & ~(uint64_t)(HPET_TN_INT_ENB | HPET_TN_FSB_EN));
+    }
+
+    POKE64(hpet.baseAddr + HPET_MAIN_CNT, 0);
+    hpet.last = 0;
+    POKE64(hpet.baseAddr + HPET_GEN_CONF, conf | HPET_CONF_ENABLE);
+
+    BootTraceMark(loaderInterface, "hpet started");
+    KernelPrintf(".. %d timers; %d-bit counter at %ld kHz\n", hpet.timerCount, hpet.wide ? 64 : 32,
+            1000000000000ul / hpet.periodFs);
+
+
+    // -- calibrate the TSC, unless it cannot be used as a clock
+    if (CpuHasInvariantTsc() && loaderInterface->clock.mult == 0) {
+        uint64_t hz = HpetTscHz();
+
+        ClockPublish(&loaderInterface->clock, hz, RDTSC());
+        BootTraceMark(loaderInterface, "tsc calibrated");
+        KernelPrintf(".. invariant TSC at %ld kHz\n", hz / 1000);
+    }
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t hpet_Nanos(void)
+*   @brief              Read the main counter in nanoseconds
+*
+*   @returns            The nanoseconds since the HPET module started the main counter
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" uint64_t hpet_Nanos(void)
+{
+    return HpetToNanos(HpetCount());
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t hpet_Periodic(int vector, uint64_t hz)
+*   @brief              Start a free comparator interrupting this cpu periodically
+*
+*   Only comparators which can deliver FSB (MSI) messages are used, so no interrupt controller routing is
+*   needed.  The main counter is stopped while the period is set, as the specification recommends.
+*
+*   @param              vector              The interrupt vector to raise
+*   @param              hz                  The number of interrupts each second
+*
+*   @returns            0 on success
+*
+*   @retval             -EINVAL             The vector or the rate cannot be used
+*   @retval             -ENODEV             There is no free comparator which can be used
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t hpet_Periodic(int vector, uint64_t hz)
+{
+    if (vector < 0x10 || vector > 0xff || hz == 0) return -EINVAL;
+
+    uint64_t period = 1000000000000000ul / hz / hpet.periodFs;
+    if (period == 0 || period < (uint64_t)hpet.minTick) return -EINVAL;
+
+    uint64_t msiAddr = 0xfee00000 | ((uint64_t)LapicGetId() << 12);
+    Return_t rv = -ENODEV;
+
+    SpinLock(&lock); {
+        for (int t = 0; t < hpet.timerCount; t ++) {
+            Addr_t reg = hpet.baseAddr + HPET_TIMER(HPET_TN_CONF_CAP, t);
+            Addr_t cmp = hpet.baseAddr + HPET_TIMER(HPET_TN_COMPARATOR, t);
+            uint64_t cfg = PEEK64(reg);
+
+            if (cfg & HPET_TN_INT_ENB) continue;                // -- already in use
+            if (!(cfg & HPET_TN_PER_INT_CAP) || !(cfg & HPET_TN_FSB_DEL_CAP)) continue;
+
+            uint64_t conf = PEEK64(hpet.baseAddr + HPET_GEN_CONF);
+            POKE64(hpet.baseAddr + HPET_GEN_CONF, conf & ~(uint64_t)HPET_CONF_ENABLE);
+
+            POKE64(hpet.baseAddr + HPET_TIMER(HPET_TN_FSB_ROUTE, t), (msiAddr << 32) | (uint64_t)vector);
+            POKE64(reg, (cfg & 0xffffffff00000000ul)
+                    | HPET_TN_INT_ENB | HPET_TN_TYPE_PERIODIC | HPET_TN_VAL_SET | HPET_TN_FSB_EN);
+
+            // -- the first write sets the comparator; with HPET_TN_VAL_SET cleared, the second sets the period
+            POKE64(cmp, PEEK64(hpet.baseAddr + HPET_MAIN_CNT) + period);
+            POKE64(cmp, period);
+
+            POKE64(hpet.baseAddr + HPET_GEN_CONF, conf);
+
+            KernelPrintf("HPET: timer %d interrupts cpu %d on vector %d at %ld Hz\n", t, LapicGetId(), vector, hz);
+            rv = 0;
+            break;
+        }
+    } SpinUnlock(&lock);
+
+    return rv;
+}
+
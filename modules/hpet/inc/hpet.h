@@ -0,0 +1,112 @@
+/****************************************************************************************************************//**
+*   @file               hpet.h
+*   @brief              High Precision Event Timer registers and structures
+*   @author             Adam Clark (hobbyos@eryjus.com)
+*   @date               2021-Nov-26
+*   @since              v0.0.13
+*
+*   @copyright          Copyright (c)  2017-2021 -- Adam Clark\n
+*                       Licensed under "THE BEER-WARE LICENSE"\n
+*                       See \ref LICENSE.md for details.
+*
+* ------------------------------------------------------------------------------------------------------------------
+*
+*   |     Date    | Tracker |  Version | Pgmr | Description
+*   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Initial version
+*
+*///=================================================================================================================
+
+
+
+#pragma once
+
+
+#include "types.h"
+#include "boot-interface.h"
+
+
+
+/****************************************************************************************************************//**
+*   @enum               HpetRegister_t
+*   @brief              The offsets of the HPET registers from the mapped base address
+*///-----------------------------------------------------------------------------------------------------------------
+enum HpetRegister_t {
+    HPET_GCAP_ID = 0x000,               //!< General Capabilities and ID Register
+    HPET_GEN_CONF = 0x010,              //!< General Configuration Register
+    HPET_GINTR_STA = 0x020,             //!< General Interrupt Status Register
+    HPET_MAIN_CNT = 0x0f0,              //!< Main Counter Value Register
+    HPET_TN_CONF_CAP = 0x100,           //!< Timer N Configuration and Capability Register (plus 0x20 * N)
+    HPET_TN_COMPARATOR = 0x108,         //!< Timer N Comparator Value Register (plus 0x20 * N)
+    HPET_TN_FSB_ROUTE = 0x110,          //!< Timer N FSB Interrupt Route Register (plus 0x20 * N)
+};
+
+
+
+/****************************************************************************************************************//**
+*   @def                HPET_TIMER
+*   @brief              The offset of a register for timer `n`
+*///-----------------------------------------------------------------------------------------------------------------
+#define HPET_TIMER(reg,n)           ((reg) + (0x20 * (n)))
+
+
+
+/****************************************************************************************************************//**
+*   @enum               HpetBits_t
+*   @brief              The bits used in the HPET registers
+*///-----------------------------------------------------------------------------------------------------------------
+enum HpetBits_t {
+    HPET_CAP_NUM_TIM_SHIFT = 8,         //!< GCAP_ID: the number of the last timer
+    HPET_CAP_NUM_TIM_MASK = 0x1f,       //!< GCAP_ID: .. and its mask
+    HPET_CAP_COUNT_SIZE = (1<<13),      //!< GCAP_ID: the main counter is 64 bits
+    HPET_CAP_PERIOD_SHIFT = 32,         //!< GCAP_ID: the counter period in femtoseconds
+
+    HPET_CONF_ENABLE = (1<<0),          //!< GEN_CONF: the main counter runs and the timers may interrupt
+    HPET_CONF_LEG_RT = (1<<1),          //!< GEN_CONF: legacy replacement routing of timers 0 and 1
+
+    HPET_TN_INT_ENB = (1<<2),           //!< Tn_CONF_CAP: interrupts are enabled
+    HPET_TN_TYPE_PERIODIC = (1<<3),     //!< Tn_CONF_CAP: periodic mode
+    HPET_TN_PER_INT_CAP = (1<<4),       //!< Tn_CONF_CAP: the timer supports periodic mode
+    HPET_TN_VAL_SET = (1<<6),           //!< Tn_CONF_CAP: the next comparator write sets the period
+    HPET_TN_FSB_EN = (1<<14),           //!< Tn_CONF_CAP: interrupts are delivered as FSB (MSI) messages
+    HPET_TN_FSB_DEL_CAP = (1<<15),      //!< Tn_CONF_CAP: the timer supports FSB delivery
+};
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            Hpet_t
+*   @brief              Formalization of the HPET Driver Structure into a type
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             Hpet_t
+*   @brief              The HPET driver structure
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct Hpet_t {
+    Addr_t baseAddr;                    //!< The address where the HPET registers are mapped
+    uint64_t periodFs;                  //!< The main counter period in femtoseconds
+    uint64_t nsMult;                    //!< Counter ticks to nanoseconds, scaled by 2^CLOCK_SHIFT
+    int timerCount;                     //!< The number of comparators
+    int minTick;                        //!< The minimum periodic tick from ACPI, in counter ticks
+    bool wide;                          //!< The main counter is 64 bits
+    uint64_t last;                      //!< The last 32-bit counter value, extended to 64 bits
+} Hpet_t;
+
+
+
+/****************************************************************************************************************//**
+*   @var                hpet
+*   @brief              The HPET driver structure
+*///-----------------------------------------------------------------------------------------------------------------
+extern Hpet_t hpet;
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t HpetCount(void)
+*   @brief              Read the main counter, extending a 32-bit counter to 64 bits
+*
+*   @returns            The main counter value
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" uint64_t HpetCount(void);
+
@@ -0,0 +1,62 @@
+;;===================================================================================================================
+;;
+;;  entry.s -- Entry point for x86_64 architecture
+;;
+;;        Copyright (c)  2017-2021 -- Adam Clark
+;;        Licensed under "THE BEER-WARE LICENSE"
+;;        See License.md for details.
+;;
+;; -----------------------------------------------------------------------------------------------------------------
+;;
+;;     Date      Tracker  Version  Pgmr  Description
+;;  -----------  -------  -------  ----  --------------------------------------------------------------------------
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+;;
+;;===================================================================================================================
+
+
+
+                global      header
+
+                extern      IoApicInitEarly
+                extern      IoApicInitLate
+                extern      irq_Route
+                extern      irq_Mask
+                extern      irq_SetAffinity
+                extern      irq_Balance
+                extern      irq_IsaGsi
+
+%include        'constants.inc'
+
+                section     .text
+
+
+;;
+;; -- Set up the header structure for parsing from the kernel
+;;    -------------------------------------------------------
+header:
+                db          'C','e','n','t','u','r','y',' ','O','S',' ','6','4',0,0,0   ;; Sig
+                db          'I','O','A','P','I','C',0,0,0,0,0,0,0,0,0,0                 ;; Name
+                dq          IoApicInitEarly                                             ;; Early Init
+                dq          IoApicInitLate                                              ;; Late Init
+                dq          0xffffaf4000000000                                          ;; Stack Locations
+                dq          0                                                           ;; interrupts
+                dq          5                                                           ;; internal Services
+                dq          0                                                           ;; OS services
+                dq          1                                                           ;; dependencies
+                dq          INT_IRQ_ROUTE                                               ;; Internal fctn 0x0b0 (Route)
+                dq          irq_Route                                                   ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_IRQ_MASK                                                ;; Internal fctn 0x0b1 (Mask)
+                dq          irq_Mask                                                    ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_IRQ_AFFINITY                                            ;; Internal fctn 0x0b2 (Affinity)
+                dq          irq_SetAffinity                                             ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_IRQ_BALANCE                                             ;; Internal fctn 0x0b3 (Balance)
+                dq          irq_Balance                                                 ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_IRQ_ISA_GSI                                             ;; Internal fctn 0x0b4 (ISA GSI)
+                dq          irq_IsaGsi                                                  ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_PMM_ALLOC                                               ;; dependency 1 (frame allocation)
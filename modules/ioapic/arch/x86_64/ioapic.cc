@@ -0,0 +1,453 @@
+/****************************************************************************************************************//**
+*   @file               ioapic.cc
+*   @brief              Functions to route the device interrupts through the IOAPICs
+*   @author             Adam Clark (hobbyos@eryjus.com)
+*   @date               2021-Nov-26
+*   @since              v0.0.13
+*
+*   @copyright          Copyright (c)  2017-2021 -- Adam Clark\n
+*                       Licensed under "THE BEER-WARE LICENSE"\n
+*                       See \ref LICENSE.md for details.
+*
+*   The loader finds the IOAPICs and the ISA interrupt source overrides in the MADT and passes them in the
+*   `BootInterface_t`.  This module masks the legacy PICs and every IOAPIC input, and then routes each global
+*   system interrupt (GSI) a driver asks for to a vector on a cpu, physically addressed by LAPIC ID.
+*
+*   A driver gets its vector from the kernel with `VectorAlloc()`.  Devices with MSI or MSI-X do not need this
+*   module at all: `MsiAddress()` and `MsiData()` compose the message for any cpu.  Here, the GSIs which are not
+*   pinned to a cpu are periodically spread over the active cpus by the number of interrupts each raised since
+*   the last pass, which the kernel counts for every vector on entry.
+*
+* ------------------------------------------------------------------------------------------------------------------
+*
+*   |     Date    | Tracker |  Version | Pgmr | Description
+*   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Initial version
+*
+*///=================================================================================================================
+
+
+
+#include "types.h"
+#include "boot-interface.h"
+#include "kernel-funcs.h"
+#include "ioapic.h"
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t IoApicInitEarly(BootInterface_t *loaderInterface)
+*   @brief              Early initialization function
+*
+*   Map the IOAPICs, mask all their inputs and work out the polarity and trigger mode of each GSI.
+*
+*   @param              loaderInterface     The Loader Interface structure containing hardware info
+*
+*   @returns            Whether the module should remain loaded
+*
+*   @retval             0                   The IOAPICs are ready to route interrupts
+*   @retval             -ENODEV             There are no IOAPICs and the module can be unloaded
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t IoApicInitEarly(BootInterface_t *loaderInterface);
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void IoApicInitLate(void)
+*   @brief              Late initialization function; start the IRQ balancer
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void IoApicInitLate(void);
+
+
+
+/********************************************************************************************************************
+*   See documentation in `ioapic.h`
+*///-----------------------------------------------------------------------------------------------------------------
+IoApic_t ioapics[MAX_IOAPIC] = { { 0 } };
+Irq_t irqs[MAX_GSI] = { { 0 } };
+
+
+
+/****************************************************************************************************************//**
+*   @var                ioapicCount
+*   @brief              The number of IOAPICs in use
+*///-----------------------------------------------------------------------------------------------------------------
+static int ioapicCount = 0;
+
+
+
+/****************************************************************************************************************//**
+*   @var                isaGsi
+*   @brief              The GSI for each ISA IRQ, after the ACPI overrides
+*///-----------------------------------------------------------------------------------------------------------------
+static int isaGsi[ISA_IRQS];
+
+
+
+/****************************************************************************************************************//**
+*   @var                lock
+*   @brief              Serializes the register selection and the routing table
+*///-----------------------------------------------------------------------------------------------------------------
+static Spinlock_t lock = {0};
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint32_t IoApicRead(IoApic_t *io, int reg)
+*   @brief              Read an indirect IOAPIC register; the lock is held
+*///-----------------------------------------------------------------------------------------------------------------
+static inline uint32_t IoApicRead(IoApic_t *io, int reg)
+{
+    POKE32(io->baseAddr + IOAPIC_IOREGSEL, reg);
+    return PEEK32(io->baseAddr + IOAPIC_IOWIN);
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void IoApicWrite(IoApic_t *io, int reg, uint32_t val)
+*   @brief              Write an indirect IOAPIC register; the lock is held
+*///-----------------------------------------------------------------------------------------------------------------
+static inline void IoApicWrite(IoApic_t *io, int reg, uint32_t val)
+{
+    POKE32(io->baseAddr + IOAPIC_IOREGSEL, reg);
+    POKE32(io->baseAddr + IOAPIC_IOWIN, val);
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint32_t IrqMode(int flags, bool isa)
+*   @brief              Convert MPS INTI flags into redirection entry bits
+*
+*   A polarity or trigger mode of 0 conforms to the bus: ISA inputs are active high and edge triggered; the
+*   others (PCI) are active low and level triggered.
+*///-----------------------------------------------------------------------------------------------------------------
+static uint32_t IrqMode(int flags, bool isa)
+{
+    int polarity = flags & 0x3;
+    int trigger = (flags >> 2) & 0x3;
+    uint32_t rv = 0;
+
+    if (polarity == 3 || (polarity == 0 && !isa)) rv |= IOAPIC_RED_POLARITY_LOW;
+    if (trigger == 3 || (trigger == 0 && !isa)) rv |= IOAPIC_RED_TRIGGER_LEVEL;
+
+    return rv;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void IrqProgram(Irq_t *irq, bool mask)
+*   @brief              Write the redirection entry for a GSI; the lock is held
+*
+*   The entry is masked while the destination is changed so the 2 halves are never seen out of step.  This is
+*   for the initial route and for masking; a routed GSI moves to another cpu with `IrqRetarget()`.
+*///-----------------------------------------------------------------------------------------------------------------
+static void IrqProgram(Irq_t *irq, bool mask)
+{
+    IoApic_t *io = &ioapics[irq->ioapic];
+    int reg = IOAPIC_REDTBL + (irq->pin * 2);
+    uint32_t low = (uint32_t)irq->vector | irq->mode;
+
+    IoApicWrite(io, reg, low | IOAPIC_RED_MASKED);
+    IoApicWrite(io, reg + 1, (uint32_t)irq->cpu << IOAPIC_RED_DEST_SHIFT);
+    if (!mask) IoApicWrite(io, reg, low);
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void IrqRetarget(Irq_t *irq)
+*   @brief              Send a routed GSI to a new cpu; the lock is held
+*
+*   Only the destination in the high half changes, so the entry is left as it is: masking it would drop an edge
+*   triggered interrupt raised in between.
+*///-----------------------------------------------------------------------------------------------------------------
+static void IrqRetarget(Irq_t *irq)
+{
+    IoApicWrite(&ioapics[irq->ioapic], IOAPIC_REDTBL + (irq->pin * 2) + 1,
+            (uint32_t)irq->cpu << IOAPIC_RED_DEST_SHIFT);
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 int IrqLeastLoaded(void)
+*   @brief              Find the active cpu with the least recent interrupt load; the lock is held
+*
+*   The cpus are numbered by LAPIC ID from 0, as the kernel starts them.  Each routed GSI counts for its recent
+*   load plus 1, so an idle cpu still fills up with quiet GSIs evenly.
+*///-----------------------------------------------------------------------------------------------------------------
+static int IrqLeastLoaded(void)
+{
+    uint64_t load[MAX_CPU] = { 0 };
+    int cpus = KrnActiveCores();
+
+    if (cpus < 1) cpus = 1;
+    if (cpus > MAX_CPU) cpus = MAX_CPU;
+
+    for (int g = 0; g < MAX_GSI; g ++) {
+        if (irqs[g].vector && irqs[g].cpu < cpus) load[irqs[g].cpu] += irqs[g].load + 1;
+    }
+
+    int rv = 0;
+    for (int c = 1; c < cpus; c ++) if (load[c] < load[rv]) rv = c;
+
+    return rv;
+}
+
+
+
+/********************************************************************************************************************
+*   See documentation above
+*///-----------------------------------------------------------------------------------------------------------------
+Return_t IoApicInitEarly(BootInterface_t *loaderInterface)
+{
+    ProcessInitTable();
+
+    KernelPrintf("Initializing the IOAPICs\n");
+
+    if (loaderInterface->ioapicCount == 0) {
+        KernelPrintf(".. ACPI does not report an IOAPIC\n");
+        return -ENODEV;
+    }
+
+
+    // -- the 8259 PICs stay masked from here; everything comes through the IOAPICs
+    OUTB(0x21, 0xff);
+    OUTB(0xa1, 0xff);
+
+    for (int g = 0; g < MAX_GSI; g ++) irqs[g].ioapic = -1;
+
+
+    for (int i = 0; i < loaderInterface->ioapicCount && i < MAX_IOAPIC; i ++) {
+        IoApic_t *io = &ioapics[ioapicCount];
+        Addr_t va = IOAPIC_MMIO + (ioapicCount * PAGE_SIZE);
+
+        MmuMapPage(va, loaderInterface->ioapic[i].addr >> 12, PG_WRT|PG_DEV);
+        io->baseAddr = va + (loaderInterface->ioapic[i].addr & (PAGE_SIZE - 1));
+        io->id = loaderInterface->ioapic[i].id;
+        io->gsiBase = loaderInterface->ioapic[i].gsiBase;
+
+        SpinLock(&lock); {
+            io->count = ((IoApicRead(io, IOAPIC_VER) >> IOAPIC_VER_MAX_REDIR_SHIFT) & IOAPIC_VER_MAX_REDIR_MASK) + 1;
+
+            for (int p = 0; p < io->count; p ++) {
+                IoApicWrite(io, IOAPIC_REDTBL + (p * 2), IOAPIC_RED_MASKED);
+
+                int g = io->gsiBase + p;
+                if (g < 0 || g >= MAX_GSI) continue;
+
+                irqs[g].ioapic = ioapicCount;
+                irqs[g].pin = p;
+                irqs[g].mode = IrqMode(0, g < ISA_IRQS);
+            }
+        } SpinUnlock(&lock);
+
+        KernelPrintf(".. IOAPIC %d: GSIs %d-%d\n", io->id, io->gsiBase, io->gsiBase + io->count - 1);
+        ioapicCount ++;
+    }
+
+
+    // -- the ISA IRQs keep the bus defaults unless the MADT overrides them
+    for (int i = 0; i < ISA_IRQS; i ++) {
+        int g = loaderInterface->isaIrq[i].gsi;
+
+        isaGsi[i] = g;
+        if (g >= 0 && g < MAX_GSI) irqs[g].mode = IrqMode(loaderInterface->isaIrq[i].flags, true);
+        if (g != i) KernelPrintf(".. ISA IRQ %d is GSI %d\n", i, g);
+    }
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t irq_Route(int gsi, int vector, int cpu)
+*   @brief              Route a GSI to a vector on a cpu; the entry is left masked
+*
+*   @param              gsi                 The global system interrupt
+*   @param              vector              The vector to raise
+*   @param              cpu                 The LAPIC ID to deliver to, or IRQ_CPU_ANY to let the module choose
+*
+*   @returns            The cpu chosen
+*
+*   @retval             -EINVAL             The GSI, vector or cpu cannot be used
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t irq_Route(int gsi, int vector, int cpu)
+{
+    if (gsi < 0 || gsi >= MAX_GSI || irqs[gsi].ioapic < 0) return -EINVAL;
+    if (vector < 0x10 || vector > 0xfe) return -EINVAL;
+    if (cpu != IRQ_CPU_ANY && (cpu < 0 || cpu >= MAX_CPU)) return -EINVAL;
+
+    Irq_t *irq = &irqs[gsi];
+
+    SpinLock(&lock); {
+        irq->vector = 0;                            // -- do not count the old route against any cpu
+        irq->pinned = (cpu != IRQ_CPU_ANY);
+        irq->cpu = irq->pinned ? cpu : IrqLeastLoaded();
+        irq->vector = vector;
+        irq->lastCount = VectorCount(vector);
+        irq->load = 0;
+
+        IrqProgram(irq, true);
+    } SpinUnlock(&lock);
+
+    return irq->cpu;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t irq_Mask(int gsi, bool mask)
+*   @brief              Mask or unmask a routed GSI
+*
+*   @retval             0                   The entry was updated
+*   @retval             -EINVAL             The GSI has not been routed
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t irq_Mask(int gsi, bool mask)
+{
+    if (gsi < 0 || gsi >= MAX_GSI || irqs[gsi].ioapic < 0 || irqs[gsi].vector == 0) return -EINVAL;
+
+    SpinLock(&lock); {
+        IrqProgram(&irqs[gsi], mask);
+    } SpinUnlock(&lock);
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t irq_SetAffinity(int gsi, int cpu)
+*   @brief              Pin a routed GSI to a cpu, or release it to the balancer with IRQ_CPU_ANY
+*
+*   @retval             0                   The affinity was updated
+*   @retval             -EINVAL             The GSI has not been routed or the cpu cannot be used
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t irq_SetAffinity(int gsi, int cpu)
+{
+    if (gsi < 0 || gsi >= MAX_GSI || irqs[gsi].ioapic < 0 || irqs[gsi].vector == 0) return -EINVAL;
+    if (cpu != IRQ_CPU_ANY && (cpu < 0 || cpu >= MAX_CPU)) return -EINVAL;
+
+    Irq_t *irq = &irqs[gsi];
+
+    SpinLock(&lock); {
+        irq->pinned = (cpu != IRQ_CPU_ANY);
+
+        if (irq->pinned && irq->cpu != cpu) {
+            irq->cpu = cpu;
+            IrqRetarget(irq);
+        }
+    } SpinUnlock(&lock);
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t irq_Balance(void)
+*   @brief              Spread the unpinned GSIs over the active cpus by their recent interrupt counts
+*
+*   This is the longest-processing-time greedy assignment: the busiest GSI goes first to the cpu with the least
+*   load so far, where the pinned GSIs have already been counted.  A GSI stays where it is when its cpu is as
+*   good as any, so a quiet system does not move interrupts around.
+*
+*   @returns            The number of GSIs which moved
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t irq_Balance(void)
+{
+    uint64_t load[MAX_CPU] = { 0 };
+    int order[MAX_GSI];
+    int n = 0;
+    int moved = 0;
+    int cpus = KrnActiveCores();
+
+    if (cpus < 1) cpus = 1;
+    if (cpus > MAX_CPU) cpus = MAX_CPU;
+
+    SpinLock(&lock); {
+        for (int g = 0; g < MAX_GSI; g ++) {
+            Irq_t *irq = &irqs[g];
+            if (irq->vector == 0) continue;
+
+            uint64_t count = VectorCount(irq->vector);
+            irq->load = count - irq->lastCount;
+            irq->lastCount = count;
+
+            if (irq->pinned) {
+                if (irq->cpu < cpus) load[irq->cpu] += irq->load;
+                continue;
+            }
+
+            // -- insertion sort, busiest first; there are only ever a few routed GSIs
+            int i = n ++;
+            while (i > 0 && irqs[order[i - 1]].load < irq->load) {
+                order[i] = order[i - 1];
+                i --;
+            }
+            order[i] = g;
+        }
+
+        for (int i = 0; i < n; i ++) {
+            Irq_t *irq = &irqs[order[i]];
+            int best = (irq->cpu < cpus) ? irq->cpu : 0;
+
+            for (int c = 0; c < cpus; c ++) if (load[c] < load[best]) best = c;
+
+            load[best] += irq->load;
+
+            if (best != irq->cpu) {
+                irq->cpu = best;
+                IrqRetarget(irq);
+                moved ++;
+            }
+        }
+    } SpinUnlock(&lock);
+
+    return moved;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 Return_t irq_IsaGsi(int isa)
+*   @brief              The GSI of an ISA IRQ, after the ACPI overrides
+*
+*   @retval             -EINVAL             There is no such ISA IRQ
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t irq_IsaGsi(int isa)
+{
+    if (isa < 0 || isa >= ISA_IRQS) return -EINVAL;
+
+    return isaGsi[isa];
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 void IrqBalancer(void)
+*   @brief              The process which rebalances the device interrupts every IRQ_BALANCE_MS
+*///-----------------------------------------------------------------------------------------------------------------
+static void IrqBalancer(void)
+{
+    while (true) {
+        SchProcessMilliSleep(IRQ_BALANCE_MS);
+        irq_Balance();
+    }
+}
+
+
+
+/********************************************************************************************************************
+*   See documentation above
+*///-----------------------------------------------------------------------------------------------------------------
+void IoApicInitLate(void)
+{
+    SchProcessCreate("IRQ Balancer", (Addr_t)IrqBalancer, GetAddressSpace(), PTY_LOW);
+}
+
+
@@ -0,0 +1,119 @@
+/****************************************************************************************************************//**
+*   @file               ioapic.h
+*   @brief              IOAPIC registers and the device IRQ routing structures
+*   @author             Adam Clark (hobbyos@eryjus.com)
+*   @date               2021-Nov-26
+*   @since              v0.0.13
+*
+*   @copyright          Copyright (c)  2017-2021 -- Adam Clark\n
+*                       Licensed under "THE BEER-WARE LICENSE"\n
+*                       See \ref LICENSE.md for details.
+*
+* ------------------------------------------------------------------------------------------------------------------
+*
+*   |     Date    | Tracker |  Version | Pgmr | Description
+*   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Initial version
+*
+*///=================================================================================================================
+
+
+
+#pragma once
+
+
+#include "types.h"
+#include "boot-interface.h"
+
+
+
+/****************************************************************************************************************//**
+*   @def                MAX_GSI
+*   @brief              The number of global system interrupts which can be routed
+*///-----------------------------------------------------------------------------------------------------------------
+#define MAX_GSI             128
+
+
+
+/****************************************************************************************************************//**
+*   @enum               IoApicRegister_t
+*   @brief              The IOAPIC registers; the direct registers are offsets and the rest are indices
+*///-----------------------------------------------------------------------------------------------------------------
+enum IoApicRegister_t {
+    IOAPIC_IOREGSEL = 0x00,             //!< (offset) Selects the indirect register
+    IOAPIC_IOWIN = 0x10,                //!< (offset) Reads or writes the selected register
+    IOAPIC_VER = 0x01,                  //!< (index) The version and the last redirection entry
+    IOAPIC_REDTBL = 0x10,               //!< (index) Redirection entry N is at 0x10 + 2 * N (low dword first)
+};
+
+
+
+/****************************************************************************************************************//**
+*   @enum               IoApicBits_t
+*   @brief              The bits used in the IOAPIC registers
+*///-----------------------------------------------------------------------------------------------------------------
+enum IoApicBits_t {
+    IOAPIC_VER_MAX_REDIR_SHIFT = 16,    //!< VER: the number of the last redirection entry
+    IOAPIC_VER_MAX_REDIR_MASK = 0xff,   //!< VER: .. and its mask
+
+    IOAPIC_RED_POLARITY_LOW = (1<<13),  //!< REDTBL: the input is active low
+    IOAPIC_RED_TRIGGER_LEVEL = (1<<15), //!< REDTBL: the input is level triggered
+    IOAPIC_RED_MASKED = (1<<16),        //!< REDTBL: the input is masked
+    IOAPIC_RED_DEST_SHIFT = 24,         //!< REDTBL (high dword): the destination LAPIC ID
+};
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            IoApic_t
+*   @brief              Formalization of the IOAPIC structure into a type
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             IoApic_t
+*   @brief              One IOAPIC and the GSIs it handles
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct IoApic_t {
+    Addr_t baseAddr;                    //!< The address where the IOAPIC registers are mapped
+    int id;                             //!< The IOAPIC ID from ACPI
+    int gsiBase;                        //!< The GSI of its first input
+    int count;                          //!< The number of inputs
+} IoApic_t;
+
+
+
+/****************************************************************************************************************//**
+*   @typedef            Irq_t
+*   @brief              Formalization of the GSI routing state into a type
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             Irq_t
+*   @brief              The routing of one GSI
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct Irq_t {
+    int ioapic;                         //!< The index of the IOAPIC with this input, or -1 when there is none
+    int pin;                            //!< The input on that IOAPIC
+    uint32_t mode;                      //!< The polarity and trigger bits for its redirection entry
+    int vector;                         //!< The vector it is routed to, or 0 when it is not routed
+    int cpu;                            //!< The LAPIC ID it is delivered to
+    bool pinned;                        //!< The balancer leaves it where it is
+    uint64_t lastCount;                 //!< The vector count at the last balance
+    uint64_t load;                      //!< The interrupts counted between the last 2 balances
+} Irq_t;
+
+
+
+/****************************************************************************************************************//**
+*   @var                ioapics
+*   @brief              The IOAPICs found by the loader
+*///-----------------------------------------------------------------------------------------------------------------
+extern IoApic_t ioapics[MAX_IOAPIC];
+
+
+
+/****************************************************************************************************************//**
+*   @var                irqs
+*   @brief              The routing of each GSI
+*///-----------------------------------------------------------------------------------------------------------------
+extern Irq_t irqs[MAX_GSI];
+
+
@@ -30,10 +30,18 @@
 ;;     Date      Tracker  Version  Pgmr  Description
 ;;  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 ;;  2021-May-25  Initial  v0.0.9b  ADCL  Initial version -- COpied from Century
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Generated structure offsets; the postpone state is per-cpu
 ;;
 ;;===================================================================================================================
 
 
+;;
+;; -- The configuration and the structure offsets (generated from `offsets/asm-offsets.cc`)
+;;    -------------------------------------------------------------------------------------
+%include "constants.inc"
+%include "asm-offsets.inc"
+
+
 ;;
 ;; -- Now, expose our function to everyone
 ;;    ------------------------------------
@@ -47,33 +55,7 @@
     extern  ProcessUpdateTimeUsed
 ;;    extern  _SchCheckPostpone
     extern  sch_ProcessReady
-
-    extern  scheduler
-
-
-;;
-;; -- Some local equates for use with access structure elements
-;;    ---------------------------------------------------------
-PROC_TOS_PROCESS_SWAP   EQU     0
-PROC_VIRT_ADDR_SPACE    EQU     8
-PROC_STATUS             EQU     16      ;; dword size
-PROC_PRIORITY           EQU     20      ;; dword size
-PROC_QUANTUM_LEFT       EQU     24
-
-
-;;
-;; -- some local equates for accessing the structure offsets
-;;    ------------------------------------------------------
-SCH_CHG_PENDING         EQU     16    ;; byte size
-SCH_LOCK_COUNT          EQU     32
-SCH_POSTPONE_COUNT      EQU     40
-
-
-;;
-;; -- Some additional constants for use when managing process status
-;;    --------------------------------------------------------------
-PROC_STS_RUNNING        EQU     1
-PROC_STS_READY          EQU     2
+    extern  FpuSwitch
 
 
 ;;
@@ -91,18 +73,14 @@ bits        64
 ;;    --------------------------------------------------------------------------------------
 ProcessSwitch:
 ;;
-;; -- before we do too much, do we need to postpone?
-;;    ----------------------------------------------
+;; -- before we do too much, do we need to postpone?  this cpu's count and flag are in its own cache line
+;;    ---------------------------------------------------------------------------------------------------
         push    rax
 
-        mov     rax,scheduler
-        add     rax,SCH_POSTPONE_COUNT
-        cmp     qword [rax],0
+        cmp     qword [gs:CPU_POSTPONE_COUNT],0
         je      .cont
 
-        mov     rax,scheduler
-        add     rax,SCH_CHG_PENDING
-        mov     byte [rax],1
+        mov     byte [gs:CPU_CHG_PENDING],1
 
         pop     rax
         ret
@@ -162,7 +140,7 @@ ProcessSwitch:
 ;;
 ;; -- Get the current task structure
 ;;    ------------------------------
-        mov     r14,[gs:8]                  ;; get the address of the current process
+        mov     r14,[gs:CPU_PROCESS]        ;; get the address of the current process
         mov     r15,rdi                     ;; save the target process to a preserved register
 
         cmp     dword [r14+PROC_STATUS],PROC_STS_RUNNING    ;; is this the current running process
@@ -175,13 +153,19 @@ ProcessSwitch:
         pop     r14
 
 .saveStack:
+%if IS_ENABLED(FPU_STATE)
+        mov     rdi,r14                     ;; the outgoing process
+        mov     rsi,r15                     ;; the incoming process
+        call    FpuSwitch                   ;; save the extended state as needed
+%endif
+
         mov     [r14+PROC_TOS_PROCESS_SWAP],rsp ;; save the top of the current stack
 
 
 ;;
 ;; -- next, we get the next task and prepare to switch to that
 ;;    --------------------------------------------------------
-        mov     [gs:8],r15                  ;; this is now the current task
+        mov     [gs:CPU_PROCESS],r15        ;; this is now the current task
 
         mov     rsp,[r15+PROC_TOS_PROCESS_SWAP]  ;; get the stop of the next process stack
         mov     dword [r15+PROC_STATUS],PROC_STS_RUNNING    ;; set the new process to be running
@@ -0,0 +1,88 @@
+//===================================================================================================================
+//
+//  clock.cc -- The invariant TSC clocksource
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  When the cpu has an invariant TSC, it runs at a constant rate in every P- and C-state and the TSCs of all the
+//  cpus agree.  So, it is calibrated once on the BSP and the result is published in the boot interface page.
+//  From there, `ClockNanos()` turns the TSC into nanoseconds on any cpu in any address space.  The HPET module
+//  calibrates it during its early init; when there is no HPET, it is calibrated here against PIT channel 2.
+//  Without an invariant TSC, the clocksource is left empty and `ClockNanos()` uses the timer count.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#include "types.h"
+#include "boot-interface.h"
+#include "printf.h"
+#include "cpu.h"
+
+
+//
+// -- The PIT input clock
+//    -------------------
+#define PIT_HZ          1193182
+
+
+
+//
+// -- Count the TSC ticks over CLOCK_CAL_MS of PIT channel 2 in one-shot mode
+//    -----------------------------------------------------------------------
+static uint64_t ClockPitTsc(void)
+{
+    uint16_t count = (uint16_t)((uint64_t)PIT_HZ * CLOCK_CAL_MS / 1000);
+
+    OUTB(0x61, (INB(0x61) & 0xfd) | 1);         // -- speaker off; gate on
+    OUTB(0x43, 0xb2);                           // -- channel 2, lo/hi byte, hardware one-shot
+    OUTB(0x42, count & 0xff);
+    INB(0x60);                                  // -- short delay
+    OUTB(0x42, count >> 8);
+
+    // -- a rising edge on the gate starts the count; OUT2 goes low and then high again at the end
+    uint8_t tmp = INB(0x61) & 0xfe;
+    OUTB(0x61, tmp);
+    OUTB(0x61, tmp | 1);
+
+    while (INB(0x61) & 0x20) {}
+    uint64_t start = RDTSC();
+    while (!(INB(0x61) & 0x20)) {}
+
+    return RDTSC() - start;
+}
+
+
+
+//
+// -- Calibrate the TSC if no module has and publish the clocksource; interrupts are still disabled
+//    ---------------------------------------------------------------------------------------------
+extern "C" void ClockInit(BootInterface_t *loaderInterface)
+{
+    ClockSource_t *clk = &loaderInterface->clock;
+
+    if (clk->mult != 0) {
+        kprintf("Clock: invariant TSC at %d kHz\n", clk->hz / 1000);
+        return;
+    }
+
+    if (!CpuHasInvariantTsc()) {
+        kprintf("Clock: no invariant TSC; the clock has the timer tick resolution\n");
+        return;
+    }
+
+    uint64_t hz = ClockPitTsc() * 1000 / CLOCK_CAL_MS;
+    if (!assert_msg(hz != 0, "The TSC did not advance during calibration")) return;
+
+    ClockPublish(clk, hz, RDTSC());
+
+    BootTraceMark(loaderInterface, "tsc calibrated");
+    kprintf("Clock: invariant TSC at %d kHz (PIT)\n", hz / 1000);
+}
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jun-18  Initial  v0.0.9c  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Start all the APs in one round
 //
 //===================================================================================================================
 
@@ -35,13 +36,6 @@ ArchCpu_t cpus[MAX_CPU] = { {0} };
 
 
 
-//
-// -- The CPU that is currently starting
-//    ----------------------------------
-int cpuStarting = 0;
-
-
-
 //
 // -- The number of active CPUs
 //    -------------------------
@@ -77,9 +71,57 @@ void CpuInit(void)
 extern "C" void kInitAp(void);
 
 
+//
+// -- The stack tops for the APs, indexed by APIC ID; the trampoline reads this table
+//    -------------------------------------------------------------------------------
+static Addr_t apStacks[MAX_CPU] = {0};
+
+
+
+//
+// -- The PIT input clock, which drives the AP start delays
+//    -----------------------------------------------------
+#define PIT_HZ          1193182
+#define PIT_MAX_MICROS  50000                   // -- fits the 16-bit channel 2 count
+
+
+
+//
+// -- Spin for at least this many micro-seconds on PIT channel 2.  The APs are started before interrupts are
+//    enabled, so the timer count does not move yet; the PIT one-shot is polled through port 0x61 instead.
+//    -----------------------------------------------------------------------------------------------------
+static void CpuApDelay(uint64_t micros)
+{
+    while (micros) {
+        uint64_t chunk = micros > PIT_MAX_MICROS ? PIT_MAX_MICROS : micros;
+        uint16_t count = (uint16_t)((chunk * PIT_HZ + 999999) / 1000000);
+
+        OUTB(0x61, (INB(0x61) & 0xfd) | 1);     // -- gate channel 2 on, speaker off
+        OUTB(0x43, 0xb0);                       // -- channel 2, lo/hi byte, mode 0
+        OUTB(0x42, count & 0xff);
+        INB(0x60);                              // -- short delay
+        OUTB(0x42, (count >> 8) & 0xff);
+
+        // -- restart the count and wait for it to reach 0
+        uint8_t tmp = INB(0x61) & 0xfe;
+        OUTB(0x61, tmp);
+        OUTB(0x61, tmp | 1);
+
+        while (!(INB(0x61) & 0x20)) {}
+
+        micros -= chunk;
+    }
+}
+
+
+
 //
 // -- Start the Application Processors
-//    --------------------------------
+//
+//    Every AP's stack is prepared first, and then all of them are sent INIT-SIPI-SIPI together.  An AP which
+//    is already running ignores the second SIPI.  Each AP finds its own stack by its APIC ID, so there is
+//    nothing to hand off between them and they all start in one round.
+//    -------------------------------------------------------------------------------------------------------
 void CpuApStart(BootInterface_t *interface)
 {
     extern uint8_t SMP_START[];
@@ -90,73 +132,85 @@ void CpuApStart(BootInterface_t *interface)
     // -- only the actual trampoline code remains mapped.
     typedef struct TrampLoader_t {
         uint8_t jumpCode[8];
-        uint32_t apLock;
         uint32_t pml4;
-        uint64_t kStack;
+        uint32_t kStackCount;
+        uint64_t kStacks;
         uint64_t kEntry;
     } __attribute__((packed)) TrampLoader_t;
-    TrampLoader_t *trampLoader = (struct TrampLoader_t *)TRAMP_OFF;
-
-    trampLoader->apLock = 1;            // -- lock the CPUs until we are actually ready
-    trampLoader->pml4 = interface->bootVirtAddrSpace;
-    trampLoader->kEntry = (Addr_t)kInitAp;
+    TrampLoader_t *trampLoader = (TrampLoader_t *)TRAMP_OFF;
 
-    //
-    // -- Now, the trampoline code has been located in the correct place and the
-    //    required data elements have been updated.  With that, we are ready to try
-    //    to spin up additional CPUs.
+    int count = interface->cpuCount;
+    if (count > MAX_CPU) count = MAX_CPU;
 
     cpus[0].location = LapicGetId();
     // -- may need to set the rsp0 here!
 
-    for (int i = 1; i < interface->cpuCount; i ++) {
-#if DEBUG_ENABLED(CpuApStart)
-        kprintf("Preparing to start CPU %d\n", i);
-#endif
+    if (count <= 1) return;
 
+
+    //
+    // -- Prepare every stack before any AP is started
+    //    --------------------------------------------
+    for (int i = 1; i < count; i ++) {
         Addr_t kStack = StackFind();
-        trampLoader->kStack = kStack + STACK_SIZE;
 
 #if DEBUG_ENABLED(CpuApStart)
-        kprintf(".. Preparing a stack at %p\n", kStack);
+        kprintf("Preparing a stack at %p for CPU %d\n", kStack, i);
 #endif
 
         for (int j = 0; j < STACK_SIZE; j += PAGE_SIZE) {
             MmuMapPage(kStack + j, PmmAlloc(), PG_WRT | PG_KRN);
         }
 
-        cpuStarting = i;
+        apStacks[i] = kStack + STACK_SIZE;
         AtomicSet(&cpus[i].state, CPU_STARTING);
+    }
 
-#if DEBUG_ENABLED(CpuApStart)
-        kprintf(".. Sending INIT\n");
-#endif
+    trampLoader->pml4 = interface->bootVirtAddrSpace;
+    trampLoader->kStackCount = count;
+    trampLoader->kStacks = (Addr_t)apStacks;
+    trampLoader->kEntry = (Addr_t)kInitAp;
 
-        IpiSendInit(i);
 
+    //
+    // -- Now, the trampoline code has been located in the correct place and the
+    //    required data elements have been updated.  With that, we are ready to try
+    //    to spin up additional CPUs.
+    //    -------------------------------------------------------------------------
 #if DEBUG_ENABLED(CpuApStart)
-        kprintf(".. Sending Startup INI\n");
+    kprintf("Sending INIT-SIPI-SIPI to all APs\n");
 #endif
 
-        IpiSendSipi(i, TRAMP_OFF);
+    IpiSendInit(IPI_ALL_BUT_SELF);
+    CpuApDelay(AP_INIT_DELAY);
+    IpiSendSipi(IPI_ALL_BUT_SELF, TRAMP_OFF);
+    CpuApDelay(AP_SIPI_DELAY);
+    IpiSendSipi(IPI_ALL_BUT_SELF, TRAMP_OFF);
+
+    bool waiting = true;
 
-        uint64_t timeout = TmrCurrentCount() + 500000;
-        cpus[i].lastTimer = timeout;
+    // -- wait here until all the CPUs report they have started, or time out together
+    for (uint64_t waited = 0; waiting && waited <= AP_START_TIMEOUT; waited += AP_POLL_DELAY) {
+        waiting = false;
 
-        // -- wait here until the CPU reports it has started.
-        while (AtomicRead(&cpus[i].state) == CPU_STARTING) {
-            if (TmrCurrentCount() > timeout) {
-                AtomicSet(&cpus[i].state, CPU_STOPPED);
-                continue;
-            }
+        for (int i = 1; i < count; i ++) {
+            if (AtomicRead(&cpus[i].state) == CPU_STARTING) waiting = true;
+        }
+
+        if (waiting) CpuApDelay(AP_POLL_DELAY);
+    }
+
+    for (int i = 1; i < count; i ++) {
+        if (AtomicRead(&cpus[i].state) == CPU_STARTING) {
+            AtomicSet(&cpus[i].state, CPU_STOPPED);
+            kprintf("CPU %d did not start\n", i);
+            continue;
         }
 
         cpusActive ++;
+    }
 
 #if DEBUG_ENABLED(CpuApStart)
-        kprintf("CPU %d has reported its startup is complete\n", i);
-        kprintf(".. There are now %d CPUs active\n", cpusActive);
+    kprintf(".. There are now %d CPUs active\n", cpusActive);
 #endif
-    }
 }
-
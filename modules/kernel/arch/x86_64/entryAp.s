@@ -11,11 +11,15 @@
 ;;  different than the boot processor, these start in 16-bit real mode.  I need to get out of that as quick as I
 ;;  can.
 ;;
+;;  All the APs are started at once and run through here together.  Nothing here is written, and once in long
+;;  mode each AP takes its own stack from `kStacks`, indexed by its APIC ID.  An AP with no stack is parked.
+;;
 ;; -----------------------------------------------------------------------------------------------------------------
 ;;
 ;;     Date      Tracker  Version  Pgmr  Description
 ;;  -----------  -------  -------  ----  --------------------------------------------------------------------------
 ;;  2021-Oct-21  Initial  v0.0.12  ADCL  Initial version
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Start all the APs together; each picks its stack by APIC ID
 ;;
 ;;===================================================================================================================
 
@@ -24,8 +28,7 @@
 
 
     global  entryAp
-    global  apLock
-    global  kStack
+    global  kStacks
     global  eEntry
 
     extern  idtr
@@ -44,14 +47,14 @@ entryAp:
 
     align   8
 
-apLock:
-    dd      0
-
 pml4:
     dd      0
 
-kStack:
-    dq      0
+kStackCount:
+    dd      0                   ; the number of entries in the table at kStacks
+
+kStacks:
+    dq      0                   ; the address of the stack tops, indexed by APIC ID
 
 kEntry:
     dq      0
@@ -75,25 +78,10 @@ overData:
     mov     ds,ax
     mov     es,ax
     mov     ss,ax
-    mov     sp,TRAMP_OFF + PAGE_SIZE
-
-;;
-;; -- This is a safety net to keep only one core from moving on at a time.  There is a race to get here
-;;    when more than 1 core is started at a time.  The spinlock will work as a boundary to keep the others
-;;    at bay until it is safe to continue.
-;;    ----------------------------------------------------------------------------------------------------
-    mov     cx,1            ;; this is the value to load
-    mov     bx,(apLock - entryAp) + TRAMP_OFF;; This is the address of apLock -- an offset from the seg start!
-
-loop:
-    mov     ax,0            ;; this is the value it should be to load
-LOCK xchg   [bx],cx         ;; do the xchg -- notice the LOCK prefix
-    cmp     ax,ax
-    jnz     loop            ;; if the lock was not unlocked, loop
 
 ;;
-;; -- only 1 core at a time gets here -- set up the stack segment register (real mode!)
-;;    ---------------------------------------------------------------------------------
+;; -- every AP gets here at the same time; none of them uses a stack until it has its own
+;;    -----------------------------------------------------------------------------------
     mov     al,0xff         ;; Out 0xff to 0xA1 and 0x21 to disable all IRQs.
     out     0xa1,al
     out     0x21,al
@@ -141,7 +129,19 @@ LongMode:
     mov     fs,ax
     mov     gs,ax
     mov     ss,ax
-    mov     rsp,[(kStack - entryAp) + TRAMP_OFF]
+
+    mov     eax,1                       ;; the initial APIC ID is in ebx[31:24]
+    cpuid
+    shr     ebx,24
+
+    cmp     ebx,[(kStackCount - entryAp) + TRAMP_OFF]
+    jae     Park                        ;; no stack for this cpu
+
+    mov     rax,[(kStacks - entryAp) + TRAMP_OFF]
+    mov     rsp,[rax + rbx * 8]         ;; this cpu's own stack
+    test    rsp,rsp
+    jz      Park
+
     mov     rbx,rsp
 
     mov     rax,idtr
@@ -170,8 +170,16 @@ NewGdt:
     mov     fs,ax
     mov     gs,ax
 
-    mov     dword [(apLock - entryAp) + TRAMP_OFF],0
     mov     rax,(kEntry - entryAp) + TRAMP_OFF
     jmp     [rax]
 
 
+;;
+;; -- A cpu the kernel is not using stays here with interrupts disabled
+;;    -----------------------------------------------------------------
+Park:
+    cli
+    hlt
+    jmp     Park
+
+
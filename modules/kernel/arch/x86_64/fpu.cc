@@ -0,0 +1,405 @@
+//===================================================================================================================
+//
+//  fpu.cc -- The extended (FPU/SSE/AVX) state of each process and kernel SIMD sections
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Each process has its own save area, sized from CPUID leaf 0xd for the state components enabled in XCR0
+//  (x87, SSE and AVX, as available).  Each cpu tracks the process whose state is in its registers (the owner).
+//
+//  With FPU_LAZY, CR0.TS is set at each process switch so the first FPU/SIMD instruction a process executes
+//  raises #NM; the handler loads the process's state, unless it is still in the registers from the last time the
+//  process ran on this cpu.  Only a process which has used the registers since it was switched in is saved
+//  when it is switched out (XSAVEOPT, which skips unmodified components), so most switches do nothing at all.
+//  The state is always in memory once its process is switched out, so a process can move to another cpu.
+//
+//  Otherwise, the state is saved and restored at every switch, with XSAVES (or XSAVEC) into a compacted area
+//  when the cpu has it.  CPUs without XSAVE fall back to FXSAVE for x87 and SSE.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-24  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+#include "heap.h"
+#include "idt.h"
+#include "internals.h"
+#include "scheduler.h"
+#include "fpu.h"
+
+
+
+#if IS_ENABLED(FPU_STATE)
+
+
+//
+// -- The state components saved for a process
+//    -----------------------------------------
+#define XCR0_X87                    (1ul << 0)
+#define XCR0_SSE                    (1ul << 1)
+#define XCR0_AVX                    (1ul << 2)
+
+#define IA32_XSS                    0xda0
+
+#define FXSAVE_AREA_SIZE            512
+#define MXCSR_DEFAULT               0x1f80      // all SIMD exceptions masked
+
+
+//
+// -- How the state is saved and restored
+//    -----------------------------------
+typedef enum {
+    FPU_FXSAVE,
+    FPU_XSAVE,
+    FPU_XSAVEOPT,
+    FPU_XSAVEC,
+    FPU_XSAVES,
+} FpuMethod_t;
+
+static const char *fpuMethodNames[] = {
+    "FXSAVE",
+    "XSAVE",
+    "XSAVEOPT",
+    "XSAVEC",
+    "XSAVES",
+};
+
+
+//
+// -- The FPU state of a cpu; only that cpu reads or writes it
+//    --------------------------------------------------------
+typedef struct FpuCpu_t {
+    Process_t *owner;                           // the process whose state is in the registers, or NULL
+    bool live;                                  // FPU_LAZY: the owner is running and CR0.TS is clear
+    int kernelDepth;                            // the nesting of FpuKernelBegin() calls
+} __attribute__((aligned(64))) FpuCpu_t;
+
+
+//
+// -- The extended state management
+//    -----------------------------
+static FpuCpu_t fpuCpus[MAX_CPU];
+static bool fpuReady = false;
+static FpuMethod_t fpuMethod = FPU_FXSAVE;
+static uint64_t fpuXcr0 = 0;
+static size_t fpuSize = FXSAVE_AREA_SIZE;
+static void *fpuInitArea = NULL;                // the clean state every process starts with
+
+
+
+//
+// -- Save the registers to an area; the requested-feature bitmap is all of XCR0
+//    --------------------------------------------------------------------------
+static inline void FpuSave(void *area)
+{
+    switch (fpuMethod) {
+    case FPU_XSAVES:
+        __asm volatile("xsaves64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+
+    case FPU_XSAVEC:
+        __asm volatile("xsavec64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+
+    case FPU_XSAVEOPT:
+        __asm volatile("xsaveopt64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+
+    case FPU_XSAVE:
+        __asm volatile("xsave64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+
+    default:
+        __asm volatile("fxsave64 (%0)" :: "r"(area) : "memory");
+        break;
+    }
+}
+
+
+//
+// -- Load the registers from an area; XRSTOR understands both the standard and compacted formats
+//    -------------------------------------------------------------------------------------------
+static inline void FpuRestore(void *area)
+{
+    switch (fpuMethod) {
+    case FPU_XSAVES:
+        __asm volatile("xrstors64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+
+    case FPU_FXSAVE:
+        __asm volatile("fxrstor64 (%0)" :: "r"(area) : "memory");
+        break;
+
+    default:
+        __asm volatile("xrstor64 (%0)" :: "r"(area), "a"(0xffffffff), "d"(0xffffffff) : "memory");
+        break;
+    }
+}
+
+
+//
+// -- Put the registers in their initial state
+//    ----------------------------------------
+static inline void FpuReset(void)
+{
+    uint32_t mxcsr = MXCSR_DEFAULT;
+
+    __asm volatile("fninit" ::: "memory");
+    __asm volatile("ldmxcsr %0" :: "m"(mxcsr) : "memory");
+}
+
+
+//
+// -- Load a process's state on this cpu, unless the registers still hold it
+//    ----------------------------------------------------------------------
+static inline void FpuLoad(FpuCpu_t *c, int cpu, Process_t *proc)
+{
+    if (c->owner == proc && proc->fpuCpu == cpu + 1) return;
+
+    FpuRestore(proc->fpuArea);
+    c->owner = proc;
+    proc->fpuCpu = cpu + 1;
+}
+
+
+//
+// -- Enable the extended state on this cpu
+//    -------------------------------------
+void FpuCpuInit(void)
+{
+    SET_CR0((GET_CR0() | CR0_MP | CR0_NE) & ~(CR0_EM | CR0_TS));
+
+    if (fpuMethod == FPU_FXSAVE) {
+        SET_CR4(GET_CR4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    } else {
+        SET_CR4(GET_CR4() | CR4_OSFXSR | CR4_OSXMMEXCPT | CR4_OSXSAVE);
+        XSETBV(0, fpuXcr0);
+    }
+
+    if (fpuMethod == FPU_XSAVES) WRMSR(IA32_XSS, 0);       // no supervisor state components
+
+    FpuReset();
+
+#if IS_ENABLED(FPU_LAZY)
+    SET_CR0(GET_CR0() | CR0_TS);
+#endif
+}
+
+
+//
+// -- The first FPU/SIMD instruction since CR0.TS was set: load the current process's state
+//    -------------------------------------------------------------------------------------
+extern "C" void FpuNmVector(Addr_t *, ServiceRoutine_t *);
+void FpuNmVector(Addr_t *, ServiceRoutine_t *entry)
+{
+    Process_t *proc = CurrentThread();
+    int cpu = ThisCpu()->cpuNum;
+    FpuCpu_t *c = &fpuCpus[cpu];
+
+    // -- kernel code outside FpuKernelBegin()/FpuKernelEnd(), or a process without a save area
+    if (!proc || !proc->fpuArea || c->kernelDepth) IdtGenericHandler(entry);
+
+    CLTS();
+    FpuLoad(c, cpu, proc);
+    c->live = true;
+}
+
+
+//
+// -- Save the outgoing process's state, as needed, and prepare for the incoming process
+//    ----------------------------------------------------------------------------------
+void FpuSwitch(Process_t *prev, Process_t *next)
+{
+    if (!fpuReady) return;
+
+    int cpu = ThisCpu()->cpuNum;
+    FpuCpu_t *c = &fpuCpus[cpu];
+
+#if IS_ENABLED(FPU_LAZY)
+    (void)prev;
+    (void)next;
+
+    if (c->live) {
+        FpuSave(c->owner->fpuArea);
+        c->live = false;
+        SET_CR0(GET_CR0() | CR0_TS);
+    }
+#else
+    if (prev && c->owner == prev) FpuSave(prev->fpuArea);
+
+    if (next->fpuArea) FpuLoad(c, cpu, next);
+    else c->owner = NULL;
+#endif
+}
+
+
+//
+// -- Start a kernel section which uses the FPU/SIMD registers; the owner's state is saved first
+//    ------------------------------------------------------------------------------------------
+Addr_t FpuKernelBegin(void)
+{
+    Addr_t flags = DisableInt();
+    if (!fpuReady) return flags;
+
+    FpuCpu_t *c = &fpuCpus[ThisCpu()->cpuNum];
+    if (c->kernelDepth ++) return flags;
+
+#if IS_ENABLED(FPU_LAZY)
+    if (c->live) {
+        FpuSave(c->owner->fpuArea);
+        c->live = false;
+    }
+
+    CLTS();
+#else
+    if (c->owner) FpuSave(c->owner->fpuArea);
+#endif
+
+    c->owner = NULL;                            // the registers are about to be overwritten
+
+    return flags;
+}
+
+
+//
+// -- End a kernel section which uses the FPU/SIMD registers
+//    ------------------------------------------------------
+void FpuKernelEnd(Addr_t flags)
+{
+    if (fpuReady) {
+        int cpu = ThisCpu()->cpuNum;
+        FpuCpu_t *c = &fpuCpus[cpu];
+
+        if (-- c->kernelDepth == 0) {
+#if IS_ENABLED(FPU_LAZY)
+            SET_CR0(GET_CR0() | CR0_TS);        // the process reloads its state when it uses it again
+#else
+            Process_t *proc = CurrentThread();
+            if (proc && proc->fpuArea) FpuLoad(c, cpu, proc);
+#endif
+        }
+    }
+
+    RestoreInt(flags);
+}
+
+
+//
+// -- Can kernel code use the FPU/SIMD registers yet?
+//    -----------------------------------------------
+bool FpuKernelReady(void)
+{
+    return fpuReady;
+}
+
+
+//
+// -- Is this cpu already in a kernel section?  A nested section does not save the registers again, so it must
+//    not use them.  A section disables interrupts, so the answer cannot change for the caller before it begins.
+//    ---------------------------------------------------------------------------------------------------------
+bool FpuKernelActive(void)
+{
+    return fpuReady && fpuCpus[ThisCpu()->cpuNum].kernelDepth > 0;
+}
+
+
+//
+// -- Allocate a save area with the initial state; a process without one does not get to use the registers
+//    ----------------------------------------------------------------------------------------------------
+void FpuProcessInit(Process_t *proc)
+{
+    if (!fpuReady) return;
+
+    Addr_t raw = (Addr_t)HeapAlloc(fpuSize + FPU_AREA_ALIGN - 1, false);
+    if (!assert_msg(raw != 0, "Out of memory allocating an FPU state area")) return;
+
+    proc->fpuArea = (void *)((raw + FPU_AREA_ALIGN - 1) & ~((Addr_t)FPU_AREA_ALIGN - 1));
+    proc->fpuCpu = 0;
+    kMemMoveB(proc->fpuArea, fpuInitArea, fpuSize);
+}
+
+
+//
+// -- Enable the extended state on the bsp and choose how it will be saved
+//    --------------------------------------------------------------------
+void FpuInit(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    CPUID(1, &eax, &ebx, &ecx, &edx);
+
+    if (!assert_msg((edx & CPUID_FEAT_EDX_FXSR) != 0, "The CPU does not support FXSAVE")) return;
+
+    if (ecx & CPUID_FEAT_ECX_XSAVE) {
+        CPUID_SUB(0xd, 0, &eax, &ebx, &ecx, &edx);
+        fpuXcr0 = eax & (XCR0_X87 | XCR0_SSE | XCR0_AVX);
+
+#if IS_ENABLED(FPU_LAZY)
+        bool compact = false;
+#else
+        bool compact = true;                    // saving at every switch, so the compacted formats are worth it
+#endif
+
+        CPUID_SUB(0xd, 1, &eax, &ebx, &ecx, &edx);
+        fpuMethod = FPU_XSAVE;
+        if (eax & (1 << 0)) fpuMethod = FPU_XSAVEOPT;
+        if (compact && (eax & (1 << 1))) fpuMethod = FPU_XSAVEC;
+        if (compact && (eax & (1 << 3))) fpuMethod = FPU_XSAVES;
+    }
+
+    FpuCpuInit();
+
+    // -- the sizes reported depend on what has just been enabled in XCR0
+    if (fpuMethod == FPU_XSAVEC || fpuMethod == FPU_XSAVES) {
+        CPUID_SUB(0xd, 1, &eax, &ebx, &ecx, &edx);
+        fpuSize = ebx;
+    } else if (fpuMethod != FPU_FXSAVE) {
+        CPUID_SUB(0xd, 0, &eax, &ebx, &ecx, &edx);
+        fpuSize = ebx;
+    }
+
+    // -- the xsave header must start out clear
+    Addr_t raw = (Addr_t)HeapAlloc(fpuSize + FPU_AREA_ALIGN - 1, false);
+    fpuInitArea = (void *)((raw + FPU_AREA_ALIGN - 1) & ~((Addr_t)FPU_AREA_ALIGN - 1));
+    kMemSetB(fpuInitArea, 0, fpuSize);
+
+    CLTS();
+    FpuReset();
+    FpuSave(fpuInitArea);
+
+#if IS_ENABLED(FPU_LAZY)
+    SET_CR0(GET_CR0() | CR0_TS);
+    krn_SetVectorHandler(7, (Addr_t)FpuNmVector, 0, 0);
+#endif
+
+    kprintf("FPU: saving state with %s, %d bytes per process (XCR0 %p)\n", fpuMethodNames[fpuMethod], fpuSize,
+            fpuXcr0);
+
+    fpuReady = true;
+}
+
+
+#else
+
+
+//
+// -- Without FPU_STATE, kernel code still needs to be able to ask; there is no SSE to use
+//    ------------------------------------------------------------------------------------
+Addr_t FpuKernelBegin(void) { return DisableInt(); }
+void FpuKernelEnd(Addr_t flags) { RestoreInt(flags); }
+bool FpuKernelReady(void) { return false; }
+bool FpuKernelActive(void) { return false; }
+
+
+#endif
+
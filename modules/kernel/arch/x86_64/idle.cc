@@ -0,0 +1,165 @@
+//===================================================================================================================
+//
+//  idle.cc -- Put an idle cpu into the deepest C-state the expected idle time can pay for
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  CPUID leaf 5 reports how many MWAIT sub-states each C-state has.  Every C-state with at least one becomes an
+//  idle state here, with the hint for its first sub-state and a target residency: the idle time below which
+//  the cost of entering and leaving it is more than it saves.  The caller says how long it expects to be idle
+//  (to its next timer tick or sleeper deadline) and the deepest state whose target residency fits is used.
+//  MWAIT wakes on an interrupt or on a write to the monitored line, so a cpu waiting on a flag is woken by
+//  the write alone.  Without MONITOR/MWAIT, there is a single `hlt` state.  C3 and deeper are only offered when
+//  CPUID leaf 6 reports ARAT, since otherwise the LAPIC timer stops in them.
+//
+//  The time spent in each state and the number of entries are kept per cpu alongside `cpuIdleTime`.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#include "types.h"
+#include "printf.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+
+
+//
+// -- The CPUID leaf 5 bits
+//    ---------------------
+#define MWAIT_ECX_EMX       (1<<0)          // -- the MWAIT extensions are enumerated
+#define MWAIT_ECX_IBE       (1<<1)          // -- interrupts break MWAIT even when they are disabled
+
+
+//
+// -- The CPUID leaf 6 bits
+//    ---------------------
+#define PM_EAX_ARAT         (1<<2)          // -- the APIC timer keeps running in deep C-states
+
+
+//
+// -- An idle state
+//    -------------
+typedef struct IdleState_t {
+    char name[4];
+    uint32_t hint;                          // -- the MWAIT hint: (C-state - 1) << 4 | sub-state
+    uint64_t residencyNs;                   // -- the least expected idle time worth entering it for
+} IdleState_t;
+
+
+//
+// -- The target residencies (us) by C-state number; conservative, as the real values are only in ACPI _CST
+//    -----------------------------------------------------------------------------------------------------
+static const uint64_t targetResidencyUs[8] = { 0, 0, 20, 100, 400, 800, 1500, 3000 };
+
+
+static IdleState_t idleStates[IDLE_STATES] = { { "HLT", 0, 0 } };
+static int idleStateCount = 1;
+static bool idleMwait = false;
+
+
+
+//
+// -- Find the idle states this cpu supports; every cpu is assumed to be the same as the BSP
+//    --------------------------------------------------------------------------------------
+extern "C" void IdleInit(void)
+{
+#if IS_ENABLED(IDLE_MWAIT)
+    uint32_t a, b, c, d;
+
+    CPUID(0, &a, &b, &c, &d);
+    if (a < 5) return;
+
+    // -- without ARAT the LAPIC timer stops in C3 and deeper, and an idle cpu would stop ticking
+    int deepest = 2;
+
+    if (a >= 6) {
+        CPUID(6, &a, &b, &c, &d);
+        if (a & PM_EAX_ARAT) deepest = 7;
+    }
+
+    CPUID(1, &a, &b, &c, &d);
+    if (!(c & CPUID_FEAT_ECX_MONITOR)) return;
+
+    CPUID(5, &a, &b, &c, &d);
+    if (!(c & MWAIT_ECX_EMX)) return;
+
+    idleStateCount = 0;
+
+    for (int cs = 1; cs <= deepest && idleStateCount < IDLE_STATES; cs ++) {
+        if (((d >> (cs * 4)) & 0xf) == 0) continue;
+
+        IdleState_t *st = &idleStates[idleStateCount ++];
+        st->name[0] = 'C';
+        st->name[1] = '0' + cs;
+        st->name[2] = 0;
+        st->hint = (cs - 1) << 4;
+        st->residencyNs = targetResidencyUs[cs] * 1000;
+    }
+
+    if (idleStateCount == 0) {
+        idleStateCount = 1;
+        return;
+    }
+
+    idleMwait = true;
+
+    kprintf("Idle: MWAIT with %d C-states (deepest %s)\n", idleStateCount, idleStates[idleStateCount - 1].name);
+#endif
+}
+
+
+
+//
+// -- Wait for an interrupt, or a write to `monitor` while it is still 0; interrupts are disabled on entry
+//    and on return
+//    ----------------------------------------------------------------------------------------------------
+extern "C" void CpuIdle(volatile void *monitor, uint64_t expectedNs)
+{
+    ArchCpu_t *cpu = ThisCpu();
+    int st = 0;
+
+    while (st + 1 < idleStateCount && idleStates[st + 1].residencyNs <= expectedNs) st ++;
+
+    uint64_t start = ClockNanos();
+
+    if (idleMwait) {
+        __asm volatile("monitor" :: "a"(monitor), "c"(0), "d"(0) : "memory");
+
+        // -- `sti` holds off interrupts until after `mwait` has started, as it does for `hlt`
+        if (*(volatile int64_t *)monitor == 0) {
+            __asm volatile("sti\n mwait\n cli" :: "a"(idleStates[st].hint), "c"(0) : "memory");
+        }
+    } else {
+        if (*(volatile int64_t *)monitor == 0) __asm volatile("sti\n hlt\n cli" ::: "memory");
+    }
+
+    cpu->idleTime[st] += ClockNanos() - start;
+    cpu->idleCount[st] ++;
+}
+
+
+
+//
+// -- The idle states, for reporting
+//    ------------------------------
+extern "C" int IdleStateCount(void)
+{
+    return idleStateCount;
+}
+
+
+extern "C" const char *IdleStateName(int state)
+{
+    if (state < 0 || state >= idleStateCount) return "";
+
+    return idleStates[state].name;
+}
+
@@ -11,6 +11,7 @@
 ;;     Date      Tracker  Version  Pgmr  Description
 ;;  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 ;;  2021-Jan-13  Initial  v0.0.2   ADCL  Initial version
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Count each hardware vector as it is raised; align the stack for PmuServiceExit
 ;;
 ;;===================================================================================================================
 
@@ -23,11 +24,16 @@
         extern  internalTable
         extern  serviceTable
         extern  vectorTable
+        extern  vectorCount
         extern  krn_SpinLock
         extern  krn_SpinUnlock
+        extern  TraceEvent
+        extern  PmuServiceEnter
+        extern  PmuServiceExit
 
 
 MAX_HANDLERS    equ         1024
+TRC_INTERNAL    equ         6                   ;; must match TraceType_t in trace.h
 
         cpu     x64
         section .text
@@ -109,6 +115,9 @@ isr%1:
         push    rax
         push    rbx
 
+        mov     rbx,vectorCount         ;; count the interrupt for the IRQ balancer
+        lock inc qword [rbx+%1*8]
+
         mov     rax,[rsp+16]
         mov     rbx,rax
         shl     rax,5                   ;; 32 bytes in the structure; offset the service
@@ -422,6 +431,39 @@ InternalTarget:
         cmp     rbx,MAX_HANDLERS
         jge     Einval
 
+%if IS_ENABLED(TRACE_BUFFER) || IS_ENABLED(PMU_COUNTERS)
+        push    rax                     ;; -- preserve the parameters (and count) across the trace/pmu calls
+        push    rdi
+        push    rsi
+        push    rdx
+        push    rcx
+        push    r8
+        push    r9
+        push    r10
+        push    r11
+
+%if IS_ENABLED(TRACE_BUFFER)
+        mov     rdi,TRC_INTERNAL
+        mov     rsi,rbx
+        xor     rdx,rdx
+        call    TraceEvent
+%endif
+
+%if IS_ENABLED(PMU_COUNTERS)
+        call    PmuServiceEnter         ;; -- note the counts on the way in
+%endif
+
+        pop     r11
+        pop     r10
+        pop     r9
+        pop     r8
+        pop     rcx
+        pop     rdx
+        pop     rsi
+        pop     rdi
+        pop     rax
+%endif
+
         push    rax
         mov     rax,rbx
         shl     rax,5                   ;; 32 bytes in the structure; offset the service
@@ -441,6 +483,32 @@ InternalTarget:
 
         call    CommonTarget            ;; jump to the common handler (below)
         mov     [rsp+8],rax             ;; set the return value
+
+%if IS_ENABLED(PMU_COUNTERS)
+        push    rdi                     ;; -- preserve the caller's registers across the pmu call
+        push    rsi
+        push    rdx
+        push    rcx
+        push    r8
+        push    r9
+        push    r10
+        push    r11
+
+        mov     rdi,[rsp+8*8+16]        ;; the service number
+        sub     rsp,8                   ;; -- 8 pushes leave rsp 8 off a 16-byte boundary; realign for the call
+        call    PmuServiceExit
+        add     rsp,8
+
+        pop     r11
+        pop     r10
+        pop     r9
+        pop     r8
+        pop     rcx
+        pop     rdx
+        pop     rsi
+        pop     rdi
+%endif
+
         jmp     ExitPoint
 
 
@@ -571,6 +639,18 @@ NoStack:
         push    r12                     ;; save the old cr3 value
         push    rbx                     ;; save the structure location
 
+        ;; -- interrupt vectors are called as `handler(Addr_t *regs, ServiceRoutine_t *entry)`
+        mov     rbp,vectorTable
+        cmp     rbx,rbp
+        jb      NoFrame
+        add     rbp,256*48
+        cmp     rbx,rbp
+        jae     NoFrame
+
+        mov     rdi,r11                 ;; the saved register frame
+        mov     rsi,rbx                 ;; the vector table entry
+
+NoFrame:
         call    [rbx+0]                 ;; make the actual handler function call
 
         pop     rbx                     ;; restore the structure location
@@ -23,6 +23,7 @@
 #include "scheduler.h"
 #include "kernel-funcs.h"
 #include "idt.h"
+#include "log.h"
 
 
 #if __has_include("tss.h")
@@ -403,6 +404,8 @@ void __attribute__((noreturn)) IdtGenericHandler(ServiceRoutine_t *handler)
     Addr_t *stack = (Addr_t *)handler->runtimeRegs;
     char buf[200];
 
+    LogPanic();
+
     ksprintf(buf, "An exception has occurred on CPU%d by process %-64.64s\n", LapicGetId(),
             CurrentThread()?CurrentThread()->command:"Unknown");
     kprintf(buf);
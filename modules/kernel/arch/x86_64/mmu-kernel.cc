@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Nov-07 | Initial |  v0.0.13 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Add `krn_MmuFrame()` and `krn_MmuShootdown()`
 *
 *///=================================================================================================================
 
@@ -22,6 +23,8 @@
 #include "types.h"
 #include "kernel-funcs.h"
 #include "printf.h"
+#include "cpu.h"
+#include "internals.h"
 #include "mmu.h"
 
 
@@ -61,6 +64,71 @@ Return_t krn_MmuUnmapEx(Addr_t space, Addr_t a)
 
 
 
+/********************************************************************************************************************
+*   Documented in `mmu-funcs.h`
+*///-----------------------------------------------------------------------------------------------------------------
+Frame_t krn_MmuFrame(Addr_t a)
+{
+    if (!GetPML4Entry(a)->p) return 0;
+    if (!GetPDPTEntry(a)->p || GetPDPTEntry(a)->pat) return 0;
+    if (!GetPDEntry(a)->p || GetPDEntry(a)->pat) return 0;
+    if (!GetPTEntry(a)->p) return 0;
+
+    return GetPTEntry(a)->frame;
+}
+
+
+
+//
+// -- The range to flush on the other cpus
+//    ------------------------------------
+typedef struct MmuShootdown_t {
+    Addr_t addr;
+    size_t count;
+} MmuShootdown_t;
+
+
+
+//
+// -- Flush the range on this cpu; called from the IPI handler with interrupts disabled
+//    ---------------------------------------------------------------------------------
+static void MmuShootdownHere(Addr_t arg)
+{
+    MmuShootdown_t *range = (MmuShootdown_t *)arg;
+
+    if (range->count > MMU_FLUSH_LIMIT) {
+        FLUSH_TLB();
+        return;
+    }
+
+    for (size_t i = 0; i < range->count; i ++) INVLPG(range->addr + (i * PAGE_SIZE));
+}
+
+
+
+/********************************************************************************************************************
+*   Documented in `mmu-funcs.h`
+*///-----------------------------------------------------------------------------------------------------------------
+void krn_MmuShootdown(Addr_t a, size_t count)
+{
+    MmuShootdown_t range = { a, count };
+    uint64_t others = 0;
+
+    Addr_t flags = DisableInt();
+    int self = LapicGetId();
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (c != self && AtomicRead(&cpus[c].state) == CPU_STARTED) others |= (1ul << c);
+    }
+
+    // -- the range is on this stack, so the other cpus must be done with it before returning
+    if (others) krn_CpuCall(others, (Addr_t)MmuShootdownHere, (Addr_t)&range, true);
+
+    RestoreInt(flags);
+}
+
+
+
 /********************************************************************************************************************
 *   Documented in `mmu-funcs.h`
 *///-----------------------------------------------------------------------------------------------------------------
@@ -95,7 +163,7 @@ Return_t krn_MmuDump(Addr_t addr)
     kprintf("%s   ", ent->rw ? "1" : "0");
     kprintf("%s\n", ent->p ? "1" : "0");
 
-    if (!ent->p) goto exit;
+    if (!ent->p || ent->pat) goto exit;       // -- not present or a 1GB page
 
 
     idx = (addr >> (12 + (9 * 1))) & 0x1ff;
@@ -109,7 +177,7 @@ Return_t krn_MmuDump(Addr_t addr)
     kprintf("%s   ", ent->rw ? "1" : "0");
     kprintf("%s\n", ent->p ? "1" : "0");
 
-    if (!ent->p) goto exit;
+    if (!ent->p || ent->pat) goto exit;       // -- not present or a 2MB page
 
 
     idx = (addr >> (12 + (9 * 0))) & 0x1ff;
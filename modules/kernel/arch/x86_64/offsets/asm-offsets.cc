@@ -0,0 +1,55 @@
+//===================================================================================================================
+//
+//  asm-offsets.cc -- Structure offsets and constants for the assembly sources
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  This file is never linked.  It is compiled to assembly only, and the build pulls each `->NAME value` line out
+//  of that into `asm-offsets.inc` as a nasm `%define`.  So, the assembly sources stay in step with the C++
+//  structures whenever a field moves.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#include "types.h"
+#include "cpu.h"
+#include "scheduler.h"
+
+
+#define DEFINE(sym, val)        __asm volatile("\n->" #sym " %c0" :: "i"(val))
+
+
+//
+// -- The offsets from the gs base are relative to `ArchCpu_t.cpu`
+//    ------------------------------------------------------------
+#define GS_OFFSET(fld)          (offsetof(ArchCpu_t, fld) - offsetof(ArchCpu_t, cpu))
+
+
+static_assert(GS_OFFSET(process) == 8, "`CurrentThread()` reads the current process from gs:8");
+static_assert(offsetof(ArchCpu_t, stackTop) == CACHE_LINE_SIZE, "the per-cpu hot fields no longer fit a cache line");
+static_assert(offsetof(Process_t, stsQueue) + sizeof(ListHead_t::List_t) <= CACHE_LINE_SIZE,
+        "the Process_t hot fields no longer fit a cache line");
+
+
+void AsmOffsets(void)
+{
+    DEFINE(PROC_TOS_PROCESS_SWAP, offsetof(Process_t, tosProcessSwap));
+    DEFINE(PROC_VIRT_ADDR_SPACE, offsetof(Process_t, virtAddrSpace));
+    DEFINE(PROC_STATUS, offsetof(Process_t, status));
+    DEFINE(PROC_PRIORITY, offsetof(Process_t, priority));
+    DEFINE(PROC_QUANTUM_LEFT, offsetof(Process_t, quantumLeft));
+    DEFINE(PROC_STS_RUNNING, PROC_RUNNING);
+    DEFINE(PROC_STS_READY, PROC_READY);
+
+    DEFINE(CPU_PROCESS, GS_OFFSET(process));
+    DEFINE(CPU_POSTPONE_COUNT, GS_OFFSET(postponeCount));
+    DEFINE(CPU_CHG_PENDING, GS_OFFSET(processChangePending));
+}
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-May-26  Initial  v0.0.9b  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Keep the stack frames so the stack can be released
 //
 //===================================================================================================================
 
@@ -19,7 +20,9 @@
 #include "stacks.h"
 #include "kernel-funcs.h"
 #include "heap.h"
+#include "mmu.h"
 #include "scheduler.h"
+#include "klog.h"
 
 
 
@@ -38,26 +41,26 @@ void ProcessNewStack(Process_t *proc, Addr_t startingAddr)
     Frame_t *stackFrames = NULL;
     const size_t frameCount = STACK_SIZE / PAGE_SIZE;
 
-    KernelPrintf("Creating a new Process stack\n");
-    KernelPrintf(".. allocating frames for the stack\n");
+    KLOG(STACKS, DEBUG, "Creating a new Process stack\n");
+    KLOG(STACKS, DEBUG, ".. allocating frames for the stack\n");
     stackFrames = (Frame_t *)HeapAlloc(sizeof (Frame_t *) * frameCount, false);
     assert_msg(stackFrames != NULL, "HeapAlloc() ran out of memory allocating stack frames!");
-    KernelPrintf(".. Temporary Stack Frames are located at %p\n", stackFrames);
+    KLOG(STACKS, DEBUG, ".. Temporary Stack Frames are located at %p\n", stackFrames);
 
     for (int i = 0; i < frameCount; i ++) {
-        KernelPrintf(".. allocating stack frame %d of %d\n", i + 1, frameCount);
+        KLOG(STACKS, DEBUG, ".. allocating stack frame %d of %d\n", i + 1, frameCount);
         stackFrames[i] = PmmAlloc();
     }
 
-    KernelPrintf(".. Locking the stack build spinlock\n");
+    KLOG(STACKS, DEBUG, ".. Locking the stack build spinlock\n");
     Addr_t flags = DisableInt();
     SpinLock(&mmuStackInitLock); {
-        KernelPrintf(".. Mapping the stack to the temporary build address\n");
+        KLOG(STACKS, DEBUG, ".. Mapping the stack to the temporary build address\n");
         for (int i = 0; i < frameCount; i ++) {
             MmuMapPage(MMU_STACK_INIT_VADDR + (PAGE_SIZE * i), stackFrames[i], PG_WRT);
         }
 
-        KernelPrintf(".. Building the stack contents\n");
+        KLOG(STACKS, DEBUG, ".. Building the stack contents\n");
         stack = (Addr_t *)(MMU_STACK_INIT_VADDR + STACK_SIZE);
 
         *--stack = (Addr_t)ProcessEnd;         // -- just in case, we will self-terminate
@@ -79,30 +82,59 @@ void ProcessNewStack(Process_t *proc, Addr_t startingAddr)
         *--stack = 0;                          // -- r14
         *--stack = 0;                          // -- r15
 
-        KernelPrintf(".. Unmapping the stack from temporary address space\n");
+        KLOG(STACKS, DEBUG, ".. Unmapping the stack from temporary address space\n");
         for (int i = 0; i < frameCount; i ++) {
             MmuUnmapPage(MMU_STACK_INIT_VADDR + (PAGE_SIZE * i));
         }
 
-        KernelPrintf(".. Unlocking the spinlock\n");
+        KLOG(STACKS, DEBUG, ".. Unlocking the spinlock\n");
         SpinUnlock(&mmuStackInitLock);
         RestoreInt(flags);
     }
 
-    KernelPrintf(".. Finding a stack address\n");
+    KLOG(STACKS, DEBUG, ".. Finding a stack address\n");
     Addr_t stackLoc = StackFind();    // get a new stack
     assert(stackLoc != 0);
     proc->tosProcessSwap = ((Addr_t)stack - MMU_STACK_INIT_VADDR) + stackLoc;
 
-    KernelPrintf("Mapping the stack into address space %p\n", GetAddressSpace());
+    KLOG(STACKS, DEBUG, "Mapping the stack into address space %p\n", GetAddressSpace());
     for (int i = 0; i < frameCount; i ++) {
-        KernelPrintf(".. in space %p: frame %d (%p to %p)\n", proc->virtAddrSpace, i,
+        KLOG(STACKS, DEBUG, ".. in space %p: frame %d (%p to %p)\n", proc->virtAddrSpace, i,
                 stackLoc + (PAGE_SIZE * i), stackFrames[i]);
         MmuMapPageEx(proc->virtAddrSpace, stackLoc + (PAGE_SIZE * i), stackFrames[i], PG_WRT);
-        KernelPrintf(".. page mapped in the other address space\n");
+        KLOG(STACKS, DEBUG, ".. page mapped in the other address space\n");
     }
 
-    HeapFree(stackFrames);
+    proc->stackLoc = stackLoc;
+    proc->stackFrames = stackFrames;
+}
+
+
+
+//
+// -- Give back the stack of an ended process, once no cpu is on it any more
+//    ----------------------------------------------------------------------
+void ProcessFreeStack(Process_t *proc)
+{
+    const size_t frameCount = STACK_SIZE / PAGE_SIZE;
+
+    if (proc->stackLoc == 0) return;
+
+    KLOG(STACKS, DEBUG, "Releasing the stack at %p\n", proc->stackLoc);
+    for (size_t i = 0; i < frameCount; i ++) {
+        MmuUnmapPageEx(proc->virtAddrSpace, proc->stackLoc + (PAGE_SIZE * i));
+    }
+
+    // -- the slot and the frames are about to be handed out again, so no cpu may still reach them
+    krn_MmuShootdown(proc->stackLoc, frameCount);
+
+    for (size_t i = 0; i < frameCount; i ++) PmmRelease(proc->stackFrames[i]);
+
+    StackRelease(proc->stackLoc);
+    HeapFree(proc->stackFrames);
+
+    proc->stackLoc = 0;
+    proc->stackFrames = NULL;
 }
 
 
@@ -0,0 +1,53 @@
+//===================================================================================================================
+//
+//  fpu.h -- The extended (FPU/SSE/AVX) state of each process and kernel SIMD sections
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  The kernel is built without FP/SIMD code generation, so any kernel code which uses vector instructions must
+//  do so between `FpuKernelBegin()` and `FpuKernelEnd()`.  Interrupts are disabled in between, and the state of
+//  the process which was using the registers is saved first.  These must not be used before `FpuInit()`, since
+//  SSE is not enabled until then; `FpuKernelReady()` says when they can be.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-24  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+struct Process_t;
+
+
+//
+// -- function prototypes
+//    -------------------
+extern "C" {
+    // -- enable the extended state on the bsp, choose how to save it and build the initial state for processes
+    void FpuInit(void);
+
+    // -- enable the extended state on an ap, the way the bsp did
+    void FpuCpuInit(void);
+
+    // -- give a new process its own copy of the initial extended state
+    void FpuProcessInit(struct Process_t *proc);
+
+    // -- called from `ProcessSwitch()` with the scheduler locked
+    void FpuSwitch(struct Process_t *prev, struct Process_t *next);
+
+    // -- bracket kernel code which uses the FPU/SIMD registers
+    Addr_t FpuKernelBegin(void);
+    void FpuKernelEnd(Addr_t flags);
+    bool FpuKernelReady(void);
+    bool FpuKernelActive(void);
+}
+
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-19  Initial  v0.0.2   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  The early frame allocator takes a count
 //
 //===================================================================================================================
 
@@ -29,7 +30,7 @@
 extern "C" {
     void IntInit(void);
     void VectorInit(void);
-    Frame_t PmmEarlyFrame(void);
+    Frame_t PmmEarlyFrame(bool low, int bitsAligned, size_t count);
     void __attribute__((noreturn)) IdtGenericHandler(ServiceRoutine_t *handler);
 }
 
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-20  Initial  v0.0.3   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Device vector allocation and counts; cross-cpu calls
 //
 //===================================================================================================================
 
@@ -51,7 +52,13 @@ extern "C" {
     // -- Vector Handlers
     Addr_t krn_GetVectorHandler(int i);
     Return_t krn_SetVectorHandler(int i, Addr_t handler, Addr_t cr3, Addr_t stack);
+    Return_t krn_VectorAlloc(int count, Addr_t handler, Addr_t cr3, Addr_t stack);
+    Return_t krn_VectorFree(int i);
+    uint64_t krn_VectorCount(int i);
+    void IpiCallFunction(Addr_t *regs);
+    Return_t krn_CpuCall(uint64_t mask, Addr_t fn, Addr_t arg, bool wait);
     void VectorTableDump(void);
+    void PageFaultInit(void);
 
     // -- OS Services
     void ServiceInit(void);
@@ -0,0 +1,45 @@
+//===================================================================================================================
+//
+//  ipc.h -- Synchronous call/reply IPC between processes
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+#include "lists.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+
+
+//
+// -- An endpoint: a server waiting in `IpcReplyWait()`, or the callers waiting for one.  Everything here is
+//    protected by the scheduler lock; endpoints are never freed.
+//    -----------------------------------------------------------------------------------------------------
+typedef struct IpcEndpoint_t {
+    Process_t *server;                  // -- the server blocked waiting for a call, if any
+    ListHead_t callers;                 // -- the callers blocked in PROC_MSGW, on their `stsQueue`
+} IpcEndpoint_t;
+
+
+//
+// -- The IPC functions
+//    -----------------
+extern "C" {
+    IpcEndpoint_t *krn_IpcCreate(void);
+    Return_t krn_IpcCall(IpcEndpoint_t *ep, uint64_t *mr);
+    Return_t krn_IpcReplyWait(IpcEndpoint_t *ep, uint64_t *mr);
+    void IpcBenchStart(void);
+}
+
@@ -0,0 +1,39 @@
+//===================================================================================================================
+//
+//  log.h -- The kernel log: per-cpu rings drained to the serial port
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-21  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+//
+// -- function prototypes
+//    -------------------
+extern "C" {
+    // -- append a character to this cpu's log ring (or the serial port when not buffering); interrupts must be off
+    void LogPutChar(uint8_t ch);
+
+    // -- append a string to this cpu's log ring (or the serial port); interrupts must be off
+    void LogWrite(const char *str, size_t len);
+
+    // -- start the drainer process and begin buffering output
+    void LogInit(void);
+
+    // -- stop buffering and synchronously write everything still in the rings; for fatal errors
+    void LogPanic(void);
+}
+
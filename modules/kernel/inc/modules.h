@@ -25,6 +25,9 @@
 //    -------------------
 extern "C" {
     void ModuleEarlyInit(void);
+    void ModuleInitWorker(void);
+    void ModuleInitComplete(void);
     void ModuleLateInit(void);
+    Return_t ModuleInfo(int i, const char **name, Addr_t *cr3, Addr_t *image);
 }
 
@@ -0,0 +1,73 @@
+//===================================================================================================================
+//
+//  msgq.h -- Message queues between processes
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+#include "lists.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+
+
+//
+// -- A message as it waits in a queue; the pages it carries are held as a list of frames on the heap
+//    -----------------------------------------------------------------------------------------------
+typedef struct MsgqSlot_t {
+    uint64_t type;
+    uint64_t data[MSGQ_WORDS];
+    Pid_t sender;
+    size_t pageCount;
+    Frame_t *frames;
+} MsgqSlot_t;
+
+
+//
+// -- A message queue: `head` and `tail` only ever count up, and index the ring modulo MSGQ_DEPTH
+//    -------------------------------------------------------------------------------------------
+typedef struct MessageQueue_t {
+    Spinlock_t lock;                    // -- protects the ring and the waiting receivers
+    uint64_t head;
+    uint64_t tail;
+    ListHead_t waiting;                 // -- the receivers blocked in PROC_MSGW, on their `stsQueue`
+    ListHead_t refBy;                   // -- the `Reference_t`s of the processes using it; scheduler lock
+    MsgqSlot_t ring[MSGQ_DEPTH];
+} MessageQueue_t;
+
+
+//
+// -- The messages the Butler handles
+//    -------------------------------
+#define BUTLER_CLEAN_PROCESS        1   // -- a process has ended; release what it holds
+
+
+//
+// -- The Butler's queue
+//    ------------------
+extern MessageQueue_t *butlerMsgq;
+
+
+//
+// -- The message queue functions
+//    ---------------------------
+extern "C" {
+    MessageQueue_t *krn_MsgqCreate(void);
+    Return_t krn_MsgqRelease(MessageQueue_t *q);
+    Return_t krn_MsgqSend(MessageQueue_t *q, Message_t *msg);
+    Return_t krn_MsgqReceive(MessageQueue_t *q, Message_t *msg, bool block);
+    void MsgqReleaseProcess(Process_t *proc);
+}
+
@@ -0,0 +1,60 @@
+//===================================================================================================================
+//
+//  pmu.h -- Per-cpu performance counters, virtualized per process and attributed to internal services
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-24  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+struct Process_t;
+
+
+//
+// -- function prototypes
+//    -------------------
+extern "C" {
+    // -- the internal services
+    Return_t pmu_Control(uint64_t events);
+    uint64_t pmu_Read(int event);
+    uint64_t pmu_ProcessCount(int event);
+
+    // -- the current process is being switched out; charge it with the counts since it was switched in
+    void PmuSwitch(struct Process_t *from);
+
+    // -- called from the timer vector on every cpu; programs this cpu when the event set has changed
+    void PmuTick(void);
+
+    // -- called from `idt-asm.s` around each internal service
+    void PmuServiceEnter(void);
+    void PmuServiceExit(uint64_t svc);
+
+    // -- all cpus are running; find the PMU and start accepting requests
+    void PmuInit(void);
+}
+
+
+//
+// -- Hook the scheduler and timer, compiled away when the counters are not built in
+//    ------------------------------------------------------------------------------
+#if IS_ENABLED(PMU_COUNTERS)
+#   define PMU_SWITCH(from)         PmuSwitch(from)
+#   define PMU_TICK()               PmuTick()
+#else
+#   define PMU_SWITCH(from)         do {} while (0)
+#   define PMU_TICK()               do {} while (0)
+#endif
+
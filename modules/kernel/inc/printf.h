@@ -30,8 +30,16 @@
 //    ------------------------------------
 extern "C" {
     int kprintf(const char *fmt, ...);
+    int kvprintf(const char *fmt, va_list args);
 }
 
 
+//
+// -- the kernel logs directly rather than trapping to itself through `KernelPrintf()`
+//    --------------------------------------------------------------------------------
+#undef KLOG_PRINTF
+#define KLOG_PRINTF kprintf
+
+
 #endif
 
@@ -0,0 +1,40 @@
+//====================================================================================================================
+//
+//  profile.h -- The sampling profiler, driven by the PMU or the LAPIC timer and controlled from the debugger
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-23  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+//
+// -- function prototypes
+//    -------------------
+extern "C" {
+    // -- called from the timer vector on every cpu; arms or disarms this cpu and takes timer-driven samples
+    void ProfileTick(Addr_t *regs);
+}
+
+
+//
+// -- Hook the timer, compiled away when the profiler is not built in
+//    ---------------------------------------------------------------
+#if IS_ENABLED(PROFILER) && IS_ENABLED(KERNEL_DEBUGGER)
+#   define PROFILE_TICK(regs)       ProfileTick(regs)
+#else
+#   define PROFILE_TICK(regs)       do {} while (0)
+#endif
+
@@ -46,6 +46,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-May-10  Initial  v0.0.9   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Hot and cold fields on their own cache lines; reschedule IPI; handoff; IPC registers
 //
 //===================================================================================================================
 
@@ -126,24 +127,46 @@ typedef enum {
 // -- This is a process structure
 //    ---------------------------
 typedef struct Process_t {
+    // -- the first cache line is used on every switch and every tick; `ProcessSwitch.s` gets its offsets
+    //    from `asm-offsets.inc`
     Addr_t tosProcessSwap;              // This is the process current esp value (when not executing)
     Addr_t virtAddrSpace;               // This is the process top level page table
     ProcStatus_t status;                // This is the process status
     ProcPriority_t priority;            // This is the process priority
     volatile AtomicInt_t quantumLeft;   // This is the quantum remaining for the process (may be more than priority)
-
-// -- Anything above this line is referenced from ASM and therefore can any changes need to be checked
-    Pid_t pid;                          // This is the PID of this process
-    char command[CMD_LEN];              // The identifying command, includes the terminating null
-    ProcPolicy_t policy;                // This is the scheduling policy
-    uint64_t timeUsed;                  // This is the relative amount of CPU used
+    uint64_t timeUsed;                  // The cpu time used, in nanoseconds
     uint64_t wakeAtMicros;              // Wake this process at or after this micros since boot
     ListHead_t::List_t stsQueue;        // This is the location on the current status queue
-    ListHead_t::List_t globalList;      // This is the global list entry
+
+#if IS_ENABLED(FPU_STATE)
+    // -- also used on every switch
+    void *fpuArea __attribute__((aligned(CACHE_LINE_SIZE)));   // the extended state save area, aligned in its block
+    int fpuCpu;                         // 1 + the cpu whose registers this state was last loaded into (0: none)
+#endif
+
+    // -- the rest is set up when the process is created and seldom changed after that
+    Pid_t pid __attribute__((aligned(CACHE_LINE_SIZE)));       // This is the PID of this process
+    ProcPolicy_t policy;                // This is the scheduling policy
     int pendingErrno;                   // this is the pending error number for a blocked process
+    ListHead_t::List_t globalList;      // This is the global list entry
+    char command[CMD_LEN];              // The identifying command, includes the terminating null
 
     ListHead_t references;              // NOTE the lock is required to update this structure
-} Process_t;
+    bool refsReleased;                  // once ended, the Butler has released the references
+    Addr_t stackLoc;                    // the stack from `StackFind()`; 0 once it has been released
+    Frame_t *stackFrames;               // the frames behind that stack
+
+    // -- the synchronous IPC message registers (see `ipc.cc`) and the caller waiting for this process to reply
+    uint64_t ipcMr[IPC_WORDS] __attribute__((aligned(CACHE_LINE_SIZE)));
+    struct Process_t *ipcReplyTo;
+
+#if IS_ENABLED(PMU_COUNTERS)
+    // -- the performance counts while this process was running, written on every switch and service call
+    uint64_t pmuCounts[PMU_EVENT_COUNT] __attribute__((aligned(CACHE_LINE_SIZE)));
+    int pmuSvcDepth;                    // the depth of nested internal service calls
+    uint64_t pmuSvcStart[PMU_SVC_DEPTH][PMU_EVENT_COUNT];   // the counts on entry to each of those calls
+#endif
+} __attribute__((aligned(CACHE_LINE_SIZE))) Process_t;
 
 
 //
@@ -175,19 +198,16 @@ typedef struct Scheduler_t {
     // -- These fields can only be changed after ProcessLockAndPostpone(); SMP may change this
     Pid_t nextPID;                          // the next pid number to allocate
     volatile uint64_t nextWake;             // the next tick-since-boot when a process needs to wake up
+    AtomicInt_t enabled;                    //!< Set to 1 when the scheduler is finally enabled in startup
 
-    // -- these fields will eventually be set up on a per-CPU basis
-    volatile bool processChangePending;     // whether there is a change that is pending
-    Addr_t flags;                           // the flags for the CPU when interrupts were disabled
-
-    // -- This is a critical field controlled by its lock
-    volatile AtomicInt_t schedulerLockCount;// the depth of the locks
-    volatile AtomicInt_t postponeCount;     // the depth of the number of postpone requests
-
+    // -- These are critical fields controlled by the lock, written only by the cpu holding it; the pending
+    //    change and postpone depth are kept in each cpu's `ArchCpu_t`
+    volatile AtomicInt_t schedulerLockCount __attribute__((aligned(CACHE_LINE_SIZE)));    // the depth of the locks
     int lockCpu;                            // the CPU that currently holds the lock (invalid when no lock is held)
+    Addr_t flags;                           // the flags for the CPU when interrupts were disabled
 
     // -- and the different lists a process might be on, locks in each list will be used
-    QueueHead_t queueOS;                    // this is the queue for the OS tasks -- if it can run it does
+    QueueHead_t queueOS __attribute__((aligned(CACHE_LINE_SIZE)));     // the OS tasks -- if it can run it does
     QueueHead_t queueHigh;                  // this is the queue for High pty tasks
     QueueHead_t queueNormal;                // these are the typical tasks -- most non-OS tasks will be here
     QueueHead_t queueLow;                   // low priority tasks which do not need cpu unless there is nothing else
@@ -196,9 +216,7 @@ typedef struct Scheduler_t {
     ListHead_t  listSleeping;               // these are sleeping tasks, which the timer interrupt will investigate
     ListHead_t  listTerminated;             // these are terminated tasks, which are waiting to be torn down
     ListHead_t  globalProcesses;            // this is the complete list of all processes regardless where the reside
-
-    AtomicInt_t enabled;                    //!< Set to 1 when the scheduler is finally enabled in startup
-} Scheduler_t;
+} __attribute__((aligned(CACHE_LINE_SIZE))) Scheduler_t;
 
 
 
@@ -209,15 +227,24 @@ extern "C" {
     void ProcessSwitch(Process_t *next);
     void ProcessSchedule(void);
 
+    void ProcessLockAndPostpone(void);
+    void ProcessUnlockAndSchedule(void);
+    void ProcessLockScheduler(bool save);
+    void ProcessUnlockScheduler(void);
+
     void SchedulerLateInit(void);
 
     void ProcessStart(void);
     void ProcessNewStack(Process_t *proc, Addr_t startingAddr);
+    void ProcessFreeStack(Process_t *proc);
     Process_t *sch_ProcessCreate(const char *name, Addr_t startingAddr, Addr_t addrSpace, ProcPriority_t pty);
     Return_t sch_Tick(uint64_t now);
+    void IpiReschedule(Addr_t *regs);
     Return_t sch_ProcessBlock(ProcStatus_t reason);
     Return_t sch_ProcessReady(Process_t *proc);
     Return_t sch_ProcessUnblock(Process_t *proc);
+    Return_t sch_ProcessHandoff(Process_t *proc);
+    Return_t sch_ProcessBlockAndSwitch(ProcStatus_t reason, Process_t *proc);
     Return_t sch_ProcessMicroSleepUntil(uint64_t when);
     Return_t ProcessInit(BootInterface_t *loaderInterface);
     void ProcessTerminate(Process_t *proc);
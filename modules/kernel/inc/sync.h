@@ -0,0 +1,75 @@
+//===================================================================================================================
+//
+//  sync.h -- Wait queues, mutexes and semaphores, which block rather than spin
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+#include "lists.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+
+
+//
+// -- A wait queue: processes blocked in PROC_SEMW until they are woken
+//    -----------------------------------------------------------------
+typedef struct WaitQueue_t {
+    ListHead_t waiting;                 // -- on their `stsQueue`; scheduler lock
+} WaitQueue_t;
+
+
+//
+// -- A mutex: `owner` is the owning `Process_t`, with MUTEX_WAITERS set once a process has blocked on it
+//    ---------------------------------------------------------------------------------------------------
+#define MUTEX_WAITERS       1
+
+typedef struct Mutex_t {
+    Addr_t owner;                       // -- changed atomically; the waiters bit only under the scheduler lock
+    ListHead_t waiting;                 // -- the processes blocked in PROC_MTXW; scheduler lock
+} Mutex_t;
+
+
+//
+// -- A counting semaphore
+//    --------------------
+typedef struct Semaphore_t {
+    int64_t count;                      // -- taken atomically; given back under the scheduler lock
+    ListHead_t waiting;                 // -- the processes blocked in PROC_SEMW; scheduler lock
+} Semaphore_t;
+
+
+//
+// -- The synchronization functions
+//    -----------------------------
+extern "C" {
+    WaitQueue_t *krn_WaitQueueCreate(void);
+    Return_t krn_WaitQueueRelease(WaitQueue_t *wq);
+    Return_t krn_WaitQueueWait(WaitQueue_t *wq, Mutex_t *mtx);
+    int krn_WaitQueueWake(WaitQueue_t *wq, int count);
+
+    Mutex_t *krn_MutexCreate(void);
+    Return_t krn_MutexRelease(Mutex_t *mtx);
+    Return_t krn_MutexLock(Mutex_t *mtx);
+    Return_t krn_MutexTry(Mutex_t *mtx);
+    Return_t krn_MutexUnlock(Mutex_t *mtx);
+
+    Semaphore_t *krn_SemCreate(int64_t count);
+    Return_t krn_SemRelease(Semaphore_t *sem);
+    Return_t krn_SemWait(Semaphore_t *sem);
+    Return_t krn_SemTry(Semaphore_t *sem);
+    Return_t krn_SemPost(Semaphore_t *sem);
+}
+
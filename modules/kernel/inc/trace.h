@@ -0,0 +1,75 @@
+//===================================================================================================================
+//
+//  trace.h -- Per-cpu binary trace rings for scheduler and interrupt events
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Each event is a fixed-size record with a TSC timestamp, so recording one is a handful of stores.  The rings
+//  overwrite their oldest records, so they always hold the most recent history for each cpu.  The dump is
+//  decoded on the host by `utils/trace2json.py` into a Chrome trace/Perfetto timeline.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-22  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+//
+// -- The event types; the names in `trace.cc` must be kept in the same order.  `idt-asm.s` uses TRC_INTERNAL.
+//    --------------------------------------------------------------------------------------------------------
+typedef enum {
+    TRC_SWITCH = 0,                 // a: pid switched from; b: pid switched to
+    TRC_EXPIRE = 1,                 // a: pid whose quantum expired in `sch_Tick()`
+    TRC_BLOCK = 2,                  // a: pid blocked; b: the reason (ProcStatus_t)
+    TRC_UNBLOCK = 3,                // a: pid unblocked; b: the status it was blocked with
+    TRC_IPI_SEND = 4,               // a: the IPI vector sent
+    TRC_IPI_RECV = 5,               // a: the IPI vector received
+    TRC_INTERNAL = 6,               // a: the internal service number called through `int 0xe0`
+    TRC_COUNT
+} TraceType_t;
+
+
+//
+// -- A single trace record
+//    ---------------------
+typedef struct TraceRecord_t {
+    uint64_t tsc;
+    uint16_t type;
+    uint16_t cpu;
+    uint32_t unused;
+    uint64_t a;
+    uint64_t b;
+} TraceRecord_t;
+
+
+//
+// -- function prototypes
+//    -------------------
+extern "C" {
+    // -- record an event on this cpu; does nothing until `TraceInit()` has been called
+    void TraceEvent(uint64_t type, uint64_t a, uint64_t b);
+
+    // -- every cpu's structure is ready, the APs' included; start recording
+    void TraceInit(void);
+}
+
+
+//
+// -- Record an event, compiled away when tracing is not built in
+//    -----------------------------------------------------------
+#if IS_ENABLED(TRACE_BUFFER)
+#   define TRACE(type, a, b)        TraceEvent((type), (uint64_t)(a), (uint64_t)(b))
+#else
+#   define TRACE(type, a, b)        do {} while (0)
+#endif
+
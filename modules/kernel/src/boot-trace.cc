@@ -0,0 +1,168 @@
+//====================================================================================================================
+//
+//  boot-trace.cc -- Print the boot trace timeline collected by the loader, kernel and modules
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-21  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "printf.h"
+#include "kernel-funcs.h"
+#include "boot-interface.h"
+#include "stacks.h"
+#include "debugger.h"
+
+
+
+#if IS_ENABLED(BOOT_TRACE)
+
+
+//
+// -- some additional declarations
+//    ----------------------------
+extern BootInterface_t *loaderInterface;
+extern "C" void BootTracePrint(void);
+
+
+//
+// -- Format the timeline; each line goes to the debugger or the kernel log
+//    ---------------------------------------------------------------------
+static void BootTraceOutput(bool dbg)
+{
+    char buf[100];
+    int cnt = loaderInterface->traceCount;
+    if (cnt > BOOT_TRACE_ENTRIES) cnt = BOOT_TRACE_ENTRIES;
+    if (cnt == 0) return;
+
+    uint64_t first = loaderInterface->trace[0].tsc;
+    uint64_t prev = first;
+
+#define OUT(s) do { if (dbg) DbgOutput(s); else kprintf("%s", s); } while (0)
+
+    OUT("Boot timeline (TSC cycles):\n");
+    OUT("+----+--------------------------+------------------+------------------+\n");
+    OUT("|  # | Phase                    |  Since Loader    |  Since Previous  |\n");
+    OUT("+----+--------------------------+------------------+------------------+\n");
+
+    for (int i = 0; i < cnt; i ++) {
+        BootTrace_t *t = &loaderInterface->trace[i];
+
+        // -- markers from other cpus can be claimed out of order by a few cycles
+        uint64_t delta = t->tsc > prev ? t->tsc - prev : 0;
+
+        ksprintf(buf, "| %2d | %-24.24s | %16ld | %16ld |\n", i, t->label, t->tsc - first, delta);
+        OUT(buf);
+        prev = t->tsc;
+    }
+
+    OUT("+----+--------------------------+------------------+------------------+\n");
+
+    if (loaderInterface->traceCount > BOOT_TRACE_ENTRIES) {
+        ksprintf(buf, "%d markers were dropped; increase BOOT_TRACE_ENTRIES\n",
+                loaderInterface->traceCount - BOOT_TRACE_ENTRIES);
+        OUT(buf);
+    }
+
+#undef OUT
+}
+
+
+//
+// -- Print the timeline to the kernel log at the end of boot
+//    -------------------------------------------------------
+void BootTracePrint(void)
+{
+    BootTraceOutput(false);
+}
+
+
+#if IS_ENABLED(KERNEL_DEBUGGER)
+
+
+//
+// -- Dump the timeline from the debugger
+//    -----------------------------------
+void DebugBootTimeline(void)
+{
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+    BootTraceOutput(true);
+}
+
+
+
+//
+// -- here is the debugger menu & function ecosystem
+//    ----------------------------------------------
+DbgState_t bootStates[] = {
+    {   // -- state 0
+        .name = "boot",
+        .transitionFrom = 0,
+        .transitionTo = 1,
+    },
+    {   // -- state 1 (timeline)
+        .name = "timeline",
+        .function = (Addr_t)DebugBootTimeline,
+    },
+};
+
+
+DbgTransition_t bootTrans[] = {
+    {   // -- transition 0
+        .command = "timeline",
+        .alias = "t",
+        .nextState = 1,
+    },
+    {   // -- transition 1
+        .command = "exit",
+        .alias = "x",
+        .nextState = -1,
+    },
+};
+
+
+DbgModule_t bootModule = {
+    .name = "boot",
+    .addrSpace = GetAddressSpace(),
+    .stack = 0,     // -- needs to be handled during late init
+    .stateCnt = sizeof(bootStates) / sizeof (DbgState_t),
+    .transitionCnt = sizeof(bootTrans) / sizeof (DbgTransition_t),
+    .list = {&bootModule.list, &bootModule.list},
+    .lock = {0},
+    // -- it does not matter what we put for .states and .transitions; will be replaced in debugger
+};
+
+
+/****************************************************************************************************************//**
+*   @fn                 void BootTraceDebugInit(void)
+*   @brief              Initialize the debugger module structure
+*
+*   Initialize the debugger module for the boot timeline
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void BootTraceDebugInit(void)
+{
+    extern Addr_t __stackSize;
+
+    bootModule.stack = StackFind();
+    for (Addr_t s = bootModule.stack; s < bootModule.stack + __stackSize; s += PAGE_SIZE) {
+        MmuMapPage(s, PmmAlloc(), PG_WRT);
+    }
+    bootModule.stack += __stackSize;
+
+    DbgRegister(&bootModule, bootStates, bootTrans);
+}
+
+
+#endif
+#endif
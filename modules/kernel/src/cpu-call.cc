@@ -0,0 +1,198 @@
+//====================================================================================================================
+//
+//  cpu-call.cc -- Run a function on other cpus, optionally waiting for them to finish
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Each cpu has a small queue of calls.  A caller queues the same call on every cpu in its mask and sends only
+//  those cpus the IPI_CALL_FUNCTION vector; when this cpu is in the mask, it runs the call itself.  The call is
+//  made in the caller's address space from the IPI handler, so the function runs with interrupts disabled and
+//  must not block.  The call record lives on the kernel heap, which every address space maps: the caller frees
+//  it after a wait, and otherwise the last cpu to run it does.
+//
+//  A caller which waits keeps draining its own queue, so 2 cpus calling each other cannot deadlock.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "heap.h"
+#include "kernel-funcs.h"
+#include "internals.h"
+#include "trace.h"
+
+
+
+//
+// -- One call, which may be queued on several cpus
+//    ---------------------------------------------
+typedef struct CpuCall_t {
+    Addr_t fn;
+    Addr_t arg;
+    Addr_t cr3;                         // -- the address space the function is in
+    bool wait;                          // -- the caller frees the call
+    AtomicInt_t pending;                // -- the cpus which have not yet run it
+} CpuCall_t;
+
+
+//
+// -- The calls queued for a cpu
+//    --------------------------
+typedef struct CpuCallQueue_t {
+    Spinlock_t lock;
+    int head;
+    int tail;
+    CpuCall_t *calls[CPU_CALL_DEPTH];
+} __attribute__((aligned(CACHE_LINE_SIZE))) CpuCallQueue_t;
+
+
+static CpuCallQueue_t callQueue[MAX_CPU];
+
+
+
+//
+// -- Run one call here and drop this cpu's reference to it
+//    -----------------------------------------------------
+static void CpuCallRun(CpuCall_t *call)
+{
+    Addr_t cr3 = GetAddressSpace();
+
+    if (call->cr3 != cr3) __asm volatile("mov %0,%%cr3" :: "r"(call->cr3) : "memory");
+    ((void (*)(Addr_t))call->fn)(call->arg);
+    if (call->cr3 != cr3) __asm volatile("mov %0,%%cr3" :: "r"(cr3) : "memory");
+
+    bool wait = call->wait;             // -- a waiting caller may free the call as soon as pending reaches 0
+    if (AtomicDecAndTest0(&call->pending) && !wait) HeapFree(call);
+}
+
+
+
+//
+// -- Run everything queued for this cpu; interrupts are disabled
+//    -----------------------------------------------------------
+static void CpuCallDrain(void)
+{
+    CpuCallQueue_t *q = &callQueue[LapicGetId()];
+
+    while (true) {
+        CpuCall_t *call = NULL;
+
+        SpinLock(&q->lock); {
+            if (q->head != q->tail) {
+                call = q->calls[q->head];
+                q->head = (q->head + 1) % CPU_CALL_DEPTH;
+            }
+        } SpinUnlock(&q->lock);
+
+        if (!call) return;
+        CpuCallRun(call);
+    }
+}
+
+
+
+//
+// -- The IPI_CALL_FUNCTION vector; the EOI comes first so a call queued while draining raises a new IPI
+//    --------------------------------------------------------------------------------------------------
+extern "C" void IpiCallFunction(Addr_t *)
+{
+    TRACE(TRC_IPI_RECV, IPI_CALL_FUNCTION, 0);
+    TmrEoi();
+    CpuCallDrain();
+}
+
+
+
+//
+// -- Queue a call on a cpu, draining this cpu's own queue while the target's is full
+//    -------------------------------------------------------------------------------
+static void CpuCallQueue(int cpu, CpuCall_t *call)
+{
+    CpuCallQueue_t *q = &callQueue[cpu];
+
+    while (true) {
+        bool queued = false;
+
+        SpinLock(&q->lock); {
+            int next = (q->tail + 1) % CPU_CALL_DEPTH;
+
+            if (next != q->head) {
+                q->calls[q->tail] = call;
+                q->tail = next;
+                queued = true;
+            }
+        } SpinUnlock(&q->lock);
+
+        if (queued) return;
+        CpuCallDrain();
+    }
+}
+
+
+
+//
+// -- Run `fn(arg)` on each cpu (by LAPIC ID) in `mask`, in the caller's address space
+//
+//    Returns 0 once the call is queued, or once every cpu has run it when `wait` is set; -EINVAL when the mask
+//    names no active cpu and -ENOMEM when the call cannot be allocated.
+//    ----------------------------------------------------------------------------------------------------------
+Return_t krn_CpuCall(uint64_t mask, Addr_t fn, Addr_t arg, bool wait)
+{
+    if (fn == 0) return -EINVAL;
+
+    uint64_t targets = 0;
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if ((mask & (1ul << c)) && AtomicRead(&cpus[c].state) == CPU_STARTED) targets |= (1ul << c);
+    }
+
+    if (targets == 0) return -EINVAL;
+
+    CpuCall_t *call = (CpuCall_t *)HeapAlloc(sizeof(CpuCall_t), false);
+    if (!call) return -ENOMEM;
+
+    call->fn = fn;
+    call->arg = arg;
+    call->cr3 = GetAddressSpace();
+    call->wait = wait;
+    AtomicSet(&call->pending, __builtin_popcountl(targets));
+
+    Addr_t flags = DisableInt();
+    int self = LapicGetId();
+    uint64_t others = targets & ~(1ul << self);
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (targets & (1ul << c)) CpuCallQueue(c, call);
+    }
+
+    if (others) {
+        TRACE(TRC_IPI_SEND, IPI_CALL_FUNCTION, others);
+        IpiSendMask(others, IPI_CALL_FUNCTION);
+    }
+
+    if (targets & (1ul << self)) CpuCallDrain();
+
+    if (wait) {
+        while (AtomicRead(&call->pending) != 0) {
+            CpuCallDrain();
+            __builtin_ia32_pause();
+        }
+
+        HeapFree(call);
+    }
+
+    RestoreInt(flags);
+
+    return 0;
+}
+
+
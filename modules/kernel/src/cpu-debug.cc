@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Oct-30  Initial  v0.0.12  ADCL  Initial version (copied from century)
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Add the idle residency of each cpu
 //
 //===================================================================================================================
 
@@ -223,6 +224,29 @@ void DebugRegisterDump(void)
 
 
 
+//
+// -- Dump the time each cpu has spent in each idle state and how often it entered it
+//    -------------------------------------------------------------------------------
+void DebugIdleResidency(void)
+{
+    char buf[80];
+
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+
+    for (int c = 0; c < KrnActiveCores(); c ++) {
+        ksprintf(buf, ANSI_ATTR_BOLD "CPU%d" ANSI_ATTR_NORMAL " (idle %ld ms)\n", c, cpus[c].cpuIdleTime / 1000000);
+        DbgOutput(buf);
+
+        for (int s = 0; s < IdleStateCount(); s ++) {
+            ksprintf(buf, "  %-4.4s | %16ld us | %16ld entries |\n", IdleStateName(s),
+                    cpus[c].idleTime[s] / 1000, cpus[c].idleCount[s]);
+            DbgOutput(buf);
+        }
+    }
+}
+
+
+
 //
 // -- here is the debugger menu & function ecosystem
 //    ----------------------------------------------
@@ -230,7 +254,7 @@ DbgState_t cpuStates[] = {
     {   // -- state 0
         .name = "cpu",
         .transitionFrom = 0,
-        .transitionTo = 2,
+        .transitionTo = 3,
     },
     {   // -- state 1 (status)
         .name = "status",
@@ -240,6 +264,10 @@ DbgState_t cpuStates[] = {
         .name = "regs",
         .function = (Addr_t)DebugRegisterDump,
     },
+    {   // -- state 3 (idle)
+        .name = "idle",
+        .function = (Addr_t)DebugIdleResidency,
+    },
 };
 
 
@@ -255,6 +283,11 @@ DbgTransition_t cpuTrans[] = {
         .nextState = 2,
     },
     {   // -- transition 2
+        .command = "idle",
+        .alias = "i",
+        .nextState = 3,
+    },
+    {   // -- transition 3
         .command = "exit",
         .alias = "x",
         .nextState = -1,
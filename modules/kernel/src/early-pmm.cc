@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-30  Initial  v0.0.4   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Honor the frame count and alignment
 //
 //===================================================================================================================
 
@@ -24,12 +25,15 @@
 
 
 //
-// -- Allocate an early frame from the pool
-//    -------------------------------------
-Frame_t PmmEarlyFrame(void)
+// -- Allocate early frames from the pool; these are handed out in order so any count is contiguous
+//    ---------------------------------------------------------------------------------------------
+Frame_t PmmEarlyFrame(bool, int bitsAligned, size_t count)
 {
     extern BootInterface_t *loaderInterface;
-    Frame_t rv = loaderInterface->nextEarlyFrame ++;
+    Frame_t mask = bitsAligned > 12 ? (1ul << (bitsAligned - 12)) - 1 : 0;
+    Frame_t rv = (loaderInterface->nextEarlyFrame + mask) & ~mask;
+
+    loaderInterface->nextEarlyFrame = rv + (count ? count : 1);
 
     kprintf(".. (new early frame: %p)\n", rv);
 
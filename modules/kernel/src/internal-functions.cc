@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Sep-03  Initial  v0.0.9d  ADCL  Initial version -- copied out of `internal.cc`
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Register the vector, cross-cpu call, message queue, IPC and sync functions
 //
 //===================================================================================================================
 
@@ -25,6 +26,12 @@
 #include "kernel-funcs.h"
 #include "stacks.h"
 #include "internals.h"
+#include "klog.h"
+#include "trace.h"
+#include "pmu.h"
+#include "msgq.h"
+#include "ipc.h"
+#include "sync.h"
 
 
 
@@ -42,7 +49,7 @@ Addr_t krn_GetInternalHandler(int i)
 {
     if (i < 0 || i >= MAX_HANDLERS) return -EINVAL;
 
-    kprintf("Getting internal handler: %p\n", internalTable[i].handler);
+    KLOG(INTERNAL, DEBUG, "Getting internal handler: %p\n", internalTable[i].handler);
 
     return internalTable[i].handler;
 }
@@ -56,7 +63,7 @@ Return_t krn_SetInternalHandler(int i, Addr_t handler, Addr_t cr3, Addr_t stack)
 {
     if (i < 0 || i >= MAX_HANDLERS) return -EINVAL;
 
-    kprintf("Setting internal handler %d to %p from %p\n", i, handler, cr3);
+    KLOG(INTERNAL, DEBUG, "Setting internal handler %d to %p from %p\n", i, handler, cr3);
 
     internalTable[i].handler = handler;
     internalTable[i].cr3 = cr3;
@@ -109,6 +116,7 @@ extern "C" Addr_t krn_PauseCores(void)
     Addr_t flags = DisableInt();
     AtomicSet(&coresEngaged, 1);
 
+    TRACE(TRC_IPI_SEND, IPI_PAUSE_CORES, 0);
     IpiSendIpi(IPI_PAUSE_CORES);
     int active = KrnActiveCores();
     while (AtomicRead(&coresEngaged) != active) {}
@@ -179,12 +187,41 @@ void InternalInit(void)
     internalTable[INT_KRN_MMU_UNMAP_EX].handler =   (Addr_t)krn_MmuUnmapEx;
     internalTable[INT_KRN_MMU_UNMAP_EX].stack =     0xffffff0000009000 + 0x1000;
     internalTable[INT_KRN_MMU_UNMAP_EX].cr3 =       GetAddressSpace();
+    internalTable[INT_KRN_MMU_MAP_RANGE].handler =  (Addr_t)cmn_MmuMapRange;
+    internalTable[INT_KRN_MMU_UNMAP_RANGE].handler = (Addr_t)cmn_MmuUnmapRange;
 
     internalTable[INT_KRN_COPY_MEM].handler =       (Addr_t)krn_AllocAndCopy;
     internalTable[INT_KRN_RLS_MEM].handler =        (Addr_t)krn_ReleaseCopy;
     internalTable[INT_KRN_CORES_ACTIVE].handler =   (Addr_t)krn_ActiveCores;
     internalTable[INT_KRN_PAUSE_CORES].handler =    (Addr_t)krn_PauseCores;
     internalTable[INT_KRN_RELEASE_CORES].handler =  (Addr_t)krn_ReleaseCores;
+    internalTable[INT_KRN_VECTOR_ALLOC].handler =   (Addr_t)krn_VectorAlloc;
+    internalTable[INT_KRN_VECTOR_FREE].handler =    (Addr_t)krn_VectorFree;
+    internalTable[INT_KRN_VECTOR_COUNT].handler =   (Addr_t)krn_VectorCount;
+    internalTable[INT_KRN_CPU_CALL].handler =       (Addr_t)krn_CpuCall;
+
+    internalTable[INT_MSGQ_CREATE].handler =        (Addr_t)krn_MsgqCreate;
+    internalTable[INT_MSGQ_RELEASE].handler =       (Addr_t)krn_MsgqRelease;
+    internalTable[INT_MSGQ_SEND].handler =          (Addr_t)krn_MsgqSend;
+    internalTable[INT_MSGQ_RECEIVE].handler =       (Addr_t)krn_MsgqReceive;
+    internalTable[INT_IPC_CREATE].handler =         (Addr_t)krn_IpcCreate;
+    internalTable[INT_IPC_CALL].handler =           (Addr_t)krn_IpcCall;
+    internalTable[INT_IPC_REPLY_WAIT].handler =     (Addr_t)krn_IpcReplyWait;
+
+    internalTable[INT_WAITQ_CREATE].handler =       (Addr_t)krn_WaitQueueCreate;
+    internalTable[INT_WAITQ_RELEASE].handler =      (Addr_t)krn_WaitQueueRelease;
+    internalTable[INT_WAITQ_WAIT].handler =         (Addr_t)krn_WaitQueueWait;
+    internalTable[INT_WAITQ_WAKE].handler =         (Addr_t)krn_WaitQueueWake;
+    internalTable[INT_MUTEX_CREATE].handler =       (Addr_t)krn_MutexCreate;
+    internalTable[INT_MUTEX_RELEASE].handler =      (Addr_t)krn_MutexRelease;
+    internalTable[INT_MUTEX_LOCK].handler =         (Addr_t)krn_MutexLock;
+    internalTable[INT_MUTEX_TRY].handler =          (Addr_t)krn_MutexTry;
+    internalTable[INT_MUTEX_UNLOCK].handler =       (Addr_t)krn_MutexUnlock;
+    internalTable[INT_SEM_CREATE].handler =         (Addr_t)krn_SemCreate;
+    internalTable[INT_SEM_RELEASE].handler =        (Addr_t)krn_SemRelease;
+    internalTable[INT_SEM_WAIT].handler =           (Addr_t)krn_SemWait;
+    internalTable[INT_SEM_TRY].handler =            (Addr_t)krn_SemTry;
+    internalTable[INT_SEM_POST].handler =           (Addr_t)krn_SemPost;
 
     internalTable[INT_PMM_ALLOC].handler =          (Addr_t)PmmEarlyFrame;
 
@@ -197,6 +234,12 @@ void InternalInit(void)
 
     internalTable[INT_DBG_INSTALLED].handler =      (Addr_t)krn_DebuggerInstalled;
 
+#if IS_ENABLED(PMU_COUNTERS)
+    internalTable[INT_PMU_CONTROL].handler =        (Addr_t)pmu_Control;
+    internalTable[INT_PMU_READ].handler =           (Addr_t)pmu_Read;
+    internalTable[INT_PMU_PROCESS].handler =        (Addr_t)pmu_ProcessCount;
+#endif
+
 
     cmn_MmuMapPage(0xffffff0000008000, PmmAlloc(), PG_WRT);
     cmn_MmuMapPage(0xffffff0000009000, PmmAlloc(), PG_WRT);
@@ -0,0 +1,219 @@
+//====================================================================================================================
+//
+//  ipc.cc -- Synchronous call/reply IPC between processes
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  A client calls an endpoint and waits for the reply; a server replies to its last client and waits for the
+//  next call in one step.  The payload is IPC_WORDS message registers, kept in each `Process_t` and copied from
+//  one process to the other; nothing is queued and nothing is allocated.
+//
+//  When the other side is already waiting, this cpu goes straight to it (`sch_ProcessBlockAndSwitch()`): the
+//  process making the call or the reply blocks and the one waiting for it runs, with no trip through the ready
+//  queues and no scheduling decision.  `ProcessSwitch()` only loads cr3 when the address space changes, so a
+//  client and server sharing one also keep their TLB entries.
+//
+//  Everything is done under the scheduler lock, so a process is always blocked before anyone can wake it.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "heap.h"
+#include "lists.h"
+#include "printf.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+#include "ipc.h"
+
+
+
+//
+// -- Copy a set of message registers
+//    -------------------------------
+static inline void IpcCopy(uint64_t *to, const uint64_t *from)
+{
+    for (int i = 0; i < IPC_WORDS; i ++) to[i] = from[i];
+}
+
+
+
+//
+// -- Create an endpoint
+//    ------------------
+IpcEndpoint_t *krn_IpcCreate(void)
+{
+    IpcEndpoint_t *ep = NEW(IpcEndpoint_t);
+    if (!ep) return NULL;
+
+    kMemSetB(ep, 0, sizeof(IpcEndpoint_t));
+    ListInit(&ep->callers.list);
+
+    return ep;
+}
+
+
+
+//
+// -- Call the server on `ep` with the IPC_WORDS words at `mr` and wait for its reply, which replaces them
+//    ----------------------------------------------------------------------------------------------------
+Return_t krn_IpcCall(IpcEndpoint_t *ep, uint64_t *mr)
+{
+    Process_t *me = CurrentThread();
+    if (!ep || !mr || !me) return -EINVAL;
+
+    IpcCopy(me->ipcMr, mr);
+
+    ProcessLockAndPostpone();
+
+    Process_t *server = ep->server;
+
+    if (server) {
+        ep->server = NULL;
+        IpcCopy(server->ipcMr, me->ipcMr);
+        server->ipcReplyTo = me;
+
+        sch_ProcessBlockAndSwitch(PROC_MSGW, server);
+    } else {
+        Enqueue(&ep->callers, &me->stsQueue);
+        sch_ProcessBlock(PROC_MSGW);
+        ProcessUnlockAndSchedule();             // -- the switch away happens here
+    }
+
+    IpcCopy(mr, me->ipcMr);
+
+    return 0;
+}
+
+
+
+//
+// -- Reply to the last caller with the IPC_WORDS words at `mr` and wait for the next call, which replaces them.
+//    There is no caller to reply to on the first call.  An endpoint has one server: -EBUSY when another is
+//    waiting on it.
+//    ---------------------------------------------------------------------------------------------------------
+Return_t krn_IpcReplyWait(IpcEndpoint_t *ep, uint64_t *mr)
+{
+    Process_t *me = CurrentThread();
+    if (!ep || !mr || !me) return -EINVAL;
+
+    IpcCopy(me->ipcMr, mr);
+
+    ProcessLockAndPostpone();
+
+    if (ep->server != NULL) {
+        ProcessUnlockAndSchedule();
+        return -EBUSY;
+    }
+
+    Process_t *client = me->ipcReplyTo;
+    me->ipcReplyTo = NULL;
+
+    if (client) IpcCopy(client->ipcMr, me->ipcMr);
+
+    if (!IsListEmpty(&ep->callers)) {
+        // -- a caller is already waiting, so keep this cpu and take its call
+        Process_t *next = FIND_PARENT(ep->callers.list.next, Process_t, stsQueue);
+        ListRemoveInit(&next->stsQueue);
+        IpcCopy(me->ipcMr, next->ipcMr);
+        me->ipcReplyTo = next;
+
+        if (client) sch_ProcessUnblock(client);
+        ProcessUnlockAndSchedule();
+    } else {
+        ep->server = me;
+
+        if (client) {
+            sch_ProcessBlockAndSwitch(PROC_MSGW, client);
+        } else {
+            sch_ProcessBlock(PROC_MSGW);
+            ProcessUnlockAndSchedule();         // -- the switch away happens here
+        }
+    }
+
+    IpcCopy(mr, me->ipcMr);
+
+    return 0;
+}
+
+
+
+#if IS_ENABLED(IPC_BENCH)
+
+//
+// -- The benchmark's endpoint
+//    ------------------------
+static IpcEndpoint_t *benchEp = NULL;
+
+
+//
+// -- The echo server: reply with the call, plus one in the first word
+//    ----------------------------------------------------------------
+static void IpcEchoServer(void)
+{
+    uint64_t mr[IPC_WORDS] = { 0 };
+
+    while (true) {
+        if (IpcReplyWait(benchEp, mr) != 0) continue;
+        mr[0] ++;
+    }
+}
+
+
+//
+// -- The client: time IPC_BENCH_ROUNDS round trips through the service interface, as a module would make them
+//    --------------------------------------------------------------------------------------------------------
+static void IpcBenchClient(void)
+{
+    uint64_t mr[IPC_WORDS] = { 0 };
+    uint64_t total = 0;
+    uint64_t best = (uint64_t)-1;
+
+    for (uint64_t i = 0; i < IPC_BENCH_ROUNDS; i ++) {
+        mr[0] = i;
+
+        uint64_t start = RDTSC();
+        IpcCall(benchEp, mr);
+        uint64_t cycles = RDTSC() - start;
+
+        if (mr[0] != i + 1) {
+            kprintf("IPC: round trip %ld came back with %ld\n", i, mr[0]);
+            return;
+        }
+
+        total += cycles;
+        if (cycles < best) best = cycles;
+    }
+
+    kprintf("IPC: %d round trips, %ld cycles best, %ld cycles average\n", IPC_BENCH_ROUNDS, best,
+            total / IPC_BENCH_ROUNDS);
+}
+
+
+//
+// -- Start the echo server and the client; the client ends when it reports and the server stays blocked
+//    --------------------------------------------------------------------------------------------------
+void IpcBenchStart(void)
+{
+    benchEp = krn_IpcCreate();
+    if (!benchEp) return;
+
+    sch_ProcessCreate("IPC Echo", (Addr_t)IpcEchoServer, GetAddressSpace(), PTY_NORM);
+    sch_ProcessCreate("IPC Bench", (Addr_t)IpcBenchClient, GetAddressSpace(), PTY_NORM);
+}
+
+#else
+
+void IpcBenchStart(void) {}
+
+#endif
+
@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Jan-19  Initial  v0.0.2   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Calibrate the TSC clock before starting the APs; idle states; the Butler's queue; IPC bench
 //
 //===================================================================================================================
 
@@ -26,6 +27,15 @@
 #include "scheduler.h"
 #include "kernel-funcs.h"
 #include "modules.h"
+#include "log.h"
+#include "trace.h"
+#include "pmu.h"
+#include "fpu.h"
+#include "kmem.h"
+#include "stacks.h"
+#include "klog.h"
+#include "msgq.h"
+#include "ipc.h"
 
 
 //
@@ -36,6 +46,69 @@ extern BootInterface_t *loaderInterface;
 
 
 extern "C" void CpuDebugInit(void);
+extern "C" void MmuDebugInit(void);
+extern "C" void BootTraceDebugInit(void);
+extern "C" void BootTracePrint(void);
+extern "C" void TraceDebugInit(void);
+extern "C" void ProfileDebugInit(void);
+extern "C" void PmuDebugInit(void);
+extern "C" void ClockInit(BootInterface_t *loaderInterface);
+
+
+//
+// -- Is a cpu still on this process's stack, running it or idling on it after it ended?  The scheduler is locked.
+//    ------------------------------------------------------------------------------------------------------------
+static bool ButlerStackInUse(Process_t *proc)
+{
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (cpus[c].process == proc || cpus[c].parked == proc) return true;
+    }
+
+    return false;
+}
+
+
+
+//
+// -- Release the message queues still referenced by each ended process, and its stack once no cpu is on it; a
+//    stack still in use is released on a later pass.  The processes stay on the terminated list for the rest of
+//    their teardown; `refsReleased` and `stackLoc` say what has been done.
+//    ------------------------------------------------------------------------------------------------------------
+static void ButlerCleanProcesses(void)
+{
+    while (true) {
+        Process_t *proc = NULL;
+        Process_t *stack = NULL;
+
+        ProcessLockAndPostpone();
+
+        ListHead_t::List_t *wrk = scheduler.listTerminated.list.next;
+
+        while (wrk != &scheduler.listTerminated.list) {
+            Process_t *p = FIND_PARENT(wrk, Process_t, stsQueue);
+
+            if (!p->refsReleased) {
+                p->refsReleased = true;
+                proc = p;
+                break;
+            }
+
+            if (p->stackLoc && !ButlerStackInUse(p)) {
+                stack = p;
+                break;
+            }
+
+            wrk = wrk->next;
+        }
+
+        ProcessUnlockAndSchedule();
+
+        if (proc) MsgqReleaseProcess(proc);
+        else if (stack) ProcessFreeStack(stack);
+        else return;
+    }
+}
+
 
 
 //
@@ -45,6 +118,7 @@ void kInit(void)
 {
     extern BootInterface_t *loaderInterface;
 
+    BootTraceMark(loaderInterface, "kernel start");
     ProcessInitTable();
     SerialOpen();
 
@@ -53,27 +127,81 @@ void kInit(void)
     IntInit();                          // init the interrupt table (hardware structure)
     VectorInit();                       // init the vector table (OS structure)
     InternalInit();                     // init the internal function table
+    PageFaultInit();                    // page faults can now page in modules
     ServiceInit();                      // init the OS services table
     CpuInit();                          // init the cpus tables
+#if IS_ENABLED(FPU_STATE)
+    FpuInit();                          // processes get an extended state area from here on
+    if (FpuKernelReady()) LibkSimdEnable(FpuKernelBegin, FpuKernelEnd, FpuKernelActive);
+#endif
+    kprintf("libk memory functions: %s\n", LibkMemImplName());
     ProcessInit(loaderInterface);
-    ModuleEarlyInit();
+    BootTraceMark(loaderInterface, "kernel tables ready");
+    ModuleEarlyInit();                  // load all modules; init those needed to start the APs
+    ClockInit(loaderInterface);         // the TSC clock, unless the HPET module has calibrated it already
+    IdleInit();                         // the C-states the idle loops can use
+    BootTraceMark(loaderInterface, "starting APs");
+    CpuApStart(loaderInterface);        // the APs help with the remaining module early init
+    BootTraceMark(loaderInterface, "APs started");
+    ModuleInitComplete();
+    BootTraceMark(loaderInterface, "module early init done");
+    StackCacheEnable();                 // every cpu has ThisCpu() now, so it can keep its own free stacks
+#if IS_ENABLED(TRACE_BUFFER)
+    TraceInit();                        // every cpu has ThisCpu() now, so events can be recorded
+#endif
+#if IS_ENABLED(PMU_COUNTERS)
+    PmuInit();                          // every cpu has ThisCpu() now, so the service hooks are safe
+#endif
 InternalTableDump();
-    CpuApStart(loaderInterface);
-    cpus[0].lastTimer = TmrCurrentCount();
+    cpus[0].lastTimer = ClockNanos();
 
     EnableInt();
 #if IS_ENABLED(KERNEL_DEBUGGER)
     CpuDebugInit();
+    MmuDebugInit();
+#if IS_ENABLED(BOOT_TRACE)
+    BootTraceDebugInit();
+#endif
+#if IS_ENABLED(TRACE_BUFFER)
+    TraceDebugInit();
+#endif
+#if IS_ENABLED(PROFILER)
+    ProfileDebugInit();
+#endif
+#if IS_ENABLED(PMU_COUNTERS)
+    PmuDebugInit();
+#endif
 #endif
     AtomicSet(&scheduler.enabled, 1);
+    LogInit();                          // from here, kprintf() no longer waits on the serial port
     ModuleLateInit();
+    IpcBenchStart();                    // with IPC_BENCH, time the call/reply round trip
+    BootTraceMark(loaderInterface, "boot complete");
+
+#if IS_ENABLED(BOOT_TRACE)
+    BootTracePrint();
+#endif
 
     // -- take on the Butler role
     CurrentThread()->priority = (ProcPriority_t)PTY_LOW;
     ksprintf(CurrentThread()->command, "Butler");
+    butlerMsgq = krn_MsgqCreate();
 
     while (true) {
-        sch_ProcessBlock(PROC_MSGW);
+        Message_t msg;
+        msg.pages = 0;
+
+        if (krn_MsgqReceive(butlerMsgq, &msg, true) != 0) continue;
+
+        switch (msg.type) {
+        case BUTLER_CLEAN_PROCESS:
+            ButlerCleanProcesses();
+            break;
+
+        default:
+            KLOG(SCHED, WARN, "The Butler received an unknown message type %d\n", msg.type);
+            break;
+        }
     }
 }
 
@@ -87,13 +215,23 @@ extern "C" void kInitAp(void)
 
     assert(AtomicRead(&cpus[me].state) == CPU_STARTING);
 
+#if IS_ENABLED(FPU_STATE)
+    FpuCpuInit();
+#endif
     SchedulerCreateKInitAp(me);
 
     TmrApInit(NULL);
-    EnableInt();
+
+    char label[BOOT_TRACE_LABEL_LEN];
+    ksprintf(label, "cpu %d started", me);
+    BootTraceMark(loaderInterface, label);
+
     kprintf("Confirming that CPU %d has started\n", me);
     AtomicSet(&cpus[me].state, CPU_STARTED);
 
+    ModuleInitWorker();                 // -- still with interrupts disabled
+    EnableInt();
+
     ProcessEnd();
     assert(false);
     while (true) {}
@@ -0,0 +1,238 @@
+//====================================================================================================================
+//
+//  log.cc -- The kernel log: per-cpu lock-free rings drained to the serial port by a low priority process
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Each cpu only ever writes to its own ring, and only with interrupts disabled, so there is a single producer.
+//  The drainer is the single consumer.  So, the head and tail indices are all the synchronization needed.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-21  Initial  v0.0.13  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Add LogWrite() so kprintf() can append a chunk; fill the UART FIFO directly
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "serial.h"
+#include "spinlock.h"
+#include "scheduler.h"
+#include "kernel-funcs.h"
+#include "log.h"
+
+
+//
+// -- The number of characters the UART can take once its transmit holding register is empty
+//    --------------------------------------------------------------------------------------
+#define UART_FIFO_SIZE      16
+
+
+//
+// -- A log ring; the producer and consumer sides are kept on separate cache lines
+//    ----------------------------------------------------------------------------
+typedef struct LogRing_t {
+    volatile uint64_t head __attribute__((aligned(64)));   // next character to write (producer)
+    volatile uint64_t dropped;                              // characters lost to a full ring (producer)
+    volatile uint64_t tail __attribute__((aligned(64)));   // next character to drain (consumer)
+    uint64_t reported;                                      // dropped characters already reported (consumer)
+    char buf[LOG_RING_SIZE];
+} LogRing_t;
+
+
+//
+// -- The rings themselves and the state of the log
+//    ---------------------------------------------
+static LogRing_t logRings[MAX_CPU];
+static volatile bool logBuffered = false;
+static Spinlock_t drainLock = {0};
+
+
+
+//
+// -- Append a character to this cpu's ring, counting it as dropped if the ring is full
+//    ---------------------------------------------------------------------------------
+void LogPutChar(uint8_t ch)
+{
+#if IS_ENABLED(LOG_BUFFERED)
+    if (logBuffered) {
+        LogRing_t *r = &logRings[ThisCpu()->cpuNum];
+        uint64_t h = r->head;
+
+        if (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+            r->dropped ++;
+            return;
+        }
+
+        r->buf[h % LOG_RING_SIZE] = ch;
+        __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+        return;
+    }
+#endif
+
+    SerialPutChar(ch);
+}
+
+
+//
+// -- Append a string to this cpu's ring with one update of the head; whatever does not fit is dropped
+//    ------------------------------------------------------------------------------------------------
+void LogWrite(const char *str, size_t len)
+{
+#if IS_ENABLED(LOG_BUFFERED)
+    if (logBuffered) {
+        LogRing_t *r = &logRings[ThisCpu()->cpuNum];
+        uint64_t h = r->head;
+        size_t room = LOG_RING_SIZE - (h - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+
+        if (len > room) {
+            r->dropped += len - room;
+            len = room;
+        }
+
+        size_t at = h % LOG_RING_SIZE;
+        size_t first = (len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at);
+
+        kMemMoveB(&r->buf[at], (void *)str, first);
+        kMemMoveB(&r->buf[0], (void *)(str + first), len - first);
+        __atomic_store_n(&r->head, h + len, __ATOMIC_RELEASE);
+        return;
+    }
+#endif
+
+    while (len --) SerialPutChar(*str ++);
+}
+
+
+//
+// -- Report any characters dropped from a ring since the last report; the consumer side must be owned
+//    ------------------------------------------------------------------------------------------------
+static void LogReportDrops(int cpu)
+{
+    LogRing_t *r = &logRings[cpu];
+    uint64_t d = r->dropped;
+
+    if (d == r->reported) return;
+
+    char buf[80];
+    ksnprintf(buf, sizeof(buf), "\n[log: %ld characters dropped on CPU %d]\n", d - r->reported, cpu);
+    SerialPutString(buf);
+    r->reported = d;
+}
+
+
+//
+// -- Write up to `max` UART slots from a ring, stopping after a complete line; returns true at a line end
+//    or when the ring is empty, meaning another cpu may have its turn.  With `fifo`, the transmitter is checked
+//    once and the characters go straight into its FIFO, so `max` must not be more than UART_FIFO_SIZE;
+//    otherwise each character waits for the transmitter.
+//    ----------------------------------------------------------------------------------------------------------
+static bool LogDrainRing(int cpu, size_t max, bool fifo)
+{
+    LogRing_t *r = &logRings[cpu];
+    uint64_t t = r->tail;
+    uint64_t h = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    bool rv = true;
+
+    LogReportDrops(cpu);
+
+    // -- a drop report may have taken the FIFO; try again on the next pass
+    if (fifo && !SerialTxReady()) return false;
+
+    while (t != h) {
+        char ch = r->buf[t % LOG_RING_SIZE];
+        size_t slots = (ch == '\n' ? 2 : 1);        // -- '\n' is expanded to "\r\n"
+
+        if (n + slots > max) {
+            rv = false;
+            break;
+        }
+
+        if (fifo) SerialPutCharNoWait(ch);
+        else SerialPutChar(ch);
+
+        n += slots;
+        t ++;
+
+        if (ch == '\n') break;
+    }
+
+    __atomic_store_n(&r->tail, t, __ATOMIC_RELEASE);
+    return rv;
+}
+
+
+//
+// -- Is there anything left to drain?
+//    --------------------------------
+static bool LogPending(void)
+{
+    for (int i = 0; i < MAX_CPU; i ++) {
+        if (logRings[i].tail != logRings[i].head || logRings[i].reported != logRings[i].dropped) return true;
+    }
+
+    return false;
+}
+
+
+//
+// -- The drainer process: feed the UART one FIFO at a time and sleep otherwise, so it never busy-waits
+//    -------------------------------------------------------------------------------------------------
+static void LogDrainer(void)
+{
+    int cpu = 0;
+
+    while (true) {
+        if (!LogPending() || !SerialTxReady()) {
+            SchProcessMilliSleep(LOG_DRAIN_SLEEP_MS);
+            continue;
+        }
+
+        krn_SpinLock(&drainLock);
+        bool next = LogDrainRing(cpu, UART_FIFO_SIZE, true);
+        krn_SpinUnlock(&drainLock);
+
+        // -- whole lines are drained from a cpu before moving on so lines are not interleaved
+        if (next) cpu = (cpu + 1) % MAX_CPU;
+    }
+}
+
+
+//
+// -- Start the drainer and begin buffering; the scheduler must be running
+//    --------------------------------------------------------------------
+void LogInit(void)
+{
+#if IS_ENABLED(LOG_BUFFERED)
+    sch_ProcessCreate("Log Drainer", (Addr_t)LogDrainer, GetAddressSpace(), PTY_LOW);
+    logBuffered = true;
+#endif
+}
+
+
+//
+// -- Something fatal happened: write the rings out directly and stop buffering.  The drain lock is not
+//    taken since its holder may be the cpu in trouble; a few garbled characters are better than a hang.
+//    ---------------------------------------------------------------------------------------------------
+void LogPanic(void)
+{
+    if (!logBuffered) return;
+
+    logBuffered = false;
+
+    for (int i = 0; i < MAX_CPU; i ++) {
+        while (logRings[i].tail != logRings[i].head) {
+            LogDrainRing(i, LOG_RING_SIZE * 2, false);
+        }
+
+        LogReportDrops(i);
+    }
+}
@@ -0,0 +1,183 @@
+//====================================================================================================================
+//
+//  mmu-debug.cc -- Debugging functions for the mmu
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-20  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+#include "mmu.h"
+#include "stacks.h"
+#include "debugger.h"
+
+
+
+#if IS_ENABLED(KERNEL_DEBUGGER)
+
+
+//
+// -- The number of 4K pages in 1GB, which is the size of each benchmark pass
+//    -----------------------------------------------------------------------
+#define BENCH_PAGES     (512ul * 512ul)
+
+
+//
+// -- Output a single benchmark result
+//    --------------------------------
+static void MmuBenchReport(const char *what, uint64_t cycles)
+{
+    char buf[100];
+
+    ksprintf(buf, "| %-30.30s | %16ld | %10ld |\n", what, cycles, cycles / BENCH_PAGES);
+    DbgOutput(buf);
+}
+
+
+//
+// -- Time mapping and unmapping 1GB of address space 3 ways: one page at a time, as a range which cannot use
+//    large pages, and as a range which can.  Each pass uses its own 1GB of address space starting at
+//    MMU_BENCH_ADDR, which is kernel-only.  The frames are never touched, so they do not need to be real memory.
+//
+//    Note that tables are not reclaimed when pages are unmapped, so the first run also includes the cost of
+//    building the paging tables for the first 2 passes.
+//    -----------------------------------------------------------------------------------------------------------
+void DebugMmuBench(void)
+{
+    Addr_t region = MMU_BENCH_ADDR;
+    uint64_t start;
+
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+    DbgOutput("Mapping and unmapping 1GB of address space:\n");
+    DbgOutput("+--------------------------------+------------------+------------+\n");
+    DbgOutput("| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Operation" ANSI_ATTR_NORMAL
+            "                      | " ANSI_ATTR_BOLD ANSI_FG_BLUE "Cycles" ANSI_ATTR_NORMAL
+            "           | " ANSI_ATTR_BOLD ANSI_FG_BLUE "Per Page" ANSI_ATTR_NORMAL "   |\n");
+    DbgOutput("+--------------------------------+------------------+------------+\n");
+
+
+    //
+    // -- Pass 1: one page at a time
+    //    --------------------------
+    start = RDTSC();
+    for (size_t i = 0; i < BENCH_PAGES; i ++) {
+        cmn_MmuMapPage(region + (i * PAGE_SIZE), i + 1, PG_NONE);
+    }
+    MmuBenchReport("Map 4K pages one by one", RDTSC() - start);
+
+    start = RDTSC();
+    for (size_t i = 0; i < BENCH_PAGES; i ++) {
+        cmn_MmuUnmapPage(region + (i * PAGE_SIZE));
+    }
+    MmuBenchReport("Unmap 4K pages one by one", RDTSC() - start);
+
+
+    //
+    // -- Pass 2: a range whose frames are not aligned for large pages
+    //    ------------------------------------------------------------
+    region += BENCH_PAGES * PAGE_SIZE;
+
+    start = RDTSC();
+    cmn_MmuMapRange(region, 1, BENCH_PAGES, PG_NONE);
+    MmuBenchReport("Map 4K pages as a range", RDTSC() - start);
+
+    start = RDTSC();
+    cmn_MmuUnmapRange(region, BENCH_PAGES);
+    MmuBenchReport("Unmap 4K pages as a range", RDTSC() - start);
+
+
+    //
+    // -- Pass 3: an aligned range, which can use large pages
+    //    ---------------------------------------------------
+    region += BENCH_PAGES * PAGE_SIZE;
+
+    start = RDTSC();
+    cmn_MmuMapRange(region, 0, BENCH_PAGES, PG_NONE);
+    MmuBenchReport("Map aligned range", RDTSC() - start);
+
+    start = RDTSC();
+    cmn_MmuUnmapRange(region, BENCH_PAGES);
+    MmuBenchReport("Unmap aligned range", RDTSC() - start);
+
+    DbgOutput("+--------------------------------+------------------+------------+\n");
+}
+
+
+
+//
+// -- here is the debugger menu & function ecosystem
+//    ----------------------------------------------
+DbgState_t mmuStates[] = {
+    {   // -- state 0
+        .name = "mmu",
+        .transitionFrom = 0,
+        .transitionTo = 1,
+    },
+    {   // -- state 1 (bench)
+        .name = "bench",
+        .function = (Addr_t)DebugMmuBench,
+    },
+};
+
+
+DbgTransition_t mmuTrans[] = {
+    {   // -- transition 0
+        .command = "bench",
+        .alias = "b",
+        .nextState = 1,
+    },
+    {   // -- transition 1
+        .command = "exit",
+        .alias = "x",
+        .nextState = -1,
+    },
+};
+
+
+DbgModule_t mmuModule = {
+    .name = "mmu",
+    .addrSpace = GetAddressSpace(),
+    .stack = 0,     // -- needs to be handled during late init
+    .stateCnt = sizeof(mmuStates) / sizeof (DbgState_t),
+    .transitionCnt = sizeof(mmuTrans) / sizeof (DbgTransition_t),
+    .list = {&mmuModule.list, &mmuModule.list},
+    .lock = {0},
+    // -- it does not matter what we put for .states and .transitions; will be replaced in debugger
+};
+
+
+/****************************************************************************************************************//**
+*   @fn                 void MmuDebugInit(void)
+*   @brief              Initialize the debugger module structure
+*
+*   Initialize the debugger module for the MMU
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void MmuDebugInit(void)
+{
+    extern Addr_t __stackSize;
+
+    mmuModule.stack = StackFind();
+    for (Addr_t s = mmuModule.stack; s < mmuModule.stack + __stackSize; s += PAGE_SIZE) {
+        MmuMapPage(s, PmmAlloc(), PG_WRT);
+    }
+    mmuModule.stack += __stackSize;
+
+    DbgRegister(&mmuModule, mmuStates, mmuTrans);
+}
+
+
+
+
+#endif
@@ -26,6 +26,7 @@
 #include "idt.h"
 #include "scheduler.h"
 #include "modules.h"
+#include "klog.h"
 
 
 //
@@ -45,6 +46,7 @@ typedef struct Module_t {
     uint64_t intCnt;
     uint64_t internalCnt;
     uint64_t osCnt;
+    uint64_t depCnt;
     struct {
         uint64_t loc;
         uint64_t target;
@@ -68,6 +70,16 @@ extern "C" Addr_t LoadCr3(Addr_t);
 extern BootInterface_t *loaderInterface;
 
 
+//
+// -- The state of a module's early initialization
+//    --------------------------------------------
+typedef enum {
+    MOD_PENDING,                    // prepared and waiting for its dependencies
+    MOD_RUNNING,                    // claimed by a cpu and being initialized
+    MOD_DONE,                       // initialized (or failed); its services are as available as they will get
+} ModState_t;
+
+
 //
 // -- we need to keep track (temporarily) of the `cr3` values for each module
 //    -----------------------------------------------------------------------
@@ -75,11 +87,37 @@ typedef struct ModuleInternal_t {
     Addr_t entries;
     Frame_t cr3Addr;
     bool loaded;
+    ModState_t state;
+    int depCnt;
+    int deps[MOD_MAX_DEPS];
+    uint64_t provides[MAX_HANDLERS / 64];
+    char name[MOD_NAME_LEN + 1];
 } ModuleInternal_t;
 
 ModuleInternal_t modInternal[MAX_MODS];
 
 
+//
+// -- The work queue for early init is the modInternal table itself, protected by this lock
+//    -------------------------------------------------------------------------------------
+static Spinlock_t modLock = {0};
+static AtomicInt_t modPending = {0};
+static AtomicInt_t modRemaining = {0};
+
+
+//
+// -- These internal services must be up before the APs can be started; their providers init on the BSP
+//    -------------------------------------------------------------------------------------------------
+static const int bootServices[] = {
+    INT_PMM_ALLOC,
+    INT_TMR_CURRENT_COUNT,
+    INT_TMR_REINIT,
+    INT_IPI_CURRENT_CPU,
+    INT_IPI_SEND_INIT,
+    INT_IPI_SEND_SIPI,
+};
+
+
 //
 // -- Check the module for validity
 //    -----------------------------
@@ -87,7 +125,7 @@ Module_t *ModuleCheck(Addr_t addr)
 {
     Module_t *rv = (Module_t *)addr;
 
-    kprintf("Checking Module for validity\n");
+    KLOG(MODULES, DEBUG, "Checking Module for validity\n");
 
     if (rv->sig[0]  != 'C') return NULL;
     if (rv->sig[1]  != 'e') return NULL;
@@ -106,13 +144,13 @@ Module_t *ModuleCheck(Addr_t addr)
     if (rv->sig[14] !=  0 ) return NULL;
     if (rv->sig[15] !=  0 ) return NULL;
 
-    kprintf(".. checking earlyInit function\n");
+    KLOG(MODULES, DEBUG, ".. checking earlyInit function\n");
     if (rv->earlyInit == 0) return NULL;
 
-    kprintf(".. checking published feature count\n");
+    KLOG(MODULES, DEBUG, ".. checking published feature count\n");
     if (rv->intCnt + rv->internalCnt + rv->osCnt == 0) return NULL;
 
-    kprintf(".. valid!\n");
+    KLOG(MODULES, DEBUG, ".. valid!\n");
 
     // -- we have a good module
     return rv;
@@ -120,124 +158,340 @@ Module_t *ModuleCheck(Addr_t addr)
 
 
 //
-// -- Find and perform the early initialization for each module
-//    ---------------------------------------------------------
-void ModuleEarlyInit()
+// -- Build the address space for a module, load its image, and record its services and dependencies
+//    ----------------------------------------------------------------------------------------------
+static void ModulePrepare(int i)
 {
     uint64_t *cr3 = (uint64_t *)0xfffffffffffff000;
-    uint64_t currentStack;
 
-//    kprintf("Checking recursive mapping %p\n", cr3[511]);
-//    kprintf("Checking kernel mapping %p\n", cr3[0x100]);
+    // -- assume the worst
+    modInternal[i].loaded = false;
+    modInternal[i].state = MOD_DONE;
+    modInternal[i].depCnt = 0;
+    kMemSetB(modInternal[i].provides, 0, sizeof(modInternal[i].provides));
+    kMemSetB(modInternal[i].name, 0, sizeof(modInternal[i].name));
 
-    for (int i = 0; i < loaderInterface->modCount; i ++) {
-//        kprintf("Module %d located at %p\n", i, loaderInterface->modAddr[i]);
+    // -- create a new page table structure
+    Frame_t cr3Frame = PmmAlloc();
+    modInternal[i].cr3Addr = cr3Frame << 12;
 
-        // -- create a new page table structure
-        Frame_t cr3Frame = PmmAlloc();
-        modInternal[i].cr3Addr = cr3Frame << 12;
+    MmuMapPage(modInternal[i].cr3Addr, cr3Frame, PG_WRT);       // This is identity mapped!
 
-//        kprintf("Preparing to map address %p to frame %p\n", modInternal[i].cr3Addr, cr3Frame);
+    KLOG(MODULES, DEBUG, "Mapping the module\n");
 
-        MmuMapPage(modInternal[i].cr3Addr, cr3Frame, PG_WRT);       // This is identity mapped!
+    uint64_t *t = (uint64_t *)(modInternal[i].cr3Addr);
+    for (int j = 0; j < 512; j ++) {
+        if ((j >= 0x100 && j < 0x140) || (j >= 0x1f0 && j < 0x1ff)) {   // -- kernel and stacks
+            t[j] = cr3[j];
+        } else t[j]  = 0;
+    }
 
-        kprintf("Mapping the module\n");
+    t[511] = ((uint64_t)t) | 0x003;
 
-        uint64_t *t = (uint64_t *)(modInternal[i].cr3Addr);
-        for (int j = 0; j < 512; j ++) {
-            if ((j >= 0x100 && j < 0x140) || (j >= 0x1f0 && j < 0x1ff)) {   // -- kernel and stacks
-                t[j] = cr3[j];
-            } else t[j]  = 0;
-        }
+    MmuUnmapPage(modInternal[i].cr3Addr);
 
-        t[511] = ((uint64_t)t) | 0x003;
+    Addr_t oldCr3 = LoadCr3(modInternal[i].cr3Addr);
 
-        MmuUnmapPage(modInternal[i].cr3Addr);
 
-//        kprintf("Loading new CR3 at frame %p (Addr %p)\n", cr3Frame, modInternal[i].cr3Addr);     // <-- this line fixes the problem
-        Addr_t oldCr3 = LoadCr3(modInternal[i].cr3Addr);
+    // -- Load the ELF image into the new CR3
+    Addr_t moduleAddr = loaderInterface->modAddr[i];
+    KLOG(MODULES, INFO, "Loading Module located at %p\n", moduleAddr);
+    KLOG(MODULES, DEBUG, ".. Old CR3: %p; New: %p\n", oldCr3, modInternal[i].cr3Addr);
 
+#if IS_ENABLED(MOD_DEMAND_PAGING)
+    modInternal[i].entries = ElfLoadImageDemand(moduleAddr);
+#else
+    modInternal[i].entries = ElfLoadImage(moduleAddr);
+#endif
+    KLOG(MODULES, DEBUG, ".. Elf Loaded\n");
 
-        // -- Load the ELF image into the new CR3
-        Addr_t moduleAddr = loaderInterface->modAddr[i];
-        kprintf("Loading Module located at %p\n", moduleAddr);
-        kprintf(".. Old CR3: %p; New: %p\n", oldCr3, modInternal[i].cr3Addr);
-        kprintf(".. Module Address is getting mapped to %p\n", moduleAddr);
 
-        kprintf(".. Image header mapped\n");
-        modInternal[i].entries = ElfLoadImage(moduleAddr);
-        kprintf(".. Elf Loaded\n");
+    // -- Now, check the module
+    Module_t *mod = ModuleCheck(modInternal[i].entries);
+    if (mod) {
+        KLOG(MODULES, INFO, ".. module name is %s\n", mod->name);
+        kMemMoveB(modInternal[i].name, mod->name, MOD_NAME_LEN);
 
+        unsigned long hookCnt = mod->intCnt + mod->internalCnt + mod->osCnt;
 
-        // -- Now, check the module
-        Module_t *mod = ModuleCheck(modInternal[i].entries);
-        if (mod) {
-            kprintf(".. module name is %s\n", mod->name);
-            EarlyInit_t init = (EarlyInit_t)mod->earlyInit;
-            kprintf(".. calling early init function at %p\n", (Addr_t)init);
-            int res = init(loaderInterface);
-            kprintf(".. early init completed\n");
+        for (unsigned long h = mod->intCnt; h < mod->intCnt + mod->internalCnt; h ++) {
+            if (mod->hooks[h].loc < MAX_HANDLERS) {
+                modInternal[i].provides[mod->hooks[h].loc / 64] |= (1ul << (mod->hooks[h].loc % 64));
+            }
 
-            modInternal[i].loaded = true;
+#if IS_ENABLED(MOD_DEMAND_PAGING)
+            // -- the PMM is needed to resolve page faults, so it can never take one itself
+            if (mod->hooks[h].loc == INT_PMM_ALLOC) {
+                KLOG(MODULES, INFO, ".. module provides the PMM; making it resident\n");
+                ElfMakeResident();
+            }
+#endif
+        }
 
-            // -- if we are not to load the module (non-zero return) then set the name to null
-            if (res) {
-                modInternal[i].loaded = false;
+        // -- the dependency list follows the hooks
+        uint64_t *deps = (uint64_t *)&mod->hooks[hookCnt];
+        for (unsigned long d = 0; d < mod->depCnt; d ++) {
+            if (modInternal[i].depCnt == MOD_MAX_DEPS) {
+                KLOG(MODULES, WARN, ".. too many dependencies; ignoring service %d\n", deps[d]);
+                continue;
             }
-        } else {
-            modInternal[i].loaded = false;
+
+            KLOG(MODULES, DEBUG, ".. depends on internal service %d\n", deps[d]);
+            modInternal[i].deps[modInternal[i].depCnt ++] = deps[d];
         }
 
+        modInternal[i].state = MOD_PENDING;
+        AtomicInc(&modPending);
+        AtomicInc(&modRemaining);
+    }
 
-        if (modInternal[i].loaded) {
-            currentStack = mod->stacksStart;
+    LoadCr3(oldCr3);
+}
 
-            kprintf(".. Hooking services: %d interrupts; %d internal functions; %d OS services\n", mod->intCnt, mod->internalCnt, mod->osCnt);
 
-            // -- Now install the hooks
-            unsigned long h;
-            for (h = 0; h < mod->intCnt; h ++) {
-                kprintf(".... Hooking Interrupt Vector %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
-                kprintf("...... stack at %p\n", currentStack);
+//
+// -- Is an internal service still waiting on its provider?  modLock must be held.
+//    ----------------------------------------------------------------------------
+static bool ModuleServicePending(int svc)
+{
+    if (svc < 0 || svc >= MAX_HANDLERS) return false;
 
-                if (currentStack) {
-                    cmn_MmuMapPage(currentStack, PmmAlloc(), PG_WRT);
-                    currentStack += MODULE_STACK_SIZE;
-                }
+    for (int i = 0; i < loaderInterface->modCount; i ++) {
+        if (modInternal[i].state == MOD_DONE) continue;
+        if (modInternal[i].provides[svc / 64] & (1ul << (svc % 64))) return true;
+    }
 
-                krn_SetVectorHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
-            }
+    return false;
+}
 
-            for ( ; h < mod->intCnt + mod->internalCnt; h ++) {
-                kprintf(".... Hooking Internal Function %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
-                kprintf("...... stack at %p\n", currentStack);
 
-                if (currentStack) {
-                    cmn_MmuMapPage(currentStack, PmmAlloc(), PG_WRT);
-                    currentStack += MODULE_STACK_SIZE;
-                }
+//
+// -- Can this module be initialized yet?  modLock must be held.
+//    ----------------------------------------------------------
+static bool ModuleReady(int i)
+{
+    if (modInternal[i].state != MOD_PENDING) return false;
 
-                krn_SetInternalHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
-            }
+    for (int d = 0; d < modInternal[i].depCnt; d ++) {
+        if (ModuleServicePending(modInternal[i].deps[d])) return false;
+    }
 
-            for ( ; h < mod->intCnt + mod->internalCnt + mod->osCnt; h ++) {
-                kprintf(".... Hooking OS Service %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
-                kprintf("...... stack at %p\n", currentStack);
+    return true;
+}
 
-                if (currentStack) {
-                    cmn_MmuMapPage(currentStack, PmmAlloc(), PG_WRT);
-                    currentStack += MODULE_STACK_SIZE;
-                }
 
-                krn_SetServiceHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
+//
+// -- Does this module provide something the APs need to start?
+//    ---------------------------------------------------------
+static bool ModuleProvidesBoot(int i)
+{
+    for (size_t s = 0; s < sizeof(bootServices) / sizeof(bootServices[0]); s ++) {
+        int svc = bootServices[s];
+        if (modInternal[i].provides[svc / 64] & (1ul << (svc % 64))) return true;
+    }
+
+    return false;
+}
+
+
+//
+// -- Are all the services needed to start the APs available?
+//    -------------------------------------------------------
+static bool ModuleBootReady(void)
+{
+    bool rv = true;
+
+    SpinLock(&modLock);
+    for (size_t s = 0; s < sizeof(bootServices) / sizeof(bootServices[0]); s ++) {
+        if (ModuleServicePending(bootServices[s])) {
+            rv = false;
+            break;
+        }
+    }
+    SpinUnlock(&modLock);
+
+    return rv;
+}
+
+
+//
+// -- Claim the next module to initialize, preferring those the APs need to start; -1 if nothing is ready
+//    ---------------------------------------------------------------------------------------------------
+static int ModuleClaim(void)
+{
+    int rv = -1;
+    bool running = false;
+
+    SpinLock(&modLock);
+
+    for (int i = 0; i < loaderInterface->modCount; i ++) {
+        if (modInternal[i].state == MOD_RUNNING) running = true;
+        if (!ModuleReady(i)) continue;
+
+        if (rv == -1 || (!ModuleProvidesBoot(rv) && ModuleProvidesBoot(i))) rv = i;
+    }
+
+    // -- nothing ready and nothing running to make it ready: this is a dependency cycle, so break it
+    if (rv == -1 && !running) {
+        for (int i = 0; i < loaderInterface->modCount; i ++) {
+            if (modInternal[i].state == MOD_PENDING) {
+                KLOG(MODULES, WARN, "Module %d has a circular dependency; initializing it anyway\n", i);
+                rv = i;
+                break;
             }
-        } else {
-            // -- unload the module
+        }
+    }
+
+    if (rv != -1) {
+        modInternal[rv].state = MOD_RUNNING;
+        AtomicDec(&modPending);
+    }
+
+    SpinUnlock(&modLock);
+
+    return rv;
+}
+
+
+//
+// -- Perform the early init for a claimed module on this cpu and hook its services
+//    -----------------------------------------------------------------------------
+static void ModuleRun(int i)
+{
+    uint64_t currentStack;
+    Addr_t oldCr3 = LoadCr3(modInternal[i].cr3Addr);
+    Module_t *mod = (Module_t *)modInternal[i].entries;
+
+    char label[BOOT_TRACE_LABEL_LEN];
+    ksprintf(label, "init %.16s", mod->name);
+    BootTraceMark(loaderInterface, label);
+
+    EarlyInit_t init = (EarlyInit_t)mod->earlyInit;
+    KLOG(MODULES, INFO, "CPU %d: calling early init function for %s at %p\n", ThisCpu()->cpuNum, mod->name, (Addr_t)init);
+    int res = init(loaderInterface);
+    KLOG(MODULES, INFO, ".. early init for %s completed\n", mod->name);
+
+    ksprintf(label, "done %.16s", mod->name);
+    BootTraceMark(loaderInterface, label);
+
+    // -- if we are not to load the module (non-zero return) then it is not loaded
+    modInternal[i].loaded = (res == 0);
+
+
+    if (modInternal[i].loaded) {
+        currentStack = mod->stacksStart;
+
+        KLOG(MODULES, DEBUG, ".. Hooking services: %d interrupts; %d internal functions; %d OS services\n", mod->intCnt, mod->internalCnt, mod->osCnt);
+
+        // -- each hook gets its own stack page; map them all at once
+        size_t hookCnt = mod->intCnt + mod->internalCnt + mod->osCnt;
+        if (currentStack && hookCnt) {
+            cmn_MmuMapRange(currentStack, PmmAllocAligned(false, 12, hookCnt), hookCnt, PG_WRT);
+        }
+
+        // -- Now install the hooks
+        unsigned long h;
+        for (h = 0; h < mod->intCnt; h ++) {
+            KLOG(MODULES, DEBUG, ".... Hooking Interrupt Vector %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
+            KLOG(MODULES, DEBUG, "...... stack at %p\n", currentStack);
+
+            if (currentStack) currentStack += MODULE_STACK_SIZE;
+
+            krn_SetVectorHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
+        }
+
+        for ( ; h < mod->intCnt + mod->internalCnt; h ++) {
+            KLOG(MODULES, DEBUG, ".... Hooking Internal Function %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
+            KLOG(MODULES, DEBUG, "...... stack at %p\n", currentStack);
+
+            if (currentStack) currentStack += MODULE_STACK_SIZE;
+
+            krn_SetInternalHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
         }
 
+        for ( ; h < mod->intCnt + mod->internalCnt + mod->osCnt; h ++) {
+            KLOG(MODULES, DEBUG, ".... Hooking OS Service %d: %p from %p\n", mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr);
+            KLOG(MODULES, DEBUG, "...... stack at %p\n", currentStack);
 
-        // -- Clean up from loading the module
-        LoadCr3(oldCr3);
+            if (currentStack) currentStack += MODULE_STACK_SIZE;
+
+            krn_SetServiceHandler(mod->hooks[h].loc, mod->hooks[h].target, modInternal[i].cr3Addr, currentStack);
+        }
+    } else {
+        // -- unload the module
+    }
+
+
+    // -- Clean up from loading the module
+    LoadCr3(oldCr3);
+
+    // -- the hooks are in place; release anything waiting on this module's services
+    SpinLock(&modLock);
+    modInternal[i].state = MOD_DONE;
+    SpinUnlock(&modLock);
+    AtomicDec(&modRemaining);
+}
+
+
+//
+// -- Find and perform the early initialization for each module
+//
+//    All modules are loaded here on the BSP.  Then the BSP initializes modules in dependency order until
+//    the services needed to start the APs are available.  The rest are left for ModuleInitWorker().
+//    ---------------------------------------------------------------------------------------------------
+void ModuleEarlyInit()
+{
+    BootTraceMark(loaderInterface, "loading modules");
+
+    for (int i = 0; i < loaderInterface->modCount; i ++) {
+        ModulePrepare(i);
+    }
+
+    BootTraceMark(loaderInterface, "modules loaded");
+
+#if IS_ENABLED(MOD_PARALLEL_INIT)
+    while (AtomicRead(&modPending) && !ModuleBootReady()) {
+#else
+    while (AtomicRead(&modPending)) {
+#endif
+        int i = ModuleClaim();
+        if (i == -1) break;
+
+        ModuleRun(i);
+    }
+}
+
+
+//
+// -- Help initialize the remaining modules; returns once there is nothing left to claim
+//
+//    Each cpu calls this with interrupts still disabled, since a module's early init runs in that module's
+//    address space and must not be rescheduled away from it.
+//    -----------------------------------------------------------------------------------------------------
+void ModuleInitWorker(void)
+{
+    while (AtomicRead(&modPending)) {
+        int i = ModuleClaim();
+
+        if (i == -1) {
+            NOP();
+            continue;
+        }
+
+        ModuleRun(i);
+    }
+}
+
+
+//
+// -- The BSP joins the remaining work and then waits for every module's early init to complete
+//    -----------------------------------------------------------------------------------------
+void ModuleInitComplete(void)
+{
+    ModuleInitWorker();
+
+    while (AtomicRead(&modRemaining)) {
+        NOP();
     }
 }
 
@@ -250,7 +504,7 @@ void ModuleLateInit(void)
     SchedulerLateInit();
 
     for (int i = 0; i < loaderInterface->modCount; i ++) {
-        kprintf("Checking module %d\n", i);
+        KLOG(MODULES, DEBUG, "Checking module %d\n", i);
         if (modInternal[i].loaded) {
             Addr_t oldCr3 = LoadCr3(modInternal[i].cr3Addr);
             Addr_t moduleAddr = loaderInterface->modAddr[i];
@@ -258,7 +512,7 @@ void ModuleLateInit(void)
             Module_t *mod = ModuleCheck(modInternal[i].entries);
 
             if (mod->lateInit) {
-                kprintf("Performing the Late initialization for module %s\n",mod->name);
+                KLOG(MODULES, INFO, "Performing the Late initialization for module %s\n",mod->name);
 
                 LateInit_t init = (LateInit_t)mod->lateInit;
                 init();
@@ -269,3 +523,20 @@ void ModuleLateInit(void)
     }
 }
 
+
+
+//
+// -- Report the name, address space and ELF image of a loaded module, so addresses can be resolved to symbols
+//    --------------------------------------------------------------------------------------------------------
+Return_t ModuleInfo(int i, const char **name, Addr_t *cr3, Addr_t *image)
+{
+    if (i < 0 || i >= loaderInterface->modCount) return -EINVAL;
+    if (!modInternal[i].loaded) return -EINVAL;
+
+    if (name) *name = modInternal[i].name;
+    if (cr3) *cr3 = modInternal[i].cr3Addr;
+    if (image) *image = loaderInterface->modAddr[i];
+
+    return 0;
+}
+
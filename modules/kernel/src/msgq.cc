@@ -0,0 +1,326 @@
+//====================================================================================================================
+//
+//  msgq.cc -- Message queues between processes
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  A message is a type and MSGQ_WORDS words, copied into a ring in the queue, so a send never allocates for a
+//  small message.  A larger payload is moved rather than copied: the sender's pages are unmapped on every cpu as it
+//  sends and their frames mapped for the receiver where it asks, so the data is never touched.
+//
+//  A receiver with nothing to receive blocks in PROC_MSGW on the queue's waiting list.  A send to a queue with a
+//  waiting receiver hands the receiver this cpu at once (`sch_ProcessHandoff()`), without a trip through the
+//  ready queues.  A send never waits; a full queue is -EAGAIN.
+//
+//  The scheduler lock is taken before the queue lock, and a sender drops the queue lock before unblocking a
+//  receiver, so a receiver is always blocked before it can be woken.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "heap.h"
+#include "mmu.h"
+#include "lists.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+#include "msgq.h"
+
+
+
+//
+// -- The Butler's queue, created when kInit takes on the Butler role
+//    ---------------------------------------------------------------
+MessageQueue_t *butlerMsgq = NULL;
+
+
+
+//
+// -- Give back the frames of pages nobody will receive
+//    -------------------------------------------------
+static void MsgqReleaseFrames(MsgqSlot_t *slot)
+{
+    if (!slot->frames) return;
+
+    for (size_t i = 0; i < slot->pageCount; i ++) PmmRelease(slot->frames[i]);
+
+    HeapFree(slot->frames);
+    slot->frames = NULL;
+}
+
+
+
+//
+// -- Free a queue no process references any longer, with the messages left in it
+//    ---------------------------------------------------------------------------
+static void MsgqFree(MessageQueue_t *q)
+{
+    assert(IsListEmpty(&q->waiting));
+
+    for (uint64_t i = q->head; i != q->tail; i ++) MsgqReleaseFrames(&q->ring[i % MSGQ_DEPTH]);
+
+    HeapFree(q);
+}
+
+
+
+//
+// -- Create a message queue, referenced by the current process
+//    ---------------------------------------------------------
+MessageQueue_t *krn_MsgqCreate(void)
+{
+    Process_t *proc = CurrentThread();
+    if (!assert(proc != NULL)) return NULL;
+
+    MessageQueue_t *q = NEW(MessageQueue_t);
+    Reference_t *ref = NEW(Reference_t);
+
+    if (!q || !ref) {
+        if (q) FREE(q);
+        if (ref) FREE(ref);
+        return NULL;
+    }
+
+    kMemSetB(q, 0, sizeof(MessageQueue_t));
+    ListInit(&q->waiting.list);
+    ListInit(&q->refBy.list);
+
+    ref->type = REF_MSGQ;
+    ref->resAddr = q;
+    ref->process = proc;
+    ListInit(&ref->procRefList);
+    ListInit(&ref->resourceRefBy);
+
+    ProcessLockAndPostpone();
+    ListAddTail(&proc->references, &ref->procRefList);
+    ListAddTail(&q->refBy, &ref->resourceRefBy);
+    ProcessUnlockAndSchedule();
+
+    return q;
+}
+
+
+
+//
+// -- Drop one reference to a queue, returning the queue when that was the last one; the scheduler is locked
+//    ------------------------------------------------------------------------------------------------------
+static MessageQueue_t *MsgqDropReference(Reference_t *ref)
+{
+    MessageQueue_t *q = (MessageQueue_t *)ref->resAddr;
+
+    ListRemoveInit(&ref->procRefList);
+    ListRemoveInit(&ref->resourceRefBy);
+    FREE(ref);
+
+    return IsListEmpty(&q->refBy) ? q : NULL;
+}
+
+
+
+//
+// -- Drop the current process's reference to a queue, freeing the queue with the last one
+//    ------------------------------------------------------------------------------------
+Return_t krn_MsgqRelease(MessageQueue_t *q)
+{
+    Process_t *proc = CurrentThread();
+    if (!q || !proc) return -EINVAL;
+
+    MessageQueue_t *dead = NULL;
+    Return_t rv = -EINVAL;
+
+    ProcessLockAndPostpone();
+
+    ListHead_t::List_t *wrk = q->refBy.list.next;
+    while (wrk != &q->refBy.list) {
+        Reference_t *ref = FIND_PARENT(wrk, Reference_t, resourceRefBy);
+
+        if (ref->process == proc) {
+            dead = MsgqDropReference(ref);
+            rv = 0;
+            break;
+        }
+
+        wrk = wrk->next;
+    }
+
+    ProcessUnlockAndSchedule();
+
+    if (dead) MsgqFree(dead);
+
+    return rv;
+}
+
+
+
+//
+// -- Drop every queue reference an ended process still holds; called by the Butler
+//    -----------------------------------------------------------------------------
+void MsgqReleaseProcess(Process_t *proc)
+{
+    while (true) {
+        MessageQueue_t *dead = NULL;
+        bool found = false;
+
+        ProcessLockAndPostpone();
+
+        ListHead_t::List_t *wrk = proc->references.list.next;
+        while (wrk != &proc->references.list) {
+            Reference_t *ref = FIND_PARENT(wrk, Reference_t, procRefList);
+
+            if (ref->type == REF_MSGQ) {
+                dead = MsgqDropReference(ref);
+                found = true;
+                break;
+            }
+
+            wrk = wrk->next;
+        }
+
+        ProcessUnlockAndSchedule();
+
+        if (dead) MsgqFree(dead);
+        if (!found) return;
+    }
+}
+
+
+
+//
+// -- Send a message, moving any pages it names out of the sender's address space
+//    ---------------------------------------------------------------------------
+Return_t krn_MsgqSend(MessageQueue_t *q, Message_t *msg)
+{
+    if (!q || !msg) return -EINVAL;
+    if (msg->pageCount > MSGQ_MAX_PAGES) return -EINVAL;
+    if (msg->pageCount && (msg->pages & (PAGE_SIZE - 1))) return -EINVAL;
+
+    Frame_t *frames = NULL;
+
+    if (msg->pageCount) {
+        frames = (Frame_t *)HeapAlloc(sizeof(Frame_t) * msg->pageCount, false);
+        if (!frames) return -ENOMEM;
+
+        for (size_t i = 0; i < msg->pageCount; i ++) {
+            frames[i] = krn_MmuFrame(msg->pages + (i * PAGE_SIZE));
+
+            if (frames[i] == 0) {
+                HeapFree(frames);
+                return -EFAULT;
+            }
+        }
+
+        // -- the receiver may map them as soon as the message is in the ring, so no cpu may still reach them
+        cmn_MmuUnmapRange(msg->pages, msg->pageCount);
+        krn_MmuShootdown(msg->pages, msg->pageCount);
+    }
+
+    Process_t *sender = CurrentThread();
+    Process_t *waiter = NULL;
+    bool full = false;
+
+    SpinLock(&q->lock); {
+        if (q->tail - q->head == MSGQ_DEPTH) {
+            full = true;
+        } else {
+            MsgqSlot_t *slot = &q->ring[q->tail % MSGQ_DEPTH];
+
+            slot->type = msg->type;
+            for (int i = 0; i < MSGQ_WORDS; i ++) slot->data[i] = msg->data[i];
+            slot->sender = sender ? sender->pid : 0;
+            slot->pageCount = msg->pageCount;
+            slot->frames = frames;
+            q->tail ++;
+
+            if (!IsListEmpty(&q->waiting)) {
+                waiter = FIND_PARENT(q->waiting.list.next, Process_t, stsQueue);
+                ListRemoveInit(&waiter->stsQueue);
+            }
+        }
+    } SpinUnlock(&q->lock);
+
+    if (full) {
+        for (size_t i = 0; i < msg->pageCount; i ++) {
+            cmn_MmuMapPage(msg->pages + (i * PAGE_SIZE), frames[i], PG_WRT);
+        }
+
+        if (frames) HeapFree(frames);
+
+        return -EAGAIN;
+    }
+
+    if (waiter) sch_ProcessHandoff(waiter);
+
+    return 0;
+}
+
+
+
+//
+// -- Receive the next message, mapping any pages it carries at `msg->pages` (or releasing them when that is 0)
+//    ---------------------------------------------------------------------------------------------------------
+Return_t krn_MsgqReceive(MessageQueue_t *q, Message_t *msg, bool block)
+{
+    if (!q || !msg) return -EINVAL;
+
+    MsgqSlot_t slot;
+
+    while (true) {
+        bool received = false;
+
+        ProcessLockAndPostpone();
+        SpinLock(&q->lock);
+
+        if (q->head != q->tail) {
+            slot = q->ring[q->head % MSGQ_DEPTH];
+            q->head ++;
+            received = true;
+        } else if (block && CurrentThread() != NULL) {
+            Enqueue(&q->waiting, &CurrentThread()->stsQueue);
+        }
+
+        SpinUnlock(&q->lock);
+
+        if (received) {
+            ProcessUnlockAndSchedule();
+            break;
+        }
+
+        if (!block || CurrentThread() == NULL) {
+            ProcessUnlockAndSchedule();
+            return -EAGAIN;
+        }
+
+        sch_ProcessBlock(PROC_MSGW);
+        ProcessUnlockAndSchedule();             // -- the switch away happens here
+    }
+
+    msg->type = slot.type;
+    for (int i = 0; i < MSGQ_WORDS; i ++) msg->data[i] = slot.data[i];
+    msg->sender = slot.sender;
+
+    if (slot.pageCount == 0) {
+        msg->pageCount = 0;
+    } else if (msg->pages == 0 || (msg->pages & (PAGE_SIZE - 1))) {
+        MsgqReleaseFrames(&slot);
+        msg->pageCount = 0;
+    } else {
+        for (size_t i = 0; i < slot.pageCount; i ++) {
+            cmn_MmuMapPage(msg->pages + (i * PAGE_SIZE), slot.frames[i], PG_WRT);
+        }
+
+        HeapFree(slot.frames);
+        msg->pageCount = slot.pageCount;
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,596 @@
+//====================================================================================================================
+//
+//  pmu.cc -- Per-cpu performance counters, virtualized per process and attributed to internal services
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  The architectural PMU (version 2 or better) counts cycles, instructions retired, LLC misses, dTLB misses and
+//  branch misses.  Instructions use fixed counter 0 and the rest use general purpose counters 0-3; fixed counter
+//  1 belongs to the profiler, so each register is only ever updated for the bits used here.
+//
+//  The counters run freely.  Each cpu keeps the value it last charged to a process, and the difference is added
+//  to the outgoing process at each process switch.  So a process's counts only include the time it was running,
+//  and this is also true of the counts taken on entry to and exit from an internal service, which are how the
+//  cost of a call (including any address space switch into a module) is measured.
+//
+//  A request to change the events is made on one cpu; the others program their counters on their next timer
+//  tick.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-24  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+#include "internals.h"
+#include "scheduler.h"
+#include "stacks.h"
+#include "pmu.h"
+
+
+
+#if IS_ENABLED(PMU_COUNTERS)
+
+
+//
+// -- The architectural PMU registers
+//    -------------------------------
+#define IA32_PERFEVTSEL0            0x186
+#define IA32_FIXED_CTR_CTRL         0x38d
+#define IA32_PERF_GLOBAL_CTRL       0x38f
+
+#define EVTSEL_USR                  (1 << 16)
+#define EVTSEL_OS                   (1 << 17)
+#define EVTSEL_EN                   (1 << 22)
+
+#define FIXED_CTRL_OS_USR           0x3ul       // count in rings 0 and 3, no interrupt
+#define FIXED_CTRL_MASK             0xful
+#define RDPMC_FIXED                 (1u << 30)
+
+
+//
+// -- How each event is counted
+//    -------------------------
+typedef struct PmuEvent_t {
+    const char *name;
+    bool fixed;                                 // a fixed counter rather than a general purpose counter
+    int counter;
+    uint32_t select;                            // event | umask << 8, for a general purpose counter
+    int archBit;                                // the CPUID.0AH:EBX bit set when the event is unavailable, or -1
+} PmuEvent_t;
+
+
+//
+// -- In PMU_EVT_* order
+//    ------------------
+static const PmuEvent_t pmuEventDefs[PMU_EVENT_COUNT] = {
+    { "cycles",         false,  0,  0x003c,             0 },
+    { "instructions",   true,   0,  0,                  1 },
+    { "llc-misses",     false,  1,  0x412e,             4 },
+    { "dtlb-misses",    false,  2,  PMU_DTLB_EVENT,     -1 },
+    { "branch-misses",  false,  3,  0x00c5,             6 },
+};
+
+
+//
+// -- The state of the counters on a cpu; only that cpu reads or writes it
+//    --------------------------------------------------------------------
+typedef struct PmuCpu_t {
+    uint64_t gen;                               // the request generation this cpu has programmed
+    uint64_t events;                            // the events this cpu is counting
+    uint64_t base[PMU_EVENT_COUNT];             // the counter values last charged to a process
+} __attribute__((aligned(64))) PmuCpu_t;
+
+
+//
+// -- The counts accumulated by an internal service
+//    ---------------------------------------------
+typedef struct PmuSvcStat_t {
+    uint64_t calls;
+    uint64_t counts[PMU_EVENT_COUNT];
+} PmuSvcStat_t;
+
+
+//
+// -- The counter state
+//    -----------------
+static PmuCpu_t pmuCpus[MAX_CPU];
+static PmuSvcStat_t pmuSvc[MAX_HANDLERS];
+static volatile bool pmuReady = false;          // there is a PMU and `ThisCpu()` is valid on every cpu
+static uint64_t pmuAvailable = 0;               // the events this PMU can count
+static volatile uint64_t pmuEvents = 0;         // the events requested
+static volatile uint64_t pmuGen = 0;            // incremented with each request
+static uint64_t pmuGpMask = 0;
+static uint64_t pmuFixedMask = 0;
+
+extern ServiceRoutine_t internalTable[MAX_HANDLERS];
+
+
+
+//
+// -- Read a counter
+//    --------------
+static inline uint64_t RDPMC(uint32_t c)
+{
+    uint32_t lo, hi;
+    __asm volatile ("rdpmc" : "=a"(lo), "=d"(hi) : "c"(c) : "memory");
+    return (((uint64_t)hi) << 32) | lo;
+}
+
+
+//
+// -- Read the counter for an event; the result is masked to the width of the counter
+//    -------------------------------------------------------------------------------
+static inline uint64_t PmuCounter(int e)
+{
+    const PmuEvent_t *ev = &pmuEventDefs[e];
+
+    if (ev->fixed) return RDPMC(RDPMC_FIXED | ev->counter) & pmuFixedMask;
+    else return RDPMC(ev->counter) & pmuGpMask;
+}
+
+
+//
+// -- The counts since `base`, allowing for the counter wrapping
+//    ----------------------------------------------------------
+static inline uint64_t PmuDelta(int e, uint64_t now, uint64_t base)
+{
+    return (now - base) & (pmuEventDefs[e].fixed ? pmuFixedMask : pmuGpMask);
+}
+
+
+//
+// -- The enable bit for an event in IA32_PERF_GLOBAL_CTRL
+//    ----------------------------------------------------
+static inline uint64_t PmuGlobalBit(int e)
+{
+    const PmuEvent_t *ev = &pmuEventDefs[e];
+    return 1ul << (ev->fixed ? 32 + ev->counter : ev->counter);
+}
+
+
+//
+// -- Charge a process with the counts since the last charge on this cpu; `proc` may be NULL to discard them
+//    ------------------------------------------------------------------------------------------------------
+static void PmuAccount(PmuCpu_t *c, Process_t *proc)
+{
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) {
+        if ((c->events & (1ul << e)) == 0) continue;
+
+        uint64_t now = PmuCounter(e);
+        if (proc) proc->pmuCounts[e] += PmuDelta(e, now, c->base[e]);
+        c->base[e] = now;
+    }
+}
+
+
+//
+// -- The count for a process, including the time it has been running on this cpu
+//    ---------------------------------------------------------------------------
+static inline uint64_t PmuCount(PmuCpu_t *c, Process_t *proc, int e)
+{
+    uint64_t rv = proc->pmuCounts[e];
+
+    if (c->events & (1ul << e)) rv += PmuDelta(e, PmuCounter(e), c->base[e]);
+
+    return rv;
+}
+
+
+//
+// -- Program this cpu's counters for a set of events
+//    -----------------------------------------------
+static void PmuProgram(PmuCpu_t *c, uint64_t events)
+{
+    uint64_t global = RDMSR(IA32_PERF_GLOBAL_CTRL);
+
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) global &= ~PmuGlobalBit(e);
+    WRMSR(IA32_PERF_GLOBAL_CTRL, global);
+
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) {
+        const PmuEvent_t *ev = &pmuEventDefs[e];
+        bool on = (events & (1ul << e)) != 0;
+
+        if (ev->fixed) {
+            uint64_t ctrl = RDMSR(IA32_FIXED_CTR_CTRL) & ~(FIXED_CTRL_MASK << (ev->counter * 4));
+            if (on) ctrl |= FIXED_CTRL_OS_USR << (ev->counter * 4);
+            WRMSR(IA32_FIXED_CTR_CTRL, ctrl);
+        } else {
+            WRMSR(IA32_PERFEVTSEL0 + ev->counter, on ? ev->select | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN : 0);
+        }
+
+        if (on) {
+            global |= PmuGlobalBit(e);
+            c->base[e] = PmuCounter(e);
+        }
+    }
+
+    c->events = events;
+    WRMSR(IA32_PERF_GLOBAL_CTRL, global);
+}
+
+
+//
+// -- Bring this cpu up to date with the latest request, charging the current process with the old events
+//    ---------------------------------------------------------------------------------------------------
+static void PmuUpdate(PmuCpu_t *c)
+{
+    uint64_t gen = pmuGen;
+    if (c->gen == gen) return;
+
+    PmuAccount(c, CurrentThread());
+    PmuProgram(c, pmuEvents);
+    c->gen = gen;
+}
+
+
+//
+// -- The current process is being switched out on this cpu
+//    -----------------------------------------------------
+void PmuSwitch(Process_t *from)
+{
+    if (!pmuReady) return;
+
+    PmuAccount(&pmuCpus[ThisCpu()->cpuNum], from);
+}
+
+
+//
+// -- Called from the timer vector on each cpu
+//    ----------------------------------------
+void PmuTick(void)
+{
+    if (!pmuReady) return;
+
+    PmuUpdate(&pmuCpus[ThisCpu()->cpuNum]);
+}
+
+
+//
+// -- An internal service is being called; note the counts of the calling process
+//    ---------------------------------------------------------------------------
+void PmuServiceEnter(void)
+{
+    if (!pmuReady) return;
+
+    Process_t *proc = CurrentThread();
+    if (!proc) return;
+
+    int d = proc->pmuSvcDepth ++;
+    if (d >= PMU_SVC_DEPTH) return;
+
+    PmuCpu_t *c = &pmuCpus[ThisCpu()->cpuNum];
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) proc->pmuSvcStart[d][e] = PmuCount(c, proc, e);
+}
+
+
+//
+// -- An internal service has returned; charge it with what it cost the process.  The process may have blocked
+//    in the service, but its counts do not include the time other processes ran.
+//    --------------------------------------------------------------------------------------------------------
+void PmuServiceExit(uint64_t svc)
+{
+    if (!pmuReady) return;
+
+    Process_t *proc = CurrentThread();
+    if (!proc || proc->pmuSvcDepth == 0) return;            // called before the counters were ready
+
+    int d = -- proc->pmuSvcDepth;
+    if (d >= PMU_SVC_DEPTH || svc >= MAX_HANDLERS) return;
+
+    PmuCpu_t *c = &pmuCpus[ThisCpu()->cpuNum];
+    PmuSvcStat_t *s = &pmuSvc[svc];
+
+    __atomic_fetch_add(&s->calls, 1, __ATOMIC_RELAXED);
+
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) {
+        uint64_t delta = PmuCount(c, proc, e) - proc->pmuSvcStart[d][e];
+        if (delta) __atomic_fetch_add(&s->counts[e], delta, __ATOMIC_RELAXED);
+    }
+}
+
+
+//
+// -- Internal service: count a set of events on every cpu, starting with this one
+//    ----------------------------------------------------------------------------
+Return_t pmu_Control(uint64_t events)
+{
+    if (!pmuReady) return -ENODEV;
+
+    events &= pmuAvailable;
+    pmuEvents = events;
+    __atomic_fetch_add(&pmuGen, 1, __ATOMIC_SEQ_CST);
+
+    PmuUpdate(&pmuCpus[ThisCpu()->cpuNum]);
+
+    return events;
+}
+
+
+//
+// -- Internal service: the free-running counter for an event on this cpu; 0 when it is not being counted
+//    ---------------------------------------------------------------------------------------------------
+uint64_t pmu_Read(int event)
+{
+    if (!pmuReady || event < 0 || event >= PMU_EVENT_COUNT) return 0;
+    if ((pmuCpus[ThisCpu()->cpuNum].events & (1ul << event)) == 0) return 0;
+
+    return PmuCounter(event);
+}
+
+
+//
+// -- Internal service: the count for an event accumulated by the calling process
+//    ---------------------------------------------------------------------------
+uint64_t pmu_ProcessCount(int event)
+{
+    if (!pmuReady || event < 0 || event >= PMU_EVENT_COUNT) return 0;
+
+    Process_t *proc = CurrentThread();
+    if (!proc) return 0;
+
+    return PmuCount(&pmuCpus[ThisCpu()->cpuNum], proc, event);
+}
+
+
+//
+// -- Check for a usable PMU; this is called once all the cpus are running
+//    --------------------------------------------------------------------
+void PmuInit(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    CPUID(0, &eax, &ebx, &ecx, &edx);
+    if (eax < 0xa) return;
+
+    CPUID(0xa, &eax, &ebx, &ecx, &edx);
+
+    int version = eax & 0xff;
+    int gpCnt = (eax >> 8) & 0xff;
+    int gpWidth = (eax >> 16) & 0xff;
+    int archLen = (eax >> 24) & 0xff;
+    int fixedCnt = edx & 0x1f;
+    int fixedWidth = (edx >> 5) & 0xff;
+
+    // -- the global control register needs version 2
+    if (version < 2 || gpWidth == 0 || gpWidth >= 64 || fixedWidth >= 64) return;
+
+    pmuGpMask = (1ul << gpWidth) - 1;
+    pmuFixedMask = (1ul << fixedWidth) - 1;
+
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) {
+        const PmuEvent_t *ev = &pmuEventDefs[e];
+
+        if (ev->fixed && (ev->counter >= fixedCnt || fixedWidth == 0)) continue;
+        if (!ev->fixed && ev->counter >= gpCnt) continue;
+        if (ev->archBit >= 0 && (ev->archBit >= archLen || (ebx & (1 << ev->archBit)))) continue;
+
+        pmuAvailable |= (1ul << e);
+    }
+
+    kprintf("PMU: version %d, %d general purpose counters; events available %p\n", version, gpCnt, pmuAvailable);
+
+    if (pmuAvailable) pmuReady = true;
+}
+
+
+
+#if IS_ENABLED(KERNEL_DEBUGGER)
+
+#include "debugger.h"
+
+
+//
+// -- Format an internal service number as it appears in `constants`
+//    --------------------------------------------------------------
+static void PmuSvcName(char *buf, int svc)
+{
+    const char *hex = "0123456789abcdef";
+
+    buf[0] = '0';
+    buf[1] = 'x';
+    buf[2] = hex[(svc >> 8) & 0xf];
+    buf[3] = hex[(svc >> 4) & 0xf];
+    buf[4] = hex[svc & 0xf];
+    buf[5] = 0;
+}
+
+
+//
+// -- Report the counts for each process; the running processes are only charged up to their last switch
+//    --------------------------------------------------------------------------------------------------
+void DebugPmuProcesses(void)
+{
+    char buf[100];
+
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+    DbgOutput("+--------+------------------+--------------+--------------+------------+------------+------------+\n");
+    DbgOutput("| PID    | Command          |       Cycles | Instructions | LLC Misses | dTLB Misses| Br Misses  |\n");
+    DbgOutput("+--------+------------------+--------------+--------------+------------+------------+------------+\n");
+
+    ListHead_t::List_t *wrk = scheduler.globalProcesses.list.next;
+
+    while (wrk != &scheduler.globalProcesses.list) {
+        Process_t *proc = FIND_PARENT(wrk, Process_t, globalList);
+        uint64_t *n = proc->pmuCounts;
+
+        ksprintf(buf, "| %-6ld | %-16.16s | %12ld | %12ld ", (long)proc->pid, proc->command,
+                n[PMU_EVT_CYCLES], n[PMU_EVT_INSTRUCTIONS]);
+        DbgOutput(buf);
+        ksprintf(buf, "| %10ld | %10ld | %10ld |\n", n[PMU_EVT_LLC_MISSES], n[PMU_EVT_DTLB_MISSES],
+                n[PMU_EVT_BRANCH_MISSES]);
+        DbgOutput(buf);
+
+        wrk = wrk->next;
+    }
+
+    DbgOutput("+--------+------------------+--------------+--------------+------------+------------+------------+\n");
+}
+
+
+//
+// -- Report the average cost of each internal service which has been called; `*` marks a service which runs in
+//    a module's address space
+//    ---------------------------------------------------------------------------------------------------------
+void DebugPmuServices(void)
+{
+    char buf[100];
+    char svc[6];
+
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+    DbgOutput("Average counts per call (* switches cr3 into a module)\n");
+    DbgOutput("+--------+------------+------------+------------+----------+----------+----------+\n");
+    DbgOutput("| Svc    |      Calls |     Cycles |     Instrs | LLC Miss | dTLB Miss| Br Miss  |\n");
+    DbgOutput("+--------+------------+------------+------------+----------+----------+----------+\n");
+
+    for (int i = 0; i < MAX_HANDLERS; i ++) {
+        PmuSvcStat_t *s = &pmuSvc[i];
+        uint64_t calls = s->calls;
+
+        if (calls == 0) continue;
+
+        PmuSvcName(svc, i);
+        ksprintf(buf, "| %s%s | %10ld | %10ld ", svc, internalTable[i].cr3 ? " *" : "  ", calls,
+                s->counts[PMU_EVT_CYCLES] / calls);
+        DbgOutput(buf);
+        ksprintf(buf, "| %10ld | %8ld | %8ld ", s->counts[PMU_EVT_INSTRUCTIONS] / calls,
+                s->counts[PMU_EVT_LLC_MISSES] / calls, s->counts[PMU_EVT_DTLB_MISSES] / calls);
+        DbgOutput(buf);
+        ksprintf(buf, "| %8ld |\n", s->counts[PMU_EVT_BRANCH_MISSES] / calls);
+        DbgOutput(buf);
+    }
+
+    DbgOutput("+--------+------------+------------+------------+----------+----------+----------+\n");
+}
+
+
+//
+// -- Start counting all the available events, clearing the service counts
+//    --------------------------------------------------------------------
+void DebugPmuStart(void)
+{
+    char buf[100];
+
+    kMemSetB(pmuSvc, 0, sizeof(pmuSvc));
+    Return_t rv = pmu_Control(pmuAvailable);
+
+    for (int e = 0; e < PMU_EVENT_COUNT; e ++) {
+        ksprintf(buf, "  %-16s %s\n", pmuEventDefs[e].name, (rv & (1ul << e)) ? "counting" : "not available");
+        DbgOutput(buf);
+    }
+}
+
+
+//
+// -- Stop counting; the counts are kept for reporting
+//    ------------------------------------------------
+void DebugPmuStop(void)
+{
+    pmu_Control(0);
+    DbgOutput("Performance counters are stopped\n");
+}
+
+
+
+//
+// -- here is the debugger menu & function ecosystem
+//    ----------------------------------------------
+DbgState_t pmuStates[] = {
+    {   // -- state 0
+        .name = "pmu",
+        .transitionFrom = 0,
+        .transitionTo = 4,
+    },
+    {   // -- state 1 (start)
+        .name = "start",
+        .function = (Addr_t)DebugPmuStart,
+    },
+    {   // -- state 2 (stop)
+        .name = "stop",
+        .function = (Addr_t)DebugPmuStop,
+    },
+    {   // -- state 3 (processes)
+        .name = "processes",
+        .function = (Addr_t)DebugPmuProcesses,
+    },
+    {   // -- state 4 (services)
+        .name = "services",
+        .function = (Addr_t)DebugPmuServices,
+    },
+};
+
+
+DbgTransition_t pmuTrans[] = {
+    {   // -- transition 0
+        .command = "start",
+        .alias = "on",
+        .nextState = 1,
+    },
+    {   // -- transition 1
+        .command = "stop",
+        .alias = "off",
+        .nextState = 2,
+    },
+    {   // -- transition 2
+        .command = "processes",
+        .alias = "p",
+        .nextState = 3,
+    },
+    {   // -- transition 3
+        .command = "services",
+        .alias = "s",
+        .nextState = 4,
+    },
+    {   // -- transition 4
+        .command = "exit",
+        .alias = "x",
+        .nextState = -1,
+    },
+};
+
+
+DbgModule_t pmuModule = {
+    .name = "pmu",
+    .addrSpace = GetAddressSpace(),
+    .stack = 0,     // -- needs to be handled during late init
+    .stateCnt = sizeof(pmuStates) / sizeof (DbgState_t),
+    .transitionCnt = sizeof(pmuTrans) / sizeof (DbgTransition_t),
+    .list = {&pmuModule.list, &pmuModule.list},
+    .lock = {0},
+    // -- it does not matter what we put for .states and .transitions; will be replaced in debugger
+};
+
+
+/****************************************************************************************************************//**
+*   @fn                 void PmuDebugInit(void)
+*   @brief              Initialize the debugger module structure
+*
+*   Register the performance counter reports with the debugger, if there is a PMU to report on
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void PmuDebugInit(void)
+{
+    extern Addr_t __stackSize;
+
+    if (!pmuReady) return;
+
+    pmuModule.stack = StackFind();
+    for (Addr_t s = pmuModule.stack; s < pmuModule.stack + __stackSize; s += PAGE_SIZE) {
+        MmuMapPage(s, PmmAlloc(), PG_WRT);
+    }
+    pmuModule.stack += __stackSize;
+
+    DbgRegister(&pmuModule, pmuStates, pmuTrans);
+}
+
+
+#endif
+#endif
@@ -0,0 +1,526 @@
+//====================================================================================================================
+//
+//  profile.cc -- A statistical profiler: per-cpu samples of the interrupted rip, resolved to ELF symbols
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  When the cpu has an architectural PMU (version 2 or better), fixed counter 1 (unhalted core cycles) is set to
+//  overflow every PROFILE_PMU_PERIOD cycles and interrupt through the LAPIC performance counter LVT.  Otherwise,
+//  a sample is taken on each LAPIC timer tick.  Either way, each cpu programs its own counter on its next timer
+//  tick after the profiler is started or stopped.
+//
+//  Samples cannot land in code which runs with interrupts disabled, such as the internal services, so that time
+//  is attributed to the instruction where interrupts are enabled again.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-23  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+#include "internals.h"
+#include "scheduler.h"
+#include "modules.h"
+#include "elf.h"
+#include "stacks.h"
+#include "profile.h"
+
+
+
+#if IS_ENABLED(PROFILER) && IS_ENABLED(KERNEL_DEBUGGER)
+
+#include "debugger.h"
+
+
+//
+// -- The architectural PMU registers used for sampling
+//    -------------------------------------------------
+#define IA32_FIXED_CTR1             0x30a       // unhalted core cycles
+#define IA32_FIXED_CTR_CTRL         0x38d
+#define IA32_PERF_GLOBAL_CTRL       0x38f
+#define IA32_PERF_GLOBAL_OVF_CTRL   0x390
+
+#define FIXED_CTR1_CTRL_MASK        (0xful << 4)
+#define FIXED_CTR1_OS_USR_PMI       (0xbul << 4)    // count in rings 0 and 3 and interrupt on overflow
+#define FIXED_CTR1_GLOBAL           (1ul << 33)     // fixed counter 1 in the global control and overflow registers
+
+#define LVT_MASKED                  (1 << 16)
+
+
+//
+// -- The interrupted context in the register frame built by `idt-asm.s`
+//    ------------------------------------------------------------------
+#define REG_CR3                     5
+#define REG_RIP                     26
+
+
+//
+// -- The number of distinct processes summarized in a report
+//    -------------------------------------------------------
+#define PROF_MAX_PROCS              16
+
+
+//
+// -- How samples are being taken
+//    ---------------------------
+typedef enum {
+    PROF_OFF = 0,
+    PROF_TIMER = 1,
+    PROF_PMU = 2,
+} ProfMode_t;
+
+
+//
+// -- A single sample
+//    ---------------
+typedef struct ProfSample_t {
+    Addr_t rip;
+    Addr_t cr3;                                 // module code overlaps in virtual memory; this tells which one
+    Process_t *proc;
+    Pid_t pid;
+} ProfSample_t;
+
+
+//
+// -- The samples for a cpu; only that cpu writes to it
+//    -------------------------------------------------
+typedef struct ProfBuffer_t {
+    int armed;                                  // the ProfMode_t this cpu has programmed
+    size_t count;
+    uint64_t dropped;
+    ProfSample_t samples[PROFILE_SAMPLES];
+} __attribute__((aligned(64))) ProfBuffer_t;
+
+
+//
+// -- The hottest functions and the processes found while building a report
+//    ---------------------------------------------------------------------
+typedef struct ProfHot_t {
+    char name[ELF_SYM_NAME_LEN];
+    const char *image;
+    uint64_t count;
+} ProfHot_t;
+
+typedef struct ProfProc_t {
+    Process_t *proc;
+    Pid_t pid;
+    uint64_t count;
+} ProfProc_t;
+
+
+//
+// -- The image whose symbols are being counted; a `cr3` of 0 matches any address space (the kernel)
+//    ----------------------------------------------------------------------------------------------
+typedef struct ProfWalk_t {
+    const char *image;
+    Addr_t cr3;
+} ProfWalk_t;
+
+
+//
+// -- The profiler state
+//    ------------------
+static ProfBuffer_t profBuffers[MAX_CPU];
+static volatile int profMode = PROF_OFF;
+static volatile bool profUsed = false;         // until started, `ThisCpu()` may not even be valid in a tick
+static bool pmuAvailable = false;
+static uint64_t pmuMask = 0;
+
+static ProfHot_t profHot[PROFILE_REPORT_TOP];
+static uint64_t profResolved;
+
+extern BootInterface_t *loaderInterface;
+
+
+
+//
+// -- Record the interrupted context
+//    ------------------------------
+static void ProfileSample(ProfBuffer_t *b, Addr_t *regs)
+{
+    if (b->count >= PROFILE_SAMPLES) {
+        b->dropped ++;
+        return;
+    }
+
+    ProfSample_t *s = &b->samples[b->count];
+    s->rip = regs[REG_RIP];
+    s->cr3 = regs[REG_CR3];
+    s->proc = ThisCpu()->process;
+    s->pid = (s->proc ? s->proc->pid : 0);
+
+    b->count ++;
+}
+
+
+//
+// -- Program (or stop) this cpu's counter to match the requested mode
+//    ----------------------------------------------------------------
+static void ProfileArm(ProfBuffer_t *b, int mode)
+{
+    if (pmuAvailable) {
+        WRMSR(IA32_FIXED_CTR_CTRL, RDMSR(IA32_FIXED_CTR_CTRL) & ~FIXED_CTR1_CTRL_MASK);
+
+        if (mode == PROF_PMU) {
+            WRMSR(IA32_FIXED_CTR1, (-(uint64_t)PROFILE_PMU_PERIOD) & pmuMask);
+            WRMSR(IA32_PERF_GLOBAL_OVF_CTRL, FIXED_CTR1_GLOBAL);
+            WRMSR(IA32_FIXED_CTR_CTRL, RDMSR(IA32_FIXED_CTR_CTRL) | FIXED_CTR1_OS_USR_PMI);
+            WRMSR(IA32_PERF_GLOBAL_CTRL, RDMSR(IA32_PERF_GLOBAL_CTRL) | FIXED_CTR1_GLOBAL);
+            TmrSetPerfLvt(INT_PROFILE);
+        } else {
+            TmrSetPerfLvt(LVT_MASKED | INT_PROFILE);
+        }
+    }
+
+    b->armed = mode;
+}
+
+
+//
+// -- Called from the timer vector on each cpu
+//    ----------------------------------------
+void ProfileTick(Addr_t *regs)
+{
+    if (!profUsed) return;
+
+    ProfBuffer_t *b = &profBuffers[ThisCpu()->cpuNum];
+    int mode = profMode;
+
+    if (b->armed != mode) ProfileArm(b, mode);
+    if (mode == PROF_TIMER) ProfileSample(b, regs);
+}
+
+
+//
+// -- The PMU counter overflowed: take a sample and re-arm; delivering the interrupt masked the LVT
+//    ---------------------------------------------------------------------------------------------
+extern "C" void ProfileVector(Addr_t *regs);
+void ProfileVector(Addr_t *regs)
+{
+    ProfBuffer_t *b = &profBuffers[ThisCpu()->cpuNum];
+
+    if (profMode == PROF_PMU && b->armed == PROF_PMU) {
+        ProfileSample(b, regs);
+
+        WRMSR(IA32_FIXED_CTR1, (-(uint64_t)PROFILE_PMU_PERIOD) & pmuMask);
+        WRMSR(IA32_PERF_GLOBAL_OVF_CTRL, FIXED_CTR1_GLOBAL);
+        TmrSetPerfLvt(INT_PROFILE);
+    }
+
+    TmrEoi();
+}
+
+
+//
+// -- Count the samples in one function and keep it if it is among the hottest
+//    ------------------------------------------------------------------------
+static void ProfileCountSymbol(const char *name, Addr_t addr, size_t size, void *data)
+{
+    ProfWalk_t *w = (ProfWalk_t *)data;
+    uint64_t cnt = 0;
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        ProfBuffer_t *b = &profBuffers[c];
+
+        for (size_t i = 0; i < b->count; i ++) {
+            ProfSample_t *s = &b->samples[i];
+
+            if (w->cr3 && s->cr3 != w->cr3) continue;
+            if (s->rip >= addr && s->rip < addr + size) cnt ++;
+        }
+    }
+
+    if (cnt == 0) return;
+    profResolved += cnt;
+
+    int pos = PROFILE_REPORT_TOP;
+    while (pos > 0 && profHot[pos - 1].count < cnt) pos --;
+    if (pos == PROFILE_REPORT_TOP) return;
+
+    for (int i = PROFILE_REPORT_TOP - 1; i > pos; i --) {
+        kMemMoveB(&profHot[i], &profHot[i - 1], sizeof(ProfHot_t));
+    }
+
+    kStrCpy(profHot[pos].name, name);
+    profHot[pos].image = w->image;
+    profHot[pos].count = cnt;
+}
+
+
+//
+// -- Summarize the samples by process
+//    --------------------------------
+static void ProfileReportProcesses(uint64_t total)
+{
+    ProfProc_t procs[PROF_MAX_PROCS];
+    int procCnt = 0;
+    uint64_t other = 0;
+    char buf[100];
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        ProfBuffer_t *b = &profBuffers[c];
+
+        for (size_t i = 0; i < b->count; i ++) {
+            ProfSample_t *s = &b->samples[i];
+            int p;
+
+            for (p = 0; p < procCnt; p ++) {
+                if (procs[p].proc == s->proc && procs[p].pid == s->pid) break;
+            }
+
+            if (p == procCnt) {
+                if (procCnt == PROF_MAX_PROCS) {
+                    other ++;
+                    continue;
+                }
+
+                procs[p].proc = s->proc;
+                procs[p].pid = s->pid;
+                procs[p].count = 0;
+                procCnt ++;
+            }
+
+            procs[p].count ++;
+        }
+    }
+
+    DbgOutput("\nBy process:\n");
+
+    for (int p = 0; p < procCnt; p ++) {
+        // -- the process may have ended since the sample; only trust the name if the pid still matches
+        const char *cmd = (procs[p].proc && procs[p].proc->pid == procs[p].pid ? procs[p].proc->command : "?");
+
+        ksprintf(buf, "  %8d (%3d%%)  pid %d ", procs[p].count, procs[p].count * 100 / total, procs[p].pid);
+        DbgOutput(buf);
+        ksprintf(buf, "%.40s\n", cmd);
+        DbgOutput(buf);
+    }
+
+    if (other) {
+        ksprintf(buf, "  %8d in other processes\n", other);
+        DbgOutput(buf);
+    }
+}
+
+
+//
+// -- Report the hottest functions in the kernel and modules, and where the samples came from
+//    ---------------------------------------------------------------------------------------
+void DebugProfileReport(void)
+{
+    char buf[100];
+    uint64_t total = 0;
+    uint64_t dropped = 0;
+    int wasMode = profMode;
+
+    // -- the other cores are paused, so nothing is sampling; just make sure this cpu does not either
+    profMode = PROF_OFF;
+
+    DbgOutput(ANSI_CLEAR ANSI_SET_CURSOR(0,0));
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        total += profBuffers[c].count;
+        dropped += profBuffers[c].dropped;
+    }
+
+    if (wasMode == PROF_PMU || (wasMode == PROF_OFF && pmuAvailable)) {
+        ksprintf(buf, "Profile: %d samples, 1 per %d unhalted cycles", total, PROFILE_PMU_PERIOD);
+    } else {
+        ksprintf(buf, "Profile: %d samples, 1 per timer tick", total);
+    }
+    DbgOutput(buf);
+
+    ksprintf(buf, " (%d dropped; %s)\n", dropped, wasMode == PROF_OFF ? "stopped" : "running");
+    DbgOutput(buf);
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (profBuffers[c].count == 0) continue;
+        ksprintf(buf, "  CPU %d: %d samples\n", c, profBuffers[c].count);
+        DbgOutput(buf);
+    }
+
+    if (total == 0) {
+        profMode = wasMode;
+        return;
+    }
+
+
+    // -- resolve the samples against the kernel and each module symbol table
+    kMemSetB(profHot, 0, sizeof(profHot));
+    profResolved = 0;
+
+    ProfWalk_t w = { "kernel", 0 };
+    if (loaderInterface->kernelAddr) ElfWalkFunctions(loaderInterface->kernelAddr, ProfileCountSymbol, &w);
+
+    for (int i = 0; i < loaderInterface->modCount; i ++) {
+        Addr_t image;
+
+        if (ModuleInfo(i, &w.image, &w.cr3, &image) != 0) continue;
+        ElfWalkFunctions(image, ProfileCountSymbol, &w);
+    }
+
+
+    DbgOutput("\n+----------+------+------------------+------------------------------------------+\n");
+    DbgOutput("|  Samples |    % | Image            | Function                                 |\n");
+    DbgOutput("+----------+------+------------------+------------------------------------------+\n");
+
+    for (int i = 0; i < PROFILE_REPORT_TOP && profHot[i].count; i ++) {
+        ksprintf(buf, "| %8d | %3d%% | %-16.16s | ", profHot[i].count, profHot[i].count * 100 / total, profHot[i].image);
+        DbgOutput(buf);
+        ksprintf(buf, "%-40.40s |\n", profHot[i].name);
+        DbgOutput(buf);
+    }
+
+    DbgOutput("+----------+------+------------------+------------------------------------------+\n");
+
+    if (profResolved < total) {
+        ksprintf(buf, "%d samples did not resolve to a function symbol\n", total - profResolved);
+        DbgOutput(buf);
+    }
+
+    ProfileReportProcesses(total);
+
+    profMode = wasMode;
+}
+
+
+//
+// -- Start a new profile, discarding any previous samples
+//    ----------------------------------------------------
+void DebugProfileStart(void)
+{
+    profMode = PROF_OFF;
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        profBuffers[c].count = 0;
+        profBuffers[c].dropped = 0;
+    }
+
+    profMode = (pmuAvailable ? PROF_PMU : PROF_TIMER);
+    profUsed = true;
+
+    DbgOutput(pmuAvailable ? "Profiling unhalted core cycles with the PMU\n" : "Profiling on the LAPIC timer\n");
+}
+
+
+//
+// -- Stop profiling; the samples are kept for reporting
+//    --------------------------------------------------
+void DebugProfileStop(void)
+{
+    profMode = PROF_OFF;
+    DbgOutput("Profiling is stopped\n");
+}
+
+
+
+//
+// -- here is the debugger menu & function ecosystem
+//    ----------------------------------------------
+DbgState_t profStates[] = {
+    {   // -- state 0
+        .name = "profile",
+        .transitionFrom = 0,
+        .transitionTo = 3,
+    },
+    {   // -- state 1 (start)
+        .name = "start",
+        .function = (Addr_t)DebugProfileStart,
+    },
+    {   // -- state 2 (stop)
+        .name = "stop",
+        .function = (Addr_t)DebugProfileStop,
+    },
+    {   // -- state 3 (report)
+        .name = "report",
+        .function = (Addr_t)DebugProfileReport,
+    },
+};
+
+
+DbgTransition_t profTrans[] = {
+    {   // -- transition 0
+        .command = "start",
+        .alias = "on",
+        .nextState = 1,
+    },
+    {   // -- transition 1
+        .command = "stop",
+        .alias = "off",
+        .nextState = 2,
+    },
+    {   // -- transition 2
+        .command = "report",
+        .alias = "r",
+        .nextState = 3,
+    },
+    {   // -- transition 3
+        .command = "exit",
+        .alias = "x",
+        .nextState = -1,
+    },
+};
+
+
+DbgModule_t profModule = {
+    .name = "profile",
+    .addrSpace = GetAddressSpace(),
+    .stack = 0,     // -- needs to be handled during late init
+    .stateCnt = sizeof(profStates) / sizeof (DbgState_t),
+    .transitionCnt = sizeof(profTrans) / sizeof (DbgTransition_t),
+    .list = {&profModule.list, &profModule.list},
+    .lock = {0},
+    // -- it does not matter what we put for .states and .transitions; will be replaced in debugger
+};
+
+
+/****************************************************************************************************************//**
+*   @fn                 void ProfileDebugInit(void)
+*   @brief              Initialize the debugger module structure
+*
+*   Check for a usable PMU, install the counter overflow vector and register the profiler with the debugger
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void ProfileDebugInit(void)
+{
+    extern Addr_t __stackSize;
+    uint32_t eax, ebx, ecx, edx;
+
+    CPUID(0, &eax, &ebx, &ecx, &edx);
+
+    if (eax >= 0xa) {
+        CPUID(0xa, &eax, &ebx, &ecx, &edx);
+
+        int version = eax & 0xff;
+        int fixedCnt = edx & 0x1f;
+        int fixedWidth = (edx >> 5) & 0xff;
+
+        // -- fixed counter 1 and the global control registers need version 2
+        if (version >= 2 && fixedCnt >= 2 && fixedWidth > 0 && fixedWidth < 64) {
+            pmuAvailable = true;
+            pmuMask = (1ul << fixedWidth) - 1;
+        }
+    }
+
+    krn_SetVectorHandler(INT_PROFILE, (Addr_t)ProfileVector, 0, 0);
+
+    profModule.stack = StackFind();
+    for (Addr_t s = profModule.stack; s < profModule.stack + __stackSize; s += PAGE_SIZE) {
+        MmuMapPage(s, PmmAlloc(), PG_WRT);
+    }
+    profModule.stack += __stackSize;
+
+    DbgRegister(&profModule, profStates, profTrans);
+}
+
+
+#endif
+
@@ -50,6 +50,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-May-10 | Initial |  v0.0.9  | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Per-cpu postpone; ns accounting; kick IPIs; MWAIT idle; handoff; IPC
 *
 * ===================================================================================================================
 */
@@ -64,6 +65,12 @@
 #include "boot-interface.h"
 #include "internals.h"
 #include "scheduler.h"
+#include "printf.h"
+#include "klog.h"
+#include "trace.h"
+#include "pmu.h"
+#include "fpu.h"
+#include "msgq.h"
 
 
 
@@ -73,11 +80,6 @@
 extern "C" {
     void ProcessUpdateTimeUsed(void);
 
-    void ProcessLockAndPostpone(void);
-    void ProcessUnlockAndSchedule(void);
-    void ProcessLockScheduler(bool save);
-    void ProcessUnlockScheduler(void);
-
 #if IS_ENABLED(KERNEL_DEBUGGER)
     void SchedulerDebugInit(void);
 #endif
@@ -91,11 +93,10 @@ extern "C" {
 Scheduler_t scheduler = {
     0,                      // nextPID
     ~((Addr_t)0),           // nextWake
-    false,                  // processChangePending
-    0,                      // flags
+    {0},                    // enabled
     {0},                    // schedulerLockCount
-    {0},                    // postponeCount
     -1,                     // lock CPU
+    0,                      // flags
     {{0}},                  // the os ready queue
     {{0}},                  // the high ready queue
     {{0}},                  // the normal ready queue
@@ -111,19 +112,81 @@ Scheduler_t scheduler = {
 Spinlock_t schedulerLock = {0};
 
 
+//
+// -- A reschedule IPI has been sent to the cpu and not yet handled; written by other cpus, so kept apart from
+//    the per-cpu structure
+//    --------------------------------------------------------------------------------------------------------
+typedef struct Kick_t {
+    AtomicInt_t pending;
+} __attribute__((aligned(CACHE_LINE_SIZE))) Kick_t;
+
+static Kick_t kick[MAX_CPU];
+
+
+//
+// -- The idle process only wakes for interrupts, so it monitors a line nothing writes
+//    --------------------------------------------------------------------------------
+static volatile int64_t idleMonitor __attribute__((aligned(CACHE_LINE_SIZE))) = 0;
+
+
+
+//
+// -- How long this cpu can expect to stay idle: to its next timer tick, or sooner when a sleeper is due
+//    --------------------------------------------------------------------------------------------------
+static uint64_t ProcessIdleExpected(void)
+{
+    uint64_t now = ClockNanos();
+    uint64_t deadline = ThisCpu()->lastTick + 1000000000 / TIMER_HZ;
+    uint64_t wake = scheduler.nextWake;                 // -- us; all 1s when nothing sleeps
+
+    if (wake < deadline / 1000) deadline = wake * 1000;
+
+    return deadline > now ? deadline - now : 0;
+}
+
+
+
+//
+// -- In the idle loop, wait for an interrupt unless a reschedule IPI has already been handled; `CpuIdle()` checks
+//    the kick with interrupts disabled, and a kick sent after that breaks the wait, so it cannot be missed
+//    -----------------------------------------------------------------------------------------------------------
+static inline void ProcessIdleWait(void)
+{
+    AtomicInt_t *pending = &kick[ThisCpu()->cpuNum].pending;
+
+    DisableInt();
+    CpuIdle(&pending->counter, ProcessIdleExpected());
+    AtomicSet(pending, 0);
+}
+
+
+
+//
+// -- Allocate a process structure starting on its own cache line; process structures are never freed
+//    ------------------------------------------------------------------------------------------------
+static Process_t *ProcessAlloc(void)
+{
+    Addr_t raw = (Addr_t)HeapAlloc(sizeof(Process_t) + CACHE_LINE_SIZE - 1, false);
+    if (raw == 0) return NULL;
+
+    return (Process_t *)((raw + CACHE_LINE_SIZE - 1) & ~((Addr_t)CACHE_LINE_SIZE - 1));
+}
+
+
 
 //
 // -- Idle when there is nothing to do
 //    --------------------------------
 static void ProcessIdle(void)
 {
-    kprintf("Starting the idle process\n");
+    KLOG(SCHED, INFO, "Starting the idle process\n");
     CurrentThread()->priority = PTY_IDLE;
 
     while (true) {
         assert(CurrentThread()->status == PROC_RUNNING);
+        DisableInt();
+        CpuIdle(&idleMonitor, ProcessIdleExpected());
         EnableInt();
-        __asm volatile ("hlt" ::: "memory");
     }
 }
 
@@ -154,7 +217,7 @@ void ProcessLockScheduler(bool save)
 void ProcessLockAndPostpone(void)
 {
     ProcessLockScheduler(true);
-    AtomicInc(&scheduler.postponeCount);
+    AtomicInc(&ThisCpu()->postponeCount);
 }
 
 
@@ -179,12 +242,14 @@ void ProcessUnlockScheduler(void)
 //    ----------------------------------------
 void ProcessUnlockAndSchedule(void)
 {
-    assert_msg(AtomicRead(&scheduler.postponeCount) > 0, "postponeCount out if sync");
-    assert_msg(!(AtomicRead(&scheduler.postponeCount) < 0), "postponeCount is negative");
+    ArchCpu_t *cpu = ThisCpu();
+
+    assert_msg(AtomicRead(&cpu->postponeCount) > 0, "postponeCount out if sync");
+    assert_msg(!(AtomicRead(&cpu->postponeCount) < 0), "postponeCount is negative");
 
-    if (AtomicDecAndTest0(&scheduler.postponeCount) == true) {
-        if (scheduler.processChangePending != false) {
-            scheduler.processChangePending = false;           // need to clear this to actually perform a change
+    if (AtomicDecAndTest0(&cpu->postponeCount) == true) {
+        if (cpu->processChangePending != false) {
+            cpu->processChangePending = false;                // need to clear this to actually perform a change
             ProcessSchedule();
         }
     }
@@ -218,16 +283,17 @@ static Process_t *ProcessNext(ProcPriority_t pty)
 
 
 //
-// -- Get the current timer value and update the time used of the current process
-//    ---------------------------------------------------------------------------
+// -- Get the current clock and update the time used (in nanoseconds) of the current process
+//    --------------------------------------------------------------------------------------
 void ProcessUpdateTimeUsed(void)
 {
-    uint64_t now = TmrCurrentCount();
-    uint64_t elapsed = now - cpus[LapicGetId()].lastTimer;
-    cpus[LapicGetId()].lastTimer = now;
+    ArchCpu_t *cpu = ThisCpu();
+    uint64_t now = ClockNanos();
+    uint64_t elapsed = now - cpu->lastTimer;
+    cpu->lastTimer = now;
 
     if (CurrentThread() == NULL) {
-        cpus[LapicGetId()].cpuIdleTime += elapsed;
+        cpu->cpuIdleTime += elapsed;
     } else {
         CurrentThread()->timeUsed += elapsed;
     }
@@ -242,7 +308,7 @@ static void ProcessAddGlobal(Process_t *proc)
 {
     ProcessLockAndPostpone();
 
-    kprintf(".. Checking scheduler Global Process List: %p (%p)\n", &scheduler.globalProcesses, scheduler.globalProcesses);
+    KLOG(SCHED, DEBUG, ".. Checking scheduler Global Process List: %p (%p)\n", &scheduler.globalProcesses, scheduler.globalProcesses);
     ListAddTail(&scheduler.globalProcesses, &proc->globalList);
 
     ProcessUnlockAndSchedule();
@@ -316,8 +382,8 @@ void ProcessCheckQueue(void)
     if (schedulerLock.lock) kprintf("...  on CPU%d\n", scheduler.lockCpu);
     assert(schedulerLock.lock != 0);
     assert(scheduler.lockCpu == ThisCpu()->cpuNum);
-    kprintf(".. postpone count %d\n", AtomicRead(&scheduler.postponeCount));
-    kprintf(".. currently, a reschedule is %spending\n", scheduler.processChangePending ? "" : "not ");
+    kprintf(".. postpone count %d\n", AtomicRead(&ThisCpu()->postponeCount));
+    kprintf(".. currently, a reschedule is %spending\n", ThisCpu()->processChangePending ? "" : "not ");
     kprintf("..     OS Queue process count: %d\n", ListCount(&scheduler.queueOS));
     kprintf("..   High Queue process count: %d\n", ListCount(&scheduler.queueHigh));
     kprintf(".. Normal Queue process count: %d\n", ListCount(&scheduler.queueNormal));
@@ -350,8 +416,8 @@ void ProcessSchedule(void)
 
     Process_t *next = NULL;
 
-    if (AtomicRead(&scheduler.postponeCount) != 0) {
-        scheduler.processChangePending = true;
+    if (AtomicRead(&ThisCpu()->postponeCount) != 0) {
+        ThisCpu()->processChangePending = true;
         return;
     }
 
@@ -360,7 +426,19 @@ void ProcessSchedule(void)
 
     if (next != NULL) {
         ProcessListRemove(next);
-        assert(AtomicRead(&scheduler.postponeCount) == 0);
+        assert(AtomicRead(&ThisCpu()->postponeCount) == 0);
+
+#if IS_ENABLED(BOOT_TRACE)
+        static bool firstSwitch = true;
+        if (unlikely(firstSwitch)) {
+            extern BootInterface_t *loaderInterface;
+            firstSwitch = false;
+            BootTraceMark(loaderInterface, "first process switch");
+        }
+#endif
+
+        TRACE(TRC_SWITCH, CurrentThread()->pid, next->pid);
+        PMU_SWITCH(CurrentThread());
         ProcessSwitch(next);
     } else if (CurrentThread()->status == PROC_RUNNING) {
         // -- Do nothing; the current process can continue; reset quantum
@@ -369,29 +447,49 @@ void ProcessSchedule(void)
     } else {
         // -- No tasks available; so we go into idle mode
         Process_t *save = CurrentThread();          // we will save this process for later
+        PMU_SWITCH(save);                           // the idle time is not charged to anyone
         CurrentThreadAssign(NULL);                  // nothing is running!
+        ThisCpu()->parked = save;                   // its stack is in use; it cannot be handed off to
 
         do {
-            // -- -- temporarily unlock the scheduler and enable interrupts for the timer to fire
+            // -- -- temporarily unlock the scheduler and enable interrupts for the timer or a kick to fire
             ProcessUnlockScheduler();
-            EnableInt();
-            __asm volatile("hlt" ::: "memory");
-            DisableInt();
+            ProcessIdleWait();
             ProcessLockScheduler(false);     // make sure that this does not overwrite the process's flags
             next = ProcessNext(PTY_IDLE);
         } while (next == NULL);
         ProcessListRemove(next);
 
         // -- restore the current Process and change if needed
+        PMU_SWITCH(NULL);
+        ThisCpu()->parked = NULL;
         CurrentThreadAssign(save);
         AtomicSet(&next->quantumLeft, next->priority);
 
-        if (next != CurrentThread()) ProcessSwitch(next);
+        if (next != CurrentThread()) {
+            TRACE(TRC_SWITCH, CurrentThread()->pid, next->pid);
+            PMU_SWITCH(CurrentThread());
+            ProcessSwitch(next);
+        }
     }
 }
 
 
 
+//
+// -- Tell the Butler there is an ended process to clean up after; the scheduler is locked
+//    ------------------------------------------------------------------------------------
+static void ProcessButlerClean(void)
+{
+    if (!butlerMsgq) return;
+
+    Message_t msg = { 0 };
+    msg.type = BUTLER_CLEAN_PROCESS;
+    krn_MsgqSend(butlerMsgq, &msg);
+}
+
+
+
 //
 // -- Terminate a task
 //    ----------------
@@ -406,12 +504,13 @@ void ProcessTerminate(Process_t *proc)
         Enqueue(&scheduler.listTerminated, &proc->stsQueue);
         sch_ProcessBlock(PROC_TERM);
     } else {
-        kprintf(".. termianting another process\n");
+        KLOG(SCHED, DEBUG, ".. termianting another process\n");
         ProcessListRemove(proc);
         Enqueue(&scheduler.listTerminated, &proc->stsQueue);
         proc->status = PROC_TERM;
     }
 
+    ProcessButlerClean();
     ProcessUnlockAndSchedule();
 }
 
@@ -427,14 +526,14 @@ void ProcessStart(void)
     assert_msg(AtomicRead(&scheduler.schedulerLockCount) == 1,
             "`ProcessStart()` is executing while too many locks are held");
 
-    kprintf("Starting new process with address space %p\n", GetAddressSpace());
+    KLOG(SCHED, DEBUG, "Starting new process with address space %p\n", GetAddressSpace());
 
     ProcessUnlockScheduler();
 
     assert_msg(AtomicRead(&scheduler.schedulerLockCount) == 0,
             "`ProcessStart()` still has a scheduler lock remaining");
 
-    assert_msg(AtomicRead(&scheduler.postponeCount) == 0, "`ProcessStart()` with a pending process change");
+    assert_msg(AtomicRead(&ThisCpu()->postponeCount) == 0, "`ProcessStart()` with a pending process change");
 
     EnableInt();
 }
@@ -453,7 +552,7 @@ void ProcessEnd(void)
     sch_ProcessBlock(PROC_TERM);
 
     // -- send a message with the scheduler already locked
-//    _MessageQueueSend(butlerMsgq, BUTLER_CLEAN_PROCESS, 0, 0, false);
+    ProcessButlerClean();
 
     ProcessUnlockAndSchedule();
 }
@@ -503,7 +602,8 @@ Return_t sch_Tick(uint64_t now)
     if (CurrentThread() != NULL) {
         AtomicDec(&(CurrentThread()->quantumLeft));
         if (AtomicRead(&CurrentThread()->quantumLeft) <= 0) {
-            scheduler.processChangePending = true;
+            TRACE(TRC_EXPIRE, CurrentThread()->pid, 0);
+            ThisCpu()->processChangePending = true;
         }
     }
 
@@ -518,21 +618,24 @@ Return_t sch_Tick(uint64_t now)
 //    --------------------------------------------------------------
 Process_t *sch_ProcessCreate(const char *name, Addr_t startingAddr, Addr_t addrSpace, ProcPriority_t pty)
 {
-    kprintf("Creating a new process named at %p (%s), starting at %p\n", name, name, startingAddr);
-    kprintf(".. the address space for this process in %p\n", addrSpace);
+    KLOG(SCHED, DEBUG, "Creating a new process named at %p (%s), starting at %p\n", name, name, startingAddr);
+    KLOG(SCHED, DEBUG, ".. the address space for this process in %p\n", addrSpace);
 
-    Process_t *rv = NEW(Process_t);
+    Process_t *rv = ProcessAlloc();
     if (!assert_msg(rv != NULL, "Out of memory allocating a new Process_t")) {
-        kprintf("Out of memory allocating a new Process_t");
+        KLOG(SCHED, ERROR, "Out of memory allocating a new Process_t");
         while (true) {
             __asm volatile("hlt");
         }
     }
 
     kMemSetB(rv, 0, sizeof(Process_t));
+#if IS_ENABLED(FPU_STATE)
+    FpuProcessInit(rv);
+#endif
 
     // -- set the name of the process
-    kprintf(".. naming the process: %s\n", name);
+    KLOG(SCHED, DEBUG, ".. naming the process: %s\n", name);
     int len = kStrLen(name + 1);
 
     // -- make sure we do not blow out the buffer
@@ -558,7 +661,7 @@ Process_t *sch_ProcessCreate(const char *name, Addr_t startingAddr, Addr_t addrS
     //
     // -- Construct the stack for the architecture
     //    ----------------------------------------
-    kprintf(".. Creating the new Process's stack\n");
+    KLOG(SCHED, DEBUG, ".. Creating the new Process's stack\n");
     rv->virtAddrSpace = addrSpace;
     ProcessNewStack(rv, startingAddr);
 
@@ -566,7 +669,7 @@ Process_t *sch_ProcessCreate(const char *name, Addr_t startingAddr, Addr_t addrS
     //
     // -- Put this process on the queue to execute
     //    ----------------------------------------
-    kprintf(".. Readying the new process to be scheduled: %p\n", rv);
+    KLOG(SCHED, DEBUG, ".. Readying the new process to be scheduled: %p\n", rv);
     sch_ProcessReady(rv);
 
 
@@ -583,18 +686,19 @@ Return_t ProcessInit(BootInterface_t *loaderInterface)
     MmuMapPage(MMU_STACK_INIT_VADDR, 1, 0);
     MmuUnmapPage(MMU_STACK_INIT_VADDR);
 
-    kprintf("ProcessInit() called\n");
+    KLOG(SCHED, INFO, "ProcessInit() called\n");
 
-    kprintf("Process table offsets:\n");
-    kprintf("  TOS: %d\n", offsetof(Process_t, tosProcessSwap));
-    kprintf("  Virtual Address Space: %d\n", offsetof(Process_t, virtAddrSpace));
-    kprintf("  Status: %d\n", offsetof(Process_t, status));
-    kprintf("  Priority: %d\n", offsetof(Process_t, priority));
-    kprintf("  Quantum Left: %d\n", offsetof(Process_t, quantumLeft));
-    kprintf("Scheduler structure offsets:\n");
-    kprintf("  Change pending: %d (%d)\n", offsetof(Scheduler_t, processChangePending), sizeof(bool));
-    kprintf("  Lock count: %d (%d)\n", offsetof(Scheduler_t, schedulerLockCount), sizeof (AtomicInt_t));
-    kprintf("  Postpone count: %d (%d)\n", offsetof(Scheduler_t, postponeCount), sizeof(AtomicInt_t));
+    KLOG(SCHED, DEBUG, "Process table offsets:\n");
+    KLOG(SCHED, DEBUG, "  TOS: %d\n", offsetof(Process_t, tosProcessSwap));
+    KLOG(SCHED, DEBUG, "  Virtual Address Space: %d\n", offsetof(Process_t, virtAddrSpace));
+    KLOG(SCHED, DEBUG, "  Status: %d\n", offsetof(Process_t, status));
+    KLOG(SCHED, DEBUG, "  Priority: %d\n", offsetof(Process_t, priority));
+    KLOG(SCHED, DEBUG, "  Quantum Left: %d\n", offsetof(Process_t, quantumLeft));
+    KLOG(SCHED, DEBUG, "Per-cpu offsets from the gs base:\n");
+    KLOG(SCHED, DEBUG, "  Change pending: %d (%d)\n",
+            offsetof(ArchCpu_t, processChangePending) - offsetof(ArchCpu_t, cpu), sizeof(bool));
+    KLOG(SCHED, DEBUG, "  Postpone count: %d (%d)\n",
+            offsetof(ArchCpu_t, postponeCount) - offsetof(ArchCpu_t, cpu), sizeof(AtomicInt_t));
 
 
     ListInit(&scheduler.queueOS.list);
@@ -608,12 +712,12 @@ Return_t ProcessInit(BootInterface_t *loaderInterface)
     ListInit(&scheduler.globalProcesses.list);
     AtomicSet(&scheduler.enabled, 0);
 
-    Process_t *proc = NEW(Process_t);
+    Process_t *proc = ProcessAlloc();
 
-    kprintf(".. the current process is located at %p\n", proc);
+    KLOG(SCHED, DEBUG, ".. the current process is located at %p\n", proc);
 
     if (!assert(proc != NULL)) {
-        kprintf("FATAL: Unable to allocate Current Process structure\n");
+        KLOG(SCHED, ERROR, "FATAL: Unable to allocate Current Process structure\n");
 
         while (true) {
             __asm volatile ("hlt");
@@ -621,6 +725,9 @@ Return_t ProcessInit(BootInterface_t *loaderInterface)
     }
 
     kMemSetB(proc, 0, sizeof(Process_t));
+#if IS_ENABLED(FPU_STATE)
+    FpuProcessInit(proc);
+#endif
 
     proc->tosProcessSwap = 0;
     proc->virtAddrSpace = loaderInterface->bootVirtAddrSpace;
@@ -642,18 +749,18 @@ Return_t ProcessInit(BootInterface_t *loaderInterface)
     ProcessAddGlobal(proc);           // no lock required -- still single threaded
     CurrentThreadAssign(proc);
 
-    kprintf(".. The current timer for the kInit process is %p\n", proc->timeUsed);
+    KLOG(SCHED, DEBUG, ".. The current timer for the kInit process is %p\n", proc->timeUsed);
 
     //
     // -- Create an idle process for each CPU
     //    -----------------------------------
     for (int i = 0; i < loaderInterface->cpuCount; i ++) {
-        kprintf("starting idle process %d\n", i, ProcessIdle);
+        KLOG(SCHED, DEBUG, "starting idle process %d\n", i, ProcessIdle);
         sch_ProcessCreate("Idle Process", (Addr_t)ProcessIdle, GetAddressSpace(), PTY_IDLE);
     }
 
-    ThisCpu()->lastTimer = TmrCurrentCount();
-    kprintf("ProcessInit() complete\n");
+    ThisCpu()->lastTimer = ClockNanos();
+    KLOG(SCHED, INFO, "ProcessInit() complete\n");
 
     return 0;
 }
@@ -671,6 +778,7 @@ Return_t sch_ProcessBlock(ProcStatus_t reason)
 //    kprintf("Blocking current process %p\n", CurrentThread());
 
     ProcessLockAndPostpone();
+    TRACE(TRC_BLOCK, CurrentThread()->pid, reason);
     CurrentThread()->status = reason;
     CurrentThread()->pendingErrno = 0;
     AtomicSet(&CurrentThread()->quantumLeft, 0);
@@ -683,6 +791,72 @@ Return_t sch_ProcessBlock(ProcStatus_t reason)
 
 
 
+//
+// -- Get a cpu to run a process which has just become ready, rather than leaving it for the next timer tick
+//
+//    An idle cpu is kicked first; failing that, the cpu running the lowest priority process, if that is lower
+//    than the priority of the ready process.  When that is this cpu, it reschedules as soon as the scheduler is
+//    unlocked -- except while `ProcessSwitch()` is readying the process it is switching away from.  A cpu with
+//    a kick in flight is not sent another.  The scheduler is locked.
+//    ----------------------------------------------------------------------------------------------------------
+static void ProcessKick(Process_t *proc)
+{
+    int pty = proc->priority;
+    int self = ThisCpu()->cpuNum;
+    int target = -1;
+    int low = pty;                      // -- only a cpu running something lower is worth interrupting
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (c == self || AtomicRead(&cpus[c].state) != CPU_STARTED) continue;
+
+        Process_t *running = cpus[c].process;               // -- NULL in the idle loop; processes are never freed
+        int running_pty = running ? (int)running->priority : 0;
+
+        if (running_pty < low) {
+            low = running_pty;
+            target = c;
+            if (running_pty <= PTY_IDLE) break;
+        }
+    }
+
+
+    // -- this cpu in its idle loop finds the process as soon as the interrupt it is handling returns
+    Process_t *current = CurrentThread();
+    if (current == NULL) return;
+
+    if (current != proc && (int)current->priority <= low && (int)current->priority < pty) {
+        ThisCpu()->processChangePending = true;
+        return;
+    }
+
+    if (target == -1) return;
+
+    if (AtomicSet(&kick[target].pending, 1) == 0) {
+        TRACE(TRC_IPI_SEND, IPI_RESCHEDULE, target);
+        IpiSendTo(target, IPI_RESCHEDULE);
+    }
+}
+
+
+
+//
+// -- The reschedule IPI: look for a higher priority process now; the idle loop only needs to wake up
+//    --------------------------------------------------------------------------------------------------------
+extern "C" void IpiReschedule(Addr_t *)
+{
+    TRACE(TRC_IPI_RECV, IPI_RESCHEDULE, 0);
+    TmrEoi();
+
+    if (CurrentThread() == NULL) return;            // -- the idle loop clears the kick itself
+
+    AtomicSet(&kick[ThisCpu()->cpuNum].pending, 0);
+    ProcessLockAndPostpone();
+    ThisCpu()->processChangePending = true;
+    ProcessUnlockAndSchedule();
+}
+
+
+
 //
 // -- Place a process on the correct ready queue
 //    ------------------------------------------
@@ -729,6 +903,8 @@ Return_t sch_ProcessReady(Process_t *proc)
         break;
     }
 
+    if (proc->priority > PTY_IDLE) ProcessKick(proc);
+
     ProcessUnlockAndSchedule();
 
     return 0;
@@ -744,6 +920,7 @@ Return_t sch_ProcessUnblock(Process_t *proc)
     if (!assert(proc != NULL)) return -EINVAL;
 
     ProcessLockAndPostpone();
+    TRACE(TRC_UNBLOCK, proc->pid, proc->status);
     proc->status = PROC_READY;
     sch_ProcessReady(proc);
     ProcessUnlockAndSchedule();
@@ -753,12 +930,124 @@ Return_t sch_ProcessUnblock(Process_t *proc)
 
 
 
+//
+// -- Can this cpu switch straight to the blocked `proc`?  Not when the scheduler is not running a process, when
+//    `proc`'s stack is parked under an idle loop, or from a service in another address space, which a switch
+//    would not return to.  The scheduler is locked.
+//    ------------------------------------------------------------------------------------------------------------
+static bool ProcessCanSwitchTo(Process_t *proc)
+{
+    Process_t *current = CurrentThread();
+
+    if (current == NULL || GetAddressSpace() != current->virtAddrSpace) return false;
+    if (!AtomicRead(&scheduler.enabled)) return false;
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        if (cpus[c].parked == proc) return false;
+    }
+
+    return true;
+}
+
+
+
+//
+// -- Unblock a process and give it this cpu at once, skipping the ready queues; `ProcessSwitch()` readies the
+//    current process.  When this cpu cannot switch to it here, a change is postponed, or `proc` has a lower
+//    priority, `proc` is only made ready.  From a service in another address space, the reschedule that may
+//    call for here waits for the next tick.
+//    ---------------------------------------------------------------------------------------------------------
+Return_t sch_ProcessHandoff(Process_t *proc)
+{
+    if (!assert(proc != NULL)) return -EINVAL;
+
+    ProcessLockScheduler(true);
+
+    Process_t *current = CurrentThread();
+
+    if (current == NULL || GetAddressSpace() != current->virtAddrSpace) {
+        AtomicInc(&ThisCpu()->postponeCount);
+        TRACE(TRC_UNBLOCK, proc->pid, proc->status);
+        sch_ProcessReady(proc);
+        AtomicDec(&ThisCpu()->postponeCount);
+        ProcessUnlockScheduler();
+
+        return 0;
+    }
+
+    if (!ProcessCanSwitchTo(proc) || AtomicRead(&ThisCpu()->postponeCount) != 0
+            || current->status != PROC_RUNNING || proc->priority < current->priority) {
+        ProcessUnlockScheduler();
+
+        return sch_ProcessUnblock(proc);
+    }
+
+    TRACE(TRC_UNBLOCK, proc->pid, proc->status);
+    ProcessListRemove(proc);
+    TRACE(TRC_SWITCH, current->pid, proc->pid);
+    PMU_SWITCH(current);
+    ProcessSwitch(proc);
+
+    ProcessUnlockScheduler();
+
+    return 0;
+}
+
+
+
+//
+// -- Block the current process for `reason` and give this cpu to the blocked `proc`, skipping the ready queues
+//    both ways.  This is the synchronous IPC path: the process giving up the cpu waits on the one taking it, so
+//    their priorities do not matter.  When this cpu cannot switch to it here, `proc` is made ready and the
+//    current process blocks as usual.
+//
+//    The caller has locked and postponed with `ProcessLockAndPostpone()`, once, so it can publish that the
+//    current process is about to block; both are released here.  Returns once the current process runs again.
+//    ----------------------------------------------------------------------------------------------------------
+Return_t sch_ProcessBlockAndSwitch(ProcStatus_t reason, Process_t *proc)
+{
+    if (!assert(proc != NULL)) return -EINVAL;
+    if (!assert(CurrentThread() != NULL)) return -EINVAL;
+
+    ArchCpu_t *cpu = ThisCpu();
+
+    if (AtomicRead(&cpu->postponeCount) != 1 || !ProcessCanSwitchTo(proc)) {
+        sch_ProcessUnblock(proc);
+        sch_ProcessBlock(reason);
+        ProcessUnlockAndSchedule();             // -- the switch away happens here
+
+        return 0;
+    }
+
+    Process_t *current = CurrentThread();
+
+    AtomicDec(&cpu->postponeCount);
+    cpu->processChangePending = false;          // -- the change is made here
+
+    TRACE(TRC_BLOCK, current->pid, reason);
+    current->status = reason;
+    current->pendingErrno = 0;
+    AtomicSet(&current->quantumLeft, 0);
+
+    TRACE(TRC_UNBLOCK, proc->pid, proc->status);
+    ProcessListRemove(proc);
+    TRACE(TRC_SWITCH, current->pid, proc->pid);
+    PMU_SWITCH(current);
+    ProcessSwitch(proc);
+
+    ProcessUnlockScheduler();
+
+    return 0;
+}
+
+
+
 //
 // -- Sleep until the we reach the number of micro-seconds since boot
 //    ---------------------------------------------------------------
 Return_t sch_ProcessMicroSleepUntil(uint64_t when)
 {
-    if (when <= TmrCurrentCount()) return 0;
+    if (when <= ClockMicros()) return 0;
 
     ProcessLockAndPostpone();
     CurrentThread()->wakeAtMicros = when;
@@ -777,24 +1066,34 @@ Return_t sch_ProcessMicroSleepUntil(uint64_t when)
 //    ---------------------------------------------
 void SchedulerCreateKInitAp(int cpu)
 {
-    Process_t *proc = NEW(Process_t);
+    SetCpuStruct(cpu);
+
+    Process_t *proc = ProcessAlloc();
     char name[CMD_LEN] = {0};
 
     kMemSetB(proc, 0, sizeof(Process_t));
+#if IS_ENABLED(FPU_STATE)
+    FpuProcessInit(proc);
+#endif
 
     // -- set the name of the process
     ksprintf(name, "kInitAp(%d)", cpu);
-    kprintf(".. naming the process: %s\n", name);
+    KLOG(SCHED, DEBUG, ".. naming the process: %s\n", name);
     int len = kStrLen(name + 1);
     proc->command[len + 1] = 0;
     kStrCpy(proc->command, name);
 
+    // -- the APs all start at once
+    ProcessLockScheduler(true);
     proc->pid = scheduler.nextPID ++;
+    ProcessUnlockScheduler();
+
     proc->policy = POLICY_0;
     proc->priority = PTY_LOW;
     proc->status = PROC_RUNNING;
     AtomicSet(&proc->quantumLeft, proc->priority);
-    proc->timeUsed = cpus[LapicGetId()].lastTimer - TmrCurrentCount();
+    proc->timeUsed = 0;
+    ThisCpu()->lastTimer = ClockNanos();
     proc->wakeAtMicros = 0;
     ListInit(&proc->stsQueue);
     ListInit(&proc->references.list);
@@ -802,7 +1101,6 @@ void SchedulerCreateKInitAp(int cpu)
 
     proc->virtAddrSpace = GetAddressSpace();
 
-    SetCpuStruct(cpu);
     CurrentThreadAssign(proc);
 
     ProcessAddGlobal(proc);
@@ -1139,7 +1437,7 @@ void DebugListReadyProcesses(void)
 
     ksprintf(buf, "|  " ANSI_ATTR_BOLD "Scheduler Process Change Pending:" ANSI_ATTR_NORMAL
             " %-3.3s                            |\n",
-            scheduler.processChangePending?"yes":"no");
+            ThisCpu()->processChangePending?"yes":"no");
     DbgOutput(buf);
 
     ksprintf(buf, "|  " ANSI_ATTR_BOLD "Scheduler Lock Count:" ANSI_ATTR_NORMAL
@@ -1149,7 +1447,7 @@ void DebugListReadyProcesses(void)
 
     ksprintf(buf, "|  " ANSI_ATTR_BOLD "Scheduler Postpone Count:" ANSI_ATTR_NORMAL
             " %-8d                               |\n",
-            AtomicRead(&scheduler.postponeCount));
+            AtomicRead(&ThisCpu()->postponeCount));
     DbgOutput(buf);
 
     DbgOutput("+-------------------------------------------------------------------+\n");
@@ -0,0 +1,419 @@
+//====================================================================================================================
+//
+//  sync.cc -- Wait queues, mutexes and semaphores, which block rather than spin
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  A spinlock is right for a few instructions with interrupts disabled; for anything longer a process should
+//  give up the cpu while it waits.  These block the waiting process in PROC_MTXW or PROC_SEMW on the object's
+//  own list and make it ready again when the object is given back.
+//
+//  A mutex is taken with a single compare-and-swap when it is free.  When it is held by a process running on
+//  another cpu, the caller spins up to MUTEX_SPIN times first, since the owner is likely to release it before a
+//  block and a switch would pay off.  Once a process blocks, MUTEX_WAITERS is set in the owner, so the unlock
+//  takes the slow path and hands the mutex straight to the first waiter.  A semaphore is taken the same way
+//  while its count is above 0, and a post with a waiter hands the unit straight to it.  Handing over rather
+//  than releasing means a woken process never finds the object taken again and has to block a second time.
+//
+//  A wait queue blocks until it is woken.  The caller checks its condition holding a mutex and passes it to
+//  `krn_WaitQueueWait()`, which is released only once the caller is on the queue and taken again on waking, so
+//  a wake made by the next holder is never lost.
+//
+//  The lists and the waiters bit are protected by the scheduler lock.  The objects are on the kernel heap,
+//  which every address space maps, and are freed by their creator once nothing waits on them.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "heap.h"
+#include "lists.h"
+#include "kernel-funcs.h"
+#include "scheduler.h"
+#include "sync.h"
+
+
+
+//
+// -- Take the first process off a wait list; the scheduler is locked
+//    ---------------------------------------------------------------
+static Process_t *SyncFirstWaiter(ListHead_t *waiting)
+{
+    if (IsListEmpty(waiting)) return NULL;
+
+    Process_t *proc = FIND_PARENT(waiting->list.next, Process_t, stsQueue);
+    ListRemoveInit(&proc->stsQueue);
+
+    return proc;
+}
+
+
+
+// =================
+// == Wait Queues ==
+// =================
+
+
+//
+// -- Create a wait queue
+//    -------------------
+WaitQueue_t *krn_WaitQueueCreate(void)
+{
+    WaitQueue_t *wq = NEW(WaitQueue_t);
+    if (!wq) return NULL;
+
+    kMemSetB(wq, 0, sizeof(WaitQueue_t));
+    ListInit(&wq->waiting.list);
+
+    return wq;
+}
+
+
+
+//
+// -- Free a wait queue; -EBUSY while a process waits on it
+//    -----------------------------------------------------
+Return_t krn_WaitQueueRelease(WaitQueue_t *wq)
+{
+    if (!wq) return -EINVAL;
+
+    ProcessLockAndPostpone();
+    bool busy = !IsListEmpty(&wq->waiting);
+    ProcessUnlockAndSchedule();
+
+    if (busy) return -EBUSY;
+
+    FREE(wq);
+
+    return 0;
+}
+
+
+
+//
+// -- Wait on a queue until woken.  When `mtx` is given, the current process must hold it; it is released once
+//    the process is on the queue and taken again before returning.
+//    --------------------------------------------------------------------------------------------------------
+Return_t krn_WaitQueueWait(WaitQueue_t *wq, Mutex_t *mtx)
+{
+    Process_t *me = CurrentThread();
+    if (!wq || !me) return -EINVAL;
+    if (mtx && (__atomic_load_n(&mtx->owner, __ATOMIC_RELAXED) & ~(Addr_t)MUTEX_WAITERS) != (Addr_t)me) {
+        return -EPERM;
+    }
+
+    ProcessLockAndPostpone();
+    Enqueue(&wq->waiting, &me->stsQueue);
+    if (mtx) krn_MutexUnlock(mtx);
+    sch_ProcessBlock(PROC_SEMW);
+    ProcessUnlockAndSchedule();                 // -- the switch away happens here
+
+    if (mtx) return krn_MutexLock(mtx);
+
+    return 0;
+}
+
+
+
+//
+// -- Wake up to `count` processes waiting on a queue, or all of them when `count` is 0; returns the number woken
+//    -----------------------------------------------------------------------------------------------------------
+int krn_WaitQueueWake(WaitQueue_t *wq, int count)
+{
+    if (!wq || count < 0) return -EINVAL;
+
+    int woken = 0;
+
+    ProcessLockAndPostpone();
+
+    while (count == 0 || woken < count) {
+        Process_t *proc = SyncFirstWaiter(&wq->waiting);
+        if (!proc) break;
+
+        sch_ProcessUnblock(proc);
+        woken ++;
+    }
+
+    ProcessUnlockAndSchedule();
+
+    return woken;
+}
+
+
+
+// =============
+// == Mutexes ==
+// =============
+
+
+//
+// -- Create a mutex, not held
+//    ------------------------
+Mutex_t *krn_MutexCreate(void)
+{
+    Mutex_t *mtx = NEW(Mutex_t);
+    if (!mtx) return NULL;
+
+    kMemSetB(mtx, 0, sizeof(Mutex_t));
+    ListInit(&mtx->waiting.list);
+
+    return mtx;
+}
+
+
+
+//
+// -- Free a mutex; -EBUSY while it is held
+//    -------------------------------------
+Return_t krn_MutexRelease(Mutex_t *mtx)
+{
+    if (!mtx) return -EINVAL;
+    if (__atomic_load_n(&mtx->owner, __ATOMIC_ACQUIRE) != 0) return -EBUSY;
+
+    FREE(mtx);
+
+    return 0;
+}
+
+
+
+//
+// -- Take a mutex if it is free
+//    --------------------------
+static inline bool MutexTake(Mutex_t *mtx, Process_t *me)
+{
+    Addr_t exp = 0;
+
+    return __atomic_compare_exchange_n(&mtx->owner, &exp, (Addr_t)me, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+
+
+//
+// -- Take a mutex without waiting: -EBUSY when it is held
+//    ----------------------------------------------------
+Return_t krn_MutexTry(Mutex_t *mtx)
+{
+    Process_t *me = CurrentThread();
+    if (!mtx || !me) return -EINVAL;
+
+    return MutexTake(mtx, me) ? 0 : -EBUSY;
+}
+
+
+
+//
+// -- Take a mutex, spinning while its owner runs on another cpu and then blocking in PROC_MTXW.  A mutex is not
+//    recursive: -EDEADLK when the current process already holds it.
+//    ---------------------------------------------------------------------------------------------------------
+Return_t krn_MutexLock(Mutex_t *mtx)
+{
+    Process_t *me = CurrentThread();
+    if (!mtx || !me) return -EINVAL;
+
+    for (int spin = 0; ; spin ++) {
+        if (MutexTake(mtx, me)) return 0;
+
+        Process_t *owner = (Process_t *)(__atomic_load_n(&mtx->owner, __ATOMIC_RELAXED) & ~(Addr_t)MUTEX_WAITERS);
+
+        if (owner == me) return -EDEADLK;
+        if (spin >= MUTEX_SPIN) break;
+        if (owner != NULL && *(volatile ProcStatus_t *)&owner->status != PROC_RUNNING) break;
+
+        __builtin_ia32_pause();
+    }
+
+    while (true) {
+        ProcessLockAndPostpone();
+
+        Addr_t owner = __atomic_load_n(&mtx->owner, __ATOMIC_RELAXED);
+
+        if (owner == 0) {
+            bool taken = MutexTake(mtx, me);
+            ProcessUnlockAndSchedule();
+
+            if (taken) return 0;
+            continue;
+        }
+
+        // -- the owner may have changed, or released it, since it was read
+        if (!__atomic_compare_exchange_n(&mtx->owner, &owner, owner | MUTEX_WAITERS, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            ProcessUnlockAndSchedule();
+            continue;
+        }
+
+        Enqueue(&mtx->waiting, &me->stsQueue);
+        sch_ProcessBlock(PROC_MTXW);
+        ProcessUnlockAndSchedule();             // -- the switch away happens here
+
+        // -- `krn_MutexUnlock()` handed the mutex to this process
+        return 0;
+    }
+}
+
+
+
+//
+// -- Release a mutex, handing it to the first waiting process; -EPERM when the current process does not hold it
+//    ----------------------------------------------------------------------------------------------------------
+Return_t krn_MutexUnlock(Mutex_t *mtx)
+{
+    Process_t *me = CurrentThread();
+    if (!mtx || !me) return -EINVAL;
+
+    Addr_t exp = (Addr_t)me;
+
+    if (__atomic_compare_exchange_n(&mtx->owner, &exp, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) return 0;
+    if ((exp & ~(Addr_t)MUTEX_WAITERS) != (Addr_t)me) return -EPERM;
+
+    // -- MUTEX_WAITERS is set, and only changes under the scheduler lock
+    ProcessLockAndPostpone();
+
+    Process_t *next = SyncFirstWaiter(&mtx->waiting);
+
+    if (!next) {
+        __atomic_store_n(&mtx->owner, 0, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&mtx->owner, (Addr_t)next | (IsListEmpty(&mtx->waiting) ? 0 : MUTEX_WAITERS),
+                __ATOMIC_RELEASE);
+        sch_ProcessUnblock(next);
+    }
+
+    ProcessUnlockAndSchedule();
+
+    return 0;
+}
+
+
+
+// ================
+// == Semaphores ==
+// ================
+
+
+//
+// -- Create a semaphore with `count` units
+//    -------------------------------------
+Semaphore_t *krn_SemCreate(int64_t count)
+{
+    if (count < 0) return NULL;
+
+    Semaphore_t *sem = NEW(Semaphore_t);
+    if (!sem) return NULL;
+
+    kMemSetB(sem, 0, sizeof(Semaphore_t));
+    sem->count = count;
+    ListInit(&sem->waiting.list);
+
+    return sem;
+}
+
+
+
+//
+// -- Free a semaphore; -EBUSY while a process waits on it
+//    ----------------------------------------------------
+Return_t krn_SemRelease(Semaphore_t *sem)
+{
+    if (!sem) return -EINVAL;
+
+    ProcessLockAndPostpone();
+    bool busy = !IsListEmpty(&sem->waiting);
+    ProcessUnlockAndSchedule();
+
+    if (busy) return -EBUSY;
+
+    FREE(sem);
+
+    return 0;
+}
+
+
+
+//
+// -- Take a unit while there is one
+//    ------------------------------
+static inline bool SemTake(Semaphore_t *sem)
+{
+    int64_t c = __atomic_load_n(&sem->count, __ATOMIC_RELAXED);
+
+    while (c > 0) {
+        if (__atomic_compare_exchange_n(&sem->count, &c, c - 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+//
+// -- Take a unit without waiting: -EAGAIN when there is none
+//    -------------------------------------------------------
+Return_t krn_SemTry(Semaphore_t *sem)
+{
+    if (!sem) return -EINVAL;
+
+    return SemTake(sem) ? 0 : -EAGAIN;
+}
+
+
+
+//
+// -- Take a unit, blocking in PROC_SEMW until one is posted
+//    ------------------------------------------------------
+Return_t krn_SemWait(Semaphore_t *sem)
+{
+    Process_t *me = CurrentThread();
+    if (!sem || !me) return -EINVAL;
+
+    if (SemTake(sem)) return 0;
+
+    ProcessLockAndPostpone();
+
+    // -- a post adds to the count only under the scheduler lock, and only when nobody waits
+    if (SemTake(sem)) {
+        ProcessUnlockAndSchedule();
+        return 0;
+    }
+
+    Enqueue(&sem->waiting, &me->stsQueue);
+    sch_ProcessBlock(PROC_SEMW);
+    ProcessUnlockAndSchedule();                 // -- the switch away happens here
+
+    // -- `krn_SemPost()` handed the unit to this process
+    return 0;
+}
+
+
+
+//
+// -- Give back a unit, straight to the first waiting process when there is one
+//    -------------------------------------------------------------------------
+Return_t krn_SemPost(Semaphore_t *sem)
+{
+    if (!sem) return -EINVAL;
+
+    ProcessLockAndPostpone();
+
+    Process_t *next = SyncFirstWaiter(&sem->waiting);
+
+    if (next) sch_ProcessUnblock(next);
+    else __atomic_add_fetch(&sem->count, 1, __ATOMIC_RELEASE);
+
+    ProcessUnlockAndSchedule();
+
+    return 0;
+}
+
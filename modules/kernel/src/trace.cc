@@ -0,0 +1,260 @@
+//====================================================================================================================
+//
+//  trace.cc -- Per-cpu binary trace rings for scheduler and interrupt events
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-22  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "cpu.h"
+#include "kernel-funcs.h"
+#include "stacks.h"
+#include "trace.h"
+
+
+
+#if IS_ENABLED(TRACE_BUFFER)
+
+
+//
+// -- A trace ring; the head is only ever incremented, so `head & (TRACE_RING_ENTRIES - 1)` is the next record
+//    --------------------------------------------------------------------------------------------------------
+typedef struct TraceRing_t {
+    uint64_t head __attribute__((aligned(64)));
+    TraceRecord_t rec[TRACE_RING_ENTRIES];
+} TraceRing_t;
+
+
+static_assert((TRACE_RING_ENTRIES & (TRACE_RING_ENTRIES - 1)) == 0, "TRACE_RING_ENTRIES must be a power of 2");
+
+
+//
+// -- The event names, in TraceType_t order; these are written into the dump for the decoder
+//    --------------------------------------------------------------------------------------
+static const char *traceNames[] = {
+    "switch",
+    "expire",
+    "block",
+    "unblock",
+    "ipi-send",
+    "ipi-recv",
+    "internal",
+};
+
+static_assert(sizeof(traceNames) / sizeof(traceNames[0]) == TRC_COUNT, "traceNames[] is out of sync with TraceType_t");
+
+
+//
+// -- The rings and whether we are recording
+//    --------------------------------------
+static TraceRing_t traceRings[MAX_CPU];
+static volatile bool traceOn = false;
+
+
+
+//
+// -- Record an event.  The head is claimed atomically since an interrupt on this cpu can record an event in
+//    the middle of this one.
+//    ------------------------------------------------------------------------------------------------------
+void TraceEvent(uint64_t type, uint64_t a, uint64_t b)
+{
+    if (!traceOn) return;
+
+    int cpu = ThisCpu()->cpuNum;
+    TraceRing_t *r = &traceRings[cpu];
+    uint64_t i = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED) & (TRACE_RING_ENTRIES - 1);
+    TraceRecord_t *rec = &r->rec[i];
+
+    rec->tsc = RDTSC();
+    rec->type = type;
+    rec->cpu = cpu;
+    rec->a = a;
+    rec->b = b;
+}
+
+
+//
+// -- Every cpu, the APs included, has its cpu structure, so `ThisCpu()` can be trusted; start recording.  An AP
+//    makes internal calls before its gs base is set, so this must wait until they have all started.
+//    ------------------------------------------------------------------------------------------------------------
+void TraceInit(void)
+{
+    traceOn = true;
+}
+
+
+#if IS_ENABLED(KERNEL_DEBUGGER)
+
+#include "debugger.h"
+
+
+//
+// -- Dump the rings in the text format `utils/trace2json.py` reads, oldest record first for each cpu.
+//    Recording is suspended for the dump, since every line of output is itself an internal service call.
+//    ---------------------------------------------------------------------------------------------------
+void DebugTraceDump(void)
+{
+    char buf[100];
+    bool wasOn = traceOn;
+    traceOn = false;
+
+    ksprintf(buf, "#TRACE 1 %d %d\n", MAX_CPU, TRACE_RING_ENTRIES);
+    DbgOutput(buf);
+
+    for (int t = 0; t < TRC_COUNT; t ++) {
+        ksprintf(buf, "#EVENT %d %s\n", t, traceNames[t]);
+        DbgOutput(buf);
+    }
+
+    for (int c = 0; c < MAX_CPU; c ++) {
+        TraceRing_t *r = &traceRings[c];
+        uint64_t end = r->head;
+        uint64_t start = end > TRACE_RING_ENTRIES ? end - TRACE_RING_ENTRIES : 0;
+
+        for (uint64_t i = start; i < end; i ++) {
+            TraceRecord_t *rec = &r->rec[i & (TRACE_RING_ENTRIES - 1)];
+
+            ksprintf(buf, "%d %p %d ", rec->cpu, rec->tsc, rec->type);
+            ksprintf(buf + kStrLen(buf), "%p %p\n", rec->a, rec->b);
+            DbgOutput(buf);
+        }
+    }
+
+    DbgOutput("#END\n");
+
+    traceOn = wasOn;
+}
+
+
+//
+// -- Start, stop, and clear recording
+//    --------------------------------
+void DebugTraceStart(void)
+{
+    traceOn = true;
+    DbgOutput("Tracing is on\n");
+}
+
+
+void DebugTraceStop(void)
+{
+    traceOn = false;
+    DbgOutput("Tracing is off\n");
+}
+
+
+void DebugTraceClear(void)
+{
+    bool wasOn = traceOn;
+    traceOn = false;
+
+    for (int c = 0; c < MAX_CPU; c ++) traceRings[c].head = 0;
+
+    traceOn = wasOn;
+    DbgOutput("Trace rings cleared\n");
+}
+
+
+
+//
+// -- here is the debugger menu & function ecosystem
+//    ----------------------------------------------
+DbgState_t traceStates[] = {
+    {   // -- state 0
+        .name = "trace",
+        .transitionFrom = 0,
+        .transitionTo = 4,
+    },
+    {   // -- state 1 (dump)
+        .name = "dump",
+        .function = (Addr_t)DebugTraceDump,
+    },
+    {   // -- state 2 (start)
+        .name = "start",
+        .function = (Addr_t)DebugTraceStart,
+    },
+    {   // -- state 3 (stop)
+        .name = "stop",
+        .function = (Addr_t)DebugTraceStop,
+    },
+    {   // -- state 4 (clear)
+        .name = "clear",
+        .function = (Addr_t)DebugTraceClear,
+    },
+};
+
+
+DbgTransition_t traceTrans[] = {
+    {   // -- transition 0
+        .command = "dump",
+        .alias = "d",
+        .nextState = 1,
+    },
+    {   // -- transition 1
+        .command = "start",
+        .alias = "on",
+        .nextState = 2,
+    },
+    {   // -- transition 2
+        .command = "stop",
+        .alias = "off",
+        .nextState = 3,
+    },
+    {   // -- transition 3
+        .command = "clear",
+        .alias = "c",
+        .nextState = 4,
+    },
+    {   // -- transition 4
+        .command = "exit",
+        .alias = "x",
+        .nextState = -1,
+    },
+};
+
+
+DbgModule_t traceModule = {
+    .name = "trace",
+    .addrSpace = GetAddressSpace(),
+    .stack = 0,     // -- needs to be handled during late init
+    .stateCnt = sizeof(traceStates) / sizeof (DbgState_t),
+    .transitionCnt = sizeof(traceTrans) / sizeof (DbgTransition_t),
+    .list = {&traceModule.list, &traceModule.list},
+    .lock = {0},
+    // -- it does not matter what we put for .states and .transitions; will be replaced in debugger
+};
+
+
+/****************************************************************************************************************//**
+*   @fn                 void TraceDebugInit(void)
+*   @brief              Initialize the debugger module structure
+*
+*   Initialize the debugger module for the trace rings
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" void TraceDebugInit(void)
+{
+    extern Addr_t __stackSize;
+
+    traceModule.stack = StackFind();
+    for (Addr_t s = traceModule.stack; s < traceModule.stack + __stackSize; s += PAGE_SIZE) {
+        MmuMapPage(s, PmmAlloc(), PG_WRT);
+    }
+    traceModule.stack += __stackSize;
+
+    DbgRegister(&traceModule, traceStates, traceTrans);
+}
+
+
+#endif
+#endif
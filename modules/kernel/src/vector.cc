@@ -13,6 +13,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Sep-10  Initial  v0.0.9d  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Clock-based ticks; device vectors; cross-cpu call and reschedule IPIs
 //
 //===================================================================================================================
 
@@ -24,7 +25,13 @@
 #include "internals.h"
 #include "scheduler.h"
 #include "kernel-funcs.h"
+#include "mmu.h"
+#include "elf.h"
 #include "idt.h"
+#include "trace.h"
+#include "profile.h"
+#include "pmu.h"
+#include "stacks.h"
 
 
 //
@@ -33,6 +40,18 @@
 ServiceRoutine_t vectorTable[256] = { { 0 }};
 
 
+//
+// -- the number of times each vector has been raised (counted on entry; see `idt-asm.s`)
+//    -----------------------------------------------------------------------------------
+uint64_t vectorCount[256] = { 0 };
+
+
+//
+// -- serializes handing out the device vectors
+//    -----------------------------------------
+static Spinlock_t vectorLock = {0};
+
+
 
 //
 // -- Get an interrupt vector handler
@@ -69,15 +88,90 @@ Return_t krn_SetVectorHandler(int i, Addr_t handler, Addr_t cr3, Addr_t stack)
 
 
 
+//
+// -- Allocate `count` device vectors (a power of 2, aligned, as multi-message MSI needs) for a handler
+//
+//    Each vector of a block may run on a different cpu at once, so a block cannot share a handler stack.
+//    Returns the first vector, or -EINVAL for a bad request and -EBUSY when no block is free.
+//    ----------------------------------------------------------------------------------------------------
+Return_t krn_VectorAlloc(int count, Addr_t handler, Addr_t cr3, Addr_t stack)
+{
+    if (count < 1 || count > 32 || (count & (count - 1)) != 0 || handler == 0) return -EINVAL;
+    if (count > 1 && stack != 0) return -EINVAL;
+
+    Return_t rv = -EBUSY;
+
+    SpinLock(&vectorLock); {
+        for (int v = (INT_DEVICE_FIRST + count - 1) & ~(count - 1); v + count - 1 <= INT_DEVICE_LAST; v += count) {
+            bool free = true;
+
+            for (int i = v; i < v + count; i ++) {
+                if (vectorTable[i].handler != 0) {
+                    free = false;
+                    break;
+                }
+            }
+
+            if (!free) continue;
+
+            for (int i = v; i < v + count; i ++) {
+                krn_SetVectorHandler(i, handler, cr3, stack);
+                vectorCount[i] = 0;
+            }
+
+            rv = v;
+            break;
+        }
+    } SpinUnlock(&vectorLock);
+
+    return rv;
+}
+
+
+
+//
+// -- Release a device vector from `krn_VectorAlloc()`; the interrupt source must already be quiet
+//    --------------------------------------------------------------------------------------------
+Return_t krn_VectorFree(int i)
+{
+    if (i < INT_DEVICE_FIRST || i > INT_DEVICE_LAST) return -EINVAL;
+
+    SpinLock(&vectorLock); {
+        vectorTable[i].handler = 0;
+        vectorTable[i].cr3 = 0;
+        vectorTable[i].stack = 0;
+    } SpinUnlock(&vectorLock);
+
+    return 0;
+}
+
+
+
+//
+// -- The number of times a vector has been raised
+//    --------------------------------------------
+uint64_t krn_VectorCount(int i)
+{
+    if (i < 0 || i >= 256) return 0;
+
+    return __atomic_load_n(&vectorCount[i], __ATOMIC_RELAXED);
+}
+
+
+
 //
 // -- This is the timer vector
 //    ------------------------
 extern "C" void TimerVector(Addr_t *);
-void TimerVector(Addr_t *)
+void TimerVector(Addr_t *regs)
 {
-    uint64_t now = TmrTick();
+    PROFILE_TICK(regs);
+    PMU_TICK();
+
+    ThisCpu()->lastTick = ClockNanos();             // -- the idle driver expects the next tick 1 period on
+    TmrTick();
     TmrEoi();
-    sch_Tick(now);
+    sch_Tick(ClockMicros());
 }
 
 
@@ -89,6 +183,7 @@ AtomicInt_t coresEngaged = { 0 };
 //    -----------------------------------------------
 extern "C" void IpiPauseCores(Addr_t *regs)
 {
+    TRACE(TRC_IPI_RECV, IPI_PAUSE_CORES, 0);
     AtomicInc(&coresEngaged);
     cpus[LapicGetId()].stackTop = (Addr_t)regs;
 
@@ -100,6 +195,52 @@ extern "C" void IpiPauseCores(Addr_t *regs)
 
 
 
+//
+// -- Exceptions are reported by the generic handler, which works from the vector table entry
+//    ---------------------------------------------------------------------------------------
+extern "C" void IdtGenericVector(Addr_t *, ServiceRoutine_t *);
+void IdtGenericVector(Addr_t *, ServiceRoutine_t *entry)
+{
+    IdtGenericHandler(entry);
+}
+
+
+
+
+//
+// -- The page fault handler gets its own stack, which also means that the vector lock is held while it runs and
+//    the saved registers cannot be replaced by a fault on another cpu
+//    ----------------------------------------------------------------------------------------------------------
+#define PAGE_FAULT_STACK        0xffffff000000a000
+
+
+//
+// -- Handle a page fault: a not-present page in a demand-paged module is mapped and the instruction restarted;
+//    anything else is fatal
+//    ---------------------------------------------------------------------------------------------------------
+extern "C" void PageFaultVector(Addr_t *);
+void PageFaultVector(Addr_t *regs)
+{
+    Addr_t cr2 = regs[6];
+    Addr_t err = regs[25];
+
+    if ((err & 1) == 0 && ElfPageFault(cr2) == 0) return;
+    if (StackIsGuard(cr2)) kprintf("Kernel stack overflow: %p is in the guard page below a stack\n", cr2);
+
+    IdtGenericHandler(&vectorTable[14]);
+}
+
+
+//
+// -- Install the page fault handler; this needs the internal functions table to be initialized
+//    -----------------------------------------------------------------------------------------
+void PageFaultInit(void)
+{
+    cmn_MmuMapPage(PAGE_FAULT_STACK, PmmAlloc(), PG_WRT);
+    krn_SetVectorHandler(14, (Addr_t)PageFaultVector, 0, PAGE_FAULT_STACK + PAGE_SIZE);
+}
+
+
 
 
 //
@@ -116,40 +257,42 @@ extern "C" void IpiPauseCores(Addr_t *regs)
 // -- Initialize the vector table
 void VectorInit(void)
 {
-    krn_SetVectorHandler( 0, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 1, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 2, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 3, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 4, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 5, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 6, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 7, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 8, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler( 9, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(10, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(11, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(12, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(13, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(14, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(15, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(16, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(17, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(18, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(19, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(20, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(21, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(22, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(23, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(24, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(25, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(26, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(27, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(28, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(29, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(30, (Addr_t)IdtGenericHandler, 0, 0);
-    krn_SetVectorHandler(31, (Addr_t)IdtGenericHandler, 0, 0);
+    krn_SetVectorHandler( 0, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 1, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 2, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 3, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 4, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 5, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 6, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 7, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 8, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler( 9, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(10, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(11, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(12, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(13, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(14, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(15, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(16, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(17, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(18, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(19, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(20, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(21, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(22, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(23, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(24, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(25, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(26, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(27, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(28, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(29, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(30, (Addr_t)IdtGenericVector, 0, 0);
+    krn_SetVectorHandler(31, (Addr_t)IdtGenericVector, 0, 0);
 
     krn_SetVectorHandler(IPI_PAUSE_CORES, (Addr_t)IpiPauseCores, 0, 0);
+    krn_SetVectorHandler(IPI_CALL_FUNCTION, (Addr_t)IpiCallFunction, 0, 0);
+    krn_SetVectorHandler(IPI_RESCHEDULE, (Addr_t)IpiReschedule, 0, 0);
     krn_SetVectorHandler(INT_TIMER, (Addr_t)TimerVector, 0, 0);
 }
 
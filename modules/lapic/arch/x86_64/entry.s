@@ -11,6 +11,7 @@
 ;;     Date      Tracker  Version  Pgmr  Description
 ;;  -----------  -------  -------  ----  --------------------------------------------------------------------------
 ;;  2021-May-05  Initial  v0.0.8   ADCL  Initial version
+;;  2021-Nov-26  Initial  v0.0.13  ADCL  Calibrate after the HPET, when there is one; targeted IPIs
 ;;
 ;;===================================================================================================================
 
@@ -23,10 +24,13 @@
                 extern      tmr_GetCurrentTimer
                 extern      tmr_Tick
                 extern      tmr_Eoi
+                extern      tmr_SetPerfLvt
                 extern      ipi_LapicGetId
                 extern      ipi_SendInit
                 extern      ipi_SendSipi
                 extern      ipi_SendIpi
+                extern      ipi_SendTo
+                extern      ipi_SendMask
 
 %include        'constants.inc'
 
@@ -43,8 +47,9 @@ header:
                 dq          Init                                                        ;; Late Init
                 dq          0xffffaf4000000000                                          ;; Stack Locations
                 dq          0                                                           ;; interrupts
-                dq          8                                                           ;; internal Services
+                dq          11                                                          ;; internal Services
                 dq          0                                                           ;; OS services
+                dq          2                                                           ;; dependencies
                 dq          INT_TMR_CURRENT_COUNT                                       ;; Internal fctn 0x040 (Tmr Cnt)
                 dq          tmr_GetCurrentTimer                                         ;; .. target address
                 dq          0                                                           ;; .. stack
@@ -57,6 +62,9 @@ header:
                 dq          INT_TMR_REINIT                                              ;; Internal fctn 0x043 (reInit)
                 dq          X2ApicInitEarly                                             ;; .. target address
                 dq          0                                                           ;; .. stack
+                dq          INT_TMR_PERF_LVT                                            ;; Internal fctn 0x044 (Perf LVT)
+                dq          tmr_SetPerfLvt                                              ;; .. target address
+                dq          0                                                           ;; .. stack
                 dq          INT_IPI_CURRENT_CPU                                         ;; Internal fctn 0x080 (LAPICID)
                 dq          ipi_LapicGetId                                              ;; .. target address
                 dq          0                                                           ;; .. stack
@@ -66,7 +74,15 @@ header:
                 dq          INT_IPI_SEND_SIPI                                           ;; Internal fctn 0x082 (SIPI)
                 dq          ipi_SendSipi                                                ;; .. target address
                 dq          0                                                           ;; .. stack
-                dq          INT_IPI_SEND_IPI                                            ;; Internal fctn 0x082 (SIPI)
+                dq          INT_IPI_SEND_IPI                                            ;; Internal fctn 0x083 (IPI)
                 dq          ipi_SendIpi                                                 ;; .. target address
                 dq          0                                                           ;; .. stack
+                dq          INT_IPI_SEND_TO                                             ;; Internal fctn 0x084 (IPI to)
+                dq          ipi_SendTo                                                  ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_IPI_SEND_MASK                                           ;; Internal fctn 0x085 (IPI mask)
+                dq          ipi_SendMask                                                ;; .. target address
+                dq          0                                                           ;; .. stack
+                dq          INT_PMM_ALLOC                                               ;; dependency 1 (frame allocation)
+                dq          INT_HPET_NANOS                                              ;; dependency 2 (timer calibration)
 
@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-May-05 | Initial |  v0.0.08 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | INIT/SIPI to all but self; HPET calibration; targeted, mask and self IPIs
 *
 *///=================================================================================================================
 
@@ -193,10 +194,13 @@ bool IsWritable(ApicRegister_t reg)
             return true;
 
         case APIC_ICR2:
-        case APIC_SELF_IPI:
             if (apic->version == XAPIC) return true;
             else return false;
 
+        case APIC_SELF_IPI:
+            if (apic->version == X2APIC) return true;
+            else return false;
+
         default:
             return false;
     }
@@ -215,6 +219,62 @@ bool IsStatus(ApicRegister_t reg)
 
 
 
+/********************************************************************************************************************
+*   See documentation in `lapic.h`
+*///-----------------------------------------------------------------------------------------------------------------
+uint64_t LapicTimerHz(BootInterface_t *loaderInterface)
+{
+    uint64_t count;
+    uint64_t elapsed;                   // -- nanoseconds
+
+    apic->writeApicRegister(APIC_LVT_TIMER, APIC_LVT_MASKED);
+
+    if (GetInternalHandler(INT_HPET_NANOS) != 0) {
+        uint64_t start = HpetNanos();
+        uint64_t now;
+
+        apic->writeApicRegister(APIC_TIMER_ICR, 0xffffffff);
+        do {
+            now = HpetNanos();
+        } while (now - start < CLOCK_HPET_CAL_US * 1000);
+
+        count = 0xffffffff - apic->readApicRegister(APIC_TIMER_CCR);
+        elapsed = now - start;
+    } else {
+        OUTB(0x61, (INB(0x61) & 0xfd) | 1);
+        OUTB(0x43, 0xb2);
+
+        //
+        // -- So, here is the math:
+        //    We need to divide the clock by 20 to have a value large enough to get a decent time.
+        //    So, we will be measuring 1/20th of a second.
+        // -- 1193180 Hz / 20 == 59659 cycles == e90b cycles
+        OUTB(0x42, 0x0b);
+        INB(0x60);      // short delay
+        OUTB(0x42, 0xe9);
+
+        // -- now reset the PIT timer and start counting
+        uint8_t tmp = INB(0x61) & 0xfe;
+        OUTB(0x61, tmp);
+        OUTB(0x61, tmp | 1);
+
+        // -- start the APIC counter from -1
+        apic->writeApicRegister(APIC_TIMER_ICR, 0xffffffff);
+
+        while (!(INB(0x61) & 0x20)) {}  // -- busy wait here
+
+        count = 0xffffffff - apic->readApicRegister(APIC_TIMER_CCR);
+        elapsed = 1000000000 / 20;
+    }
+
+    apic->writeApicRegister(APIC_TIMER_ICR, 0);
+    BootTraceMark(loaderInterface, "lapic timer calibrated");
+
+    return count * 1000000000 / elapsed;
+}
+
+
+
 /********************************************************************************************************************
 *   See documentation above
 *///-----------------------------------------------------------------------------------------------------------------
@@ -373,6 +433,43 @@ extern "C" Return_t tmr_Eoi(void)
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 Return_t tmr_SetPerfLvt(uint32_t lvt)
+*   @brief              Program this cpu's performance monitoring counter LVT
+*
+*   The LAPIC masks this LVT each time a counter overflow interrupt is delivered, so the handler must call this
+*   again to unmask it.
+*
+*   @param              lvt                 The LVT contents: the vector and any mask bit
+*
+*   @returns            0
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" Return_t tmr_SetPerfLvt(uint32_t lvt)
+{
+    apic->writeApicRegister(APIC_LVT_PERF_COUNTING_REG, lvt);
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t IcrDest(int core)
+*   @brief              Place a physical destination in the ICR
+*
+*   The xAPIC takes an 8-bit APIC ID in bits 56-63; the x2APIC takes a 32-bit x2APIC ID in bits 32-63.
+*
+*   @param              core                The APIC ID of the destination core
+*
+*   @returns            The destination bits of the ICR
+*///-----------------------------------------------------------------------------------------------------------------
+static inline uint64_t IcrDest(int core)
+{
+    if (apic->version == X2APIC) return (uint64_t)(uint32_t)core << 32;
+    else return ((uint64_t)core & 0xff) << 56;
+}
+
+
+
 /****************************************************************************************************************//**
 *   @fn                 int ipi_LapicGetId(void)
 *   @brief              Read the Local APIC ID
@@ -394,7 +491,7 @@ extern "C" int ipi_LapicGetId(void)
 *
 *   Send an INIT IPI to a core
 *
-*   @param              core                The core to receive the INIT IPI
+*   @param              core                The core to receive the INIT IPI, or IPI_ALL_BUT_SELF
 *
 *   @returns            0
 *///-----------------------------------------------------------------------------------------------------------------
@@ -412,7 +509,8 @@ extern "C" int ipi_SendInit(int core)
     //
     //   or 0000 0000 0000 0000 1101 0101 0000 0000 (0x0000d500)
 
-    uint64_t icr = 0x000000000000d500 | (((uint64_t)core & 0xff) << 56);
+    uint64_t icr = 0x000000000000d500 | IcrDest(core);
+    if (core == IPI_ALL_BUT_SELF) icr = 0x00000000000cd500;         // -- destination shorthand (11)
 
 #if DEBUG_ENABLED(ipi_SendInit)
     char buf[64];
@@ -433,7 +531,7 @@ extern "C" int ipi_SendInit(int core)
 *
 *   Send an Startup IPI to a core
 *
-*   @param              core                The core to receive the INIT IPI
+*   @param              core                The core to receive the SIPI, or IPI_ALL_BUT_SELF
 *   @param              vector              The segment register (offset 0x0000) to set for the startup location
 *
 *   @returns            0
@@ -452,7 +550,8 @@ extern "C" int ipi_SendSipi(int core, Addr_t vector)
     //
     //   or 0000 0000 0000 0000 1101 0110 0000 0000 (0x0000d600)
 
-    uint64_t icr = 0x000000000000d600 | (((uint64_t)core & 0xff) << 56) | ((vector >> 12) & 0xff);
+    uint64_t icr = 0x000000000000d600 | IcrDest(core) | ((vector >> 12) & 0xff);
+    if (core == IPI_ALL_BUT_SELF) icr = 0x00000000000cd600 | ((vector >> 12) & 0xff);
 
     apic->writeApicIcr(icr);
 
@@ -491,6 +590,80 @@ extern "C" int ipi_SendIpi(int vector)
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 int ipi_SendTo(int core, int vector)
+*   @brief              Send a fixed IPI to one core
+*
+*   An IPI to this core uses the x2APIC SELF IPI register, which is the cheapest way to raise it, or the self
+*   destination shorthand on an xAPIC.
+*
+*   @param              core                The APIC ID of the core, or IPI_SELF
+*   @param              vector              The interrupt vector to send to the core
+*
+*   @returns            0 on success
+*
+*   @retval             -EINVAL             The core or vector is not valid
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" int ipi_SendTo(int core, int vector)
+{
+    if (vector < 0x10 || vector > 0xff) return -EINVAL;
+
+    if (core == IPI_SELF) {
+        if (apic->version == X2APIC) apic->writeApicRegister(APIC_SELF_IPI, vector);
+        else apic->writeApicIcr(APIC_ICR_SELF | vector);
+
+        return 0;
+    }
+
+    if (core < 0) return -EINVAL;
+
+    apic->writeApicIcr(IcrDest(core) | vector);
+
+    return 0;
+}
+
+
+
+/****************************************************************************************************************//**
+*   @fn                 int ipi_SendMask(uint64_t mask, int vector)
+*   @brief              Send a fixed IPI to each core in a mask of APIC IDs
+*
+*   The x2APIC logical ID is fixed by the hardware: the cluster is the APIC ID shifted right by 4 and the core
+*   is 1 bit of 16 in that cluster.  So the cores in each cluster of the mask get one logical (cluster mode)
+*   message.  The xAPIC gets one physical message per core.
+*
+*   @param              mask                The cores, with bit N for APIC ID N
+*   @param              vector              The interrupt vector to send to the cores
+*
+*   @returns            0 on success
+*
+*   @retval             -EINVAL             The vector is not valid
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" int ipi_SendMask(uint64_t mask, int vector)
+{
+    if (vector < 0x10 || vector > 0xff) return -EINVAL;
+
+    if (apic->version == X2APIC) {
+        for (int cluster = 0; mask != 0; cluster ++, mask >>= 16) {
+            uint64_t cores = mask & 0xffff;
+            if (cores == 0) continue;
+
+            apic->writeApicIcr(((((uint64_t)cluster << 16) | cores) << 32) | APIC_ICR_LOGICAL | vector);
+        }
+    } else {
+        while (mask) {
+            int core = __builtin_ctzl(mask);
+            mask &= mask - 1;
+
+            apic->writeApicIcr(IcrDest(core) | vector);
+        }
+    }
+
+    return 0;
+}
+
+
+
 #if IS_ENABLED(KERNEL_DEBUGGER) || defined(__DOXYGEN__)
 
 
@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-May-06 | Initial |  v0.0.08 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Calibrate the timer with `LapicTimerHz()`; write the whole ICR MSR
 *
 *///=================================================================================================================
 
@@ -127,7 +128,7 @@ static bool CheckX2apicStatus(ApicRegister_t reg, uint8_t index)
 *///-----------------------------------------------------------------------------------------------------------------
 static int EarlyInit(BootInterface_t *loaderInterface)
 {
-    static int freq = 1000;
+    static int freq = TIMER_HZ;
     uint64_t apicBaseMsr = RDMSR(IA32_APIC_BASE_MSR);
     bool isBoot = (apicBaseMsr & IA32_APIC_BASE_MSR__BSP) != 0;
 
@@ -167,32 +168,10 @@ static int EarlyInit(BootInterface_t *loaderInterface)
     WriteX2apicRegister(APIC_LVT_TIMER, 32);        // timer is vector 32; now unmasked
 
 
-    // -- enable the PIC timer in one-shot mode
+    // -- calibrate the timer on the BSP; the APs use the same factor
     if (isBoot) {
         KernelPrintf(".. Setting up the boot LAPIC\n");
-        OUTB(0x61, (INB(0x61) & 0xfd) | 1);
-        OUTB(0x43, 0xb2);
-
-        //
-        // -- So, here is the math:
-        //    We need to divide the clock by 20 to have a value large enough to get a decent time.
-        //    So, we will be measuring 1/20th of a second.
-        // -- 1193180 Hz / 20 == 59659 cycles == e90b cycles
-        OUTB(0x42, 0x0b);
-        INB(0x60);      // short delay
-        OUTB(0x42, 0xe9);
-
-        // -- now reset the PIT timer and start counting
-        uint8_t tmp = INB(0x61) & 0xfe;
-        OUTB(0x61, tmp);
-        OUTB(0x61, tmp | 1);
-
-        // -- reset the APIC counter to -1
-        WriteX2apicRegister(APIC_TIMER_CCR, 0xffffffff);
-
-        while (!(INB(0x61) & 0x20)) {}  // -- busy wait here
-
-        WriteX2apicRegister(APIC_LVT_TIMER, APIC_LVT_MASKED);
+        uint64_t timerHz = LapicTimerHz(loaderInterface);
 
         // -- remap the 8259 PIC to some obscure interrupts
         OUTB(0x20, 0x11);       // starts the initialization sequence (in cascade mode)
@@ -207,11 +186,7 @@ static int EarlyInit(BootInterface_t *loaderInterface)
         OUTB(0xa1, 0xff);
 
 
-        //
-        // -- Now we can calculate the cpu frequency, converting back to a full second
-        //    ------------------------------------------------------------------------
-        uint64_t cpuFreq = (0xffffffff - ReadX2apicRegister(APIC_TIMER_CCR) * 16 * 20);
-        x2apic.factor = cpuFreq / freq / 16;
+        x2apic.factor = timerHz / freq;
 
         if (((((uint64_t)x2apic.factor) >> 32) & 0xffffffff) != 0) {
             KernelPrintf("PANIC: The factor is too large for the architecture!\n");
@@ -251,13 +226,14 @@ static int GetId(void)
 *   @fn                 void WriteX2apicIcr(uint64_t val)
 *   @brief              Write 64-bits to the ICR register
 *
-*   Write 64-bits to the ICR register
+*   In x2APIC mode, the ICR is a single 64-bit MSR (the one at the ICR1 offset) with a 32-bit destination in the
+*   high half, and a write does not need to wait for the previous IPI to be delivered.
 *
 *   @param              val                 The value to write to the ICR register
 *///-----------------------------------------------------------------------------------------------------------------
 static void WriteX2apicIcr(uint64_t val)
 {
-    WriteX2apicRegister(APIC_ICR2, val);
+    WRMSR(GetX2apicMsr(APIC_ICR1), val);
 }
 
 
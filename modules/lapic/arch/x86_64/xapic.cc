@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-May-06 | Initial |  v0.0.08 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Calibrate the timer with `LapicTimerHz()`; wait for the ICR to be idle
 *
 *///=================================================================================================================
 
@@ -112,7 +113,7 @@ static bool CheckXapicStatus(ApicRegister_t reg, uint8_t index)
 *///-----------------------------------------------------------------------------------------------------------------
 static int EarlyInit(BootInterface_t *loaderInterface)
 {
-    static int freq = 1000;
+    static int freq = TIMER_HZ;
     uint64_t apicBaseMsr = RDMSR(IA32_APIC_BASE_MSR);
     bool isBoot = (apicBaseMsr & IA32_APIC_BASE_MSR__BSP) != 0;
     Frame_t apicFrame = apicBaseMsr >> 12;
@@ -157,32 +158,10 @@ static int EarlyInit(BootInterface_t *loaderInterface)
     WriteXapicRegister(APIC_LVT_TIMER, 32);        // timer is vector 32; now unmasked
 
 
-    // -- enable the PIC timer in one-shot mode
+    // -- calibrate the timer on the BSP; the APs use the same factor
     if (isBoot) {
         KernelPrintf(".. Setting up the boot LAPIC\n");
-        OUTB(0x61, (INB(0x61) & 0xfd) | 1);
-        OUTB(0x43, 0xb2);
-
-        //
-        // -- So, here is the math:
-        //    We need to divide the clock by 20 to have a value large enough to get a decent time.
-        //    So, we will be measuring 1/20th of a second.
-        // -- 1193180 Hz / 20 == 59659 cycles == e90b cycles
-        OUTB(0x42, 0x0b);
-        INB(0x60);      // short delay
-        OUTB(0x42, 0xe9);
-
-        // -- now reset the PIT timer and start counting
-        uint8_t tmp = INB(0x61) & 0xfe;
-        OUTB(0x61, tmp);
-        OUTB(0x61, tmp | 1);
-
-        // -- reset the APIC counter to -1
-        WriteXapicRegister(APIC_TIMER_ICR, 0xffffffff);
-
-        while (!(INB(0x61) & 0x20)) {}  // -- busy wait here
-
-        WriteXapicRegister(APIC_LVT_TIMER, APIC_LVT_MASKED);
+        uint64_t timerHz = LapicTimerHz(loaderInterface);
 
         // -- remap the 8259 PIC to some obscure interrupts
         OUTB(0x20, 0x11);       // starts the initialization sequence (in cascade mode)
@@ -197,11 +176,7 @@ static int EarlyInit(BootInterface_t *loaderInterface)
         OUTB(0xa1, 0xff);
 
 
-        //
-        // -- Now we can calculate the cpu frequency, converting back to a full second
-        //    ------------------------------------------------------------------------
-        uint64_t cpuFreq = (0xffffffff - ReadXapicRegister(APIC_TIMER_CCR)) * 16 * 20;
-        xapic.factor = cpuFreq / freq / 16;
+        xapic.factor = timerHz / freq;
 
         if (((((uint64_t)xapic.factor) >> 32) & 0xffffffff) != 0) {
             KernelPrintf("PANIC: The factor is too large for the architecture!\n");
@@ -252,6 +227,9 @@ static void WriteXapicIcr(uint64_t val)
     uint32_t hi = (uint32_t)((val >> 32) & 0xffffffff);
     uint32_t lo = (uint32_t)(val & 0xffffffff);
 
+    // -- the previous IPI must be sent before the ICR is written again
+    while (ReadXapicRegister(APIC_ICR1) & APIC_ICR_PENDING) {}
+
     WriteXapicRegister(APIC_ICR2, hi);
     WriteXapicRegister(APIC_ICR1, lo);
 }
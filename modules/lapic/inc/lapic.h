@@ -14,6 +14,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-May-05 | Initial |  v0.0.08 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Add `LapicTimerHz()`
 *
 *///=================================================================================================================
 
@@ -185,3 +186,19 @@ extern "C" bool IsWritable(ApicRegister_t reg);
 *///-----------------------------------------------------------------------------------------------------------------
 extern "C" bool IsStatus(ApicRegister_t reg);
 
+
+
+/****************************************************************************************************************//**
+*   @fn                 uint64_t LapicTimerHz(BootInterface_t *loaderInterface)
+*   @brief              Measure the rate of this cpu's LAPIC timer
+*
+*   Count the LAPIC timer (with the divide configuration already set) over CLOCK_HPET_CAL_US of the HPET when
+*   the HPET module has provided it, or over 1/20th of a second of PIT channel 2 when it has not.  The timer
+*   is left stopped and masked.
+*
+*   @param              loaderInterface     The Loader Interface structure, for the boot trace
+*
+*   @returns            The LAPIC timer ticks per second
+*///-----------------------------------------------------------------------------------------------------------------
+extern "C" uint64_t LapicTimerHz(BootInterface_t *loaderInterface);
+
@@ -22,41 +22,6 @@
                 global  InternalDispatch3
                 global  InternalDispatch4
                 global  InternalDispatch5
-                global  KernelPrintf
-
-
-;;
-;; -- Internal Function 8 -- kprintf
-;;    ------------------------------
-KernelPrintf:
-                push    r9
-                push    r8
-                push    rcx
-                push    rdx
-                push    rsi
-                push    rdi
-                push    r11
-
-                mov     r11,r9
-                mov     r9,r8
-                mov     r8,rcx
-                mov     rcx,rdx
-                mov     rdx,rsi
-                mov     rsi,rdi
-                mov     rdi,0x008
-                int     0xe0
-
-                pop     r11
-                pop     rdi
-                pop     rsi
-                pop     rdx
-                pop     rcx
-                pop     r8
-                pop     r9
-
-                ret
-
-
 
 
 ;;
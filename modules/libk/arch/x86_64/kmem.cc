@@ -0,0 +1,602 @@
+//===================================================================================================================
+//
+//  kmem.cc -- Memory and string functions, with the implementation chosen for the cpu at boot
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Every image (the kernel and each module) links its own copy of libk, so each one chooses its implementation
+//  when it runs its init table:
+//  * "word" works 8 bytes at a time and is used until then, so it must work on any x86_64 cpu
+//  * "erms" uses `rep stosb`/`rep movsb` for memset and memmove when the cpu has Enhanced REP MOVSB/STOSB,
+//    since microcode then moves whole cache lines
+//
+//  The SSE2 and AVX2 versions need the vector registers, which belong to the running process.  They are only
+//  used for blocks of at least LIBK_SIMD_MIN bytes, only on a cpu without ERMS, and only after the image calls
+//  `LibkSimdEnable()` with the functions which save the process state around them (the kernel does this with
+//  `FpuKernelBegin()` and `FpuKernelEnd()`).  Strings are scanned a word at a time in all cases: kernel strings
+//  are short, and aligned 8-byte reads never cross into another page.
+//
+//  `utils/kmem-bench.cc` builds this file on the host to check and time each implementation.
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-25  Initial  v0.0.13  ADCL  Initial version; replaces kMemSetB.s, kMemMoveB.s, kStrCpy.s and kStrLen.s
+//
+//===================================================================================================================
+
+
+#ifndef KMEM_HOST_BENCH
+#   include "types.h"
+#   include "kernel-funcs.h"
+#else
+#   include <cstdint>
+#   include <cstddef>
+    typedef uint64_t Addr_t;
+
+    extern "C" {
+        void kMemSetB(void *buf, uint8_t byt, size_t cnt);
+        void kMemMoveB(void *dest, void *src, size_t cnt);
+        int kMemCmpB(const void *a, const void *b, size_t cnt);
+        void kStrCpy(char *dest, const char *src);
+        size_t kStrLen(const char *str);
+    }
+#endif
+
+#include "kmem.h"
+
+
+
+//
+// -- Unaligned and aliasing access to memory
+//    ---------------------------------------
+typedef uint64_t __attribute__((may_alias)) U64a_t;
+typedef uint64_t __attribute__((aligned(1), may_alias)) U64u_t;
+typedef char V16_t __attribute__((vector_size(16), aligned(1), may_alias));
+typedef char V32_t __attribute__((vector_size(32), aligned(1), may_alias));
+
+#define ONES            0x0101010101010101ul
+#define HIGHS           0x8080808080808080ul
+
+// -- a byte in `v` is zero (the lowest such byte is always reported correctly)
+#define HAS_ZERO(v)     (((v) - ONES) & ~(v) & HIGHS)
+
+
+
+// ===================
+// == Word versions ==
+// ===================
+
+
+//
+// -- Fill with 8-byte stores once the destination is aligned
+//    -------------------------------------------------------
+static void WordMemSet(void *buf, uint8_t byt, size_t cnt)
+{
+    uint8_t *d = (uint8_t *)buf;
+    uint64_t pat = byt * ONES;
+
+    if (cnt >= 16) {
+        *(U64u_t *)d = pat;                     // -- unaligned head, then align the rest
+        size_t adj = 8 - ((Addr_t)d & 7);
+        d += adj;
+        cnt -= adj;
+
+        size_t q = cnt >> 3;
+        __asm volatile("cld\n rep stosq" : "+D"(d), "+c"(q) : "a"(pat) : "memory");
+
+        if (cnt & 7) *(U64u_t *)(d + (cnt & 7) - 8) = pat;      // -- overlapping tail
+        return;
+    }
+
+    while (cnt --) *d ++ = byt;
+}
+
+
+//
+// -- Copy backwards, 8 bytes at a time; for a destination above an overlapping source
+//    --------------------------------------------------------------------------------
+static void WordMemMoveDown(uint8_t *d, const uint8_t *s, size_t cnt)
+{
+    while (cnt >= 8) {
+        cnt -= 8;
+        *(U64u_t *)(d + cnt) = *(const U64u_t *)(s + cnt);
+    }
+
+    while (cnt --) d[cnt] = s[cnt];
+}
+
+
+//
+// -- Copy with 8-byte moves, backwards when the destination overlaps the end of the source
+//    -------------------------------------------------------------------------------------
+static void WordMemMove(void *dest, const void *src, size_t cnt)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (d > s && d < s + cnt) {
+        WordMemMoveDown(d, s, cnt);
+        return;
+    }
+
+    size_t q = cnt >> 3;
+    size_t r = cnt & 7;
+    __asm volatile("cld\n rep movsq\n mov %3,%%rcx\n rep movsb" : "+D"(d), "+S"(s), "+c"(q) : "r"(r) : "memory");
+}
+
+
+//
+// -- Compare 8 bytes at a time; the result is the difference between the first bytes which differ
+//    --------------------------------------------------------------------------------------------
+static int WordMemCmp(const void *a, const void *b, size_t cnt)
+{
+    const uint8_t *p = (const uint8_t *)a;
+    const uint8_t *q = (const uint8_t *)b;
+
+    while (cnt >= 8) {
+        uint64_t x = *(const U64u_t *)p ^ *(const U64u_t *)q;
+
+        if (x) {
+            int i = __builtin_ctzl(x) >> 3;     // -- little endian: the lowest differing bit is the first byte
+            return (int)p[i] - (int)q[i];
+        }
+
+        p += 8;
+        q += 8;
+        cnt -= 8;
+    }
+
+    for (size_t i = 0; i < cnt; i ++) {
+        if (p[i] != q[i]) return (int)p[i] - (int)q[i];
+    }
+
+    return 0;
+}
+
+
+//
+// -- Find the terminating NUL reading aligned words; the bytes before the string are forced non-zero
+//    -----------------------------------------------------------------------------------------------
+static size_t WordStrLen(const char *str)
+{
+    const U64a_t *w = (const U64a_t *)((Addr_t)str & ~7ul);
+    int skip = (Addr_t)str & 7;
+    uint64_t v = *w | ((1ul << (skip * 8)) - 1);
+
+    while (!HAS_ZERO(v)) v = *++ w;
+
+    return (const char *)w + (__builtin_ctzl(HAS_ZERO(v)) >> 3) - str;
+}
+
+
+//
+// -- Copy a string a word at a time once the source is aligned
+//    ---------------------------------------------------------
+static void WordStrCpy(char *dest, const char *src)
+{
+    while ((Addr_t)src & 7) {
+        if ((*dest ++ = *src ++) == 0) return;
+    }
+
+    while (true) {
+        uint64_t v = *(const U64a_t *)src;
+        if (HAS_ZERO(v)) break;
+
+        *(U64u_t *)dest = v;
+        dest += 8;
+        src += 8;
+    }
+
+    while ((*dest ++ = *src ++) != 0) {}
+}
+
+
+
+// ===================
+// == ERMS versions ==
+// ===================
+
+
+//
+// -- Fill with `rep stosb`
+//    ---------------------
+static void ErmsMemSet(void *buf, uint8_t byt, size_t cnt)
+{
+    __asm volatile("cld\n rep stosb" : "+D"(buf), "+c"(cnt) : "a"(byt) : "memory");
+}
+
+
+//
+// -- Copy with `rep movsb`, backwards when the destination overlaps the end of the source
+//    ------------------------------------------------------------------------------------
+static void ErmsMemMove(void *dest, const void *src, size_t cnt)
+{
+    if ((uint8_t *)dest > (uint8_t *)src && (uint8_t *)dest < (uint8_t *)src + cnt) {
+        WordMemMoveDown((uint8_t *)dest, (const uint8_t *)src, cnt);
+        return;
+    }
+
+    __asm volatile("cld\n rep movsb" : "+D"(dest), "+S"(src), "+c"(cnt) :: "memory");
+}
+
+
+
+// ===================
+// == SSE2 versions ==
+// ===================
+
+
+//
+// -- Fill 16 bytes at a time; the head and tail stores overlap the aligned body
+//    --------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void Sse2MemSet(void *buf, uint8_t byt, size_t cnt)
+{
+    if (cnt < 32) {
+        WordMemSet(buf, byt, cnt);
+        return;
+    }
+
+    uint8_t *d = (uint8_t *)buf;
+    uint8_t *end = d + cnt;
+    V16_t v = (V16_t){} + (char)byt;
+
+    *(V16_t *)d = v;
+    *(V16_t *)(end - 16) = v;
+
+    d = (uint8_t *)(((Addr_t)d + 16) & ~15ul);
+
+    for ( ; d + 64 <= end; d += 64) {
+        ((V16_t *)d)[0] = v;
+        ((V16_t *)d)[1] = v;
+        ((V16_t *)d)[2] = v;
+        ((V16_t *)d)[3] = v;
+    }
+
+    for ( ; d + 16 <= end; d += 16) *(V16_t *)d = v;
+}
+
+
+//
+// -- Copy 16 bytes at a time; all loads for a block are done before its stores
+//    -------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void Sse2MemMove(void *dest, const void *src, size_t cnt)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (cnt < 32 || (d > s && d < s + cnt)) {
+        WordMemMove(dest, src, cnt);
+        return;
+    }
+
+    V16_t tail = *(const V16_t *)(s + cnt - 16);
+    uint8_t *end = d + cnt;
+
+    while (d + 64 <= end) {
+        V16_t x0 = ((const V16_t *)s)[0];
+        V16_t x1 = ((const V16_t *)s)[1];
+        V16_t x2 = ((const V16_t *)s)[2];
+        V16_t x3 = ((const V16_t *)s)[3];
+        ((V16_t *)d)[0] = x0;
+        ((V16_t *)d)[1] = x1;
+        ((V16_t *)d)[2] = x2;
+        ((V16_t *)d)[3] = x3;
+        d += 64;
+        s += 64;
+    }
+
+    while (d + 16 <= end) {
+        *(V16_t *)d = *(const V16_t *)s;
+        d += 16;
+        s += 16;
+    }
+
+    *(V16_t *)(end - 16) = tail;
+}
+
+
+//
+// -- Compare 16 bytes at a time
+//    --------------------------
+__attribute__((target("sse2")))
+static int Sse2MemCmp(const void *a, const void *b, size_t cnt)
+{
+    const uint8_t *p = (const uint8_t *)a;
+    const uint8_t *q = (const uint8_t *)b;
+
+    while (cnt >= 16) {
+        int m = __builtin_ia32_pmovmskb128((V16_t)(*(const V16_t *)p == *(const V16_t *)q)) ^ 0xffff;
+
+        if (m) {
+            int i = __builtin_ctz(m);
+            return (int)p[i] - (int)q[i];
+        }
+
+        p += 16;
+        q += 16;
+        cnt -= 16;
+    }
+
+    return WordMemCmp(p, q, cnt);
+}
+
+
+
+// ===================
+// == AVX2 versions ==
+// ===================
+
+
+//
+// -- Fill 32 bytes at a time; the head and tail stores overlap the aligned body
+//    --------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void Avx2MemSet(void *buf, uint8_t byt, size_t cnt)
+{
+    if (cnt < 64) {
+        WordMemSet(buf, byt, cnt);
+        return;
+    }
+
+    uint8_t *d = (uint8_t *)buf;
+    uint8_t *end = d + cnt;
+    V32_t v = (V32_t){} + (char)byt;
+
+    *(V32_t *)d = v;
+    *(V32_t *)(end - 32) = v;
+
+    d = (uint8_t *)(((Addr_t)d + 32) & ~31ul);
+
+    for ( ; d + 128 <= end; d += 128) {
+        ((V32_t *)d)[0] = v;
+        ((V32_t *)d)[1] = v;
+        ((V32_t *)d)[2] = v;
+        ((V32_t *)d)[3] = v;
+    }
+
+    for ( ; d + 32 <= end; d += 32) *(V32_t *)d = v;
+}
+
+
+//
+// -- Copy 32 bytes at a time
+//    -----------------------
+__attribute__((target("avx2")))
+static void Avx2MemMove(void *dest, const void *src, size_t cnt)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (cnt < 64 || (d > s && d < s + cnt)) {
+        WordMemMove(dest, src, cnt);
+        return;
+    }
+
+    V32_t tail = *(const V32_t *)(s + cnt - 32);
+    uint8_t *end = d + cnt;
+
+    while (d + 128 <= end) {
+        V32_t x0 = ((const V32_t *)s)[0];
+        V32_t x1 = ((const V32_t *)s)[1];
+        V32_t x2 = ((const V32_t *)s)[2];
+        V32_t x3 = ((const V32_t *)s)[3];
+        ((V32_t *)d)[0] = x0;
+        ((V32_t *)d)[1] = x1;
+        ((V32_t *)d)[2] = x2;
+        ((V32_t *)d)[3] = x3;
+        d += 128;
+        s += 128;
+    }
+
+    while (d + 32 <= end) {
+        *(V32_t *)d = *(const V32_t *)s;
+        d += 32;
+        s += 32;
+    }
+
+    *(V32_t *)(end - 32) = tail;
+}
+
+
+//
+// -- Compare 32 bytes at a time
+//    --------------------------
+__attribute__((target("avx2")))
+static int Avx2MemCmp(const void *a, const void *b, size_t cnt)
+{
+    const uint8_t *p = (const uint8_t *)a;
+    const uint8_t *q = (const uint8_t *)b;
+
+    while (cnt >= 32) {
+        uint32_t m = ~(uint32_t)__builtin_ia32_pmovmskb256((V32_t)(*(const V32_t *)p == *(const V32_t *)q));
+
+        if (m) {
+            int i = __builtin_ctz(m);
+            return (int)p[i] - (int)q[i];
+        }
+
+        p += 32;
+        q += 32;
+        cnt -= 32;
+    }
+
+    return WordMemCmp(p, q, cnt);
+}
+
+
+
+//
+// -- The implementations, in LibkMemImpl_t order
+//    -------------------------------------------
+static const LibkMemOps_t libkOps[] = {
+    { "word",   WordMemSet,     WordMemMove,    WordMemCmp,     WordStrLen,     WordStrCpy },
+    { "erms",   ErmsMemSet,     ErmsMemMove,    WordMemCmp,     WordStrLen,     WordStrCpy },
+    { "sse2",   Sse2MemSet,     Sse2MemMove,    Sse2MemCmp,     WordStrLen,     WordStrCpy },
+    { "avx2",   Avx2MemSet,     Avx2MemMove,    Avx2MemCmp,     WordStrLen,     WordStrCpy },
+};
+
+static_assert(sizeof(libkOps) / sizeof(libkOps[0]) == LIBK_IMPL_COUNT, "libkOps[] is out of sync with LibkMemImpl_t");
+
+
+//
+// -- The implementations chosen for this image
+//    -----------------------------------------
+static const LibkMemOps_t *libkCur = &libkOps[LIBK_WORD];      // -- safe on any cpu, even before init
+static const LibkMemOps_t *libkSimd = NULL;
+static Addr_t (*libkSimdBegin)(void) = NULL;
+static void (*libkSimdEnd)(Addr_t) = NULL;
+static bool (*libkSimdActive)(void) = NULL;
+static bool libkErms = false;
+
+
+
+// ===============================
+// == The functions libk offers ==
+// ===============================
+
+
+//
+// -- Use the vector registers for a large block, when the image allows it and they are not already in use
+//    -----------------------------------------------------------------------------------------------------
+#define USE_SIMD(cnt)   (libkSimd && (cnt) >= LIBK_SIMD_MIN && !libkSimdActive())
+
+
+void kMemSetB(void *buf, uint8_t byt, size_t cnt)
+{
+    if (USE_SIMD(cnt)) {
+        Addr_t flags = libkSimdBegin();
+        libkSimd->memSet(buf, byt, cnt);
+        libkSimdEnd(flags);
+        return;
+    }
+
+    libkCur->memSet(buf, byt, cnt);
+}
+
+
+void kMemMoveB(void *dest, void *src, size_t cnt)
+{
+    if (USE_SIMD(cnt)) {
+        Addr_t flags = libkSimdBegin();
+        libkSimd->memMove(dest, src, cnt);
+        libkSimdEnd(flags);
+        return;
+    }
+
+    libkCur->memMove(dest, src, cnt);
+}
+
+
+int kMemCmpB(const void *a, const void *b, size_t cnt)
+{
+    if (USE_SIMD(cnt)) {
+        Addr_t flags = libkSimdBegin();
+        int rv = libkSimd->memCmp(a, b, cnt);
+        libkSimdEnd(flags);
+        return rv;
+    }
+
+    return libkCur->memCmp(a, b, cnt);
+}
+
+
+size_t kStrLen(const char *str)
+{
+    return libkCur->strLen(str);
+}
+
+
+void kStrCpy(char *dest, const char *src)
+{
+    libkCur->strCpy(dest, src);
+}
+
+
+
+//
+// -- The cpu features which choose the implementation
+//    ------------------------------------------------
+static inline void LibkCpuid(uint32_t code, uint32_t sub, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(code), "c"(sub));
+}
+
+
+//
+// -- Choose the scalar implementation; this runs from the init table of each image
+//    -----------------------------------------------------------------------------
+__attribute__((constructor))
+void LibkMemInit(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    LibkCpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    if (eax < 7) return;
+
+    LibkCpuid(7, 0, &eax, &ebx, &ecx, &edx);
+    libkErms = (ebx & (1 << 9)) != 0;
+
+    if (libkErms) libkCur = &libkOps[LIBK_ERMS];
+}
+
+
+//
+// -- Allow large blocks to use the vector registers, bracketed by `begin()` and `end()`.  A nested `begin()`
+//    does not save the registers again, so a copy made inside another section (`active()`) takes the scalar
+//    path rather than clobber the registers of the code around it.  AVX2 needs XCR0 to have the AVX state
+//    enabled, so this must be called after the extended state is set up.
+//    -------------------------------------------------------------------------------------------------------
+void LibkSimdEnable(Addr_t (*begin)(void), void (*end)(Addr_t), bool (*active)(void))
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    if (libkErms) return;                       // -- `rep movsb` is as fast, without saving any state
+
+    LibkCpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    bool sse2 = (edx & (1 << 26)) != 0;
+    bool osxsave = (ecx & (1 << 27)) != 0;
+
+    LibkCpuid(7, 0, &eax, &ebx, &ecx, &edx);
+    bool avx2 = (ebx & (1 << 5)) != 0;
+
+    if (avx2 && osxsave) {
+        uint32_t lo, hi;
+        __asm volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        avx2 = (lo & 0x6) == 0x6;               // -- the SSE and AVX state are both enabled
+    } else {
+        avx2 = false;
+    }
+
+    libkSimdBegin = begin;
+    libkSimdEnd = end;
+    libkSimdActive = active;
+
+    if (avx2) libkSimd = &libkOps[LIBK_AVX2];
+    else if (sse2) libkSimd = &libkOps[LIBK_SSE2];
+}
+
+
+//
+// -- The implementation in use, for reporting
+//    ----------------------------------------
+const char *LibkMemImplName(void)
+{
+    return libkSimd ? libkSimd->name : libkCur->name;
+}
+
+
+//
+// -- An implementation by number, for the host benchmark
+//    ---------------------------------------------------
+const LibkMemOps_t *LibkMemImpl(int i)
+{
+    if (i < 0 || i >= LIBK_IMPL_COUNT) return NULL;
+    return &libkOps[i];
+}
+
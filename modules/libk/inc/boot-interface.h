@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Feb-01  Initial  v0.0.4   ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Publish the TSC clocksource; the HPET and IOAPICs found by the loader
 //
 //===================================================================================================================
 
@@ -19,6 +20,7 @@
 
 
 #include "types.h"
+#include "constants.h"
 
 
 //
@@ -26,24 +28,76 @@
 //    --------------------------------------------------
 #define MAX_MODS    25
 #define MAX_MEM     10
+#define MAX_IOAPIC  4
+#define ISA_IRQS    16
+
+
+//
+// -- A single boot trace marker: the TSC when a boot phase was reached
+//    -----------------------------------------------------------------
+typedef struct BootTrace_t {
+    uint64_t tsc;
+    char label[BOOT_TRACE_LABEL_LEN];
+} BootTrace_t;
 
 
 //
 // -- This structure passes information between the loader and the kernel
 //    -------------------------------------------------------------------
 typedef struct BootInterface_t {
+    ClockSource_t clock;                    // must be first; filled in by the kernel (see `ClockNanos()`)
     Frame_t nextEarlyFrame;
     Addr_t bootVirtAddrSpace;
     int cpuCount;
     int modCount;
     Addr_t modAddr[MAX_MODS];
+    Addr_t kernelAddr;                      // the kernel ELF image, kept for its symbol table
     struct {
         uint64_t start;
         uint64_t end;
     } memBlocks[MAX_MEM];
     int localApic;
+    Addr_t hpetAddr;                        // physical address of the HPET registers; 0 when there is none
+    int hpetMinTick;                        // the minimum periodic tick the HPET supports, in counter ticks
+    int ioapicCount;
+    struct {
+        Addr_t addr;                        // physical address of the IOAPIC registers
+        int id;
+        int gsiBase;                        // the first global system interrupt it handles
+    } ioapic[MAX_IOAPIC];
+    struct {
+        int gsi;                            // the global system interrupt an ISA IRQ is connected to
+        int flags;                          // MPS INTI flags: polarity (bits 0-1) and trigger mode (bits 2-3)
+    } isaIrq[ISA_IRQS];
+    int traceCount;                         // may exceed BOOT_TRACE_ENTRIES; the excess markers were dropped
+    BootTrace_t trace[BOOT_TRACE_ENTRIES];
 } BootInterface_t;
 
+static_assert(offsetof(BootInterface_t, clock) == 0, "`ClockNanos()` reads the clock at INTERFACE_LOCATION");
+
+
+//
+// -- Append a marker to the boot trace; safe to call from the loader, the kernel, any module and any cpu
+//    ---------------------------------------------------------------------------------------------------
+inline void BootTraceMark(BootInterface_t *bi, const char *label)
+{
+#if IS_ENABLED(BOOT_TRACE)
+    uint32_t lo, hi;
+
+    if (!bi) return;
+
+    __asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    int i = __atomic_fetch_add(&bi->traceCount, 1, __ATOMIC_RELAXED);
+    if (i >= BOOT_TRACE_ENTRIES) return;
+
+    bi->trace[i].tsc = ((uint64_t)hi << 32) | lo;
+
+    int j;
+    for (j = 0; j < BOOT_TRACE_LABEL_LEN - 1 && label[j]; j ++) bi->trace[i].label[j] = label[j];
+    bi->trace[i].label[j] = 0;
+#endif
+}
+
 
 
 //
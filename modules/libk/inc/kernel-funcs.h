@@ -11,6 +11,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-Feb-16  Initial  v0.0.6   ADCL  Initial version (relocated)
+//  2021-Nov-26  Initial  v0.0.13  ADCL  TSC clock and sleeps; HPET, vector, IRQ, IPI, cpu call, msgq, IPC and sync functions
 //
 //===================================================================================================================
 
@@ -20,6 +21,8 @@
 #pragma once
 
 
+#include <stdarg.h>
+
 #include "types.h"
 #include "debugger.h"
 
@@ -85,13 +88,26 @@ extern "C" void ProcessInitTable(void);
 extern "C" {
     void kMemSetB(void *buf, uint8_t byt, size_t cnt);
     void kMemMoveB(void *dest, void *src, size_t cnt);
+    int kMemCmpB(const void *a, const void *b, size_t cnt);
     void kStrCpy(char *dest, const char *src);
     int kStrCmp(const char *str1, const char *str2);
     size_t kStrLen(const char *str);
     char *ksprintf(char *, const char *, ...);
+    int ksnprintf(char *buf, size_t size, const char *fmt, ...);
+    int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args);
 }
 
 
+//
+// -- The formatter behind all the printf() functions, writing each chunk of output with `put()`
+//    ------------------------------------------------------------------------------------------
+typedef void (*KFmtPut_t)(void *ctx, const char *str, size_t len);
+
+#define KFMT_KPRINTF    (1<<0)          // -- `kprintf()` hex: 64-bit `%x`/`%u`, "0x" on `%x` and `%p`
+
+extern "C" int kvformat(KFmtPut_t put, void *ctx, int dialect, const char *fmt, va_list args);
+
+
 
 #define INTERNAL0(type,name,func)                                                                               \
     inline type name(void) {                                                                                    \
@@ -183,10 +199,11 @@ INTERNAL4(Return_t, SetServiceHandler, INT_SET_SERVICE, int, Addr_t, Addr_t, Add
 
 
 //
-// -- Function 0x008 -- Handle the Kernel's limited version of printf()
+// -- Function 0x008 -- Write to the kernel log like `kprintf()`
 //
-//    Note: this function is implemented in assembly -- no macro here.
-//    -----------------------------------------------------------------
+//    Note: a module formats the output itself, so there is no limit on the arguments; the kernel's own
+//          version writes directly to the log ring.  No macro here.
+//    ---------------------------------------------------------------------------------------------------
 extern "C" int KernelPrintf(const char *fmt, ...);
 
 
@@ -279,6 +296,22 @@ INTERNAL4(Return_t, MmuMapPageEx, INT_KRN_MMU_MAP_EX, Addr_t, Addr_t, Frame_t, i
 INTERNAL2(Return_t, MmuUnmapPageEx, INT_KRN_MMU_UNMAP_EX, Addr_t, Addr_t)
 
 
+//
+// -- Function 0x01e -- Map a range of contiguous frames in the current address space
+//
+//    Prototype: Return_t MmuMapRange(Addr_t addr, Frame_t frame, size_t count, int flags);
+//    -------------------------------------------------------------------------------------
+INTERNAL4(Return_t, MmuMapRange, INT_KRN_MMU_MAP_RANGE, Addr_t, Frame_t, size_t, int)
+
+
+//
+// -- Function 0x01f -- Unmap a range of pages in the current address space
+//
+//    Prototype: Return_t MmuUnmapRange(Addr_t addr, size_t count);
+//    -------------------------------------------------------------
+INTERNAL2(Return_t, MmuUnmapRange, INT_KRN_MMU_UNMAP_RANGE, Addr_t, size_t)
+
+
 
 // ==============================
 // == Kernel Utility functions ==
@@ -322,6 +355,138 @@ INTERNAL1(Return_t, KrnReleaseCores, INT_KRN_RELEASE_CORES, Addr_t)
 
 
 
+//
+// -- Function 0x025 -- Allocate an aligned block of `count` device vectors (a power of 2) for a handler
+//
+//    Prototype: Return_t VectorAlloc(int count, Addr_t handler, Addr_t cr3, Addr_t stack);
+//    Returns the first vector; a block of more than 1 vector must run on the interrupted stack (`stack` is 0)
+//    --------------------------------------------------------------------------------------------------------
+INTERNAL4(Return_t, VectorAlloc, INT_KRN_VECTOR_ALLOC, int, Addr_t, Addr_t, Addr_t)
+
+
+//
+// -- Function 0x026 -- Release a device vector
+//
+//    Prototype: Return_t VectorFree(int vector);
+//    -------------------------------------------
+INTERNAL1(Return_t, VectorFree, INT_KRN_VECTOR_FREE, int)
+
+
+//
+// -- Function 0x027 -- The number of times a vector has been raised
+//
+//    Prototype: uint64_t VectorCount(int vector);
+//    --------------------------------------------
+INTERNAL1(uint64_t, VectorCount, INT_KRN_VECTOR_COUNT, int)
+
+
+//
+// -- The MSI address and data which deliver a fixed, edge-triggered `vector` to the LAPIC `cpu`; a device
+//    with an MSI or MSI-X capability is steered to another cpu by rewriting only its address
+//    ------------------------------------------------------------------------------------------------------
+inline uint32_t MsiAddress(int cpu) { return 0xfee00000 | ((uint32_t)(cpu & 0xff) << 12); }
+inline uint32_t MsiData(int vector) { return (uint32_t)(vector & 0xff); }
+
+
+//
+// -- Function 0x028 -- Run `fn(arg)` on each cpu in a mask of LAPIC IDs, in the caller's address space
+//
+//    Prototype: Return_t CpuCall(uint64_t mask, Addr_t fn, Addr_t arg, bool wait);
+//    `fn` is `void fn(Addr_t arg)` and runs with interrupts disabled on each cpu, so it cannot block
+//    ----------------------------------------------------------------------------------------------------
+INTERNAL4(Return_t, CpuCall, INT_KRN_CPU_CALL, uint64_t, Addr_t, Addr_t, bool)
+
+#define CPU_MASK(cpu)       (1ul << (cpu))
+inline Return_t CpuCallOn(int cpu, Addr_t fn, Addr_t arg, bool wait) { return CpuCall(CPU_MASK(cpu), fn, arg, wait); }
+
+
+
+// =============================
+// == Message Queue functions ==
+// =============================
+
+
+//
+// -- A message: a type and a few words are copied through the queue; `pageCount` pages starting at `pages` are
+//    unmapped from the sender and mapped for the receiver at the `pages` address it passes in
+//    -----------------------------------------------------------------------------------------------------------
+typedef struct Message_t {
+    uint64_t type;
+    uint64_t data[MSGQ_WORDS];
+    Pid_t sender;                       // -- filled in by `MsgqSend()`
+    Addr_t pages;                       // -- send: the first page to move; receive: where to map them
+    size_t pageCount;                   // -- send: the pages to move; receive: the pages mapped
+} Message_t;
+
+struct MessageQueue_t;
+
+
+//
+// -- Function 0x030 -- Create a message queue, referenced by the current process
+//
+//    Prototype: MessageQueue_t *MsgqCreate(void);
+//    ---------------------------------------------------------------------------
+INTERNAL0(struct MessageQueue_t *, MsgqCreate, INT_MSGQ_CREATE)
+
+
+//
+// -- Function 0x031 -- Drop the current process's reference to a queue; the last one frees it
+//
+//    Prototype: Return_t MsgqRelease(MessageQueue_t *q);
+//    ---------------------------------------------------------------------------------------
+INTERNAL1(Return_t, MsgqRelease, INT_MSGQ_RELEASE, struct MessageQueue_t *)
+
+
+//
+// -- Function 0x032 -- Send a message without waiting; a waiting receiver may be handed this cpu at once
+//
+//    Prototype: Return_t MsgqSend(MessageQueue_t *q, Message_t *msg);
+//    -----------------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, MsgqSend, INT_MSGQ_SEND, struct MessageQueue_t *, Message_t *)
+
+
+//
+// -- Function 0x033 -- Receive the next message, waiting for one when `block` is set
+//
+//    Prototype: Return_t MsgqReceive(MessageQueue_t *q, Message_t *msg, bool block);
+//    ----------------------------------------------------------------------------
+INTERNAL3(Return_t, MsgqReceive, INT_MSGQ_RECEIVE, struct MessageQueue_t *, Message_t *, bool)
+
+
+
+// ===============================
+// == Synchronous IPC functions ==
+// ===============================
+
+
+struct IpcEndpoint_t;
+
+
+//
+// -- Function 0x038 -- Create an endpoint for a server to take calls on
+//
+//    Prototype: IpcEndpoint_t *IpcCreate(void);
+//    ------------------------------------------------------------------
+INTERNAL0(struct IpcEndpoint_t *, IpcCreate, INT_IPC_CREATE)
+
+
+//
+// -- Function 0x039 -- Call the server on an endpoint with IPC_WORDS words at `mr`; its reply replaces them
+//
+//    Prototype: Return_t IpcCall(IpcEndpoint_t *ep, uint64_t *mr);
+//    -----------------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, IpcCall, INT_IPC_CALL, struct IpcEndpoint_t *, uint64_t *)
+
+
+//
+// -- Function 0x03a -- Reply to the last caller with the words at `mr`; the next call replaces them
+//
+//    Prototype: Return_t IpcReplyWait(IpcEndpoint_t *ep, uint64_t *mr);
+//    ----------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, IpcReplyWait, INT_IPC_REPLY_WAIT, struct IpcEndpoint_t *, uint64_t *)
+
+
+
 // =====================
 // == Timer functions ==
 // =====================
@@ -335,6 +500,36 @@ INTERNAL1(Return_t, KrnReleaseCores, INT_KRN_RELEASE_CORES, Addr_t)
 INTERNAL0(uint64_t, TmrCurrentCount, INT_TMR_CURRENT_COUNT)
 
 
+
+//
+// -- The nanoseconds since the clock was calibrated, read from the boot interface page (which every address
+//    space maps) without a lock or an internal service call.  Without an invariant TSC, this falls back to the
+//    timer count and its tick resolution.
+//    ----------------------------------------------------------------------------------------------------------
+inline uint64_t ClockNanos(void)
+{
+    const volatile ClockSource_t *clk = (const volatile ClockSource_t *)INTERFACE_LOCATION;
+    uint64_t mult = clk->mult;
+
+    if (unlikely(mult == 0)) return TmrCurrentCount() * 1000;
+
+    return (uint64_t)(((unsigned __int128)(RDTSC() - clk->base) * mult) >> CLOCK_SHIFT);
+}
+
+inline uint64_t ClockMicros(void) { return ClockNanos() / 1000; }
+
+
+//
+// -- Publish a calibrated TSC frequency; `mult` is written last, so a reader never sees half a clocksource
+//    -----------------------------------------------------------------------------------------------------
+inline void ClockPublish(ClockSource_t *clk, uint64_t hz, uint64_t base)
+{
+    clk->hz = hz;
+    clk->base = base;
+    __atomic_store_n(&clk->mult, (1000000000ul << CLOCK_SHIFT) / hz, __ATOMIC_RELEASE);
+}
+
+
 //
 // -- Function 0x041 -- Perform the timer functions related to a timer tick
 //
@@ -361,6 +556,15 @@ INTERNAL1(Return_t, TmrApInit, INT_TMR_REINIT, BootInterface_t *);
 
 
 
+//
+// -- Function 0x044 -- Set this cpu's LAPIC performance counter LVT (the vector plus any mask bit)
+//
+//    Prototype: Return_t TmrSetPerfLvt(uint32_t lvt)
+//    ---------------------------------------------------------------------------------------------
+INTERNAL1(Return_t, TmrSetPerfLvt, INT_TMR_PERF_LVT, uint32_t);
+
+
+
 // =======================================
 // == Physical Memory Manager functions ==
 // =======================================
@@ -449,9 +653,9 @@ INTERNAL1(Return_t, SchProcessUnblock, INT_SCH_UNBLOCK, Process_t *)
 //    Prototype: Return_t SchProcessMicroSleepUntil(uint64_t when);
 //    --------------------------------------------------------------------------------------
 INTERNAL1(Return_t, SchProcessMicroSleepUntil, INT_SCH_SLEEP_UNTIL, uint64_t)
-inline Return_t SchProcessMicroSleep(uint64_t u) { return SchProcessMicroSleepUntil(TmrCurrentCount() + u); }
-inline Return_t SchProcessMilliSleep(uint64_t m) { return SchProcessMicroSleepUntil(TmrCurrentCount() + (m * 1000)); }
-inline Return_t SchProcessSleep(uint64_t s) { return SchProcessMicroSleepUntil(TmrCurrentCount() + (s * 1000000)); }
+inline Return_t SchProcessMicroSleep(uint64_t u) { return SchProcessMicroSleepUntil(ClockMicros() + u); }
+inline Return_t SchProcessMilliSleep(uint64_t m) { return SchProcessMicroSleepUntil(ClockMicros() + (m * 1000)); }
+inline Return_t SchProcessSleep(uint64_t s) { return SchProcessMicroSleepUntil(ClockMicros() + (s * 1000000)); }
 
 
 
@@ -537,6 +741,13 @@ INTERNAL0(int, LapicGetId, INT_IPI_CURRENT_CPU)
 
 
 
+//
+// -- The core for `IpiSendInit()` and `IpiSendSipi()` which sends to every cpu except this one
+//    -----------------------------------------------------------------------------------------
+#define IPI_ALL_BUT_SELF        (-1)
+
+
+
 //
 // -- Function 0x081 -- Send the Init IPI to the specified core
 //
@@ -563,6 +774,279 @@ INTERNAL2(Return_t, IpiSendSipi, INT_IPI_SEND_SIPI, int, Addr_t)
 INTERNAL1(Return_t, IpiSendIpi, INT_IPI_SEND_IPI, int)
 
 
+
+
+//
+// -- The core for `IpiSendTo()` which sends to this cpu
+//    --------------------------------------------------
+#define IPI_SELF                (-2)
+
+
+
+//
+// -- Function 0x084 -- Send an IPI to one core by LAPIC ID, or to IPI_SELF
+//
+//    Prototype: int IpiSendTo(int core, int vector);
+//    -----------------------------------------------------------------------
+INTERNAL2(Return_t, IpiSendTo, INT_IPI_SEND_TO, int, int)
+
+
+
+//
+// -- Function 0x085 -- Send an IPI to each core in a mask of LAPIC IDs (in as few messages as the APIC allows)
+//
+//    Prototype: int IpiSendMask(uint64_t mask, int vector);
+//    ------------------------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, IpiSendMask, INT_IPI_SEND_MASK, uint64_t, int)
+
+
+
+
+// ===================
+// == PMU functions ==
+// ===================
+
+
+//
+// -- The events which can be counted; these are bit numbers for PmuControl() and the event for the others
+//    -----------------------------------------------------------------------------------------------------
+#define PMU_EVT_CYCLES          0
+#define PMU_EVT_INSTRUCTIONS    1
+#define PMU_EVT_LLC_MISSES      2
+#define PMU_EVT_DTLB_MISSES     3
+#define PMU_EVT_BRANCH_MISSES   4
+
+
+//
+// -- Function 0x090 -- Count the set of events in the mask (0 stops counting) on all CPUs
+//
+//    Prototype: Return_t PmuControl(uint64_t events);
+//    Returns the events which are being counted, or -ENODEV when there is no usable PMU
+//    ----------------------------------------------------------------------------------
+INTERNAL1(Return_t, PmuControl, INT_PMU_CONTROL, uint64_t)
+
+
+
+//
+// -- Function 0x091 -- Read the free-running counter for an event on the current CPU
+//
+//    Prototype: uint64_t PmuRead(int event);
+//    ---------------------------------------
+INTERNAL1(uint64_t, PmuRead, INT_PMU_READ, int)
+
+
+
+//
+// -- Function 0x092 -- Read the count for an event accumulated by the calling process
+//
+//    Prototype: uint64_t PmuProcessCount(int event);
+//    -----------------------------------------------
+INTERNAL1(uint64_t, PmuProcessCount, INT_PMU_PROCESS, int)
+
+
+
+// ====================
+// == HPET functions ==
+// ====================
+
+
+//
+// -- Function 0x0a0 -- Read the HPET main counter, in nanoseconds since the HPET module started it
+//
+//    Prototype: uint64_t HpetNanos(void);
+//    Check `GetInternalHandler(INT_HPET_NANOS)` first; there is no HPET on every machine
+//    -----------------------------------------------------------------------------------
+INTERNAL0(uint64_t, HpetNanos, INT_HPET_NANOS)
+
+
+
+//
+// -- Function 0x0a1 -- Start an HPET timer interrupting the current CPU on a vector `hz` times a second
+//
+//    Prototype: Return_t HpetPeriodic(int vector, uint64_t hz);
+//    Returns -ENODEV when no HPET timer can deliver periodic interrupts this way, and -EINVAL for a bad rate
+//    -------------------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, HpetPeriodic, INT_HPET_PERIODIC, int, uint64_t)
+
+
+
+// ======================
+// == IOAPIC functions ==
+// ======================
+
+
+//
+// -- Let the IOAPIC module pick the cpu for an interrupt
+//    ---------------------------------------------------
+#define IRQ_CPU_ANY         (-1)
+
+
+//
+// -- Function 0x0b0 -- Route a GSI to a vector on a cpu (by LAPIC ID), or IRQ_CPU_ANY for the least loaded one
+//
+//    Prototype: Return_t IrqRoute(int gsi, int vector, int cpu);
+//    The entry is left masked; returns the cpu chosen
+//    ------------------------------------------------------------------------------------------------------------
+INTERNAL3(Return_t, IrqRoute, INT_IRQ_ROUTE, int, int, int)
+
+
+//
+// -- Function 0x0b1 -- Mask or unmask a GSI
+//
+//    Prototype: Return_t IrqMask(int gsi, bool mask);
+//    ------------------------------------------------
+INTERNAL2(Return_t, IrqMask, INT_IRQ_MASK, int, bool)
+
+
+//
+// -- Function 0x0b2 -- Pin a GSI to a cpu, or hand it back to the balancer with IRQ_CPU_ANY
+//
+//    Prototype: Return_t IrqSetAffinity(int gsi, int cpu);
+//    -----------------------------------------------------
+INTERNAL2(Return_t, IrqSetAffinity, INT_IRQ_AFFINITY, int, int)
+
+
+//
+// -- Function 0x0b3 -- Spread the unpinned GSIs over the active cpus by their recent interrupt counts
+//
+//    Prototype: Return_t IrqBalance(void);
+//    Returns the number of GSIs which moved
+//    ---------------------------------------------------------------------------------------------------
+INTERNAL0(Return_t, IrqBalance, INT_IRQ_BALANCE)
+
+
+//
+// -- Function 0x0b4 -- The GSI of an ISA IRQ, after the ACPI overrides
+//
+//    Prototype: Return_t IrqIsaGsi(int isa);
+//    ---------------------------------------
+INTERNAL1(Return_t, IrqIsaGsi, INT_IRQ_ISA_GSI, int)
+
+
+
+// ===============================
+// == Synchronization functions ==
+// ===============================
+
+
+struct WaitQueue_t;
+struct Mutex_t;
+struct Semaphore_t;
+
+
+//
+// -- Function 0x0c0 -- Create a wait queue
+//
+//    Prototype: WaitQueue_t *WaitQueueCreate(void);
+//    ----------------------------------------------
+INTERNAL0(struct WaitQueue_t *, WaitQueueCreate, INT_WAITQ_CREATE)
+
+
+//
+// -- Function 0x0c1 -- Free a wait queue; -EBUSY while a process waits on it
+//
+//    Prototype: Return_t WaitQueueRelease(WaitQueue_t *wq);
+//    ----------------------------------------------------------------------
+INTERNAL1(Return_t, WaitQueueRelease, INT_WAITQ_RELEASE, struct WaitQueue_t *)
+
+
+//
+// -- Function 0x0c2 -- Wait on a queue until woken, releasing the mutex held (or NULL) while waiting
+//
+//    Prototype: Return_t WaitQueueWait(WaitQueue_t *wq, Mutex_t *mtx);
+//    -----------------------------------------------------------------------------------------------
+INTERNAL2(Return_t, WaitQueueWait, INT_WAITQ_WAIT, struct WaitQueue_t *, struct Mutex_t *)
+
+
+//
+// -- Function 0x0c3 -- Wake up to `count` waiting processes, or all of them with 0
+//
+//    Prototype: int WaitQueueWake(WaitQueue_t *wq, int count);
+//    Returns the number of processes woken
+//    -----------------------------------------------------------------------------
+INTERNAL2(int, WaitQueueWake, INT_WAITQ_WAKE, struct WaitQueue_t *, int)
+
+
+//
+// -- Function 0x0c8 -- Create a mutex, not held
+//
+//    Prototype: Mutex_t *MutexCreate(void);
+//    --------------------------------------
+INTERNAL0(struct Mutex_t *, MutexCreate, INT_MUTEX_CREATE)
+
+
+//
+// -- Function 0x0c9 -- Free a mutex; -EBUSY while it is held
+//
+//    Prototype: Return_t MutexRelease(Mutex_t *mtx);
+//    ------------------------------------------------------
+INTERNAL1(Return_t, MutexRelease, INT_MUTEX_RELEASE, struct Mutex_t *)
+
+
+//
+// -- Function 0x0ca -- Take a mutex, spinning briefly while its owner runs and then blocking
+//
+//    Prototype: Return_t MutexLock(Mutex_t *mtx);
+//    --------------------------------------------------------------------------------------
+INTERNAL1(Return_t, MutexLock, INT_MUTEX_LOCK, struct Mutex_t *)
+
+
+//
+// -- Function 0x0cb -- Take a mutex without waiting; -EBUSY when it is held
+//
+//    Prototype: Return_t MutexTry(Mutex_t *mtx);
+//    ---------------------------------------------------------------------
+INTERNAL1(Return_t, MutexTry, INT_MUTEX_TRY, struct Mutex_t *)
+
+
+//
+// -- Function 0x0cc -- Release a mutex, handing it to the first waiting process
+//
+//    Prototype: Return_t MutexUnlock(Mutex_t *mtx);
+//    -------------------------------------------------------------------------
+INTERNAL1(Return_t, MutexUnlock, INT_MUTEX_UNLOCK, struct Mutex_t *)
+
+
+//
+// -- Function 0x0d0 -- Create a counting semaphore with `count` units
+//
+//    Prototype: Semaphore_t *SemCreate(int64_t count);
+//    ---------------------------------------------------------------
+INTERNAL1(struct Semaphore_t *, SemCreate, INT_SEM_CREATE, int64_t)
+
+
+//
+// -- Function 0x0d1 -- Free a semaphore; -EBUSY while a process waits on it
+//
+//    Prototype: Return_t SemRelease(Semaphore_t *sem);
+//    ---------------------------------------------------------------------
+INTERNAL1(Return_t, SemRelease, INT_SEM_RELEASE, struct Semaphore_t *)
+
+
+//
+// -- Function 0x0d2 -- Take a unit, blocking until one is posted
+//
+//    Prototype: Return_t SemWait(Semaphore_t *sem);
+//    ----------------------------------------------------------
+INTERNAL1(Return_t, SemWait, INT_SEM_WAIT, struct Semaphore_t *)
+
+
+//
+// -- Function 0x0d3 -- Take a unit without waiting; -EAGAIN when there is none
+//
+//    Prototype: Return_t SemTry(Semaphore_t *sem);
+//    ------------------------------------------------------------------------
+INTERNAL1(Return_t, SemTry, INT_SEM_TRY, struct Semaphore_t *)
+
+
+//
+// -- Function 0x0d4 -- Give back a unit, straight to the first waiting process when there is one
+//
+//    Prototype: Return_t SemPost(Semaphore_t *sem);
+//    -------------------------------------------------------------------------------------------
+INTERNAL1(Return_t, SemPost, INT_SEM_POST, struct Semaphore_t *)
+
+
 #endif
 
 
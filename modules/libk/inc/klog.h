@@ -0,0 +1,52 @@
+//===================================================================================================================
+//
+//  klog.h -- Leveled, per-subsystem logging which compiles away when a level is not enabled
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  Each subsystem has a level in `config/constants` named `LOG_LEVEL_<subsystem>`.  A log site is written as
+//  `KLOG(SCHED, DEBUG, "fmt", ...)` and is only kept when the subsystem level is at least that level.  Since
+//  both sides of the test are constants, a disabled site (and the evaluation of its arguments) is removed by
+//  the compiler.
+//
+//  Modules log through `KernelPrintf()`.  The kernel includes `printf.h`, which redirects `KLOG()` to
+//  `kprintf()` to avoid the trap into itself.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-21  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+#include "types.h"
+
+
+//
+// -- The output function used by enabled log sites
+//    ---------------------------------------------
+#ifndef KLOG_PRINTF
+#   define KLOG_PRINTF KernelPrintf
+#endif
+
+
+//
+// -- Is a level enabled for a subsystem?  Useful to guard a block of log-only work.
+//    ------------------------------------------------------------------------------
+#define KLOG_ENABLED(sub, lvl)      (LOG_LEVEL_##sub >= LOG_LVL_##lvl)
+
+
+//
+// -- Log a message for a subsystem at a level
+//    ----------------------------------------
+#define KLOG(sub, lvl, ...)                                 \
+    do {                                                    \
+        if (KLOG_ENABLED(sub, lvl)) KLOG_PRINTF(__VA_ARGS__); \
+    } while (0)
+
@@ -0,0 +1,68 @@
+//===================================================================================================================
+//
+//  kmem.h -- The memory and string implementations libk chooses between
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  The functions themselves (`kMemSetB()` and friends) are prototyped in `kernel-funcs.h`.
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-25  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#pragma once
+
+
+//
+// -- The implementations, in order of preference
+//    -------------------------------------------
+typedef enum {
+    LIBK_WORD = 0,
+    LIBK_ERMS,
+    LIBK_SSE2,
+    LIBK_AVX2,
+    LIBK_IMPL_COUNT,
+} LibkMemImpl_t;
+
+
+//
+// -- One implementation of each function
+//    -----------------------------------
+typedef struct LibkMemOps_t {
+    const char *name;
+    void (*memSet)(void *buf, uint8_t byt, size_t cnt);
+    void (*memMove)(void *dest, const void *src, size_t cnt);
+    int (*memCmp)(const void *a, const void *b, size_t cnt);
+    size_t (*strLen)(const char *str);
+    void (*strCpy)(char *dest, const char *src);
+} LibkMemOps_t;
+
+
+extern "C" {
+    //
+    // -- Choose the scalar implementation for this cpu (run from the init table)
+    //    -----------------------------------------------------------------------
+    void LibkMemInit(void);
+
+
+    //
+    // -- Allow large blocks to use SSE2/AVX2, saving the process state with `begin()` and `end()`; not while
+    //    `active()` says the registers are already in use
+    //    ---------------------------------------------------------------------------------------------------
+    void LibkSimdEnable(Addr_t (*begin)(void), void (*end)(Addr_t), bool (*active)(void));
+
+
+    //
+    // -- Report the implementation in use, or get one by number
+    //    ------------------------------------------------------
+    const char *LibkMemImplName(void);
+    const LibkMemOps_t *LibkMemImpl(int i);
+}
+
@@ -14,6 +14,7 @@
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-May-17  Initial  v0.0.9b  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Add the per-cpu caches and guard pages
 //
 //===================================================================================================================
 
@@ -41,6 +42,18 @@ extern "C" {
     // -- Find an available stack
     //    -----------------------
     Addr_t StackFind(void);
+
+
+    //
+    // -- Start using the per-cpu caches; every cpu must be able to find its own structure
+    //    --------------------------------------------------------------------------------
+    void StackCacheEnable(void);
+
+
+    //
+    // -- Is an address in the unmapped guard below a stack?
+    //    --------------------------------------------------
+    bool StackIsGuard(Addr_t addr);
 }
 
 
@@ -0,0 +1,497 @@
+//====================================================================================================================
+//
+//  kformat.cc -- The one formatter behind `ksprintf()`, `ksnprintf()`, `kprintf()` and `KernelPrintf()`
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  The formatter does not allocate.  It collects output in a small chunk on the stack and hands each chunk to
+//  a `put()` function: a bounded copy into a buffer for `ksnprintf()`, the log ring for `kprintf()`, or a trap
+//  into the kernel for `KernelPrintf()` in a module.
+//
+//  Supported: `%[-+ 0#][width|*][.prec|.*][h|l|ll|z|j|t](d i u x X o b c s p P %)`.  Two dialects differ only
+//  in the defaults for hex, so existing output does not change:
+//  * `ksprintf()`: `%x` and `%u` take an `int` unless `l` is given and `%p` is 16 digits; `#` adds "0x"
+//  * `KFMT_KPRINTF`: `%x` and `%u` take 64 bits, and `%x` and `%p` always get "0x"
+//
+//  -----------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Oct-10  Initial  v0.0.10  ADCL  Initial version (as ksprintf.cc)
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Rewritten on va_list as the shared formatter; add ksnprintf()
+//
+//===================================================================================================================
+
+
+
+#include "types.h"
+#include "kernel-funcs.h"
+
+
+
+//
+// -- The size of the chunk collected before it is handed to `put()`
+//    --------------------------------------------------------------
+#define KFMT_CHUNK      128
+
+
+//
+// -- Flags for a conversion
+//    ----------------------
+enum {
+    LEFT    = 1<<0,             // -- left justify
+    ZEROPAD = 1<<1,             // -- pad with zeros
+    PLUS    = 1<<2,             // -- show a '+' on positive numbers
+    SPACE   = 1<<3,             // -- show a ' ' on positive numbers
+    SPECIAL = 1<<4,             // -- show the base ("0x", "0", "0b")
+    UPPER   = 1<<5,             // -- use 'ABCDEF' instead of 'abcdef'
+};
+
+
+//
+// -- A conversion, once parsed
+//    -------------------------
+typedef struct KFmtSpec_t {
+    int flags;
+    int width;
+    int prec;                   // -- -1 when not given
+} KFmtSpec_t;
+
+
+//
+// -- The output collected so far
+//    ---------------------------
+typedef struct KFmtOut_t {
+    KFmtPut_t put;
+    void *ctx;
+    size_t n;
+    int total;
+    char chunk[KFMT_CHUNK];
+} KFmtOut_t;
+
+
+//
+// -- The decimal digit pairs, so numbers are converted 2 digits per divide
+//    ---------------------------------------------------------------------
+static const char decPairs[201] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+static const char lowerDigits[] = "0123456789abcdef";
+static const char upperDigits[] = "0123456789ABCDEF";
+
+
+
+//
+// -- Hand what has been collected to `put()`
+//    ---------------------------------------
+static void OutFlush(KFmtOut_t *o)
+{
+    if (o->n) o->put(o->ctx, o->chunk, o->n);
+    o->n = 0;
+}
+
+
+//
+// -- Add a character
+//    ---------------
+static inline void OutChar(KFmtOut_t *o, char ch)
+{
+    if (o->n == KFMT_CHUNK) OutFlush(o);
+    o->chunk[o->n ++] = ch;
+    o->total ++;
+}
+
+
+//
+// -- Add a string of known length; a long one goes straight to `put()`
+//    -----------------------------------------------------------------
+static void OutStr(KFmtOut_t *o, const char *str, size_t len)
+{
+    if (len > KFMT_CHUNK - o->n) {
+        OutFlush(o);
+
+        if (len >= KFMT_CHUNK) {
+            o->put(o->ctx, str, len);
+            o->total += len;
+            return;
+        }
+    }
+
+    kMemMoveB(o->chunk + o->n, (void *)str, len);
+    o->n += len;
+    o->total += len;
+}
+
+
+//
+// -- Add `cnt` copies of a character
+//    -------------------------------
+static void OutPad(KFmtOut_t *o, char ch, int cnt)
+{
+    while (cnt -- > 0) OutChar(o, ch);
+}
+
+
+//
+// -- Write `val` in decimal, backwards from `p`; returns the first digit
+//    -------------------------------------------------------------------
+static char *FmtDecimal(char *p, uint64_t val)
+{
+    while (val >= 100) {
+        const char *d = &decPairs[(val % 100) * 2];
+        val /= 100;
+        *-- p = d[1];
+        *-- p = d[0];
+    }
+
+    if (val >= 10) {
+        const char *d = &decPairs[val * 2];
+        *-- p = d[1];
+        *-- p = d[0];
+    } else {
+        *-- p = '0' + val;
+    }
+
+    return p;
+}
+
+
+//
+// -- Format a number with its sign, base prefix, precision and width
+//    ---------------------------------------------------------------
+static void FmtNumber(KFmtOut_t *o, uint64_t val, bool neg, int base, const KFmtSpec_t *spec)
+{
+    char tmp[66];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+    const char *dig = (spec->flags & UPPER) ? upperDigits : lowerDigits;
+    int flags = spec->flags;
+
+    if (base == 10) {
+        p = FmtDecimal(end, val);
+    } else {
+        int shift = (base == 16 ? 4 : base == 8 ? 3 : 1);
+        uint64_t v = val;
+
+        do {
+            *-- p = dig[v & (base - 1)];
+            v >>= shift;
+        } while (v);
+    }
+
+    if (val == 0 && spec->prec == 0) p = end;           // -- "%.0d" of 0 is nothing at all
+
+    int digits = end - p;
+    char prefix[3];
+    int pl = 0;
+
+    if (neg) prefix[pl ++] = '-';
+    else if (flags & PLUS) prefix[pl ++] = '+';
+    else if (flags & SPACE) prefix[pl ++] = ' ';
+
+    if (flags & SPECIAL) {
+        if (base == 16) {
+            prefix[pl ++] = '0';
+            prefix[pl ++] = (flags & UPPER) ? 'X' : 'x';
+        } else if (base == 2) {
+            prefix[pl ++] = '0';
+            prefix[pl ++] = 'b';
+        } else if (base == 8 && (digits == 0 || *p != '0')) {
+            prefix[pl ++] = '0';
+        }
+    }
+
+    int zeros = (spec->prec > digits ? spec->prec - digits : 0);
+    if ((flags & (ZEROPAD | LEFT)) == ZEROPAD && spec->prec < 0 && spec->width > pl + digits) {
+        zeros = spec->width - pl - digits;
+    }
+
+    int pad = spec->width - pl - zeros - digits;
+
+    if (!(flags & LEFT)) OutPad(o, ' ', pad);
+    OutStr(o, prefix, pl);
+    OutPad(o, '0', zeros);
+    OutStr(o, p, digits);
+    if (flags & LEFT) OutPad(o, ' ', pad);
+}
+
+
+//
+// -- Format a string (or a single character) with precision and width
+//    -----------------------------------------------------------------
+static void FmtString(KFmtOut_t *o, const char *str, int len, const KFmtSpec_t *spec)
+{
+    int pad = spec->width - len;
+
+    if (!(spec->flags & LEFT)) OutPad(o, ' ', pad);
+    OutStr(o, str, len);
+    if (spec->flags & LEFT) OutPad(o, ' ', pad);
+}
+
+
+//
+// -- Parse a decimal number in a format
+//    ----------------------------------
+static int FmtParseInt(const char **fmt)
+{
+    int rv = 0;
+
+    while (**fmt >= '0' && **fmt <= '9') {
+        rv = rv * 10 + (**fmt - '0');
+        (*fmt) ++;
+    }
+
+    return rv;
+}
+
+
+//
+// -- The formatter; returns the number of characters produced
+//    --------------------------------------------------------
+int kvformat(KFmtPut_t put, void *ctx, int dialect, const char *fmt, va_list args)
+{
+    KFmtOut_t o;
+    o.put = put;
+    o.ctx = ctx;
+    o.n = 0;
+    o.total = 0;
+
+    if (!fmt) return 0;
+
+    while (*fmt) {
+        // -- copy everything up to the next '%' at once
+        const char *run = fmt;
+        while (*fmt && *fmt != '%') fmt ++;
+        if (fmt != run) OutStr(&o, run, fmt - run);
+        if (!*fmt) break;
+
+        const char *start = fmt ++;
+        KFmtSpec_t spec = { 0, 0, -1 };
+        bool isLong = false;
+
+        // -- flags, in any order
+        for ( ; ; fmt ++) {
+            if (*fmt == '-') spec.flags |= LEFT;
+            else if (*fmt == '0') spec.flags |= ZEROPAD;
+            else if (*fmt == '+') spec.flags |= PLUS;
+            else if (*fmt == ' ') spec.flags |= SPACE;
+            else if (*fmt == '#') spec.flags |= SPECIAL;
+            else break;
+        }
+
+        // -- width
+        if (*fmt == '*') {
+            spec.width = va_arg(args, int);
+            if (spec.width < 0) {
+                spec.flags |= LEFT;
+                spec.width = -spec.width;
+            }
+            fmt ++;
+        } else {
+            spec.width = FmtParseInt(&fmt);
+        }
+
+        // -- precision
+        if (*fmt == '.') {
+            fmt ++;
+
+            if (*fmt == '*') {
+                spec.prec = va_arg(args, int);
+                if (spec.prec < 0) spec.prec = -1;
+                fmt ++;
+            } else {
+                spec.prec = FmtParseInt(&fmt);
+            }
+        }
+
+        // -- length; everything but 'h' means 64 bits
+        while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z' || *fmt == 'j' || *fmt == 't') {
+            if (*fmt != 'h') isLong = true;
+            fmt ++;
+        }
+
+        switch (*fmt) {
+        case '\0':
+            OutStr(&o, start, fmt - start);
+            continue;
+
+        case '%':
+            OutChar(&o, '%');
+            break;
+
+        case 'c': {
+            char ch = (char)va_arg(args, int);
+            FmtString(&o, &ch, 1, &spec);
+            break;
+        }
+
+        case 's': {
+            const char *s = va_arg(args, const char *);
+            if (!s) s = "(NULL)";
+
+            int len = 0;
+            while (s[len] && (spec.prec < 0 || len < spec.prec)) len ++;
+
+            FmtString(&o, s, len, &spec);
+            break;
+        }
+
+        case 'd':
+        case 'i': {
+            int64_t val = (isLong ? va_arg(args, long) : va_arg(args, int));
+            FmtNumber(&o, val < 0 ? -(uint64_t)val : (uint64_t)val, val < 0, 10, &spec);
+            break;
+        }
+
+        case 'X':
+            spec.flags |= UPPER;
+            // -- fall through
+
+        case 'x':
+            if (dialect & KFMT_KPRINTF) {
+                spec.flags |= SPECIAL;
+                isLong = true;
+            }
+
+            FmtNumber(&o, isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), false, 16, &spec);
+            break;
+
+        case 'u':
+            if (dialect & KFMT_KPRINTF) isLong = true;
+            FmtNumber(&o, isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), false, 10, &spec);
+            break;
+
+        case 'o':
+            FmtNumber(&o, isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), false, 8, &spec);
+            break;
+
+        case 'b':
+            FmtNumber(&o, isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), false, 2, &spec);
+            break;
+
+        case 'P':
+            spec.flags |= UPPER;
+            // -- fall through
+
+        case 'p':
+            if (dialect & KFMT_KPRINTF) spec.flags |= SPECIAL;
+            if (spec.prec < 0) spec.prec = sizeof(Addr_t) * 2;
+
+            FmtNumber(&o, (Addr_t)va_arg(args, void *), false, 16, &spec);
+            break;
+
+        default:
+            // -- not a conversion we know; show it as it was written
+            OutStr(&o, start, fmt - start + 1);
+            break;
+        }
+
+        fmt ++;
+    }
+
+    OutFlush(&o);
+    return o.total;
+}
+
+
+
+//
+// -- Copy formatted output into a buffer, keeping room for the terminating NULL
+//    --------------------------------------------------------------------------
+typedef struct KFmtBuf_t {
+    char *buf;
+    size_t size;
+    size_t len;
+} KFmtBuf_t;
+
+
+static void BufPut(void *ctx, const char *str, size_t len)
+{
+    KFmtBuf_t *b = (KFmtBuf_t *)ctx;
+
+    if (b->len + 1 >= b->size) return;
+    if (len > b->size - 1 - b->len) len = b->size - 1 - b->len;
+
+    kMemMoveB(b->buf + b->len, (void *)str, len);
+    b->len += len;
+}
+
+
+//
+// -- Format into at most `size` bytes (including the NULL); returns the length the whole output would have
+//    -----------------------------------------------------------------------------------------------------
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+    KFmtBuf_t b = { buf, size, 0 };
+
+    if (!buf) b.size = 0;
+
+    int rv = kvformat(BufPut, &b, 0, fmt, args);
+    if (b.size) buf[b.len] = 0;
+
+    return rv;
+}
+
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int rv = kvsnprintf(buf, size, fmt, args);
+    va_end(args);
+
+    return rv;
+}
+
+
+//
+// -- The unbounded version; prefer `ksnprintf()` in new code
+//    -------------------------------------------------------
+char *ksprintf(char *buf, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    kvsnprintf(buf, (size_t)-1, fmt, args);
+    va_end(args);
+
+    return buf;
+}
+
+
+
+//
+// -- A module hands each chunk to the kernel, which adds it to the log ring; the kernel replaces this with a
+//    version which writes to the ring directly
+//    -------------------------------------------------------------------------------------------------------
+static void KernelPut(void *ctx, const char *str, size_t len)
+{
+    (void)ctx;
+    InternalDispatch3(INT_PRINTF, (Addr_t)"%.*s", (Addr_t)len, (Addr_t)str);
+}
+
+
+__attribute__((weak))
+int KernelPrintf(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    int rv = kvformat(KernelPut, NULL, KFMT_KPRINTF, fmt, args);
+    va_end(args);
+
+    return rv;
+}
+
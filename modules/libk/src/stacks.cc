@@ -9,11 +9,17 @@
 //  There are several kernel stack locations that need to be managed.  These will all use the same address space.
 //  These functions will assist in this.
 //
+//  Each stack slot is `__stackSize` bytes preceded by STACK_GUARD_PAGES pages which are never mapped, so running
+//  off the bottom of a stack faults rather than writing over the stack below it.  The free slots are found with
+//  a find-first-zero over the bitmap, starting from the lowest word which may have one.  Once enabled, each cpu
+//  also keeps up to STACK_CACHE_SIZE released stacks which it hands out again without taking the lock.
+//
 // ------------------------------------------------------------------------------------------------------------------
 //
 //     Date      Tracker  Version  Pgmr  Description
 //  -----------  -------  -------  ----  ---------------------------------------------------------------------------
 //  2021-May-17  Initial  v0.0.9b  ADCL  Initial version
+//  2021-Nov-26  Initial  v0.0.13  ADCL  Guard pages, find-first-zero allocation and per-cpu caches
 //
 //===================================================================================================================
 
@@ -23,6 +29,7 @@
 #include "kernel-funcs.h"
 #include "heap.h"
 #include "stacks.h"
+#include "klog.h"
 
 
 
@@ -30,15 +37,29 @@
 // -- This is the stack Manager structure
 //    -----------------------------------
 typedef struct StackManager_t {
-    Addr_t startStart;
+    Addr_t stackStart;
     Addr_t stackSize;
+    Addr_t guardSize;
+    Addr_t slotSize;                    // -- the guard and the stack
     size_t stackCount;
     size_t elementCount;
-    size_t bits;
+    size_t hint;                        // -- no free slot in any word before this one
     Bitmap_t stacks[0];
 } StackManager_t;
 
 
+//
+// -- The released stacks kept by a cpu
+//    ---------------------------------
+typedef struct StackCache_t {
+    int count;
+    Addr_t stacks[STACK_CACHE_SIZE];
+} __attribute__((aligned(64))) StackCache_t;
+
+
+#define BITS            (sizeof(Bitmap_t) * 8)
+
+
 
 //
 // -- Lock for managing the stacks
@@ -53,6 +74,13 @@ static Spinlock_t lock = {0};
 static StackManager_t *stackManager = NULL;
 
 
+//
+// -- The per-cpu caches, used once every cpu can find its own structure
+//    ------------------------------------------------------------------
+static StackCache_t stackCache[MAX_CPU];
+static bool stackCacheReady = false;
+
+
 
 //
 // -- Initialize the stack structures
@@ -63,14 +91,13 @@ static void StackInit(void)
     extern Addr_t __stackCount;
     extern Addr_t __stackSize;
 
-    KernelPrintf("===================================================================\n");
-    KernelPrintf("Initializing %d stacks for address space %p\n", __stackCount, GetAddressSpace());
-    KernelPrintf("===================================================================\n");
+    KLOG(STACKS, DEBUG, "===================================================================\n");
+    KLOG(STACKS, DEBUG, "Initializing %d stacks for address space %p\n", __stackCount, GetAddressSpace());
+    KLOG(STACKS, DEBUG, "===================================================================\n");
 
-    int bits = sizeof(Bitmap_t) * 8;
-    int stacksCount = (__stackCount + (bits - 1)) / bits;
+    size_t stacksCount = (__stackCount + (BITS - 1)) / BITS;
 
-    KernelPrintf(".. initializing %d stack indices in address space %p\n", stacksCount, GetAddressSpace());
+    KLOG(STACKS, DEBUG, ".. initializing %d stack indices in address space %p\n", stacksCount, GetAddressSpace());
 
     stackManager = (StackManager_t *)HeapAlloc(sizeof(StackManager_t) + (stacksCount * sizeof(Bitmap_t)), false);
 
@@ -80,36 +107,82 @@ static void StackInit(void)
 
     stackManager->stackCount = __stackCount;
     stackManager->elementCount = stacksCount;
-    stackManager->bits = bits;
     stackManager->stackSize = __stackSize;
-    stackManager->startStart = __stackStart;
+    stackManager->guardSize = STACK_GUARD_PAGES * PAGE_SIZE;
+    stackManager->slotSize = stackManager->stackSize + stackManager->guardSize;
+    stackManager->stackStart = __stackStart;
+    stackManager->hint = 0;
 
     kMemSetB(stackManager->stacks, 0, stacksCount * sizeof(Bitmap_t));
+
+    // -- the bits past the last stack are permanently in use, so the search never needs to check the count
+    if (__stackCount % BITS) stackManager->stacks[stacksCount - 1] = ~(Bitmap_t)0 << (__stackCount % BITS);
 }
 
 
 
 //
-// -- Do the actual Stack Allocation
-//    ------------------------------
+// -- Convert between a stack and its slot number; returns -1 for an address which is not a stack
+//    -------------------------------------------------------------------------------------------
+static inline Addr_t StackAddr(size_t slot)
+{
+    return stackManager->stackStart + (slot * stackManager->slotSize) + stackManager->guardSize;
+}
+
+
+static long StackSlot(Addr_t stack)
+{
+    if (stack < stackManager->stackStart + stackManager->guardSize) return -1;
+
+    Addr_t off = stack - stackManager->stackStart;
+    size_t slot = off / stackManager->slotSize;
+
+    if (slot >= stackManager->stackCount) return -1;
+    if (off % stackManager->slotSize < stackManager->guardSize) return -1;
+
+    return slot;
+}
+
+
+
+//
+// -- Do the actual Stack Allocation; the lock is held
+//    ------------------------------------------------
 static void StackDoAlloc(Addr_t stack)
 {
-    KernelPrintf("stackManager = %p\n", stackManager);
     if (unlikely(stackManager == NULL)) StackInit();
 
-    KernelPrintf("Preparing to allocate stack at %p (starts at %p)\n", stack, stackManager->startStart);
-    KernelPrintf(".. (end of stacks is at %p\n", stackManager->startStart + (stackManager->stackCount * stackManager->stackSize));
-    stack &= ~(stackManager->stackSize - 1);
+    long slot = StackSlot(stack);
+    if (!assert(slot >= 0)) return;
+
+    KLOG(STACKS, DEBUG, "Marking the stack %p (slot %d) as used\n", StackAddr(slot), slot);
 
-    int idx = ((stack - stackManager->startStart) / stackManager->stackSize) / stackManager->bits;
-    int off = ((stack - stackManager->startStart) / stackManager->stackSize) % stackManager->bits;
+    stackManager->stacks[slot / BITS] |= ((Bitmap_t)1 << (slot % BITS));
+}
+
+
+
+//
+// -- Take the lowest free stack; the lock is held
+//    --------------------------------------------
+static Addr_t StackTake(void)
+{
+    if (unlikely(stackManager == NULL)) StackInit();
 
-    if (!assert(stack >= stackManager->startStart)) return;
-    if (!assert(stack < stackManager->startStart + (stackManager->stackCount * stackManager->stackSize))) return;
+    for (size_t i = stackManager->hint; i < stackManager->elementCount; i ++) {
+        Bitmap_t free = ~stackManager->stacks[i];
 
-    KernelPrintf("Marking the stack %p at index %d and offset %d as used\n", stack, idx, off);
+        if (free) {
+            size_t bit = __builtin_ctzl(free);
+            stackManager->stacks[i] |= ((Bitmap_t)1 << bit);
+            stackManager->hint = i;
 
-    stackManager->stacks[idx] |= (1 << off);
+            return StackAddr((i * BITS) + bit);
+        }
+    }
+
+    stackManager->hint = stackManager->elementCount;
+    return 0;
 }
 
 
@@ -133,27 +206,23 @@ Addr_t StackFind(void)
 {
     Addr_t rv = 0;
 
-    SpinLock(&lock); {
-        KernelPrintf("stackManager = %p\n", stackManager);
-        if (unlikely(stackManager == NULL)) StackInit();
-
-        for (int i = 0; i < stackManager->elementCount; i ++) {
-            if (stackManager->stacks[i] != (Addr_t)-1) {
-                for (int j = 0; j < stackManager->bits; j ++) {
-                    if ((stackManager->stacks[i] & (1 << j)) == 0) {
-                        rv = stackManager->startStart + (stackManager->stackSize * ((i * stackManager->bits) + j));
-                        StackDoAlloc(rv);
-                        KernelPrintf("In address space %p, allocating stack %p\n", GetAddressSpace(), rv);
-                        goto exit;
-                    }
-                }
-            }
-        }
+    if (stackCacheReady) {
+        Addr_t flags = DisableInt();
+        StackCache_t *c = &stackCache[ThisCpu()->cpuNum];
+
+        if (c->count) rv = c->stacks[-- c->count];
 
-exit:
-        SpinUnlock(&lock);
+        RestoreInt(flags);
+        if (rv) return rv;
     }
 
+    SpinLock(&lock); {
+        rv = StackTake();
+    } SpinUnlock(&lock);
+
+    KLOG(STACKS, DEBUG, "In address space %p, allocating stack %p\n", GetAddressSpace(), rv);
+    assert_msg(rv != 0, "Out of stacks");
+
     return rv;
 }
 
@@ -164,17 +233,55 @@ exit:
 //    ---------------
 void StackRelease(Addr_t stack)
 {
-    int idx = ((stack - stackManager->startStart) / stackManager->stackSize) / stackManager->bits;
-    int off = ((stack - stackManager->startStart) / stackManager->stackSize) % stackManager->bits;
+    if (!assert(stackManager != NULL)) return;
 
-    if (!assert(stack >= stackManager->startStart)) return;
-    if (!assert(stack < stackManager->startStart + (stackManager->stackCount * stackManager->stackSize))) return;
+    long slot = StackSlot(stack);
+    if (!assert(slot >= 0)) return;
 
-    SpinLock(&lock); {
-        stackManager->stacks[idx] &= ~(1 << off);
-        SpinUnlock(&lock);
+    if (stackCacheReady) {
+        Addr_t flags = DisableInt();
+        StackCache_t *c = &stackCache[ThisCpu()->cpuNum];
+        bool cached = false;
+
+        if (c->count < STACK_CACHE_SIZE) {
+            c->stacks[c->count ++] = StackAddr(slot);
+            cached = true;
+        }
+
+        RestoreInt(flags);
+        if (cached) return;
     }
+
+    SpinLock(&lock); {
+        size_t idx = slot / BITS;
+
+        stackManager->stacks[idx] &= ~((Bitmap_t)1 << (slot % BITS));
+        if (idx < stackManager->hint) stackManager->hint = idx;
+    } SpinUnlock(&lock);
 }
 
 
 
+//
+// -- Every cpu can find its own structure, so the per-cpu caches can be used
+//    -----------------------------------------------------------------------
+void StackCacheEnable(void)
+{
+    stackCacheReady = true;
+}
+
+
+
+//
+// -- Is this address in the guard below one of the stacks?
+//    -----------------------------------------------------
+bool StackIsGuard(Addr_t addr)
+{
+    if (!stackManager || addr < stackManager->stackStart) return false;
+
+    Addr_t off = addr - stackManager->stackStart;
+
+    return (off / stackManager->slotSize) < stackManager->stackCount
+            && (off % stackManager->slotSize) < stackManager->guardSize;
+}
+
@@ -16,6 +16,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Oct-24 | Initial |  v0.0.12 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Pass the HPET, the IOAPICs and the ISA overrides to the kernel
 *
 *///=================================================================================================================
 
@@ -189,6 +190,29 @@ typedef struct MADT_t {
 
 
 
+/****************************************************************************************************************//**
+*   @typedef            Hpet_t
+*   @brief              A formalization of the HPET table structure
+*///-----------------------------------------------------------------------------------------------------------------
+/****************************************************************************************************************//**
+*   @struct             Hpet_t
+*   @brief              The High Precision Event Timer Description Table (HPET)
+*///-----------------------------------------------------------------------------------------------------------------
+typedef struct Hpet_t {
+    AcpiStdHdr_t hdr;               //!< The standard ACPI table header
+    uint32_t eventTimerBlockId;     //!< The hardware ID of the event timer block (a copy of the capabilities)
+    uint8_t addressSpaceId;         //!< The address space of the registers; 0 is system memory
+    uint8_t registerBitWidth;       //!< The register width in bits
+    uint8_t registerBitOffset;      //!< The register offset in bits
+    uint8_t accessSize;             //!< The access size
+    uint64_t baseAddress;           //!< The address of the HPET registers
+    uint8_t hpetNumber;             //!< The HPET sequence number
+    uint16_t minTick;               //!< The minimum clock tick in periodic mode without losing interrupts
+    uint8_t pageProtection;         //!< The page protection and OEM attributes
+} __attribute__((packed)) Hpet_t;
+
+
+
 /****************************************************************************************************************//**
 *   @typedef            MadtLocalApic_t
 *   @brief              A formalization of the Local Processor APIC structure
@@ -569,9 +593,16 @@ static void AcpiReadMadt(Addr_t loc, BootInterface_t *hw)
 
         case MADT_IO_APIC:
             {
-#if DEBUG_ENABLED(AcpiReadMadt)
                 MadtIoApic_t *local = (MadtIoApic_t *)wrk;
 
+                if (hw->ioapicCount < MAX_IOAPIC) {
+                    hw->ioapic[hw->ioapicCount].addr = local->ioApicAddr;
+                    hw->ioapic[hw->ioapicCount].id = local->apicId;
+                    hw->ioapic[hw->ioapicCount].gsiBase = local->gsiBase;
+                    hw->ioapicCount ++;
+                }
+
+#if DEBUG_ENABLED(AcpiReadMadt)
                 SerialPutString(".... MADT_IO_APIC\n");
                 SerialPutString("...... APIC Addr: ");
                 SerialPutHex64(local->ioApicAddr);
@@ -586,9 +617,14 @@ static void AcpiReadMadt(Addr_t loc, BootInterface_t *hw)
 
         case MADT_INTERRUPT_SOURCE_OVERRIDE:
             {
-#if DEBUG_ENABLED(AcpiReadMadt)
                 MadtIntSrcOverride_t *local = (MadtIntSrcOverride_t *)wrk;
 
+                if (local->bus == 0 && local->source < ISA_IRQS) {
+                    hw->isaIrq[local->source].gsi = local->gsInt;
+                    hw->isaIrq[local->source].flags = local->flags & 0xffff;
+                }
+
+#if DEBUG_ENABLED(AcpiReadMadt)
                 SerialPutString(".... MADT_INTERRUPT_SOURCE_OVERRIDE\n");
                 SerialPutString("...... source: ");
                 SerialPutHex32(local->source);
@@ -692,6 +728,41 @@ static void AcpiReadMadt(Addr_t loc, BootInterface_t *hw)
 
 
 
+/****************************************************************************************************************//**
+*   @fn                 static void AcpiReadHpet(Addr_t loc, BootInterface_t *hw)
+*   @brief              Read the ACPI HPET Table and record the HPET for the kernel
+*
+*   Only the first HPET in system memory is used; the HPET module does the rest.
+*
+*   @param              loc         The location of the HPET table
+*   @param              hw          Pointer to the hardware interface table containing items of interest
+*
+*   @note Memory must be mapped before calling
+*///-----------------------------------------------------------------------------------------------------------------
+static void AcpiReadHpet(Addr_t loc, BootInterface_t *hw)
+{
+    Hpet_t *hpet = (Hpet_t *)loc;
+
+#if DEBUG_ENABLED(AcpiReadHpet)
+
+    SerialPutString(".... HPET number ");
+    SerialPutHex32(hpet->hpetNumber);
+    SerialPutString(" registers at ");
+    SerialPutHex64(hpet->baseAddress);
+    SerialPutString("; minimum tick ");
+    SerialPutHex32(hpet->minTick);
+    SerialPutChar('\n');
+
+#endif
+
+    if (hw->hpetAddr != 0 || hpet->addressSpaceId != 0 || hpet->baseAddress == 0) return;
+
+    hw->hpetAddr = hpet->baseAddress;
+    hw->hpetMinTick = hpet->minTick;
+}
+
+
+
 /****************************************************************************************************************//**
 *   @fn                 static uint32_t AcpiGetTableSig(Addr_t loc, BootInterface_t *hw)
 *   @brief              Get the table signature (and check its valid); return 0 if invalid
@@ -919,6 +990,7 @@ static uint32_t AcpiGetTableSig(Addr_t loc, BootInterface_t *hw)
 
 #endif
 
+        AcpiReadHpet(loc, hw);
         break;
 
     case MAKE_SIG("IBFT"):
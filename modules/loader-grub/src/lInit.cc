@@ -18,6 +18,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Jan-03 | Initial |  v0.0.01 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Start with no clock, HPET or IOAPIC in the kernel interface
 *
 *///=================================================================================================================
 
@@ -87,8 +88,19 @@ extern "C" void lInit(void)
     kernelInterface = (BootInterface_t *)INTERFACE_LOCATION;
     kernelInterface->modCount = 0;
     kernelInterface->bootVirtAddrSpace = pml4;
+    kernelInterface->traceCount = 0;
+    kernelInterface->clock.mult = 0;
+    kernelInterface->hpetAddr = 0;
+    kernelInterface->hpetMinTick = 0;
+    kernelInterface->ioapicCount = 0;
+    for (int i = 0; i < ISA_IRQS; i ++) {
+        kernelInterface->isaIrq[i].gsi = i;         // -- identity mapped unless ACPI overrides it
+        kernelInterface->isaIrq[i].flags = 0;
+    }
+    BootTraceMark(kernelInterface, "loader start");
 
     PlatformDiscovery(kernelInterface);
+    BootTraceMark(kernelInterface, "platform discovered");
 
     for (int i = 0; i < MAX_MEM; i ++) {
         kernelInterface->memBlocks[i].start = kernelInterface->memBlocks[i].end = 0;
@@ -104,6 +116,7 @@ extern "C" void lInit(void)
 #endif
 
     Addr_t kernel = MBootGetKernel();
+    kernelInterface->kernelAddr = kernel;
     Addr_t stack = (earlyFrame);
     earlyFrame += (STACK_SIZE / PAGE_SIZE);
 
@@ -113,10 +126,7 @@ extern "C" void lInit(void)
 
 #endif
 
-    cmn_MmuMapPage(KERNEL_STACK + (0 * PAGE_SIZE), stack + 0, PG_WRT);
-    cmn_MmuMapPage(KERNEL_STACK + (1 * PAGE_SIZE), stack + 1, PG_WRT);
-    cmn_MmuMapPage(KERNEL_STACK + (2 * PAGE_SIZE), stack + 2, PG_WRT);
-    cmn_MmuMapPage(KERNEL_STACK + (3 * PAGE_SIZE), stack + 3, PG_WRT);
+    cmn_MmuMapRange(KERNEL_STACK, stack, STACK_SIZE / PAGE_SIZE, PG_WRT);
 
 #if DEBUG_ENABLED(lInit)
 
@@ -126,6 +136,7 @@ extern "C" void lInit(void)
 
     if (kernel != 0) {
         Addr_t entry = ElfLoadImage(kernel);
+        BootTraceMark(kernelInterface, "kernel image loaded");
 
         kernelInterface->nextEarlyFrame = earlyFrame;
 
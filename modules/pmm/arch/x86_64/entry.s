@@ -39,6 +39,7 @@ header:
                 dq          0                                                           ;; interrupts
                 dq          2                                                           ;; internal Services
                 dq          0                                                           ;; OS services
+                dq          0                                                           ;; dependencies
                 dq          INT_PMM_ALLOC                                               ;; internal function 1
                 dq          pmm_PmmAllocateAligned                                      ;; .. target address
                 dq          0                                                           ;; .. stack
@@ -19,6 +19,7 @@
 *   |     Date    | Tracker |  Version | Pgmr | Description
 *   |:-----------:|:-------:|:--------:|:----:|:--------------------------------------------------------------------
 *   | 2021-Feb-12 | Initial |  v0.0.04 | ADCL | Initial version
+*   | 2021-Nov-26 | Initial |  v0.0.13 | ADCL | Wake the cleaner with a message when frames are released
 *
 *///=================================================================================================================
 
@@ -51,6 +52,14 @@ extern "C" void DumpPmm(void);
 #endif
 
 
+/****************************************************************************************************************//**
+*   @def                PMM_CLEAN
+*   @brief              The message type which wakes the cleaner to scrub the released frames
+*///-----------------------------------------------------------------------------------------------------------------
+#define PMM_CLEAN           1
+
+
+
 /****************************************************************************************************************//**
 *   @typedef            PmmFrameInfo_t
 *   @brief              Formalization of the PMM Frame Information Structure
@@ -98,6 +107,10 @@ typedef struct Pmm_t {
     // -- some additional locks for mapped address usage
     Spinlock_t insertLock;          //!< Lock that protects a temporary address for inserting a block
     Spinlock_t clearLock;           //!< Lock that protects the address used to clear a frame
+
+    // -- waking the cleaner
+    struct MessageQueue_t *msgq;    //!< The cleaner waits here for frames to scrub
+    AtomicInt_t cleanPending;       //!< A message to the cleaner has been sent and not yet received
 } Pmm_t;
 
 
@@ -125,78 +138,78 @@ void DumpPmm(void)
     DbgOutput(ANSI_ATTR_BOLD ANSI_FG_RED " Dumping PMM Structure:\n");
     DbgOutput("+----------------------------+--------------------------+\n");
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Number of frames available" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Number of frames available" ANSI_ATTR_NORMAL
             " | %-12ld             |\n", pmm.framesAvail);
     DbgOutput(buf);
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Lock State" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Lock State" ANSI_ATTR_NORMAL
             "             | %-8.8s                 |\n", pmm.lowLock.lock?"locked":"unlocked");
     DbgOutput(buf);
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack Address" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack Address" ANSI_ATTR_NORMAL
             "          | %p         |\n", pmm.lowStack);
     DbgOutput(buf);
 
     if (pmm.lowStack && MmuIsMapped((Addr_t)pmm.lowStack)) {
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack TOS frame" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack TOS frame" ANSI_ATTR_NORMAL
                 "      | %p         |\n", pmm.lowStack->frame);
         DbgOutput(buf);
 
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack TOS count" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Low Stack TOS count" ANSI_ATTR_NORMAL
                 "      | %-8d                 |\n", pmm.lowStack->count);
         DbgOutput(buf);
     }
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Lock State" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Lock State" ANSI_ATTR_NORMAL
             "          | %-8.8s                 |\n", pmm.normLock.lock?"locked":"unlocked");
     DbgOutput(buf);
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack Address" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack Address" ANSI_ATTR_NORMAL
             "       | %p         |\n", pmm.normStack);
     DbgOutput(buf);
 
     if (pmm.normStack && MmuIsMapped((Addr_t)pmm.normStack)) {
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack TOS frame" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack TOS frame" ANSI_ATTR_NORMAL
                 "   | %p         |\n", pmm.normStack->frame);
         DbgOutput(buf);
 
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack TOS count" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Normal Stack TOS count" ANSI_ATTR_NORMAL
                 "   | %-8d                 |\n", pmm.normStack->count);
         DbgOutput(buf);
     }
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Lock State" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Lock State" ANSI_ATTR_NORMAL
             "           | %-8.8s                 |\n", pmm.scrubLock.lock?"locked":"unlocked");
     DbgOutput(buf);
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack Address" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack Address" ANSI_ATTR_NORMAL
             "        | %p         |\n", pmm.scrubStack);
     DbgOutput(buf);
 
     if (pmm.scrubStack && MmuIsMapped((Addr_t)pmm.scrubStack)) {
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack TOS frame" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack TOS frame" ANSI_ATTR_NORMAL
                 "    | %p         |\n", pmm.scrubStack->frame);
         DbgOutput(buf);
 
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack TOS count" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Scrub Stack TOS count" ANSI_ATTR_NORMAL
                 "    | %-8d                 |\n", pmm.scrubStack->count);
         DbgOutput(buf);
     }
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Lock State" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Lock State" ANSI_ATTR_NORMAL
             "          | %-8.8s                 |\n", pmm.searchLock.lock?"locked":"unlocked");
     DbgOutput(buf);
 
-    ksprintf(buf, "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack Address" ANSI_ATTR_NORMAL
+    ksnprintf(buf, sizeof(buf), "| " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack Address" ANSI_ATTR_NORMAL
             "       | %p         |\n", pmm.search);
     DbgOutput(buf);
 
     if (pmm.search && MmuIsMapped((Addr_t)pmm.search)) {
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack TOS frame" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack TOS frame" ANSI_ATTR_NORMAL
                 "   | %p         |\n", pmm.search->frame);
         DbgOutput(buf);
 
-        ksprintf(buf, "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack TOS count" ANSI_ATTR_NORMAL
+        ksnprintf(buf, sizeof(buf), "|   " ANSI_ATTR_BOLD ANSI_FG_BLUE "Search Stack TOS count" ANSI_ATTR_NORMAL
                 "   | %-8d                 |\n", pmm.search->count);
         DbgOutput(buf);
     }
@@ -451,6 +464,7 @@ Return_t PmmInitEarly(BootInterface_t *loaderInterface)
         MmuUnmapPage(TEMP_MAP);
     }
 
+    BootTraceMark(loaderInterface, "pmm free blocks queued");
     SetInternalHandler(INT_PMM_ALLOC, (Addr_t)pmm_PmmAllocateAligned, GetAddressSpace(), 0);
 
 #if DEBUG_ENABLED(PmmInitEarly)
@@ -813,7 +827,12 @@ Return_t pmm_PmmReleaseFrame(Frame_t frame, size_t count)
 
 #endif
 
-//    MessageQueueSend(butlerMsgq, BUTLER_CLEAN_PMM, 0, 0);
+    if (pmm.msgq && AtomicSet(&pmm.cleanPending, 1) == 0) {
+        Message_t msg = { 0 };
+        msg.type = PMM_CLEAN;
+        MsgqSend(pmm.msgq, &msg);
+    }
+
     return 0;
 }
 
@@ -919,7 +938,12 @@ void PmmCleanProcess(void)
 #endif
 
             SpinUnlock(&pmm.scrubLock);
-            SchProcessBlock(PRC_MSGW);
+
+            // -- a release after the check above has sent a message, so it is not missed
+            Message_t msg;
+            msg.pages = 0;
+            MsgqReceive(pmm.msgq, &msg, true);
+            AtomicSet(&pmm.cleanPending, 0);
         }
     }
 }
@@ -940,6 +964,7 @@ void pmm_LateInit(void)
 
 #endif
 
+    pmm.msgq = MsgqCreate();
     SchProcessCreate("PMM Cleaner", (Addr_t)PmmCleanProcess, GetAddressSpace(), PTY_LOW);
 
 #if DEBUG_ENABLED(pmm_LateInit)
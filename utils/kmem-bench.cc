@@ -0,0 +1,225 @@
+//===================================================================================================================
+//
+//  kmem-bench.cc -- Check and time each libk memory/string implementation on the build host
+//
+//        Copyright (c)  2017-2021 -- Adam Clark
+//        Licensed under "THE BEER-WARE LICENSE"
+//        See License.md for details.
+//
+//  This builds `modules/libk/arch/x86_64/kmem.cc` as it is, checks every implementation the host cpu supports
+//  against a byte-at-a-time reference (including overlapping moves and every alignment), and then reports the
+//  cycles per call for sizes from 8 bytes to 1 MiB.  Use it to choose LIBK_SIMD_MIN.  From the top of the tree:
+//
+//      g++ -O2 -fno-tree-vectorize -fno-builtin -I modules/libk/inc -o kmem-bench utils/kmem-bench.cc
+//      ./kmem-bench
+//
+// ------------------------------------------------------------------------------------------------------------------
+//
+//     Date      Tracker  Version  Pgmr  Description
+//  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+//  2021-Nov-25  Initial  v0.0.13  ADCL  Initial version
+//
+//===================================================================================================================
+
+
+#define KMEM_HOST_BENCH
+#define LIBK_SIMD_MIN   4096
+
+#include "../modules/libk/arch/x86_64/kmem.cc"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <x86intrin.h>
+
+
+//
+// -- The buffers; the guard space catches writes past the end
+//    --------------------------------------------------------
+#define CHECK_MAX   300
+#define BENCH_MAX   (1024 * 1024)
+#define GUARD       64
+
+static uint8_t bufA[BENCH_MAX + 2 * GUARD] __attribute__((aligned(64)));
+static uint8_t bufB[BENCH_MAX + 2 * GUARD] __attribute__((aligned(64)));
+static uint8_t refA[CHECK_MAX * 2 + 2 * GUARD];
+static int errors = 0;
+
+
+//
+// -- Does this host have what an implementation needs?
+//    -------------------------------------------------
+static bool Supported(int i)
+{
+    switch (i) {
+    case LIBK_ERMS: return __builtin_cpu_supports("sse2");     // -- `rep movsb` is correct on any cpu
+    case LIBK_SSE2: return __builtin_cpu_supports("sse2");
+    case LIBK_AVX2: return __builtin_cpu_supports("avx2");
+    default:        return true;
+    }
+}
+
+
+static void Fail(const char *impl, const char *what, size_t n, size_t a, size_t b)
+{
+    if (errors ++ < 20) printf("FAIL: %s %s n=%zu align=%zu/%zu\n", impl, what, n, a, b);
+}
+
+
+static void Fill(uint8_t *p, size_t n, unsigned seed)
+{
+    for (size_t i = 0; i < n; i ++) p[i] = (uint8_t)(seed * 131 + i * 7 + 1);
+}
+
+
+//
+// -- Check one implementation against byte-at-a-time references
+//    ----------------------------------------------------------
+static void Check(const LibkMemOps_t *ops)
+{
+    size_t span = CHECK_MAX * 2 + 2 * GUARD;
+
+    for (size_t n = 0; n < CHECK_MAX; n ++) {
+        for (size_t a = 0; a < 16; a ++) {
+            // -- memset
+            Fill(bufA, span, n);
+            memcpy(refA, bufA, span);
+            ops->memSet(bufA + GUARD + a, 0xa5, n);
+            for (size_t i = 0; i < n; i ++) refA[GUARD + a + i] = 0xa5;
+            if (memcmp(bufA, refA, span)) Fail(ops->name, "memSet", n, a, 0);
+
+            for (size_t b = 0; b < 16; b += 3) {
+                // -- memmove, disjoint
+                Fill(bufA, span, n + 1);
+                Fill(bufB, span, n + 2);
+                memcpy(refA, bufA, span);
+                ops->memMove(bufA + GUARD + a, bufB + GUARD + b, n);
+                memcpy(refA + GUARD + a, bufB + GUARD + b, n);
+                if (memcmp(bufA, refA, span)) Fail(ops->name, "memMove", n, a, b);
+
+                // -- memmove, overlapping in both directions
+                for (int dir = 0; dir < 2; dir ++) {
+                    size_t d = dir ? a + b : a;
+                    size_t s = dir ? a : a + b;
+                    Fill(bufA, span, n + 3);
+                    memcpy(refA, bufA, span);
+                    ops->memMove(bufA + GUARD + d, bufA + GUARD + s, n);
+                    memmove(refA + GUARD + d, refA + GUARD + s, n);
+                    if (memcmp(bufA, refA, span)) Fail(ops->name, dir ? "memMove up" : "memMove down", n, a, b);
+                }
+
+                // -- memcmp, equal and with one byte changed
+                Fill(bufA, span, n);
+                Fill(bufB, span, n);
+                memmove(bufB + GUARD + b, bufA + GUARD + a, n);
+                if (ops->memCmp(bufA + GUARD + a, bufB + GUARD + b, n) != 0) Fail(ops->name, "memCmp eq", n, a, b);
+
+                if (n) {
+                    size_t at = (n * 7 + b) % n;
+                    bufB[GUARD + b + at] ^= 0x81;
+                    int r = ops->memCmp(bufA + GUARD + a, bufB + GUARD + b, n);
+                    int e = (int)bufA[GUARD + a + at] - (int)bufB[GUARD + b + at];
+                    if (r != e) Fail(ops->name, "memCmp ne", n, a, b);
+                }
+            }
+
+            // -- strings
+            Fill(bufA, span, n);
+            for (size_t i = 0; i < span; i ++) if (!bufA[i]) bufA[i] = 1;
+            bufA[GUARD + a + n] = 0;
+            if (ops->strLen((char *)bufA + GUARD + a) != n) Fail(ops->name, "strLen", n, a, 0);
+
+            Fill(bufB, span, n + 4);
+            memcpy(refA, bufB, span);
+            ops->strCpy((char *)bufB + GUARD + (a ^ 5), (char *)bufA + GUARD + a);
+            memcpy(refA + GUARD + (a ^ 5), bufA + GUARD + a, n + 1);
+            if (memcmp(bufB, refA, span)) Fail(ops->name, "strCpy", n, a, 0);
+        }
+    }
+}
+
+
+//
+// -- Cycles per call, best of several runs
+//    -------------------------------------
+template <typename F>
+static uint64_t Time(size_t n, F f)
+{
+    int reps = (int)(64 * 1024 * 1024 / (n + 64)) / 8 + 1;
+    uint64_t best = ~0ul;
+
+    for (int run = 0; run < 5; run ++) {
+        uint64_t t0 = __rdtsc();
+        for (int r = 0; r < reps; r ++) {
+            f();
+            __asm volatile("" ::: "memory");
+        }
+        uint64_t t = (__rdtsc() - t0) / reps;
+        if (t < best) best = t;
+    }
+
+    return best;
+}
+
+
+int main(void)
+{
+    int count = 0;
+    const LibkMemOps_t *impl[LIBK_IMPL_COUNT];
+
+    for (int i = 0; i < LIBK_IMPL_COUNT; i ++) {
+        if (!Supported(i)) {
+            printf("%s: not supported on this cpu\n", LibkMemImpl(i)->name);
+            continue;
+        }
+
+        impl[count ++] = LibkMemImpl(i);
+    }
+
+    for (int i = 0; i < count; i ++) Check(impl[i]);
+    printf("correctness: %s (%d failures)\n", errors ? "FAILED" : "ok", errors);
+    printf("chosen for this cpu: %s\n\n", LibkMemImplName());
+
+    static const char *ops[] = { "memSet", "memMove", "memCmp", "strLen" };
+
+    for (int op = 0; op < 4; op ++) {
+        printf("%-8s %8s", ops[op], "bytes");
+        for (int i = 0; i < count; i ++) printf(" %10s", impl[i]->name);
+        printf("   (cycles per call)\n");
+
+        for (size_t n = 8; n <= BENCH_MAX; n *= 2) {
+            printf("%-8s %8zu", "", n);
+
+            for (int i = 0; i < count; i ++) {
+                const LibkMemOps_t *o = impl[i];
+                uint8_t *a = bufA + GUARD;
+                uint8_t *b = bufB + GUARD;
+                uint64_t t = 0;
+
+                switch (op) {
+                case 0: t = Time(n, [=] { o->memSet(a, 0x5a, n); }); break;
+                case 1: t = Time(n, [=] { o->memMove(a, b, n); }); break;
+                case 2:
+                    memset(a, 1, n);
+                    memset(b, 1, n);
+                    t = Time(n, [=] { o->memCmp(a, b, n); });
+                    break;
+                case 3:
+                    memset(a, 1, n);
+                    a[n - 1] = 0;
+                    t = Time(n, [=] { o->strLen((char *)a); });
+                    break;
+                }
+
+                printf(" %10lu", (unsigned long)t);
+            }
+
+            printf("\n");
+        }
+
+        printf("\n");
+    }
+
+    return errors ? 1 : 0;
+}
+
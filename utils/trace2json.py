@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#####################################################################################################################
+##
+##  trace2json.py -- Convert a kernel debugger `trace dump` into a Chrome trace / Perfetto JSON timeline
+##
+##        Copyright (c)  2017-2021 -- Adam Clark
+##        Licensed under "THE BEER-WARE LICENSE"
+##        See License.md for details.
+##
+##  Capture the serial output while running `trace` -> `dump` in the kernel debugger, then:
+##
+##      trace2json.py --tsc-mhz 2400 serial.log > trace.json
+##
+##  and load `trace.json` into chrome://tracing or https://ui.perfetto.dev.  Each cpu is a track; the process
+##  running on it is shown as a slice between context switches and everything else as an instant event.  Any
+##  other serial output around the dump is ignored.
+##
+## ------------------------------------------------------------------------------------------------------------------
+##
+##     Date      Tracker  Version  Pgmr  Description
+##  -----------  -------  -------  ----  ---------------------------------------------------------------------------
+##  2021-Nov-22  Initial  v0.0.13  ADCL  Initial version
+##
+#####################################################################################################################
+
+
+import argparse
+import json
+import sys
+
+
+def parse(lines):
+    names = {}
+    records = []
+    inDump = False
+
+    for line in lines:
+        f = line.strip().split()
+        if not f: continue
+
+        if f[0] == '#TRACE':
+            inDump = True
+            names = {}
+            records = []
+        elif not inDump:
+            continue
+        elif f[0] == '#EVENT':
+            names[int(f[1])] = f[2]
+        elif f[0] == '#END':
+            inDump = False
+        elif len(f) == 5:
+            try:
+                records.append((int(f[1], 16), int(f[0]), int(f[2]), int(f[3], 16), int(f[4], 16)))
+            except ValueError:
+                pass            # -- a line garbled by other output
+
+    return names, sorted(records)
+
+
+def convert(names, records, mhz):
+    events = []
+    if not records: return events
+
+    first = records[0][0]
+    running = {}                # cpu -> (pid, start)
+
+    def us(tsc):
+        return (tsc - first) / mhz
+
+    for tsc, cpu, typ, a, b in records:
+        name = names.get(typ, 'event-%d' % typ)
+
+        if name == 'switch':
+            if cpu in running:
+                pid, start = running[cpu]
+                events.append({'name': 'pid %d' % pid, 'ph': 'X', 'pid': 0, 'tid': cpu,
+                               'ts': us(start), 'dur': us(tsc) - us(start)})
+            running[cpu] = (b, tsc)
+        else:
+            if name == 'internal':
+                label = 'svc %#x' % a
+            elif name in ('block', 'unblock'):
+                label = '%s pid %d (status %d)' % (name, a, b)
+            elif name == 'expire':
+                label = 'expire pid %d' % a
+            else:
+                label = '%s %#x' % (name, a)
+
+            events.append({'name': label, 'cat': name, 'ph': 'i', 's': 't', 'pid': 0, 'tid': cpu,
+                           'ts': us(tsc), 'args': {'a': a, 'b': b}})
+
+    for cpu in sorted(set(r[1] for r in records)):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': cpu, 'args': {'name': 'CPU %d' % cpu}})
+
+    return events
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Convert a CenturyOS trace dump into Chrome trace JSON')
+    ap.add_argument('--tsc-mhz', type=float, required=True, help='the TSC frequency in MHz')
+    ap.add_argument('dump', nargs='?', help='the captured serial output (default: stdin)')
+    args = ap.parse_args()
+
+    src = open(args.dump, errors='replace') if args.dump else sys.stdin
+    names, records = parse(src)
+    json.dump({'traceEvents': convert(names, records, args.tsc_mhz), 'displayTimeUnit': 'ns'}, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()